@@ -36,6 +36,7 @@
 
 #include <ff/node.hpp>
 #include <ff/multinode.hpp>
+#include <ff/keyed_policies.hpp>
 
 namespace ff {
 
@@ -239,6 +240,25 @@ protected:
             }
             workers1[i]->set_id(int(i));
         }
+        // key-partitioned scheduling, each node of the first set has its own keyed_lb
+        if (keyed.enabled()) {
+            for(size_t i=0;i<workers1.size();++i) {
+                svector<ff_node*> w;
+                workers1[i]->get_out_nodes(w);
+                for(size_t k=0;k<w.size(); ++k) {
+                    if (!w[k]->isMultiOutput() || w[k]->isFarm() || w[k]->isAll2All() ||
+                        w[k]->isPipe() || w[k]->isComp()) {
+                        error("A2A, the key-partitioned scheduling requires multi-output nodes as last stages of the first set\n");
+                        return -1;
+                    }
+                    ff_monode* mo = reinterpret_cast<ff_monode*>(w[k]);
+                    keyed_lb* _lb = new keyed_lb(MAX_NUM_THREADS, keyed);
+                    assert(_lb);
+                    if (mo->lb) static_cast<ff_loadbalancer&>(*_lb) = std::move(*mo->lb);
+                    mo->setlb(_lb, true);
+                }
+            }
+        }
         // checking R-Workers
         if (!workers2[0]->isMultiInput()) { // NOTE: we suppose that all others are the same        
             if (workers2[0]->isMultiOutput()) {
@@ -360,6 +380,7 @@ public:
         out_buffer_entries   = p.out_buffer_entries;
         wraparound           = p.wraparound;
         ondemand_chunk       = p.ondemand_chunk;
+        keyed                = p.keyed;
         outputNodes          = p.outputNodes;
         internalSupportNodes = p.internalSupportNodes;
 
@@ -626,6 +647,22 @@ public:
     const svector<ff_node*>& getSecondSet() const { return workers2; }
 
     int ondemand_buffer() const { return ondemand_chunk; }
+
+    /**
+     * The data elements with the same key are sent by all the nodes of the
+     * first set to the same node of the second set (see keyed_policies.hpp).
+     * The nodes of the first set must be standard nodes or multi-output nodes
+     * that use ff_send_out (without the destination).
+     */
+    void set_scheduling_keyed(const ff_keyed_policy &policy) {
+        if (prepared) {
+            error("A2A, set_scheduling_keyed, a2a already prepared\n");
+            return;
+        }
+        keyed = policy;
+    }
+    // it returns nullptr if the key-partitioned scheduling is not set
+    const ff_keyed_policy* keyed_policy() const { return keyed.enabled() ? &keyed : nullptr; }
     
     int numThreads() const { return cardinality(); }
 
@@ -838,6 +875,7 @@ protected:
     bool wraparound=false;
     int in_buffer_entries, out_buffer_entries;
     int ondemand_chunk=0;
+    ff_keyed_policy    keyed;     // key-partitioned scheduling
     svector<ff_node*>  workers1;  // first set, nodes must be multi-output
     svector<ff_node*>  workers2;  // second set, nodes must be multi-input
     svector<ff_node*>  outputNodes;
@@ -139,6 +139,8 @@ namespace ff {
     enum { N_SLABBUFFER=9, MAX_SLABBUFFER_SIZE=8192};
     static const int POW2_MIN  = 5;
     static const int POW2_MAX  = 13;
+    // default capacity of the per-thread magazines (see ff_allocator::enableMagazines)
+    static const int MAGAZINE_SIZE = 64;
 
     // array containing different possbile sizes for a slab buffer
     static const int buffersize[N_SLABBUFFER] = 
@@ -163,6 +165,9 @@ namespace ff {
         std::atomic_long      hit;
         std::atomic_long      miss;
         std::atomic_long      leakremoved;
+        std::atomic_long      maghit;
+        std::atomic_long      magflush;
+        std::atomic_long      magrefill;
         std::atomic_long      memallocated;
         std::atomic_long      memfreed;
         std::atomic_long      segmalloc;
@@ -180,6 +185,9 @@ namespace ff {
             hit.store(0);
             miss.store(0);
             leakremoved.store(0);
+            maghit.store(0);
+            magflush.store(0);
+            magrefill.store(0);
             memallocated.store(0);
             memfreed.store(0);
             segmalloc.store(0);
@@ -198,8 +206,11 @@ namespace ff {
                 << "malloc        = " << nmalloc << "\n"
                 << "  cache hit   = " << hit << "\n"
                 << "  cache miss  = " << miss << "\n"
-                << "  leakremoved = " << leakremoved  << "\n\n"
+                << "  leakremoved = " << leakremoved  << "\n"
+                << "  mag. hit    = " << maghit << "\n"
+                << "  mag. refill = " << magrefill << "\n\n"
                 << "free          = " << nfree << "\n"
+                << "  mag. flush  = " << magflush << "\n"
                 << "realloc       = " << nrealloc << "\n\n"
                 << "mem. allocated= " << memallocated << "\n"
                 << "mem. freed    = " << memfreed << "\n\n"
@@ -354,13 +365,19 @@ namespace ff {
      * (\p uSWSR_Ptr_Buffer). These buffers guarantee deadlock avoidance and
      * scalability in stream-oriented applications.
      *
+     * If the magazines are enabled, each thread also has a magazine, i.e. a
+     * bounded LIFO stack of free buffers, which is used only by the thread
+     * itself. The buffers freed by the thread are first stored in the
+     * magazine and pushed into the leak queue in bulk when the magazine is
+     * full. The magazine of the allocator thread is also used to serve its
+     * malloc requests.
      *
      */
     struct xThreadData {
         enum { LEAK_CHUNK=4096 };
     
         xThreadData(const bool /*allocator*/, size_t /*nslabs*/, const pthread_t key)
-            : leak(0), key(key) {
+            : leak(0), key(key), mag(0), magcnt(0) {
             //leak = (uSWSR_Ptr_Buffer*)::malloc(sizeof(uSWSR_Ptr_Buffer));
             leak = (uSWSR_Ptr_Buffer*)getAlignedMemory(128,sizeof(uSWSR_Ptr_Buffer));
             if (!leak) abort();
@@ -370,11 +387,15 @@ namespace ff {
 
         ~xThreadData() {
             if (leak) { leak->~uSWSR_Ptr_Buffer(); freeAlignedMemory(leak); } // free(leak)
+            if (mag)  ::free(mag);
         }
     
         uSWSR_Ptr_Buffer * leak;   //
         const pthread_t    key;    // used to identify a thread (threadID)
-        long padding[longxCacheLine-((sizeof(const pthread_t)+sizeof(uSWSR_Ptr_Buffer*))/sizeof(long))]; //
+        void            ** mag;    // magazine, NULL if the magazines are disabled
+        size_t             magcnt; // number of buffers in the magazine
+        long padding[longxCacheLine-((sizeof(const pthread_t)+sizeof(uSWSR_Ptr_Buffer*)+
+                                      sizeof(void**)+sizeof(size_t))/sizeof(long))]; //
     };
 
     /* 
@@ -585,6 +606,47 @@ namespace ff {
             return -1;
         }
 
+        /*
+         * Magazines: it pushes the oldest buffers of the magazine of \p xtd
+         * into the leak queue of the thread, so that they are published to
+         * the allocator thread in bulk, leaving only the newest \p keep
+         * buffers in the magazine. If the allocator has been deregistered the
+         * buffers are given back to their segments.
+         */
+        inline void flushmag(xThreadData * xtd, size_t keep=0) {
+            const size_t n = xtd->magcnt - keep;
+            if (nomoremalloc.load()) {
+                for(size_t i=0;i<n;++i) checkReclaim(getsegctl((Buf_ctl *)xtd->mag[i]));
+            } else {
+                for(size_t i=0;i<n;++i) xtd->leak->mpush(xtd->mag[i]);
+                xtd->leak->flush();
+            }
+            for(size_t i=0;i<keep;++i) xtd->mag[i] = xtd->mag[n+i];
+            xtd->magcnt = keep;
+            ALLSTATS(all_stats::instance()->magflush.fetch_add(1));
+        }
+
+        /*
+         * Magazines: the magazine of the allocator thread is empty, it is
+         * refilled (half-way) in bulk from one of the leak queues.
+         *
+         * \returns one of the buffers obtained, NULL if the leak queues are empty
+         */
+        inline void * refillmag() {
+            for(unsigned i=0;i<fb_size;++i) {
+                unsigned k=(lastqueue+i)%fb_size;
+                size_t n = fb[k]->leak->multipop(ownerxtd->mag, magsize/2);
+                if (n) {
+                    ALLSTATS(all_stats::instance()->magrefill.fetch_add(1));
+                    ALLSTATS(all_stats::instance()->leakremoved.fetch_add(n));
+                    lastqueue=k;
+                    ownerxtd->magcnt = n-1;
+                    return ownerxtd->mag[n-1];
+                }
+            }
+            return 0;
+        }
+
     public: 
         /*
          * Default Constructor
@@ -603,7 +665,7 @@ namespace ff {
         SlabCache( ff_allocator * const mainalloc, const int delayedReclaim,
                    SegmentAllocator * const alloc, size_t sz, int ns )
             : size(sz), nslabs(ns), fb(0), fb_capacity(0), fb_size(0),
-              buffptr(0), availbuffers(0), alloc(alloc),
+              buffptr(0), availbuffers(0), magsize(0), ownerxtd(0), alloc(alloc),
               mainalloc(mainalloc), delayedReclaim(delayedReclaim),lastqueue(0) { }
     
         /**
@@ -658,6 +720,31 @@ namespace ff {
             if ( prealloc && (newslab()<0) ) return -1;
             return 0;
         }
+
+        /*
+         * Enables the per-thread magazines of \p size buffers. It must be
+         * called before any thread is registered. The magazines cannot be
+         * used together with the delayed reclaim.
+         *
+         * \returns 0 if successful, -1 otherwise
+         */
+        inline int setmagazine(size_t size) {
+            if (delayedReclaim || size<2 || fb_size) return -1;
+            magsize = size;
+            return 0;
+        }
+
+        /*
+         * It publishes the buffers in the magazine of the calling thread.
+         * A thread that frees memory should call it when it stops freeing,
+         * otherwise up to \p magsize buffers per size are kept in its magazine.
+         */
+        inline void flushmagazine() {
+            if (!magsize) return;
+            int entry = searchfb(pthread_self());
+            if (entry<0 || !fb[entry]->mag || !fb[entry]->magcnt) return;
+            flushmag(fb[entry]);
+        }
     
         /*
          * Register the calling thread into the shared buffer (leak queue).\n
@@ -680,6 +767,10 @@ namespace ff {
                 xThreadData * xtd = (xThreadData*)::malloc(sizeof(xThreadData));
                 if (!xtd) return NULL;
                 new (xtd) xThreadData(allocator, nslabs, key);
+                if (magsize) {
+                    xtd->mag = (void**)::malloc(magsize*sizeof(void*));
+                    if (!xtd->mag) { xtd->~xThreadData(); ::free(xtd); return NULL; }
+                }
 
                 /*
                  * REW
@@ -703,6 +794,7 @@ namespace ff {
                 spin_unlock(lock);
             }
             DBG(assert(fb[entry]->key == key));
+            if (allocator && fb[entry]->mag) ownerxtd = fb[entry];
             return fb[entry];                   // position of new entry in buffer
         }
 
@@ -717,6 +809,9 @@ namespace ff {
             // and prevented from allocating
             nomoremalloc.store(1);
 
+            // the allocator's magazine is given back to the segments
+            if (reclaim && ownerxtd) flushmag(ownerxtd);
+
             // try to reclaim some memory
             for(unsigned i=0;i<fb_size;++i) {
                 DBG(assert(fb[i]));
@@ -739,6 +834,12 @@ namespace ff {
             DBG(assert(nslabs>0));
             void * item = 0;
 
+            /* the buffers most recently freed by the allocator thread itself */
+            if (ownerxtd && ownerxtd->magcnt) {
+                ALLSTATS(all_stats::instance()->maghit.fetch_add(1));
+                return ((char *)ownerxtd->mag[--ownerxtd->magcnt] + BUFFER_OVERHEAD);
+            }
+
             /* try to get one item from the available ones */
             if (availbuffers) {
             avail:
@@ -763,7 +864,7 @@ namespace ff {
             }
 
             // else, try to get a free item from cache
-            item = delayedReclaim ? getfrom_fb_delayed() : getfrom_fb();
+            item = delayedReclaim ? getfrom_fb_delayed() : (ownerxtd ? refillmag() : getfrom_fb());
 
             if (item) {
                 ALLSTATS(all_stats::instance()->hit.fetch_add(1));
@@ -809,6 +910,12 @@ namespace ff {
             if (entry<0) xtd = register4free();     // if not present, register it
             else xtd = fb[entry];                   // else, point to its position
             DBG(if (!xtd) abort());
+            if (xtd->mag) {                         // the item goes in the magazine
+                xtd->mag[xtd->magcnt++] = (void *)buf;
+                // the allocator keeps the newest half of the magazine for its mallocs
+                if (xtd->magcnt == magsize) flushmag(xtd, (xtd == ownerxtd) ? magsize/2 : 0);
+                return false;
+            }
             xtd->leak->push((void *)buf);           // push the item in the buffer
             return false;
         }
@@ -833,6 +940,9 @@ namespace ff {
         Buf_ctl *             buffptr;
         size_t                availbuffers;
 
+        size_t                magsize;         /* capacity of the magazines, 0 disabled */
+        xThreadData         * ownerxtd;        /* allocator thread's data (magazines only) */
+
     private:
         std::atomic_long            nomoremalloc;
 
@@ -1099,6 +1209,49 @@ namespace ff {
             return 0;
         }
 
+        /**
+         * \brief enables the per-thread magazines
+         *
+         * Each registered thread gets, for each slab size, a magazine, i.e. a
+         * bounded LIFO stack of \p size free buffers. The buffers freed by a
+         * thread are kept in its magazine and are pushed into its leak queue
+         * in bulk only when the magazine is full. The allocator thread serves
+         * its malloc requests from its own magazine first and it refills the
+         * magazine in bulk from the leak queues. In the common case malloc
+         * and free on hot sizes neither touch the slab segments nor the
+         * queues shared with the other threads.
+         *
+         * It must be called after \p init and before any thread registers
+         * itself. It cannot be used with the delayed reclaim.
+         * A thread that frees memory should call \p flushMagazines when it
+         * stops freeing (e.g. in its \p svc_end), otherwise the buffers kept
+         * in its magazines are not reused until the allocator is destroyed.
+         *
+         * \return 0 if successful, -1 otherwise
+         */
+        inline int enableMagazines(size_t size=MAGAZINE_SIZE) {
+            if (slabcache.size()==0) return -1;
+            svector<SlabCache *>::iterator b(slabcache.begin()), e(slabcache.end());
+            for(;b!=e;++b) {
+                if ((*b)->getnslabs())
+                    if ((*b)->setmagazine(size)<0) return -1;
+            }
+            return 0;
+        }
+
+        /**
+         * \brief publishes the buffers kept in the magazines of the calling thread
+         *
+         * See \p enableMagazines.
+         */
+        inline void flushMagazines() {
+            svector<SlabCache *>::iterator b(slabcache.begin()), e(slabcache.end());
+            for(;b!=e;++b) {
+                if ((*b)->getnslabs())
+                    (*b)->flushmagazine();
+            }
+        }
+
         /**
         * \brief malloc
         *
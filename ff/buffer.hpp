@@ -92,11 +92,17 @@ static const int longxCacheLine = (CACHE_LINE_SIZE/sizeof(long));
   */ 
 
 class SWSR_Ptr_Buffer {
+public:
     /**
      * experimentally we found that a good value is between 
      * 2 and 6 cache lines (16 to 48 entries respectively)
      */
     enum {MULTIPUSH_BUFFER_SIZE=16};
+    /**
+     * max number of elements returned by a single multipop call
+     * (one cache line of slots)
+     */
+    enum {MULTIPOP_BUFFER_SIZE=CACHE_LINE_SIZE/sizeof(void*)};
 
 private:
     // Padding is required to avoid false-sharing between 
@@ -118,15 +124,15 @@ private:
     size_t     size;
     void    ** buf;
     
-#if defined(SWSR_MULTIPUSH)
     /* massimot: experimental code (see multipush)
      *
      */
     long padding3[longxCacheLine-2];    
-    // local multipush buffer used by the mpush method
+    // local multipush buffer used by the mpush method (producer side)
     void  * multipush_buf[MULTIPUSH_BUFFER_SIZE];
     int     mcnt;
-#endif
+    int     numa_node;   // memory node of the storage, -1 no policy
+    bool    numa_pages;  // the storage is allocated on whole pages (see numa_bind)
 
 public:    
     /* pointer to member function for the push method */
@@ -141,7 +147,7 @@ public:
      *  \param n the size of the buffer
      */
     SWSR_Ptr_Buffer(unsigned long n, const bool=true):
-        pread(0),pwrite(0),size(n),buf(0) {
+        pread(0),pwrite(0),size(n),buf(0),mcnt(0),numa_node(-1),numa_pages(false) {
         pushPMF=&SWSR_Ptr_Buffer::push;
         popPMF =&SWSR_Ptr_Buffer::pop;
         // Avoid unused private field warning on padding1, padding2
@@ -170,15 +176,51 @@ public:
 #if defined(SWSR_MULTIPUSH)
         if (size<MULTIPUSH_BUFFER_SIZE) return false;
 #endif
-        // getAlignedMemory is a function defined in 'sysdep.h'
-        buf=(void**)getAlignedMemory(longxCacheLine*sizeof(long),size*sizeof(void*));
-        if (!buf) return false;
+        if (numa_node<0 && !numa_pages) {
+            // getAlignedMemory is a function defined in 'sysdep.h'
+            buf=(void**)getAlignedMemory(longxCacheLine*sizeof(long),size*sizeof(void*));
+            if (!buf) return false;
+        } else {
+            // the storage does not share pages with other data, the policy
+            // is set before the first touch (reset)
+            const size_t pagesz = ff_page_size();
+            buf=(void**)getAlignedMemory(pagesz, ((size*sizeof(void*)+pagesz-1)/pagesz)*pagesz);
+            if (!buf) return false;
+            numa_pages = true;
+            if (numa_node>=0) ff_numa_bind(buf, size*sizeof(void*), numa_node);
+        }
 
         reset(startatlineend);
 
         return true;
     }
 
+    /**
+     * It places the storage of the buffer on the NUMA memory node \p node.
+     * If it is called before \p init the storage is allocated on the node,
+     * otherwise the pages already allocated are migrated to the node: this
+     * is done only if the storage has been allocated on whole pages (see
+     * set_numa_pages), the pages are not shared with other data.
+     * It should be called by the consumer before using the buffer, it has
+     * no effect if the kernel does not support NUMA policies.
+     *
+     * \return 0 if successful, -1 otherwise
+     */
+    int numa_bind(int node) {
+        if (node<0) return -1;
+        numa_node = node;
+        if (!buf) return 0;
+        if (!numa_pages) return -1;
+        return ff_numa_bind(buf, size*sizeof(void*), node, true);
+    }
+    /**
+     * It has to be called before \p init if the buffer will be placed with
+     * numa_bind after init (i.e. the node is not known yet): the storage is
+     * allocated on whole pages, so that it can be migrated.
+     */
+    inline void set_numa_pages() { numa_pages = true; }
+    inline int get_numa_node() const { return numa_node; }
+
     /** 
      * It returns true if the buffer is empty.
      */
@@ -271,7 +313,7 @@ public:
         unsigned long i;
 
         if (buf[last]==NULL) {
-            
+            WMB(); // see push
             if (last < pwrite) {
                 for(i=len;i>r;--i,--l) 
                     buf[l] = data[i];
@@ -282,47 +324,55 @@ public:
                 for(int i=len;i>=0;--i) 
                     buf[pwrite+i] = data[i];
             
-            WMB();
-            pwrite = pwrite + ((last+1 >= size) ? 0 : (last+1));
-#if defined(SWSR_MULTIPUSH)
-            mcnt = 0; // reset mpush counter
-#endif
+            pwrite = ((last+1 >= size) ? 0 : (last+1));
             return true;
         }
         return false;
     }
 
-
-#if defined(SWSR_MULTIPUSH)
-    
     // massimot: experimental code
     /**
      * This method provides the same interface of the \p push method, but it
      * allows to provide a batch of items to
      * the consumer, thus ensuring better cache locality and 
      * lowering the cache trashing.
+     * The element is kept in a producer-local batch that is published
+     * with a single multipush either when the batch is full or when
+     * \p flush is called. It returns \p false only if the batch is full
+     * and there is no room in the queue for publishing it, in that case
+     * the element has not been enqueued and the call should be retried.
+     * If the queue is too small to hold a batch, it behaves like \p push.
      *
      * \param data Element to be pushed in the buffer
      */
     inline bool mpush(void * const data) {
         assert(data);
-        
-        if (mcnt==MULTIPUSH_BUFFER_SIZE)
-            return multipush(multipush_buf,MULTIPUSH_BUFFER_SIZE);
+        if (size < 2*MULTIPUSH_BUFFER_SIZE) return push(data);
 
+        if (mcnt==MULTIPUSH_BUFFER_SIZE && !flush()) return false;
         multipush_buf[mcnt++]=data;
-
-        if (mcnt==MULTIPUSH_BUFFER_SIZE)
-            return multipush(multipush_buf,MULTIPUSH_BUFFER_SIZE);
-
+        if (mcnt==MULTIPUSH_BUFFER_SIZE) flush(); // if it fails, it is retried later
         return true;
     }
 
-    /* REW -- ? */
+    /**
+     * It publishes the elements buffered by \p mpush. 
+     *
+     * \return \p false if there is not enough room in the queue,
+     * in that case the batch is kept and the call should be retried.
+     */
     inline bool flush() {
-        return (mcnt ? multipush(multipush_buf,mcnt) : true);
+        if (!mcnt) return true;
+        if (!multipush(multipush_buf,mcnt)) return false;
+        mcnt = 0;
+        return true;
     }
-#endif /* SWSR_MULTIPUSH */
+
+    /**
+     * It returns the number of elements buffered by \p mpush and not
+     * yet published in the queue.
+     */
+    inline int mpending() const { return mcnt; }
     
 
     /**
@@ -348,6 +398,27 @@ public:
         //std::atomic_thread_fence(std::memory_order_acquire);
         return inc();
     } 
+
+    /**
+     *  Multipop method: get at most \p len values from the FIFO buffer 
+     *  (typically \p MULTIPOP_BUFFER_SIZE, i.e. a cache line of slots) 
+     *  updating the read pointer only once.
+     *
+     *  \param data array where to store the data popped from the buffer.
+     *  \return the number of elements popped (0 if the buffer is empty).
+     */
+    inline unsigned long multipop(void * data[], unsigned long len) {
+        unsigned long r = pread, n = 0;
+        while(n<len) {
+            void * const d = buf[r];
+            if (d == NULL) break;
+            data[n++] = d;
+            buf[r] = NULL;
+            r = r + ((r+1 >= size) ? (1-size): 1); // circular buffer
+        }
+        pread = r;
+        return n;
+    }
         
     /** 
      *  It returns the "head" of the buffer, i.e. the element pointed by the read
@@ -375,9 +446,7 @@ public:
             pread=0;
             pwrite=0; 
         }
-#if defined(SWSR_MULTIPUSH)        
         mcnt   = 0;
-#endif  
         if (size<=512) for(unsigned long i=0;i<size;++i) buf[i]=0;
         else memset(buf,0,size*sizeof(void*));
     }
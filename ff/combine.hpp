@@ -625,6 +625,12 @@ protected:
         comp_nodes[1]->eosnotify(id);
     }
 
+    // the second node is fed by the first one, so both are idle
+    void idlenotify() {
+        comp_nodes[0]->idlenotify();
+        comp_nodes[1]->idlenotify();
+    }
+
     void propagateEOS(void *task=FF_EOS) {
         if (comp_nodes[1]->isComp()) {
             comp_nodes[1]->propagateEOS(task);
@@ -712,8 +718,9 @@ protected:
         if (!r) return false;
         // if the first node is a standard node or a multi-output node
         // then the comb node and the first node share the same
-        // cond variable. This is due to the put_done method in the lb
-        // (i.e. the prev node is a multi-output or an emitter node) 
+        // cond variable. The threads park on the notifiers attached to
+        // the channels (see futex.hpp), the sharing is kept for the
+        // consistency checks of the blocking wiring.
         assert(n->cons_m == nullptr);
         n->set_cons_c(c);
         //n->cons_c = c; n->cons_m = nullptr;        <---- TOGLIERE
@@ -735,6 +742,7 @@ protected:
     // uses as output channel(s) the one(s) of the second node.
     // these functions should not be called if the node is multi-output
     inline bool  get(void **ptr)                 { return comp_nodes[1]->get(ptr);}
+    inline unsigned long mget(void **ptr, unsigned long len) { return comp_nodes[1]->mget(ptr,len);}
     inline pthread_cond_t    &get_cons_c()  {
         ff_node *n = getFirst();
         if (n->isMultiInput()) return ff_minode::get_cons_c();
@@ -1199,10 +1207,10 @@ static inline const ff_pipeline combine_ofarm_farm(ff_farm& farm1, ff_farm& farm
     assert(_lb);
     const size_t memsize = farm1.getNWorkers() * (2*newfarm1.ondemand_buffer()+3)+ DEF_OFARM_ONDEMAND_MEMORY; 
     newfarm1.ordered_resize_memory(memsize);
-    _lb->init(newfarm1.ordered_get_memory(), memsize);
-    newfarm1.setlb(_lb, true);
-    OrderedCollectorWrapper* cw = new OrderedCollectorWrapper(DEF_OFARM_ONDEMAND_MEMORY);
+    OrderedCollectorWrapper* cw = new OrderedCollectorWrapper(memsize);
     assert(cw);
+    _lb->init(newfarm1.ordered_get_memory(), memsize, cw->released());
+    newfarm1.setlb(_lb, true);
     
     // emitter1 
     ff_node* emitter1 = farm1.getEmitter();   
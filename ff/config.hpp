@@ -173,10 +173,28 @@
 
 /* Used in blocking mode to limit the amount of time 
  * before checking again the input/output queue.
+ * The threads park on the futex notifiers of the channels (see futex.hpp),
+ * the timeout only bounds the cost of a (rare) missed wake-up.
  * NOTE: it cannot be greater than 1e+9 (i.e. 1sec)
  */
 #define FF_TIMEDWAIT_NS   200000
 
+/* Used by the adaptive spin-then-park waiting policy (see spinpark.hpp).
+ * A parked thread checks again its channel after FF_PARK_TIMEOUT_NS
+ * (it cannot be greater than 1e+9) even if nobody wakes it up.
+ * The spin window is learned online and it is kept in the range
+ * [FF_SPIN_MIN_TICKS, FF_SPIN_MAX_TICKS].
+ */
+#if !defined(FF_PARK_TIMEOUT_NS)
+#define FF_PARK_TIMEOUT_NS  1000000
+#endif
+#if !defined(FF_SPIN_MIN_TICKS)
+#define FF_SPIN_MIN_TICKS   2000
+#endif
+#if !defined(FF_SPIN_MAX_TICKS)
+#define FF_SPIN_MAX_TICKS   200000
+#endif
+
 /*
  * Used in the ordered farm pattern (ff_OFarm). 
  * It is the maximum amount of data elements buffered in the farm's collector
@@ -204,6 +222,11 @@
 // maximum number of workers in a farm
 #define DEF_MAX_NUM_WORKERS   (MAX_NUM_THREADS-2)
 
+// workers of each group of a hierarchical farm (see ff_farm::set_hierarchical)
+#if !defined(DEF_HIER_FANOUT)
+#define DEF_HIER_FANOUT       16
+#endif
+
 // NOTE: BACKOFF_MIN/MAX are lower and upper bound backoff values.
 // Notice that backoff bounds are highly dependent on the system and 
 // from the concurrency levels. This values should be carefully tuned
@@ -29,6 +29,7 @@
  */
 
 
+#include <atomic>
 #include <functional>
 #include <tuple>
 #include <vector>
@@ -151,6 +152,75 @@ protected:
         delete subops;
     }
     
+    /*
+     * Adaptive cutoff: the workers measure the cost of the subtrees they
+     * execute inline (at the beginning only the base cases), the scheduler
+     * measures its own cost per task. When the subtrees at depth d cost on
+     * average less than ratio times the scheduler cost, the subtrees at
+     * depth d-1 are executed inline by the worker that receives them, i.e.
+     * divide, recursion and combine without creating tasks. The cutoff
+     * moves up one level at a time, provided that there are at least
+     * TASKS_PER_WORKER tasks per worker at the new cutoff level.
+     */
+    struct cutoff_t {
+        enum { MAXLEVELS=64, MINSAMPLES=8, TASKS_PER_WORKER=4 };
+        struct level_t {
+            std::atomic<ticks> cost;     // cost of the inline subtrees
+            std::atomic<long>  nsamples; // n. of inline subtrees
+            std::atomic<long>  ntasks;   // n. of nodes at this depth
+        };
+
+        cutoff_t():ratio(4.0),nw(1) { reset(1); }
+
+        void reset(size_t nworkers) {
+            nw = nworkers;
+            level.store(MAXLEVELS);
+            overhead.store(0);
+            for(auto &l: L) { l.cost.store(0); l.nsamples.store(0); l.ntasks.store(0); }
+        }
+        inline bool enabled() const { return ratio>0; }
+        inline bool inlined(const long depth) const {
+            return enabled() && depth >= level.load(std::memory_order_relaxed);
+        }
+        inline void node(const long depth) {
+            if (depth < MAXLEVELS) L[depth].ntasks.fetch_add(1, std::memory_order_relaxed);
+        }
+        inline void sample(const long depth, const ticks t) {
+            if (depth < 1 || depth >= MAXLEVELS) return;
+            level_t &l = L[depth];
+            const ticks c = l.cost.fetch_add(t, std::memory_order_relaxed) + t;
+            const long  n = l.nsamples.fetch_add(1, std::memory_order_relaxed) + 1;
+            if (n < MINSAMPLES) return;
+            if ((double)c/n >= ratio*overhead.load(std::memory_order_relaxed)) return;
+            long cur = level.load(std::memory_order_relaxed);
+            if (depth-1 < 1 || depth-1 >= cur) return;
+            if (L[depth-1].ntasks.load(std::memory_order_relaxed) < (long)(TASKS_PER_WORKER*nw)) return;
+            while(depth-1 < cur && !level.compare_exchange_weak(cur, depth-1)) ;
+        }
+
+        double             ratio;     // <=0 disables the adaptive cutoff
+        size_t             nw;
+        std::atomic<long>  level;     // the subtrees at depth >= level are executed inline
+        std::atomic<ticks> overhead;  // scheduler cost per task
+        level_t            L[MAXLEVELS];
+    };
+
+    // sequential execution of a subtree on the calling worker
+    static void DACInline(const divide_f_t& _divide_fn, const combine_f_t& _combine_fn,
+                          const seq_f_t& _seq_fn, const cond_f_t& _condition_fn,
+                          const OperandType& op, ResultType& ret) {
+        if (_condition_fn(op)) {
+            _seq_fn(op, ret);
+            return;
+        }
+        std::vector<OperandType> ops;
+        _divide_fn(op, ops);
+        std::vector<ResultType> ress(ops.size());
+        for(size_t i=0;i<ops.size();++i)
+            DACInline(_divide_fn,_combine_fn,_seq_fn,_condition_fn, ops[i], ress[i]);
+        _combine_fn(ress, ret);
+    }
+
     /**
      * @brief DACFunction it represents the generic (recursive) task of a Divide and Conquer algorithm. Threfore the operand is 'divided', then it is called
      *      the DACFunction for each suboperands and finally the Combine produces the final output. It supports unknown branch factor (i.e. unknown number
@@ -165,12 +235,16 @@ protected:
      * @param _condition_fn condition (for base case)
      * @param op operand
      * @param ret pointer to memory area in which store the result
+     * @param depth depth of the operand in the recursion tree (see cutoff_t)
      */
     static void DACFunction(void *w,const std::function<void (const OperandType&, std::vector<OperandType> &)>& _divide_fn, const std::function<void(std::vector<ResultType>&,ResultType&)>& _combine_fn,
                             const std::function<void(const OperandType&,ResultType&)>& _seq_fn,const std::function<bool(const OperandType&)>& _condition_fn,
-                            OperandType* op, ResultType *ret )
+                            OperandType* op, ResultType *ret, long depth )
 	{
-		if(!_condition_fn(*op))  //this is not the base case
+        cutoff_t *const co = ((DACWorker*)w)->co;
+        co->node(depth);
+        const bool base = _condition_fn(*op);
+		if(!base && !co->inlined(depth))  //this is not the base case
             {
                 //divide
                 //std::vector<OperandType*> ops=_divide_fn(*op);
@@ -193,11 +267,11 @@ protected:
                         params.push_back(r);
                         ((DACWorker*)w)->AddTaskWorker(params,
                                                        ff_DC<IN_t, OUT_t, OperandType, ResultType, compare_t>::DACFunction, 
-                                                       w,_divide_fn,_combine_fn,_seq_fn,_condition_fn, &(*ops)[i], &(*ress)[i]);
+                                                       w,_divide_fn,_combine_fn,_seq_fn,_condition_fn, &(*ops)[i], &(*ress)[i], depth+1);
                     }
                 
                 
-                DACFunction(w,_divide_fn,_combine_fn,_seq_fn,_condition_fn, &(*ops)[branch_factor-1], &(*ress)[branch_factor-1]);
+                DACFunction(w,_divide_fn,_combine_fn,_seq_fn,_condition_fn, &(*ops)[branch_factor-1], &(*ress)[branch_factor-1], depth+1);
                 
                 //combine task
                 params.clear();
@@ -216,14 +290,18 @@ protected:
 
             }
         else{
-            //base case
-            _seq_fn(*op,*ret);
+            //base case or subtree below the cutoff, combined here without tasks
+            const ticks t0 = co->enabled() ? getticks() : 0;
+            if (base) _seq_fn(*op,*ret);
+            else DACInline(_divide_fn,_combine_fn,_seq_fn,_condition_fn, *op, *ret);
+            if (co->enabled()) co->sample(depth, getticks()-t0);
         }
     }
     
     
     /* --------------  worker ------------------------------- */
     struct DACWorker: ff_node_t<hash_task_t,generic_task_t> {
+        DACWorker(cutoff_t *const co):co(co) {}
 
 		//DEBUG
 //		DACWorker():_task_exe(0), _task_created(0),_times(0){}
@@ -263,6 +341,8 @@ protected:
 //			_task_created++;
         }
 
+        cutoff_t *const co;
+
 
 //		//DEBUG
 //		void svc_end()
@@ -291,7 +371,7 @@ protected:
                                        hash_task_t *waittask=nullptr) {
             unsigned long act_id=baseSched::task_id++;
             hash_task_t *act_task=baseSched::createTask(act_id,NOT_READY,msg->wtask);	    
-            icl_hash_insert(baseSched::task_set, &act_task->id, act_task); 
+            baseSched::task_set.insert(act_task->id, act_task); 
             for (auto p: msg->P) {
                 auto d    = p.tag;
                 auto dir  = p.dir;
@@ -299,10 +379,10 @@ protected:
                     // hash_task_t * t=(hash_task_t *)icl_hash_find(address_set,(void*)d);
                     
                     //address_set is an hash table data->task_id. The task_id is memorized in plain format (i.e. it is not a pointer to a memory area that contains the id)
-                    unsigned long t_id=(unsigned long)icl_hash_find(baseSched::address_set,(void *)d);
+                    unsigned long t_id=baseSched::lastWriter(d);
                     hash_task_t * t=NULL;
                     if(t_id)    //t_id==0 if the hash table does not contains info for d
-                        t=(hash_task_t *)icl_hash_find(baseSched::task_set,&t_id);
+                        t=baseSched::findTask(t_id);
                     
                     //we have to check that the task exists
                     if(t!=NULL) {
@@ -318,9 +398,9 @@ protected:
                 } else
                     if (dir==OUTPUT) {
                         hash_task_t * t=NULL;
-                        unsigned long t_id=(unsigned long)icl_hash_find(baseSched::address_set,(void *)d);
+                        unsigned long t_id=baseSched::lastWriter(d);
                         if(t_id)
-                            t=(hash_task_t *)icl_hash_find(baseSched::task_set,&t_id);
+                            t=baseSched::findTask(t_id);
                         
                         if(t != NULL) { //someone write that data
                             
@@ -338,7 +418,7 @@ protected:
                                 std::vector<long> todelete;
 
                             for(long ii=0;ii<t->unblock_numb;ii++) {							
-                                hash_task_t* t2=(hash_task_t*)icl_hash_find(baseSched::task_set,&t->unblock_task_ids[ii]);
+                                hash_task_t* t2=baseSched::findTask(t->unblock_task_ids[ii]);
 
 
                                 //t2 must not be a READY task (false positive dependence)
@@ -378,10 +458,7 @@ protected:
                         }
 
                     }
-                    if(t_id)
-                        icl_hash_delete(baseSched::address_set,(void *)d,NULL,NULL);
-                    //icl_hash_update_insert(address_set, (void*)d, act_task);
-                    icl_hash_insert(baseSched::address_set, (void*)d,(void *)(act_task->id));
+                    baseSched::address_set.insert(d, act_task->id);
 
                 }
         }
@@ -399,10 +476,11 @@ protected:
         Scheduler(ff_loadbalancer* lb, const int maxnw, void (*schedRelaxF)(unsigned long), const std::function<void (const OperandType&, std::vector<OperandType> &)>& divide_fn,
                   const std::function<void(std::vector<ResultType>&,ResultType&)>& combine_fn,
                   const std::function<void(const OperandType&,ResultType&)>& seq_fn, const std::function<bool(const OperandType&)>& cond_fn,
-                  const OperandType* op,ResultType* res):
+                  const OperandType* op,ResultType* res, cutoff_t *co):
             TaskFScheduler<generic_task_t,compare_t>(lb,maxnw),
             task_numb(0),task_completed(0),bk_count(0),schedRelaxF(schedRelaxF),
-            _divide_fn(divide_fn), _combine_fn(combine_fn), _seq_fn(seq_fn), _condition_fn(cond_fn),_op(op),_res(res)
+            _divide_fn(divide_fn), _combine_fn(combine_fn), _seq_fn(seq_fn), _condition_fn(cond_fn),_op(op),_res(res),
+            co(co),schedTicks(0)
             {
             }
         virtual ~Scheduler() {}
@@ -412,6 +490,9 @@ protected:
 
             task_numb = task_completed = 0, bk_count = 0;
             m=0;
+            co->reset(lb->getnworkers());
+            co->node(0);
+            schedTicks = 0;
 
             return 0;
         }
@@ -451,7 +532,7 @@ protected:
                         params.push_back(r);
                         this->AddTaskScheduler(params,
                                                ff_DC<IN_t, OUT_t, OperandType, ResultType, compare_t>::DACFunction, 
-                                               (void*)0,_divide_fn,_combine_fn,_seq_fn,_condition_fn, &(*ops)[i], &(*ress)[i]);
+                                               (void*)0,_divide_fn,_combine_fn,_seq_fn,_condition_fn, &(*ops)[i], &(*ress)[i], 1L);
                     }
 
 
@@ -478,6 +559,7 @@ protected:
             else
                 {
                 bk_count = 0;
+                const ticks t0 = co->enabled() ? getticks() : 0;
                 if(t->is_new_task)
                 {
                     //new task generated by a worker
@@ -486,6 +568,7 @@ protected:
                     schedule_task(0);
                     (&(t->tf))->~task_f_t();
                     TASK_FREE(t);
+                    if (co->enabled()) schedTicks += getticks()-t0;
                     return baseSched::GO_ON;
                 }
                 else
@@ -498,6 +581,10 @@ protected:
                     schedule_task(1); // try once more
 
                     TASK_FREE(t);
+                    if (co->enabled()) {
+                        schedTicks += getticks()-t0;
+                        co->overhead.store(schedTicks/task_completed, std::memory_order_relaxed);
+                    }
                     if(task_numb==task_completed)
                     {
                         //std::cout << "Created tasks: "<<task_numb<<std::endl;
@@ -522,6 +609,8 @@ protected:
 
         const OperandType* _op;                                            //primo operando
         ResultType* _res;
+        cutoff_t   *co;
+        ticks       schedTicks;  // time spent in handling the tasks
 
         template<typename F_t, typename... Param>
         inline void AddTaskScheduler(std::vector<param_info> &P, const F_t F, Param... args)
@@ -565,10 +654,10 @@ public:
         farm = new ff_farm(false,640*maxnw,1024*maxnw,true,maxnw,true);
         std::vector<ff_node *> w;
         // NOTE: Worker objects are going to be destroyed by the farm destructor
-        for(int i=0;i<numw;++i) w.push_back(new DACWorker);
+        for(int i=0;i<numw;++i) w.push_back(new DACWorker(&cutoff));
         farm->add_workers(w);
         
-        farm->add_emitter(sched = new Scheduler(farm->getlb(), numw, schedRelaxF,_divide_fn,_combine_fn,_seq_fn,_condition_fn,&op,&res));
+        farm->add_emitter(sched = new Scheduler(farm->getlb(), numw, schedRelaxF,_divide_fn,_combine_fn,_seq_fn,_condition_fn,&op,&res,&cutoff));
         farm->wrap_around();        
     }
     ff_DC(const std::function<void (const OperandType&, std::vector<OperandType> &)>& divide_fn, const std::function<void(std::vector<ResultType>&,ResultType&)>& combine_fn,
@@ -580,10 +669,10 @@ public:
         farm = new ff_farm(false,640*maxnw,1024*maxnw,true,maxnw,true);
         std::vector<ff_node *> w;
         // NOTE: Worker objects are going to be destroyed by the farm destructor
-        for(int i=0;i<numw;++i) w.push_back(new DACWorker);
+        for(int i=0;i<numw;++i) w.push_back(new DACWorker(&cutoff));
         farm->add_workers(w);
 
-        farm->add_emitter(sched = new Scheduler(farm->getlb(), numw, schedRelaxF,_divide_fn,_combine_fn,_seq_fn,_condition_fn, nullptr, nullptr));
+        farm->add_emitter(sched = new Scheduler(farm->getlb(), numw, schedRelaxF,_divide_fn,_combine_fn,_seq_fn,_condition_fn, nullptr, nullptr, &cutoff));
         farm->wrap_around();
     }
 
@@ -600,6 +689,15 @@ public:
         farmworkers=(std::min)(ff_numCores(),nw); 
     }	
     
+    /**
+     * Adaptive cutoff (enabled by default, ratio 4): the subtrees that cost
+     * less than ratio times the scheduler cost per task are executed
+     * inline by the workers (see cutoff_t). ratio<=0 disables it, so that
+     * tasks are created down to the base cases. It must be set between
+     * two runs.
+     */
+    void setCutoffRatio(double ratio) { cutoff.ratio = ratio; }
+
     inline int run(bool=false) {
         if (!prepared) if (prepare()<0) return -1;
         return ff_node::run(true);
@@ -638,6 +736,7 @@ protected:
     int farmworkers;   // n. of workers in the farm
     ff_farm   *farm;   
     Scheduler *sched;  // farm's scheduler
+    cutoff_t   cutoff;
 };
 
 
@@ -0,0 +1,500 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \file deadline_manager.hpp
+ * \ingroup aux_classes
+ *
+ * \brief Closed-loop SCHED_DEADLINE budget manager for FastFlow graphs
+ *
+ * @detail The \p ff_deadline_manager is a stand-alone thread that attaches
+ * to a running building block (typically a \p ff_pipeline or a \p ff_farm),
+ * periodically samples the occupancy of the channels of each node and moves
+ * SCHED_DEADLINE runtime (budget) from the least loaded nodes to the
+ * busiest one. The way the budget is moved is selected through a
+ * pluggable policy (see \p ff_dl_policy).
+ *
+ * This is the runtime version of the manager used in the
+ * \p test_ossched_* tests (see "SCHED_DEADLINE evaluation.md").
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_DEADLINE_MANAGER_HPP
+#define FF_DEADLINE_MANAGER_HPP
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <ff/node.hpp>
+#include <ff/multinode.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/farm.hpp>
+#include <ff/all2all.hpp>
+#include <ff/sched_monitor.hpp>
+
+namespace ff {
+
+/*
+ * Parameters of the deadline manager. All times are in nanoseconds.
+ */
+struct ff_dl_params {
+    uint64_t period           = 1000000;   ///< SCHED_DEADLINE period (and relative deadline)
+    double   initial_util     = 1.0;       ///< total bandwidth equally split among the nodes at start-up
+    double   max_util         = -1.0;      ///< admission control bound, if <0 it is derived from the number of CPUs
+    double   bandwidth_min    = 0.01;      ///< per-node minimum (and 1-maximum) fraction of the period
+    size_t   runtime_fraction = 20;        ///< the runtime moved at each step is period/nnodes/runtime_fraction
+    long     sampling_ns      = 10000000;  ///< sampling interval of the channels
+    bool     set_initial      = true;      ///< if false the nodes set the SCHED_DEADLINE policy by themselves
+};
+
+/*
+ * One sample for each node managed. The load is the average occupancy of
+ * the input channels minus the average occupancy of the output channels,
+ * so that a positive value means that the node is a bottleneck.
+ */
+struct ff_dl_sample {
+    double   load;
+    uint64_t runtime;
+};
+
+/*!
+ * \class ff_dl_policy
+ * \ingroup aux_classes
+ *
+ * \brief Budget redistribution strategy used by \p ff_deadline_manager.
+ *
+ * The \p rebalance method receives the current samples and fills \p rt with
+ * the new runtimes (initially equal to the current ones). Runtimes must stay
+ * within [rt_min, rt_max]. It returns false if nothing has to be changed.
+ */
+class ff_dl_policy {
+public:
+    virtual ~ff_dl_policy() {}
+    virtual const char* name() const = 0;
+    virtual bool rebalance(const std::vector<ff_dl_sample>& S, std::vector<uint64_t>& rt,
+                           uint64_t offset, uint64_t rt_min, uint64_t rt_max) = 0;
+protected:
+    static inline void minmax_load(const std::vector<ff_dl_sample>& S, size_t& least, size_t& busiest) {
+        least = busiest = 0;
+        for(size_t i=1;i<S.size();++i) {
+            if (S[i].load < S[least].load)   least   = i;
+            if (S[i].load > S[busiest].load) busiest = i;
+        }
+    }
+};
+
+/*
+ * 'master' strategy: the runtime is moved from the least loaded node to the
+ * busiest one.
+ */
+class ff_dl_policy_master: public ff_dl_policy {
+public:
+    const char* name() const { return "master"; }
+    bool rebalance(const std::vector<ff_dl_sample>& S, std::vector<uint64_t>& rt,
+                   uint64_t offset, uint64_t rt_min, uint64_t rt_max) {
+        if (S.size()<2) return false;
+        size_t least, busiest;
+        minmax_load(S, least, busiest);
+        if (least == busiest) return false;
+        if (rt[least] < rt_min + offset || rt[busiest] + offset > rt_max) return false;
+        rt[least]   -= offset;
+        rt[busiest] += offset;
+        return true;
+    }
+};
+
+/*
+ * 'V2' strategy: the runtime is taken from a pool of nodes (all nodes whose
+ * load is not greater than the average load) and given to the busiest one.
+ */
+class ff_dl_policy_pool: public ff_dl_policy {
+public:
+    const char* name() const { return "pool"; }
+    bool rebalance(const std::vector<ff_dl_sample>& S, std::vector<uint64_t>& rt,
+                   uint64_t offset, uint64_t rt_min, uint64_t rt_max) {
+        if (S.size()<2) return false;
+        size_t least, busiest;
+        minmax_load(S, least, busiest);
+        if (least == busiest) return false;
+        double avg = 0.0;
+        for(size_t i=0;i<S.size();++i) avg += S[i].load;
+        avg /= S.size();
+
+        std::vector<size_t> pool;
+        for(size_t i=0;i<S.size();++i)
+            if (i != busiest && S[i].load <= avg) pool.push_back(i);
+        if (pool.empty()) return false;
+        const uint64_t share = (std::max)(offset / pool.size(), (uint64_t)1);
+
+        uint64_t taken = 0;
+        for(size_t k=0;k<pool.size();++k) {
+            const size_t i = pool[k];
+            if (rt[i] < rt_min + share) continue;
+            if (rt[busiest] + taken + share > rt_max) break;
+            rt[i] -= share;
+            taken += share;
+        }
+        if (!taken) return false;
+        rt[busiest] += taken;
+        return true;
+    }
+};
+
+/*
+ * 'V3' strategy: the runtime is removed from the nodes following a circular
+ * index (the busiest node is skipped) and given to the busiest one.
+ */
+class ff_dl_policy_circular: public ff_dl_policy {
+public:
+    const char* name() const { return "circular"; }
+    bool rebalance(const std::vector<ff_dl_sample>& S, std::vector<uint64_t>& rt,
+                   uint64_t offset, uint64_t rt_min, uint64_t rt_max) {
+        if (S.size()<2) return false;
+        size_t least, busiest;
+        minmax_load(S, least, busiest);
+        if (least == busiest) return false;
+        if (rt[busiest] + offset > rt_max) return false;
+        for(size_t k=0;k<S.size();++k) {
+            const size_t i = next;
+            next = (next+1) % S.size();
+            if (i == busiest || rt[i] < rt_min + offset) continue;
+            rt[i]       -= offset;
+            rt[busiest] += offset;
+            return true;
+        }
+        return false;
+    }
+protected:
+    size_t next = 0;
+};
+
+
+/*!
+ *  \class ff_deadline_manager
+ *  \ingroup aux_classes
+ *
+ *  \brief Thread redistributing SCHED_DEADLINE runtime among the nodes of
+ *  a building block according to the occupancy of their channels.
+ *
+ *  Usage:
+ *  \code
+ *    ff_deadline_manager dm(pipe, params, new ff_dl_policy_pool);
+ *    pipe.run();
+ *    dm.run();
+ *    pipe.wait();
+ *    dm.stop(); dm.wait();
+ *  \endcode
+ *
+ *  The manager has to be started after the building block because it needs
+ *  the OS thread ids of the nodes. Setting the SCHED_DEADLINE policy requires
+ *  the CAP_SYS_NICE capability, if the first setting fails the manager keeps
+ *  running as a simple monitor without changing any attribute.
+ *
+ *  This class is defined in \ref deadline_manager.hpp
+ */
+class ff_deadline_manager: public ff_thread {
+protected:
+    struct dl_entry {
+        ff_node               *node;
+        const ff_thread       *th;      // set for emitter/collector (lb/gt) threads
+        size_t                 tid;
+        svector<FFBUFFER*>     in;
+        svector<FFBUFFER*>     out;
+    };
+
+    inline size_t entry_tid(const dl_entry& e) const {
+        return e.th ? e.th->getOSThreadId() : e.node->getOSThreadId();
+    }
+
+    // the manager thread reads the counters published by the producers and
+    // the consumers, not the channels' internal buffers (see occupancy)
+    static inline double avg_length(const svector<FFBUFFER*>& B) {
+        if (B.size()==0) return 0.0;
+        double s=0.0;
+        for(size_t i=0;i<B.size();++i) s += B[i]->occupancy();
+        return s/B.size();
+    }
+
+    inline void add_entry(ff_node* n, const ff_thread* th,
+                          const svector<FFBUFFER*>& in, const svector<FFBUFFER*>& out) {
+        dl_entry e;
+        e.node = n; e.th = th; e.tid = 0; e.in = in; e.out = out;
+        entries.push_back(e);
+    }
+
+    static inline void push_buffer(svector<FFBUFFER*>& v, FFBUFFER* b) { if (b) v.push_back(b); }
+
+    /*
+     * Visits the building block collecting one entry for each thread.
+     * It has to be called after the building block has been prepared
+     * (i.e. channels have been created).
+     */
+    void collect(ff_node* n) {
+        if (n->isPipe()) {
+            const svector<ff_node*> V = reinterpret_cast<ff_pipeline*>(n)->get_pipeline_nodes();
+            for(size_t i=0;i<V.size();++i) collect(V[i]);
+            return;
+        }
+        if (n->isFarm()) {
+            ff_farm* farm = reinterpret_cast<ff_farm*>(n);
+            const svector<ff_node*>& W = farm->getWorkers();
+            svector<FFBUFFER*> win, wout;
+            for(size_t i=0;i<W.size();++i) {
+                push_buffer(win,  W[i]->get_in_buffer());
+                push_buffer(wout, W[i]->get_out_buffer());
+            }
+            ff_loadbalancer* lb = farm->getlb();
+            svector<FFBUFFER*> lbin;
+            push_buffer(lbin, lb->get_in_buffer());
+            add_entry(farm->getEmitter(), lb, lbin, win);
+            for(size_t i=0;i<W.size();++i) collect(W[i]);
+            if (farm->hasCollector()) {
+                ff_gatherer* gt = farm->getgt();
+                svector<FFBUFFER*> gtout;
+                push_buffer(gtout, gt->get_out_buffer());
+                add_entry(farm->getCollector(), gt, wout, gtout);
+            }
+            return;
+        }
+        if (n->isAll2All()) {
+            ff_a2a* a2a = reinterpret_cast<ff_a2a*>(n);
+            const svector<ff_node*>& L = a2a->getFirstSet();
+            const svector<ff_node*>& R = a2a->getSecondSet();
+            for(size_t i=0;i<L.size();++i) collect(L[i]);
+            for(size_t i=0;i<R.size();++i) collect(R[i]);
+            return;
+        }
+        svector<FFBUFFER*> in, out;
+        push_buffer(in,  n->get_in_buffer());
+        push_buffer(out, n->get_out_buffer());
+        if (n->isMultiInput()) {
+            add_entry(n, reinterpret_cast<ff_minode*>(n)->getgt(), in, out);
+            return;
+        }
+        if (n->isMultiOutput()) {
+            add_entry(n, reinterpret_cast<ff_monode*>(n)->getlb(), in, out);
+            return;
+        }
+        add_entry(n, nullptr, in, out);
+    }
+
+    // it waits (at most 1s) for all threads to publish their OS id
+    bool wait_tids() {
+        for(int k=0; k<1000 && !terminate.load(); ++k) {
+            bool all=true;
+            for(size_t i=0;i<entries.size();++i) {
+                entries[i].tid = entry_tid(entries[i]);
+                if (entries[i].tid == 0) all=false;
+            }
+            if (all) return true;
+            ff_relax(1000);
+        }
+        return false;
+    }
+
+    /*
+     * Admission control: the total utilisation must not exceed max_util
+     * and each runtime must be in the range [rt_min, rt_max].
+     */
+    inline bool admissible(const std::vector<uint64_t>& rt) const {
+        uint64_t total = 0;
+        for(size_t i=0;i<rt.size();++i) {
+            if (rt[i] < rt_min || rt[i] > rt_max) return false;
+            total += rt[i];
+        }
+        return total <= rt_total;
+    }
+
+    // the first setting of the policy also resets the affinity mask of the thread
+    inline bool set_runtime(size_t i, uint64_t runtime, bool first=false) {
+        struct sched_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(struct sched_attr);
+        attr.sched_policy   = SCHED_DEADLINE;
+        attr.sched_deadline = params.period;
+        attr.sched_period   = params.period;
+        attr.sched_runtime  = runtime;
+        if (set_scheduling_out(&attr, entries[i].tid, first)) return false;
+        runtime_table[i] = runtime;
+        return true;
+    }
+
+    /*
+     * Applies the new runtimes. Decreases are applied before increases so that
+     * the total bandwidth requested to the kernel never grows during the update.
+     */
+    void apply(const std::vector<uint64_t>& rt) {
+        for(int k=0;k<2;++k)
+            for(size_t i=0;i<rt.size();++i) {
+                if ((k==0) ? (rt[i] >= runtime_table[i]) : (rt[i] <= runtime_table[i])) continue;
+                if (!set_runtime(i, rt[i])) {
+                    nfailed.fetch_add(1, std::memory_order_relaxed);
+                    // the node has terminated, no more changes from now on
+                    if (errno == ESRCH) { graph_done = true; return; }
+                }
+            }
+        nadjust.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /*
+     * Default admission bound: number of CPUs times the fraction of each
+     * period the kernel reserves to real-time tasks (sched_rt_runtime_us).
+     */
+    static inline double default_max_util() {
+        double frac = 1.0;
+        long rt_runtime = -1, rt_period = -1;
+        FILE* f;
+        if ((f = fopen("/proc/sys/kernel/sched_rt_runtime_us", "r"))) {
+            if (fscanf(f, "%ld", &rt_runtime) != 1) rt_runtime = -1;
+            fclose(f);
+        }
+        if ((f = fopen("/proc/sys/kernel/sched_rt_period_us", "r"))) {
+            if (fscanf(f, "%ld", &rt_period) != 1) rt_period = -1;
+            fclose(f);
+        }
+        if (rt_runtime >= 0 && rt_period > 0) frac = (double)rt_runtime / rt_period;
+        return frac * ff_numCores();
+    }
+
+    int init() {
+        collect(bb);
+        if (entries.size()==0) {
+            error("ff_deadline_manager: no nodes to manage\n");
+            return -1;
+        }
+        if (!wait_tids()) {
+            error("ff_deadline_manager: cannot get the OS thread id of all nodes\n");
+            return -1;
+        }
+        const size_t n = entries.size();
+        max_util = (params.max_util < 0) ? default_max_util() : params.max_util;
+        offset   = params.period / n / (params.runtime_fraction ? params.runtime_fraction : 1);
+        rt_min   = (uint64_t)(params.period * params.bandwidth_min);
+        rt_max   = (uint64_t)(params.period * (1.0 - params.bandwidth_min));
+        rt_total = (uint64_t)(params.period * max_util);
+
+        runtime_table.assign(n, (uint64_t)(params.period * params.initial_util / n));
+        if (!admissible(runtime_table)) {
+            error("ff_deadline_manager: initial utilisation %.2f not admissible (max %.2f)\n",
+                  params.initial_util, max_util);
+            return -1;
+        }
+        if (params.set_initial) {
+            for(size_t i=0;i<n;++i) {
+                if (!set_runtime(i, runtime_table[i], true)) {
+                    error("ff_deadline_manager: cannot set SCHED_DEADLINE, monitoring only\n");
+                    enabled = false;
+                    break;
+                }
+            }
+        } else {
+            struct sched_attr attr;
+            for(size_t i=0;i<n;++i) {
+                if (get_sched_attributes(entries[i].tid, &attr) || attr.sched_policy != SCHED_DEADLINE) {
+                    enabled = false;
+                    break;
+                }
+                runtime_table[i] = attr.sched_runtime;
+            }
+        }
+        samples.resize(n);
+        return 0;
+    }
+
+public:
+    /**
+     * \brief Builds the manager for the building block \p bb.
+     *
+     * \param bb the building block (pipeline, farm, all-to-all or node) to manage
+     * \param p  manager parameters
+     * \param policy the redistribution strategy, it is deleted by the manager.
+     *        If null the 'master' strategy is used.
+     */
+    ff_deadline_manager(ff_node& bb, const ff_dl_params& p=ff_dl_params(), ff_dl_policy* policy=nullptr):
+        ff_thread(nullptr, false), bb(&bb), params(p),
+        policy(policy ? policy : new ff_dl_policy_master) {}
+
+    virtual ~ff_deadline_manager() {}
+
+    int run(bool=false) {
+        return (ff_thread::spawn()==-2) ? -1 : 0;
+    }
+
+    void* svc(void*) {
+        if (init()<0) return FF_EOS;
+        struct timespec waiter = { params.sampling_ns / 1000000000L, params.sampling_ns % 1000000000L };
+        std::vector<uint64_t> rt;
+        while(!terminate.load()) {
+            nanosleep(&waiter, NULL);
+            for(size_t i=0;i<entries.size();++i) {
+                samples[i].load    = avg_length(entries[i].in) - avg_length(entries[i].out);
+                samples[i].runtime = runtime_table[i];
+            }
+            nsamples.fetch_add(1, std::memory_order_relaxed);
+            if (!enabled || graph_done || terminate.load()) continue;
+
+            rt = runtime_table;
+            if (!policy->rebalance(samples, rt, offset, rt_min, rt_max)) continue;
+            if (!admissible(rt)) { nrejected.fetch_add(1, std::memory_order_relaxed); continue; }
+            apply(rt);
+        }
+        return FF_EOS;
+    }
+
+    /**
+     * \brief Asks the manager to terminate, the thread has to be joined with \p wait.
+     */
+    void stop() { terminate.store(true); ff_thread::stop(); }
+
+    /// number of nodes (threads) managed
+    size_t get_num_nodes()  const { return entries.size(); }
+    /// current runtime of the i-th node (ns)
+    uint64_t get_runtime(size_t i) const { return runtime_table[i]; }
+    /// OS thread id of the i-th node
+    size_t get_tid(size_t i) const { return entries[i].tid; }
+    /// false if the manager is only monitoring the nodes
+    bool is_enabled() const { return enabled; }
+    const char* get_policy_name() const { return policy->name(); }
+
+    size_t get_num_samples()     const { return nsamples.load(std::memory_order_relaxed); }
+    size_t get_num_adjustments() const { return nadjust.load(std::memory_order_relaxed); }
+    size_t get_num_rejected()    const { return nrejected.load(std::memory_order_relaxed); }
+    size_t get_num_failed()      const { return nfailed.load(std::memory_order_relaxed); }
+
+protected:
+    ff_node                       *bb;
+    const ff_dl_params             params;
+    std::unique_ptr<ff_dl_policy>  policy;
+    std::atomic<bool>              terminate{false};
+    bool                           enabled = true;
+    bool                           graph_done = false;
+    std::vector<dl_entry>          entries;
+    std::vector<uint64_t>          runtime_table;
+    std::vector<ff_dl_sample>      samples;
+    double                         max_util = 0.0;
+    uint64_t                       offset = 0, rt_min = 0, rt_max = 0, rt_total = 0;
+    // written by the manager thread, read by the getters from any thread
+    std::atomic<size_t>            nsamples{0}, nadjust{0}, nrejected{0}, nfailed{0};
+};
+
+} // namespace ff
+
+#endif /* FF_DEADLINE_MANAGER_HPP */
@@ -0,0 +1,392 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \file deptable.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Concurrent hash table used to track the data dependencies of the
+ * tasks, and epoch-based reclamation of the memory.
+ *
+ * @detail The keys are addresses (or task ids), the values are trivially
+ * copyable and not larger than 64 bits. The table is split into shards by
+ * address range, so the parameters lying in the same memory region (e.g.
+ * the blocks of a matrix row) end up in the same shard. Each shard is an
+ * open-addressing table with linear probing whose slots (key and value)
+ * are stored contiguously.
+ * The lookups are lock-free, the updates take the spin-lock of the shard
+ * only. When a shard grows, the old array is released through ff_epoch
+ * because a concurrent reader might still be probing it.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_DEPTABLE_HPP
+#define FF_DEPTABLE_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <type_traits>
+#include <ff/sysdep.h>
+#include <ff/config.hpp>
+#include <ff/spin-lock.hpp>
+
+namespace ff {
+
+/*!
+ * \class ff_epoch
+ * \ingroup building_blocks
+ *
+ * \brief Epoch-based reclamation.
+ *
+ * A thread accessing shared objects that may be removed concurrently stays
+ * inside a critical section (ff_epoch::guard). A removed object is passed
+ * to retire and it is released only when all threads have left the
+ * critical sections in which they might have seen it, i.e. after the
+ * global epoch has been advanced twice.
+ * There is one domain per process, the per-thread records are reused when
+ * the threads exit.
+ */
+class ff_epoch {
+    enum { RETIRE_TH = 64 };
+
+    struct retired_t {
+        void  *p;
+        void (*del)(void*);
+    };
+    struct alignas(CACHE_LINE_SIZE) record_t {
+        std::atomic<uint64_t>  epoch{0};     // epoch observed entering the critical section, 0 outside
+        std::atomic<bool>      inuse{true};
+        record_t              *next = nullptr;
+        unsigned               nesting = 0, nretired = 0;
+        uint64_t               limboEpoch[3] = {0,0,0};
+        std::vector<retired_t> limbo[3];     // objects retired in the epoch limboEpoch[i]
+    };
+
+    // it returns the record of the calling thread
+    record_t *mine() {
+        struct holder_t {
+            record_t *r = nullptr;
+            ~holder_t() { if (r) r->inuse.store(false, std::memory_order_release); }
+        };
+        static thread_local holder_t H;
+        if (H.r) return H.r;
+        for(record_t *r = records.load(std::memory_order_acquire); r; r = r->next) {
+            bool f = false;
+            if (!r->inuse.load(std::memory_order_relaxed) && r->inuse.compare_exchange_strong(f, true))
+                return H.r = r;
+        }
+        record_t *r = new record_t;
+        r->next = records.load(std::memory_order_relaxed);
+        while(!records.compare_exchange_weak(r->next, r)) ;
+        return H.r = r;
+    }
+
+    static inline void release(std::vector<retired_t> &v) {
+        for(size_t i=0;i<v.size();++i) v[i].del(v[i].p);
+        v.clear();
+    }
+
+    // the epoch is advanced if all threads inside a critical section have seen it
+    void tryAdvance() {
+        uint64_t e = global.load();
+        for(record_t *r = records.load(std::memory_order_acquire); r; r = r->next) {
+            const uint64_t re = r->epoch.load();
+            if (re != 0 && re != e) return;
+        }
+        global.compare_exchange_strong(e, e+1);
+    }
+
+    ff_epoch() {}
+
+public:
+    // the domain is never destroyed, the threads may exit after the static objects
+    static inline ff_epoch* instance() {
+        static ff_epoch *E = new ff_epoch;
+        return E;
+    }
+
+    void enter() {
+        record_t *r = mine();
+        if (r->nesting++) return;
+        uint64_t e;
+        do {
+            e = global.load();
+            r->epoch.store(e);
+        } while(global.load() != e);
+    }
+    void exit() {
+        record_t *r = mine();
+        if (--r->nesting == 0) r->epoch.store(0, std::memory_order_release);
+    }
+
+    // critical section
+    struct guard {
+        guard()  { ff_epoch::instance()->enter(); }
+        ~guard() { ff_epoch::instance()->exit(); }
+        guard(const guard&) = delete;
+        guard& operator=(const guard&) = delete;
+    };
+
+    /*
+     * The object p, already unreachable for the threads entering a critical
+     * section from now on, is released calling del(p) when it is safe.
+     */
+    void retire(void *p, void (*del)(void*)) {
+        record_t *r = mine();
+        if (++r->nretired % RETIRE_TH == 0) tryAdvance();
+        const uint64_t e = global.load();
+        const int b = (int)(e % 3);
+        if (r->limboEpoch[b] != e) { // the objects in the bucket have been retired at least 3 epochs ago
+            release(r->limbo[b]);
+            r->limboEpoch[b] = e;
+        }
+        r->limbo[b].push_back({p, del});
+    }
+
+private:
+    std::atomic<uint64_t>  global{1};
+    std::atomic<record_t*> records{nullptr};
+};
+
+/*!
+ * \class ff_deptable
+ * \ingroup building_blocks
+ *
+ * \brief Sharded open-addressing hash table (key: address, value: V).
+ *
+ * The key 0 and the key ~0 are reserved. \p find can be called
+ * concurrently with all the other operations, if the table can grow
+ * meanwhile the caller must be inside an ff_epoch critical section.
+ * \p insert, \p erase and \p update can be called concurrently by
+ * different threads. \p clear and \p for_each are not thread-safe.
+ */
+template<typename V>
+class ff_deptable {
+    static_assert(std::is_trivially_copyable<V>::value && sizeof(V) <= sizeof(uint64_t),
+                  "ff_deptable: the values must be trivially copyable and at most 64 bits");
+
+    static const uintptr_t EMPTY     = 0;
+    static const uintptr_t TOMBSTONE = ~(uintptr_t)0;
+
+    struct slot_t {
+        std::atomic<uintptr_t> key;
+        std::atomic<V>         val;
+    };
+    struct array_t {
+        array_t(size_t capacity):mask(capacity-1),slots(new slot_t[capacity]) {
+            for(size_t i=0;i<capacity;++i) slots[i].key.store(EMPTY, std::memory_order_relaxed);
+        }
+        ~array_t() { delete [] slots; }
+        static void destroy(void *p) { delete (array_t*)p; }
+
+        const size_t  mask;
+        slot_t       *slots;
+    };
+    struct alignas(CACHE_LINE_SIZE) shard_t {
+        shard_t():tab(nullptr),used(0),live(0) { init_unlocked(lock); }
+        ~shard_t() { delete tab.load(); }
+        std::atomic<array_t*> tab;
+        lock_t                lock;
+        size_t                used, live;  // keys and tombstones, keys
+    };
+
+    // 64-bit finalizer of MurmurHash3
+    static inline uint64_t mix(uint64_t k) {
+        k ^= k >> 33; k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33; k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+    inline shard_t &shardOf(uintptr_t key) const {
+        return shards[mix(key >> rangeShift) & (nshards-1)];
+    }
+    // first slot probed, the low bits of the hash may have been used to select the shard
+    static inline size_t home(uintptr_t key) { return (size_t)(mix(key) >> 16); }
+
+    // it returns the slot of the key or the slot where it has to be inserted (called holding the lock)
+    static inline slot_t *lookup(array_t *a, uintptr_t key) {
+        slot_t *ts = nullptr;
+        for(size_t i = home(key) & a->mask;; i = (i+1) & a->mask) {
+            slot_t *s = &a->slots[i];
+            const uintptr_t k = s->key.load(std::memory_order_relaxed);
+            if (k == key)       return s;
+            if (k == EMPTY)     return ts ? ts : s;
+            if (k == TOMBSTONE && !ts) ts = s;
+        }
+    }
+
+    // rehashing into a new array, the tombstones are dropped (called holding the lock)
+    void grow(shard_t &s, array_t *a) {
+        size_t capacity = a->mask+1;
+        if (2*s.live >= capacity/2) capacity *= 2;
+        array_t *n = new array_t(capacity);
+        for(size_t i=0;i<=a->mask;++i) {
+            const uintptr_t k = a->slots[i].key.load(std::memory_order_relaxed);
+            if (k == EMPTY || k == TOMBSTONE) continue;
+            slot_t *d = lookup(n, k);
+            d->val.store(a->slots[i].val.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            d->key.store(k, std::memory_order_relaxed);
+        }
+        s.used = s.live;
+        s.tab.store(n, std::memory_order_release);
+        ff_epoch::instance()->retire(a, array_t::destroy);
+    }
+
+    // it returns the slot of the key, inserting it if needed (called holding the lock)
+    inline slot_t *acquire(shard_t &s, uintptr_t key, bool &found) {
+        array_t *a = s.tab.load(std::memory_order_relaxed);
+        slot_t *d  = lookup(a, key);
+        found = (d->key.load(std::memory_order_relaxed) == key);
+        if (found) return d;
+        if (4*(s.used+1) > 3*(a->mask+1)) {
+            grow(s, a);
+            d = lookup(a = s.tab.load(std::memory_order_relaxed), key);
+        }
+        if (d->key.load(std::memory_order_relaxed) == EMPTY) ++s.used;
+        ++s.live;
+        return d;
+    }
+
+public:
+    /*
+     * \param capacity   initial number of slots of the whole table
+     * \param rangeShift the addresses in the same 2^rangeShift bytes range are in the same shard
+     * \param nshards    number of shards (power of 2)
+     */
+    explicit ff_deptable(size_t capacity=4096, unsigned rangeShift=12, size_t nshards=64):
+        rangeShift(rangeShift),nshards(nshards),shards(new shard_t[nshards]) {
+        size_t c = 16;
+        while(c*nshards < capacity) c <<= 1;
+        initcap = c;
+        for(size_t i=0;i<nshards;++i) shards[i].tab.store(new array_t(c), std::memory_order_relaxed);
+    }
+    ~ff_deptable() { delete [] shards; }
+
+    ff_deptable(const ff_deptable&) = delete;
+    ff_deptable& operator=(const ff_deptable&) = delete;
+
+    // it returns false if the key is not present
+    inline bool find(uintptr_t key, V &v) const {
+        const array_t *a = shardOf(key).tab.load(std::memory_order_acquire);
+        for(size_t i = home(key) & a->mask;; i = (i+1) & a->mask) {
+            const slot_t &s = a->slots[i];
+            const uintptr_t k = s.key.load(std::memory_order_acquire);
+            if (k == key) {
+                v = s.val.load(std::memory_order_acquire);
+                // the key might have been erased meanwhile
+                return s.key.load(std::memory_order_acquire) == key;
+            }
+            if (k == EMPTY) return false;
+        }
+    }
+
+    // it inserts the key or it changes its value
+    inline void insert(uintptr_t key, const V &v) {
+        shard_t &s = shardOf(key);
+        bool found;
+        spin_lock(s.lock);
+        slot_t *d = acquire(s, key, found);
+        d->val.store(v, std::memory_order_release);
+        if (!found) d->key.store(key, std::memory_order_release);
+        spin_unlock(s.lock);
+    }
+
+    // it returns false if the key is not present
+    inline bool erase(uintptr_t key) {
+        shard_t &s = shardOf(key);
+        spin_lock(s.lock);
+        slot_t *d = lookup(s.tab.load(std::memory_order_relaxed), key);
+        const bool found = (d->key.load(std::memory_order_relaxed) == key);
+        if (found) {
+            d->key.store(TOMBSTONE, std::memory_order_release);
+            --s.live;
+        }
+        spin_unlock(s.lock);
+        return found;
+    }
+
+    /*
+     * Atomic read-modify-write of the value of the key: f(V &v, bool found)
+     * is called holding the lock of the shard, v is value-initialized if the
+     * key is not present. If f returns false the key is removed.
+     */
+    template<typename F>
+    inline void update(uintptr_t key, F f) {
+        shard_t &s = shardOf(key);
+        bool found;
+        spin_lock(s.lock);
+        slot_t *d = acquire(s, key, found);
+        V v = found ? d->val.load(std::memory_order_relaxed) : V();
+        if (f(v, found)) {
+            d->val.store(v, std::memory_order_release);
+            if (!found) d->key.store(key, std::memory_order_release);
+        } else {
+            if (found) d->key.store(TOMBSTONE, std::memory_order_release);
+            else if (d->key.load(std::memory_order_relaxed) == EMPTY) --s.used;
+            --s.live;
+        }
+        spin_unlock(s.lock);
+    }
+
+    // it calls f(key, value) for each element
+    template<typename F>
+    void for_each(F f) const {
+        for(size_t j=0;j<nshards;++j) {
+            const array_t *a = shards[j].tab.load(std::memory_order_relaxed);
+            for(size_t i=0;i<=a->mask;++i) {
+                const uintptr_t k = a->slots[i].key.load(std::memory_order_relaxed);
+                if (k != EMPTY && k != TOMBSTONE) f(k, a->slots[i].val.load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+    // it removes all elements, the arrays are shrunk to the initial size
+    void clear() {
+        for(size_t j=0;j<nshards;++j) {
+            shard_t &s = shards[j];
+            array_t *a = s.tab.load(std::memory_order_relaxed);
+            if (a->mask+1 > initcap) {
+                s.tab.store(new array_t(initcap), std::memory_order_release);
+                ff_epoch::instance()->retire(a, array_t::destroy);
+            } else
+                for(size_t i=0;i<=a->mask;++i) a->slots[i].key.store(EMPTY, std::memory_order_relaxed);
+            s.used = s.live = 0;
+        }
+    }
+
+    // number of elements (approximated if there are concurrent updates)
+    inline size_t size() const {
+        size_t n = 0;
+        for(size_t j=0;j<nshards;++j) n += shards[j].live;
+        return n;
+    }
+
+protected:
+    const unsigned  rangeShift;
+    const size_t    nshards;
+    size_t          initcap;
+    shard_t        *shards;
+};
+
+} // namespace ff
+
+#endif /* FF_DEPTABLE_HPP */
@@ -43,6 +43,18 @@
 #define DEFAULT_BATCH_SIZE        1
 #endif
 
+// optionally, the batch is flushed also when it reaches this number of bytes
+// or when its first message is older than the timeout (microseconds), in the
+// last case the number of messages per batch adapts to the rate of each
+// destination. 0 disables the bound, by default the batches are flushed
+// only when they reach the batch size.
+#if !defined(DEFAULT_BATCH_BYTES)
+#define DEFAULT_BATCH_BYTES       0
+#endif
+#if !defined(DEFAULT_BATCH_TIMEOUT_US)
+#define DEFAULT_BATCH_TIMEOUT_US  0
+#endif
+
 // default number of On-The-Fly messages
 #if !defined(DEFAULT_INTERNALMSG_OTF)
 #define DEFAULT_INTERNALMSG_OTF  10
@@ -51,6 +63,24 @@
 #define DEFAULT_MESSAGE_OTF     100
 #endif
 
+// default number of credits of each logical channel between two groups,
+// 0 disables the credit-based flow control (see ff_dsender)
+#if !defined(DEFAULT_CHANNEL_CREDITS)
+#define DEFAULT_CHANNEL_CREDITS   0
+#endif
+
+// default size (in bytes) of the shared-memory ring used between groups
+// running on the same host, 0 disables the shared-memory transport
+#if !defined(DEFAULT_SHM_RING_SIZE)
+#define DEFAULT_SHM_RING_SIZE   (1<<20)
+#endif
+
+// default number of threads reading the socket connections in the receiver
+// of a group (see ff_dreceiver::setThreads)
+#if !defined(DEFAULT_RECEIVER_THREADS)
+#define DEFAULT_RECEIVER_THREADS  1
+#endif
+
 
 #include <ff/ff.hpp>
 #include <ff/distributed/ff_network.hpp>
@@ -2,31 +2,96 @@
 #define FF_BATCHBUFFER_H
 #include "ff_network.hpp"
 #include <sys/uio.h>
+#include <chrono>
 using namespace ff;
 
+/*
+ * Flush policy of a batch: it is flushed when it holds N messages, B bytes
+ * or when its first message is older than T microseconds, whichever comes
+ * first. N adapts to the rate of the destination: it is the number of
+ * messages expected within T according to the average inter-arrival time
+ * (EWMA, weight 1/8), bounded by the batch size. So a trickle destination
+ * sends each message as soon as it arrives, while a bursty one fills the
+ * batches. With T=0 the policy is the static one (N = batch size).
+ */
+class ff_batchPolicy {
+public:
+    using clock = std::chrono::steady_clock;
+
+    ff_batchPolicy(int maxSize=1, size_t maxBytes=DEFAULT_BATCH_BYTES, long timeoutUs=DEFAULT_BATCH_TIMEOUT_US):
+        maxSize(maxSize), limit(1), maxBytes(maxBytes),
+        timeout(std::chrono::microseconds(timeoutUs > 0 ? timeoutUs : 0)), avgGap(timeout) {
+        if (timeout.count() == 0) limit = maxSize;
+    }
+
+    /*
+     * A message of sz bytes has been added to the batch, that now holds n
+     * messages. It returns true if the batch has to be flushed.
+     */
+    inline bool added(int n, size_t sz) {
+        bytes += sz;
+        if (timeout.count() == 0) return n >= limit || (maxBytes && bytes >= maxBytes);
+
+        const clock::time_point now = clock::now();
+        clock::duration gap = now - last;
+        // long gaps are clamped so that the average can quickly recover
+        if (gap > 4*timeout) gap = 4*timeout;
+        avgGap += (gap - avgGap) / 8;
+        last = now;
+        if (n == 1) first = now;
+
+        const long expected = (avgGap.count() > 0) ? (long)(timeout / avgGap) : maxSize;
+        limit = (expected < 1) ? 1 : ((expected > maxSize) ? maxSize : (int)expected);
+        return n >= limit || (maxBytes && bytes >= maxBytes) || (now - first) >= timeout;
+    }
+
+    // the first message of the (non empty) batch is older than T
+    inline bool expired(clock::time_point now) const {
+        return timeout.count() > 0 && (now - first) >= timeout;
+    }
+
+    inline void flushed() { bytes = 0; }
+
+    // current number of messages that triggers the flush
+    inline int getLimit() const { return limit; }
+
+protected:
+    int                 maxSize, limit;
+    size_t              maxBytes, bytes = 0;
+    clock::duration     timeout, avgGap;
+    clock::time_point   first, last;
+};
+
 class ff_batchBuffer {	
     std::function<bool(struct iovec*, int)> callback;
     int batchSize;
+    ff_batchPolicy policy;
     struct iovec iov[UIO_MAXIOV];
-    std::vector<std::pair<size_t*, message_t*>> toCleanup;
+    // the headers of the messages in the batch point to these lengths
+    std::vector<size_t> sizes;
+    std::vector<message_t*> toCleanup;
 public:
     int size = 0;
     ChannelType ct;
     ff_batchBuffer() {}
-    ff_batchBuffer(int _size, ChannelType ct, std::function<bool(struct iovec*, int)> cbk) : callback(cbk), batchSize(_size), ct(ct) {
+    ff_batchBuffer(int _size, ChannelType ct, std::function<bool(struct iovec*, int)> cbk,
+                   size_t maxBytes = DEFAULT_BATCH_BYTES, long timeoutUs = DEFAULT_BATCH_TIMEOUT_US)
+        : callback(cbk), batchSize(_size), policy(_size, maxBytes, timeoutUs), ct(ct) {
 		if (_size*4+1 > UIO_MAXIOV){
             error("Size too big!\n");
             abort();
         }
         iov[0].iov_base = &(this->size);
         iov[0].iov_len = sizeof(int);
+        sizes.resize(_size);
+        toCleanup.reserve(_size);
     }
 
     int push(message_t* m){
         m->sender = htonl(m->sender);
         m->chid = htonl(m->chid);
-        size_t* sz = new size_t(htobe64(m->data.getLen()));
-
+        size_t* sz = &sizes[size];
+        *sz = htobe64(m->data.getLen());
 
         int indexBase = size * 4;
         iov[indexBase+1].iov_base = &m->sender;
@@ -38,13 +103,19 @@ public:
         iov[indexBase+4].iov_base = m->data.getPtr();
         iov[indexBase+4].iov_len = m->data.getLen();
     
-        toCleanup.push_back(std::make_pair(sz, m));
+        toCleanup.push_back(m);
 
-        if (++size == batchSize)
+        if (policy.added(++size, m->data.getLen()))
             return this->flush();
 		return 0;
     }
 
+    // it flushes the batch if its first message has been waiting for too long
+    int flushExpired(ff_batchPolicy::clock::time_point now) {
+        if (size == 0 || !policy.expired(now)) return 0;
+        return flush();
+    }
+
     int sendEOS(){
         if (push(new message_t(0,0))<0) {
 			error("pushing EOS");
@@ -64,13 +135,12 @@ public:
 			return -1;
 		}
 
-		while (!toCleanup.empty()){
-            delete toCleanup.back().first;
-            delete toCleanup.back().second;
-            toCleanup.pop_back();
-        }
+		// the messages and their buffers go back to the pool
+		for(message_t* m : toCleanup) delete m;
+		toCleanup.clear();
 
         size = 0;
+        policy.flushed();
 		return 0;
     }
 
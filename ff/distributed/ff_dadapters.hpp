@@ -62,6 +62,7 @@ private:
     int totalWorkers, index;
 	std::unordered_map<int, int> localWorkersMap;
     int nextDestination = -1;
+    ff_keyed_policy keyed;   // key-partitioned scheduling of the original a2a (if set)
 public:
 	/** Parameters:
 	 * 	- n: rightmost sequential node of the builiding block representing the left-set worker
@@ -76,6 +77,8 @@ public:
 		registerCallback(ff_send_out_to_cbk, this);
 	}
 
+	void setKeyedPolicy(const ff_keyed_policy* P) { if (P) keyed = *P; }
+
 	int svc_init() {
 		if (this->n->isMultiOutput()) {
 			ff_monode* mo = reinterpret_cast<ff_monode*>(this->n);
@@ -107,6 +110,10 @@ public:
 
     bool forward(void* task, int destination){
 
+		// the key selects the same logical destination in all the groups
+		if (destination == -1 && keyed.enabled())
+			destination = (int)keyed.select(task, totalWorkers);
+
 		if (destination == -1) {
 			message_t* msg = nullptr;
 			bool datacopied = true;
@@ -204,6 +211,10 @@ public:
             channel = msg->sender;
 			bool datacopied = true;
 			in = this->n->deserializeF(msg->data, datacopied);
+			if (!in) {  // e.g. the sender uses another encoding (see zerocopyDeserialize)
+				error("CollectorAdapter: cannot deserialize the message from %d\n", msg->sender);
+				abort();
+			}
 			if (!datacopied) msg->data.doNotCleanup();
 			delete msg;
 		} else {  // the result come from a local worker, just pass it to collector and compute the right worker id
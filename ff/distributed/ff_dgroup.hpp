@@ -84,9 +84,22 @@ class dGroup : public ff::ff_farm {
         return new WrapperIN(n);
     }
 
-    static ff_node* buildWrapperOUT(ff_node* n, int id, int outputChannels, int feedbackChannels = 0){
-        if (n->isMultiInput()) return new ff_comb(n, new WrapperOUT(new ForwarderNode(n->serializeF, n->freetaskF), id, outputChannels, feedbackChannels, true), false, true);
-        return new WrapperOUT(n, id, outputChannels, feedbackChannels);
+    static ff_node* buildWrapperOUT(ff_node* n, int id, int outputChannels, int feedbackChannels = 0, const ff_keyed_policy* keyed = nullptr){
+        WrapperOUT* w;
+        if (n->isMultiInput()) {
+            w = new WrapperOUT(new ForwarderNode(n->serializeF, n->freetaskF), id, outputChannels, feedbackChannels, true);
+            w->setKeyedPolicy(keyed);
+            return new ff_comb(n, w, false, true);
+        }
+        w = new WrapperOUT(n, id, outputChannels, feedbackChannels);
+        w->setKeyedPolicy(keyed);
+        return w;
+    }
+
+    static EmitterAdapter* buildEmitterAdapter(ff_node* n, int totalWorkers, int index, const std::unordered_map<int, int>& localWorkers, const ff_keyed_policy* keyed){
+        EmitterAdapter* e = new EmitterAdapter(n, totalWorkers, index, localWorkers);
+        e->setKeyedPolicy(keyed);
+        return e;
     }
 
 public:
@@ -101,6 +114,8 @@ public:
             }
 
             std::vector<int> reverseOutputIndexes(ir.hasLeftChildren() ? ir.outputL.rbegin() : ir.outputR.rbegin(), ir.hasLeftChildren() ? ir.outputL.rend() : ir.outputR.rend());
+            // the key-partitioned scheduling of the a2a is done by the nodes of the left set
+            const ff_keyed_policy* keyed = (ir.hasLeftChildren() && ir.parentBB->isAll2All()) ? reinterpret_cast<ff_a2a*>(ir.parentBB)->keyed_policy() : nullptr;
             for(ff_node* child: (ir.hasLeftChildren() ? ir.L : ir.R)){
                 ff::svector<ff_node*> inputs; child->get_in_nodes(inputs);
                 ff::svector<ff_node*> outputs; child->get_out_nodes(outputs);
@@ -120,7 +135,7 @@ public:
 					   if (ir.isSource && ir.isVertical() && ir.hasLeftChildren()) wrapper->skipfirstpop(true);
 					   workers.push_back(wrapper);
 				   } else  {
-					   wrapper = buildWrapperOUT(child, getBackAndPop(reverseOutputIndexes), outputChannels, feedbacksChannels);
+					   wrapper = buildWrapperOUT(child, getBackAndPop(reverseOutputIndexes), outputChannels, feedbacksChannels, keyed);
 					   workers.push_back(wrapper);
 				   }
 				   // TODO: in case there are feedback channels we cannot skip all pops!
@@ -147,7 +162,7 @@ public:
                     if (ir.hasSender){
                         for(ff_node* output : outputs){
                             ff_node* outputParent = getBB(child, output);
-                            if (outputParent) outputParent->change_node(output, buildWrapperOUT(output, getBackAndPop(reverseOutputIndexes), outputChannels, feedbacksChannels), true); // cleanup?? removefromcleanuplist??
+                            if (outputParent) outputParent->change_node(output, buildWrapperOUT(output, getBackAndPop(reverseOutputIndexes), outputChannels, feedbacksChannels, keyed), true); // cleanup?? removefromcleanuplist??
                         }
                     }
                     
@@ -156,9 +171,12 @@ public:
             }
 
             if (ir.hasReceiver){
-                if (ir.protocol == Proto::TCP)
-                    this->add_emitter(new ff_dreceiver(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR)));
-                
+                if (ir.protocol == Proto::TCP){
+                    ff_dreceiver* receiver = new ff_dreceiver(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR));
+                    receiver->setThreads(ir.receiverThreads);
+                    this->add_emitter(receiver);
+                }
+
 #ifdef DFF_MPI
                 else
                    this->add_emitter(new ff_dreceiverMPI(ir.expectedEOS, vector2Map(ir.hasLeftChildren() ? ir.inputL : ir.inputR)));
@@ -166,12 +184,20 @@ public:
             }
 
             if (ir.hasSender){
-                if(ir.protocol == Proto::TCP)
-                    this->add_collector(new ff_dsender(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF), true);
+                if(ir.protocol == Proto::TCP){
+                    ff_dsender* sender = new ff_dsender(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF);
+                    sender->setSharedMemory(ir.shmRingSize);
+                    sender->setBatchBounds(ir.outBatchBytes, ir.outBatchTimeout);
+                    sender->setCredits(ir.channelCredits);
+                    this->add_collector(sender, true);
+                }
                
 #ifdef DFF_MPI
-                else
-                   this->add_collector(new ff_dsenderMPI(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF), true);
+                else {
+                    ff_dsenderMPI* sender = new ff_dsenderMPI(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF);
+                    sender->setBatchBounds(ir.outBatchBytes, ir.outBatchTimeout);
+                    this->add_collector(sender, true);
+                }
 #endif      
             }
 			
@@ -188,17 +214,18 @@ public:
             std::vector<int> reverseLeftOutputIndexes(ir.outputL.rbegin(), ir.outputL.rend());
 
             std::unordered_map<int, int> localRightWorkers = vector2UMap(ir.inputR);
+            const ff_keyed_policy* keyed = reinterpret_cast<ff_a2a*>(ir.parentBB)->keyed_policy();
             std::vector<ff_node*> firstSet;
             for(ff_node* child : ir.L){
                 if (isSeq(child))
                     if (ir.isSource){
-                        ff_node* wrapped = new EmitterAdapter(child, ir.rightTotalInputs, getBackAndPop(reverseLeftOutputIndexes) , localRightWorkers);
+                        ff_node* wrapped = buildEmitterAdapter(child, ir.rightTotalInputs, getBackAndPop(reverseLeftOutputIndexes), localRightWorkers, keyed);
                         //if (ir.hasReceiver)
 						wrapped->skipallpop(true);
                         firstSet.push_back(wrapped);
                     } else {
 						auto d = child->getDeserializationFunction();
-                        firstSet.push_back(new ff_comb(new WrapperIN(new ForwarderNode(d.first,d.second), 1, true), new EmitterAdapter(child, ir.rightTotalInputs, getBackAndPop(reverseLeftOutputIndexes) , localRightWorkers), true, true));
+                        firstSet.push_back(new ff_comb(new WrapperIN(new ForwarderNode(d.first,d.second), 1, true), buildEmitterAdapter(child, ir.rightTotalInputs, getBackAndPop(reverseLeftOutputIndexes), localRightWorkers, keyed), true, true));
                     }
                 else {
                     
@@ -216,7 +243,7 @@ public:
                     ff::svector<ff_node*> outputs; child->get_out_nodes(outputs);
                     for(ff_node* output : outputs){
                         ff_node* outputParent = getBB(child, output);
-                        if (outputParent) outputParent->change_node(output,  new EmitterAdapter(output, ir.rightTotalInputs, getBackAndPop(reverseLeftOutputIndexes) , localRightWorkers) , true); // cleanup??? remove_fromcleanuplist??
+                        if (outputParent) outputParent->change_node(output,  buildEmitterAdapter(output, ir.rightTotalInputs, getBackAndPop(reverseLeftOutputIndexes), localRightWorkers, keyed) , true); // cleanup??? remove_fromcleanuplist??
                     }
                     firstSet.push_back(child); //ondemand?? cleanup??
                 }
@@ -278,8 +305,11 @@ public:
 
             
             if (ir.hasReceiver){
-                if (ir.protocol == Proto::TCP)
-                    this->add_emitter(new ff_dreceiverH(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.inputL)));
+                if (ir.protocol == Proto::TCP){
+                    ff_dreceiverH* receiver = new ff_dreceiverH(ir.listenEndpoint, ir.expectedEOS, vector2Map(ir.inputL));
+                    receiver->setThreads(ir.receiverThreads);
+                    this->add_emitter(receiver);
+                }
 #ifdef DFF_MPI
                 else
                    this->add_emitter(new ff_dreceiverHMPI(ir.expectedEOS, vector2Map(ir.inputL)));
@@ -287,11 +317,19 @@ public:
             }
             
             if (ir.hasSender){
-                if(ir.protocol == Proto::TCP)
-                    this->add_collector(new ff_dsenderH(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF) , true);
+                if(ir.protocol == Proto::TCP){
+                    ff_dsenderH* sender = new ff_dsenderH(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF);
+                    sender->setSharedMemory(ir.shmRingSize);
+                    sender->setBatchBounds(ir.outBatchBytes, ir.outBatchTimeout);
+                    sender->setCredits(ir.channelCredits);
+                    this->add_collector(sender, true);
+                }
 #ifdef DFF_MPI
-                else
-                   this->add_collector(new ff_dsenderHMPI(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF), true);
+                else {
+                    ff_dsenderHMPI* sender = new ff_dsenderHMPI(ir.destinationEndpoints, &ir.routingTable, ir.listenEndpoint.groupName, ir.outBatchSize, ir.messageOTF, ir.internalMessageOTF);
+                    sender->setBatchBounds(ir.outBatchBytes, ir.outBatchTimeout);
+                    this->add_collector(sender, true);
+                }
 #endif   
             }
         }  
@@ -41,6 +41,7 @@
 #include <ff/distributed/ff_dutils.hpp>
 #include <ff/distributed/ff_dintermediate.hpp>
 #include <ff/distributed/ff_dgroup.hpp>
+#include <ff/distributed/ff_dprofile.hpp>
 
 #include <cereal/cereal.hpp>
 #include <cereal/archives/json.hpp>
@@ -168,6 +169,10 @@ public:
         return -1;
       }
 
+      // profiling run, see dff_place
+      if (ff_dprofile::instance()->enabled() && ff_dprofile::instance()->dump(runningGroup) < 0)
+        return -1;
+
       #ifdef DFF_MPI
         if (usedProtocol == Proto::MPI)
           if (MPI_Finalize() != MPI_SUCCESS) abort();
@@ -195,6 +200,11 @@ private:
         int batchSize          = DEFAULT_BATCH_SIZE;
         int internalMessageOTF = DEFAULT_INTERNALMSG_OTF;
         int messageOTF         = DEFAULT_MESSAGE_OTF;
+        size_t shmRingSize     = DEFAULT_SHM_RING_SIZE;
+        size_t batchBytes      = DEFAULT_BATCH_BYTES;
+        long batchTimeout      = DEFAULT_BATCH_TIMEOUT_US;
+        int channelCredits     = DEFAULT_CHANNEL_CREDITS;
+        int receiverThreads    = DEFAULT_RECEIVER_THREADS;
 
         template <class Archive>
         void load( Archive & ar ){
@@ -222,6 +232,26 @@ private:
                 ar(cereal::make_nvp("threadMapping", threadMapping));
             } catch (cereal::Exception&) {ar.setNextName(nullptr);}
 
+            try {
+                ar(cereal::make_nvp("shmRingSize", shmRingSize));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("batchBytes", batchBytes));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("batchTimeout", batchTimeout));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("channelCredits", channelCredits));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
+            try {
+                ar(cereal::make_nvp("receiverThreads", receiverThreads));
+            } catch (cereal::Exception&) {ar.setNextName(nullptr);}
+
         }
     };
 
@@ -260,6 +290,15 @@ private:
         if (g.batchSize > 1) annotatedGroups[g.name].outBatchSize = g.batchSize;
         if (g.messageOTF) annotatedGroups[g.name].messageOTF = g.messageOTF;
         if (g.internalMessageOTF) annotatedGroups[g.name].internalMessageOTF = g.internalMessageOTF;
+        // shared-memory ring towards the groups on the same host (0 means sockets only)
+        annotatedGroups[g.name].shmRingSize = g.shmRingSize;
+        // byte and time (microseconds) bounds of the output batches
+        annotatedGroups[g.name].outBatchBytes   = g.batchBytes;
+        annotatedGroups[g.name].outBatchTimeout = g.batchTimeout;
+        // credits of each logical channel towards the other groups (0 means no flow control)
+        annotatedGroups[g.name].channelCredits  = g.channelCredits;
+        // threads reading the socket connections in the receiver of the group
+        annotatedGroups[g.name].receiverThreads = g.receiverThreads;
       }
 
       // TODO check first level pipeline before strting building the groups.
@@ -528,7 +567,7 @@ static inline int DFF_Init(int& argc, char**& argv){
     } 
 
 
-	std::string configFile, groupName;  
+	std::string configFile, groupName, profileDir;  
 
     for(int i = 0; i < argc; i++){
       if (strstr(argv[i], "--DFF_Config") != NULL){
@@ -561,6 +600,19 @@ static inline int DFF_Init(int& argc, char**& argv){
         }
         continue;
       } 
+
+      if (strstr(argv[i], "--DFF_Profile") != NULL){
+        char * equalPosition = strchr(argv[i], '=');
+        if (equalPosition == NULL){
+          profileDir = std::string(argv[i+1]);
+          argv[i] = argv[i+1] = NULL;
+          i++;
+        } else {
+          profileDir = std::string(++equalPosition);
+          argv[i] = NULL;
+        }
+        continue;
+      }
     }
 
     if (configFile.empty()){
@@ -570,6 +622,10 @@ static inline int DFF_Init(int& argc, char**& argv){
     
     dGroups::Instance()->parseConfig(configFile);
 
+    // profiling run: each group writes its profile into this directory
+    if (!profileDir.empty())
+      ff_dprofile::instance()->enable(profileDir);
+
     if (!groupName.empty())
       dGroups::Instance()->forceProtocol(Proto::TCP);
   #ifdef DFF_MPI
@@ -94,7 +94,12 @@ public:
     std::set<std::string> otherGroupsFromSameParentBB;
     size_t expectedEOS = 0;
     int outBatchSize = 1;
+    size_t outBatchBytes = DEFAULT_BATCH_BYTES;
+    long outBatchTimeout = DEFAULT_BATCH_TIMEOUT_US;
+    int channelCredits = DEFAULT_CHANNEL_CREDITS;
     int messageOTF, internalMessageOTF;
+    size_t shmRingSize = DEFAULT_SHM_RING_SIZE;
+    int receiverThreads = DEFAULT_RECEIVER_THREADS;
     // liste degli index dei nodi input/output nel builiding block in the shared memory context. The first list: inputL will become the rouitng table
     std::vector<int> inputL, outputL, inputR, outputR;
 
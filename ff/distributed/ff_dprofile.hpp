@@ -0,0 +1,153 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Profiling run of the groups (option --DFF_Profile=<dir>, see dff_run -P).
+ *
+ * The senders count the bytes and the messages sent to each destination
+ * group, and at the end each group writes <dir>/<group>.json with these
+ * counters together with the CPU time and the elapsed time of the process.
+ * The files are the input of the placement tool dff_place, which computes
+ * the mapping of the groups onto a list of hosts.
+ */
+
+#ifndef FF_DPROFILE_H
+#define FF_DPROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/uio.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <ff/utils.hpp>
+#include <cereal/cereal.hpp>
+#include <cereal/archives/json.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+namespace ff {
+
+class ff_dprofile {
+public:
+    // traffic towards one destination group
+    struct edge_t {
+        std::string to;
+        size_t bytes = 0, messages = 0;
+
+        template <class Archive>
+        void serialize(Archive& ar){
+            ar(cereal::make_nvp("to", to), cereal::make_nvp("bytes", bytes), cereal::make_nvp("messages", messages));
+        }
+    };
+
+    // content of the profile file of a group
+    struct report_t {
+        std::string group;
+        double cpuTime = 0, wallTime = 0;   // seconds
+        std::vector<edge_t> edges;
+
+        template <class Archive>
+        void serialize(Archive& ar){
+            ar(cereal::make_nvp("group", group), cereal::make_nvp("cpuTime", cpuTime),
+               cereal::make_nvp("wallTime", wallTime), cereal::make_nvp("edges", edges));
+        }
+    };
+
+    static ff_dprofile* instance(){
+        static ff_dprofile P;
+        return &P;
+    }
+
+    void enable(const std::string& directory){
+        dir   = directory;
+        start = std::chrono::steady_clock::now();
+    }
+    bool enabled() const { return !dir.empty(); }
+
+    /*
+     * It returns the transport callback of a batch buffer that also counts
+     * the traffic towards the group dest. The first element of the io
+     * vector is the number of messages of the batch.
+     */
+    std::function<bool(struct iovec*, int)> meter(const std::string& dest, std::function<bool(struct iovec*, int)> cbk){
+        counter_t* c;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            std::unique_ptr<counter_t>& p = counters[dest];
+            if (!p) p.reset(new counter_t);
+            c = p.get();
+        }
+        return [c, cbk = std::move(cbk)](struct iovec* v, int size) -> bool {
+            size_t bytes = 0;
+            for(int i=1;i<size;++i) bytes += v[i].iov_len;
+            c->bytes.fetch_add(bytes, std::memory_order_relaxed);
+            c->messages.fetch_add(ntohl(*(int*)v[0].iov_base), std::memory_order_relaxed);
+            return cbk(v, size);
+        };
+    }
+
+    // it writes the profile file of the group, it returns -1 on error
+    int dump(const std::string& group){
+        report_t r;
+        r.group    = group;
+        r.wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        struct rusage ru;
+        if (getrusage(RUSAGE_SELF, &ru) == 0)
+            r.cpuTime = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec)/1e6;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            for(auto& [dest, c] : counters)
+                r.edges.push_back({dest, c->bytes.load(), c->messages.load()});
+        }
+        std::ofstream os(dir + "/" + group + ".json");
+        if (!os) {
+            error("ff_dprofile: unable to write the profile of group %s in %s\n", group.c_str(), dir.c_str());
+            return -1;
+        }
+        {
+            cereal::JSONOutputArchive ar(os);
+            ar(cereal::make_nvp("profile", r));
+        }
+        return 0;
+    }
+
+private:
+    struct counter_t {
+        std::atomic<size_t> bytes{0}, messages{0};
+    };
+
+    ff_dprofile() {}
+
+    std::string dir;
+    std::chrono::steady_clock::time_point start;
+    std::mutex mtx;
+    std::map<std::string, std::unique_ptr<counter_t>> counters;
+};
+
+} // namespace ff
+
+#endif /* FF_DPROFILE_H */
@@ -31,21 +31,49 @@
 #include <ff/ff.hpp>
 #include <ff/distributed/ff_network.hpp>
 #include <ff/distributed/ff_dgroups.hpp>
+#include <ff/distributed/ff_shmchannel.hpp>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <cereal/cereal.hpp>
 #include <cereal/archives/portable_binary.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/polymorphic.hpp>
 
+// on Linux the connections are served with epoll, unless DFF_RECEIVER_SELECT is defined
+#if defined(__linux__) && !defined(DFF_RECEIVER_SELECT)
+#define DFF_RECEIVER_EPOLL
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <unordered_map>
+#endif
+
 using namespace ff;
 
 class ff_dreceiver: public ff_monode_t<message_t> { 
 protected:
     std::map<int, ChannelType> sck2ChannelType;
+    std::map<int, ff_shmChannel*> shmChannels;
+
+    // the connections using a shared-memory ring read from it instead of the socket
+    inline ssize_t recvn(int sck, char* ptr, size_t n){
+        auto it = shmChannels.find(sck);
+        if (it != shmChannels.end()) return it->second->readn(sck, ptr, n);
+        return readn(sck, ptr, n);
+    }
+    inline ssize_t recvvn(int sck, struct iovec* v, int count){
+        auto it = shmChannels.find(sck);
+        if (it != shmChannels.end()) return it->second->readvn(sck, v, count);
+        return readvn(sck, v, count);
+    }
 
     /*static int sendRoutingTable(const int sck, const std::vector<int>& dest){
         dataBuffer buff; std::ostream oss(&buff);
@@ -85,6 +113,38 @@ protected:
         if (readn(sck, groupName, size) < 0){
             error("Error reading from socket groupName\n"); return -1;
         }
+
+        // offer of a shared-memory ring from a sender on this host and credit window
+        int pid, shmfd, window;
+        uint64_t nonce;
+        struct iovec iov2[4];
+        iov2[0].iov_base = &pid; iov2[0].iov_len = sizeof(pid);
+        iov2[1].iov_base = &shmfd; iov2[1].iov_len = sizeof(shmfd);
+        iov2[2].iov_base = &nonce; iov2[2].iov_len = sizeof(nonce);
+        iov2[3].iov_base = &window; iov2[3].iov_len = sizeof(window);
+        switch (readvn(sck, iov2, 4)) {
+           case -1: error("Error reading from socket\n"); // fatal error
+           case  0: return -1; // connection close
+        }
+        pid = ntohl(pid); shmfd = ntohl(shmfd); nonce = be64toh(nonce); window = ntohl(window);
+        if (window > 0) {
+            creditConnections[sck] = window;
+            // the credits must not be delayed by the Nagle algorithm (it fails on local sockets)
+            int one = 1;
+            setsockopt(sck, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+        if (pid > 0) {
+            ff_shmChannel* ch = new ff_shmChannel;
+            char reply = 'Y';
+            if (ch->open(sck, pid, shmfd, nonce) < 0) {
+                delete ch;
+                reply = 'N';  // the sender falls back to the socket
+            } else shmChannels[sck] = ch;
+            if (writen(sck, &reply, 1) < 0) {
+                error("Error sending the shared-memory reply (errno=%d)\n", errno);
+                return -1;
+            }
+        }
         
         sck2ChannelType[sck] = t;
 
@@ -107,7 +167,8 @@ protected:
 
     virtual int handleBatch(int sck){
         int requestSize;
-        switch(readn(sck, reinterpret_cast<char*>(&requestSize), sizeof(requestSize))) {
+        const bool shm = shmChannels.contains(sck);
+        switch(recvn(sck, reinterpret_cast<char*>(&requestSize), sizeof(requestSize))) {
 		case -1: {			
 			perror("readn");
 			error("Something went wrong in receiving the number of tasks!\n");
@@ -115,8 +176,8 @@ protected:
 		} break;
 		case 0: return -1;
         }
-		// always sending back the acknowledgement
-        if (writen(sck, reinterpret_cast<char*>(&ACK), sizeof(ack_t)) < 0){
+		// always sending back the acknowledgement (the ring has its own flow control)
+        if (!shm && writen(sck, reinterpret_cast<char*>(&ACK), sizeof(ack_t)) < 0){
             if (errno != ECONNRESET && errno != EPIPE) {
                 error("Error sending back ACK to the sender (errno=%d)\n",errno);
                 return -1;
@@ -142,7 +203,7 @@ protected:
         iov[2].iov_base = &sz;
         iov[2].iov_len = sizeof(sz);
 
-        switch (readvn(sck, iov, 3)) {
+        switch (recvvn(sck, iov, 3)) {
 		case -1: error("Error reading from socket errno=%d\n",errno); // fatal error
 		case  0: return -1; // connection close
         }
@@ -152,16 +213,29 @@ protected:
         chid   = ntohl(chid);
         sz     = be64toh(sz);
 
+        char* buff = nullptr;
         if (sz > 0){
-            char* buff = new char [sz];
-			assert(buff);
-            if(readn(sck, buff, sz) < 0){
+            buff = dataBuffer::allocPayload(sz);
+            if(recvn(sck, buff, sz) <= 0){
                 error("Error reading from socket in handleRequest\n");
-                delete [] buff;
+                dataBuffer::freePayload(buff);
                 return -1;
             }
-			message_t* out = new message_t(buff, sz, true);
+        }
+        return handleMessage(sck, t, sender, chid, buff, sz);
+    }
+
+    /*
+     * A whole message has been received: it is either forwarded (the
+     * payload buff is then owned by the message) or a logical or physical
+     * EOS. It returns -1 if the connection has to be closed.
+     */
+    int handleMessage(int sck, ChannelType t, int sender, int chid, char* buff, size_t sz){
+        if (sz > 0){
+			message_t* out = new message_t(buff, sz, true, true);
 			assert(out);
+            if (!creditConnections.empty() && creditConnections.contains(sck))
+                ++owed[{sck, chid}];
             out->feedback = t == ChannelType::FBK;
 			out->sender = sender;
 			out->chid   = chid;
@@ -180,10 +254,602 @@ protected:
         return -1;
     }
 
+    /*
+     * It writes a control record on the socket, which may be non-blocking.
+     * With several I/O threads the acknowledgements and the credits of a
+     * connection are written by different threads, the records must not
+     * be interleaved.
+     */
+    int sendControl(int sck, const char* p, size_t n){
+        std::lock_guard<std::mutex> lock(sendLocks[(size_t)sck % NSENDLOCKS]);
+        while(n) {
+            ssize_t r = send(sck, p, n, MSG_NOSIGNAL);
+            if (r > 0) { p += r; n -= r; continue; }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd = {sck, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            if (errno == ECONNRESET || errno == EPIPE) return 0;
+            error("Error sending back control data to the sender (errno=%d)\n", errno);
+            return -1;
+        }
+        return 0;
+    }
+
+    /*
+     * Free slots and capacity of the queues towards which the messages of
+     * the logical channel chid are forwarded. It returns false if it is not
+     * known.
+     */
+    virtual bool destinationSpace(int sck, int chid, size_t& free, size_t& cap){
+        const size_t budget = creditConnections[sck];
+        if (chid == -1) return outputSpace(0, this->get_num_outchannels(), budget, free, cap);
+        auto it = routingTable.find(chid);
+        if (it == routingTable.end()) return false;
+        return outputSpace(it->second, it->second+1, budget, free, cap);
+    }
+
+    /*
+     * An unbounded queue has no free slots to measure: its capacity is
+     * taken to be budget (the credit window of the sender), so the credits
+     * are withheld as long as budget messages are waiting in it.
+     */
+    bool outputSpace(size_t first, size_t last, size_t budget, size_t& free, size_t& cap){
+        free = cap = 0;
+        ff_loadbalancer* lb = this->getlb();
+        if (!lb) return false;
+        const svector<ff_node*>& w = lb->getWorkers();
+        for(size_t i=first; i<last && i<w.size(); ++i) {
+            FFBUFFER* b = w[i]->get_in_buffer();
+            if (!b) return false;
+            size_t sz = b->buffersize();
+            if (sz == (size_t)-1) sz = budget;
+            const size_t len = b->occupancy();
+            cap  += sz;
+            free += (len < sz) ? sz - len : 0;
+        }
+        return cap > 0;
+    }
+
+    /*
+     * Credit-based flow control: the credits consumed by the messages
+     * forwarded so far are granted back in proportion to the free space of
+     * the destination queues, so a congested destination slows down only
+     * its own logical channel. It returns true if some credits are still owed.
+     */
+    bool grantCredits(){
+        bool pending = false;
+        for(auto it = owed.begin(); it != owed.end();) {
+            auto& [key, n] = *it;
+            size_t free, cap;
+            int g = n;
+            if (destinationSpace(key.first, key.second, free, cap))
+                g = (int)(((size_t)n * free + cap - 1) / cap);
+            if (g > 0) {
+                char rec[credit_t::SIZE];
+                credit_t{key.second, g}.encode(rec);
+                if (sendControl(key.first, rec, sizeof(rec)) < 0) g = n; // the connection will be closed
+                n -= g;
+            }
+            if (n == 0) { it = owed.erase(it); continue; }
+            pending = true;
+            ++it;
+        }
+        return pending;
+    }
+
+    void dropCredits(int sck){
+        if (!creditConnections.erase(sck)) return;
+        for(auto it = owed.begin(); it != owed.end();)
+            if (it->first.first == sck) it = owed.erase(it); else ++it;
+    }
+
+    /*
+     * It reads one batch from each non-empty shared-memory ring. The
+     * function unwatch removes the socket of a closed ring from the set of
+     * descriptors of the caller. It returns true if something has been read.
+     */
+    bool pollShmChannels(const std::function<void(int)>& unwatch){
+        bool busy = false;
+        for(auto it = shmChannels.begin(); it != shmChannels.end();) {
+            const int sck = it->first;
+            ff_shmChannel* ch = it->second;
+            if (!ch->readable()) { ++it; continue; }
+            busy = true;
+            if (this->handleBatch(sck) < 0){
+                delete ch;
+                it = shmChannels.erase(it);
+                unwatch(sck);
+                dropCredits(sck);
+                close(sck);
+                continue;
+            }
+            ++it;
+        }
+        return busy;
+    }
+
+    /*
+     * Before sleeping, the senders are asked to ring the doorbell. It
+     * returns false if a ring is not empty, in that case the receiver must
+     * not sleep.
+     */
+    bool armShmChannels(){
+        bool sleep = true;
+        for(auto& [sck, ch] : shmChannels)
+            if (!ch->prepareWait()) sleep = false;
+        return sleep;
+    }
+
+    /*
+     * Doorbell on the socket of a shared-memory ring. At the end of the
+     * stream the sender closes its side of the socket but the ring may
+     * still be non empty. It returns false if the socket has been closed.
+     */
+    static bool drainDoorbell(int sck){
+        char bell[64];
+        ssize_t n;
+        while((n = recv(sck, bell, sizeof(bell), MSG_DONTWAIT)) > 0);
+        return !(n == 0 || (errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR));
+    }
+
+#if defined(DFF_RECEIVER_EPOLL)
+    enum { CONN_BUFFER_SIZE = 65536, READ_BUDGET = 16, MAX_EVENTS = 256, FRAME_QUEUE_SIZE = 4096 };
+    static constexpr size_t HEADER_SIZE = 2*sizeof(int)+sizeof(size_t);
+
+    /*
+     * Input state of a socket connection. The bytes are read into a buffer
+     * reused for the whole connection, which then holds only the incomplete
+     * frame (at most a header) between two reads. The payload of a message
+     * not yet complete is received directly into its own buffer.
+     */
+    struct connection_t {
+        connection_t():buffer(CONN_BUFFER_SIZE) {}
+        ~connection_t() { if (payload) dataBuffer::freePayload(payload); }
+        connection_t(const connection_t&) = delete;
+        connection_t& operator=(const connection_t&) = delete;
+
+        std::vector<char> buffer;
+        size_t  len      = 0;       // bytes in buffer
+        int     pending  = 0;       // messages still to receive of the current batch
+        char*   payload  = nullptr;
+        size_t  size     = 0, received = 0;
+        int     sender   = 0, chid = 0;
+        ChannelType t    = ChannelType::FWD;
+    };
+    std::unordered_map<int, connection_t> connections;
+
+    /*
+     * A message received by an I/O thread, handed to the receiver node
+     * that forwards it (the output channels have a single producer).
+     * closed means that the I/O thread has stopped reading the socket,
+     * which is then closed by the node.
+     */
+    struct frame_t {
+        static void* operator new(size_t sz) {
+            void* p = ff::ff_msgPool::instance()->alloc(sz);
+            if (!p) throw std::bad_alloc();
+            return p;
+        }
+        static void operator delete(void* p) { ff::ff_msgPool::instance()->free(p); }
+
+        int         sck;
+        ChannelType t;
+        int         sender, chid;
+        char*       buff;
+        size_t      sz;
+        bool        closed;
+    };
+
+    /*
+     * I/O thread of the receiver (see setThreads). The node hands each
+     * accepted socket connection to one of them, round-robin. A thread
+     * serves its connections with its own epoll instance and passes the
+     * messages to the node through a bounded queue: when the queue is full
+     * it stops reading, so the senders are slowed down by TCP as with a
+     * single thread.
+     */
+    struct ioThread_t {
+        int efd    = -1;    // epoll instance of the connections
+        int wakefd = -1;    // it is written to stop the thread
+        std::unordered_map<int, connection_t> connections;
+        SWSR_Ptr_Buffer frames{FRAME_QUEUE_SIZE};
+        std::atomic<bool> stop{false};
+        std::thread th;
+    };
+    std::vector<std::unique_ptr<ioThread_t>> ioThreads;
+    size_t nthreads = DEFAULT_RECEIVER_THREADS;
+    size_t next_io  = 0;
+    int notifyfd    = -1;   // written by the I/O threads when they queue messages
+
+    // the socket is non-blocking, the acknowledgement must not be lost
+    int sendAck(int sck){
+        return sendControl(sck, reinterpret_cast<char*>(&ACK), sizeof(ack_t));
+    }
+
+    /*
+     * It handles all the complete frames in the buffer, deliver is called
+     * for each message and -1 means close.
+     */
+    template<typename Deliver>
+    int parseFrames(int sck, connection_t& c, Deliver&& deliver){
+        size_t off = 0;
+        int r = 0;
+        while(r == 0) {
+            char*  p     = c.buffer.data() + off;
+            size_t avail = c.len - off;
+            if (c.pending == 0) {
+                int requestSize;
+                if (avail < sizeof(requestSize)) break;
+                memcpy(&requestSize, p, sizeof(requestSize));
+                off += sizeof(requestSize);
+                // always sending back the acknowledgement
+                if (sendAck(sck) < 0) r = -1;
+                c.pending = ntohl(requestSize);
+                continue;
+            }
+            if (avail < HEADER_SIZE) break;
+            int sender, chid;
+            size_t sz;
+            memcpy(&sender, p, sizeof(int));
+            memcpy(&chid, p + sizeof(int), sizeof(int));
+            memcpy(&sz, p + 2*sizeof(int), sizeof(size_t));
+            sender = ntohl(sender);
+            chid   = ntohl(chid);
+            sz     = be64toh(sz);
+            off   += HEADER_SIZE; avail -= HEADER_SIZE; p += HEADER_SIZE;
+            --c.pending;
+
+            char* buff = nullptr;
+            if (sz > 0) {
+                buff = dataBuffer::allocPayload(sz);
+                if (avail < sz) { // the rest of the payload comes with the next reads
+                    memcpy(buff, p, avail);
+                    off += avail;
+                    c.payload = buff; c.size = sz; c.received = avail;
+                    c.sender  = sender; c.chid = chid;
+                    break;
+                }
+                memcpy(buff, p, sz);
+                off += sz;
+            }
+            r = deliver(sck, c.t, sender, chid, buff, sz);
+        }
+        // the incomplete frame is moved to the beginning of the buffer
+        if (off) {
+            memmove(c.buffer.data(), c.buffer.data() + off, c.len - off);
+            c.len -= off;
+        }
+        return r;
+    }
+
+    /*
+     * Edge-triggered read: it reads until the socket is drained or at most
+     * READ_BUDGET times, so that a fast sender cannot starve the others.
+     * It returns -1 if the connection has to be closed.
+     */
+    template<typename Deliver>
+    int readConnection(int sck, connection_t& c, bool& drained, Deliver&& deliver){
+        drained = false;
+        for(int i=0;i<READ_BUDGET;++i) {
+            ssize_t n;
+            if (c.payload) {
+                n = recv(sck, c.payload + c.received, c.size - c.received, 0);
+                if (n > 0) {
+                    if ((c.received += n) == c.size) {
+                        char* buff = c.payload;
+                        c.payload  = nullptr;
+                        if (deliver(sck, c.t, c.sender, c.chid, buff, c.size) < 0) return -1;
+                    }
+                    continue;
+                }
+            } else {
+                n = recv(sck, c.buffer.data() + c.len, c.buffer.size() - c.len, 0);
+                if (n > 0) {
+                    c.len += n;
+                    if (parseFrames(sck, c, deliver) < 0) return -1;
+                    continue;
+                }
+            }
+            if (n == 0) return -1; // connection closed
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) { drained = true; return 0; }
+            error("Error reading from socket errno=%d\n", errno);
+            return -1;
+        }
+        return 0;
+    }
+
+    static inline void signalfd(int fd){
+        const uint64_t one = 1;
+        if (write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+            error("Error writing on eventfd (errno=%d)\n", errno);
+    }
+
+    // body of an I/O thread
+    void ioLoop(ioThread_t& io){
+        std::vector<struct epoll_event> events(MAX_EVENTS);
+        std::deque<int> ready;
+        bool queued = false;   // messages queued since the node has been signalled
+
+        auto push = [&](frame_t* f) {
+            while(!io.frames.push(f)) {  // the node is behind, the sockets are not read
+                signalfd(notifyfd); queued = false;
+                if (io.stop.load(std::memory_order_relaxed)) {
+                    if (f->buff) dataBuffer::freePayload(f->buff);
+                    delete f; return;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+            queued = true;
+        };
+        // the node handles the logical EOSs, the physical one ends the connection
+        auto deliver = [&](int sck, ChannelType t, int sender, int chid, char* buff, size_t sz) -> int {
+            push(new frame_t{sck, t, sender, chid, buff, sz, false});
+            return (sz == 0 && chid != -2) ? -1 : 0;
+        };
+
+        while(!io.stop.load(std::memory_order_relaxed)) {
+            if (queued) { signalfd(notifyfd); queued = false; }
+            int n = epoll_wait(io.efd, events.data(), MAX_EVENTS, ready.empty() ? -1 : 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                error("Error on epoll_wait (errno=%d)\n", errno);
+                break;
+            }
+            for(int i=0;i<n;++i) {
+                const int fd = (int)(events[i].data.u64 & 0xffffffff);
+                if (fd == io.wakefd) {
+                    uint64_t v;
+                    if (read(io.wakefd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+                        error("Error reading from eventfd (errno=%d)\n", errno);
+                    continue;
+                }
+                auto [it, created] = io.connections.try_emplace(fd);
+                if (created) it->second.t = (ChannelType)(events[i].data.u64 >> 32);
+                ready.push_back(fd);
+            }
+            for(size_t k=ready.size(); k>0 && !io.stop.load(std::memory_order_relaxed); --k) {
+                const int fd = ready.front();
+                ready.pop_front();
+                auto it = io.connections.find(fd);
+                if (it == io.connections.end()) continue; // already closed
+                bool drained;
+                if (readConnection(fd, it->second, drained, deliver) < 0) {
+                    epoll_ctl(io.efd, EPOLL_CTL_DEL, fd, NULL);
+                    const ChannelType t = it->second.t;
+                    io.connections.erase(it);
+                    push(new frame_t{fd, t, 0, 0, nullptr, 0, true});
+                    continue;
+                }
+                if (!drained && std::find(ready.begin(), ready.end(), fd) == ready.end())
+                    ready.push_back(fd);
+            }
+        }
+        if (queued) signalfd(notifyfd);
+    }
+
+    int startIOThreads(){
+        if ((notifyfd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) < 0) {
+            error("Error creating the eventfd of the receiver (errno=%d)\n", errno);
+            return -1;
+        }
+        for(size_t i=0;i<nthreads;++i) {
+            ioThread_t* io = new ioThread_t;
+            ioThreads.emplace_back(io);
+            if (!io->frames.init() || (io->efd = epoll_create1(EPOLL_CLOEXEC)) < 0 ||
+                (io->wakefd = eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC)) < 0) {
+                error("Error creating the I/O thread %ld of the receiver (errno=%d)\n", (long)i, errno);
+                return -1;
+            }
+            struct epoll_event ev;
+            ev.events   = EPOLLIN;
+            ev.data.u64 = (uint64_t)io->wakefd;
+            if (epoll_ctl(io->efd, EPOLL_CTL_ADD, io->wakefd, &ev) < 0) {
+                error("Error adding the eventfd to epoll (errno=%d)\n", errno);
+                return -1;
+            }
+            io->th = std::thread([this, io]() { ioLoop(*io); });
+        }
+        return 0;
+    }
+
+    // the connection is served by the next I/O thread
+    int handoff(int connfd){
+        ioThread_t& io = *ioThreads[next_io];
+        next_io = (next_io + 1) % ioThreads.size();
+        fcntl(connfd, F_SETFL, fcntl(connfd, F_GETFL) | O_NONBLOCK);
+        struct epoll_event ev;
+        ev.events   = EPOLLIN | EPOLLRDHUP | EPOLLET;
+        ev.data.u64 = ((uint64_t)sck2ChannelType[connfd] << 32) | (uint32_t)connfd;
+        if (epoll_ctl(io.efd, EPOLL_CTL_ADD, connfd, &ev) < 0) {
+            error("Error adding a connection to epoll (errno=%d)\n", errno);
+            return -1;
+        }
+        return 0;
+    }
+
+    // it forwards the messages queued by the I/O threads
+    void drainIOThreads(){
+        void* p;
+        for(auto& io : ioThreads)
+            while(io->frames.pop(&p)) {
+                frame_t* f = (frame_t*)p;
+                if (f->closed) {
+                    dropCredits(f->sck);
+                    close(f->sck);
+                } else
+                    handleMessage(f->sck, f->t, f->sender, f->chid, f->buff, f->sz);
+                delete f;
+            }
+    }
+
+    void stopIOThreads(){
+        for(auto& io : ioThreads) {
+            io->stop.store(true);
+            if (io->wakefd >= 0) signalfd(io->wakefd);
+        }
+        for(auto& io : ioThreads)
+            if (io->th.joinable()) io->th.join();
+        void* p;
+        for(auto& io : ioThreads) {
+            while(io->frames.pop(&p)) {  // only the closed connections are left
+                frame_t* f = (frame_t*)p;
+                if (f->closed) { dropCredits(f->sck); close(f->sck); }
+                else if (f->buff) dataBuffer::freePayload(f->buff);
+                delete f;
+            }
+            for(auto& [fd, c] : io->connections) { dropCredits(fd); close(fd); }
+            if (io->efd >= 0) close(io->efd);
+            if (io->wakefd >= 0) close(io->wakefd);
+        }
+        ioThreads.clear();
+        if (notifyfd >= 0) { close(notifyfd); notifyfd = -1; }
+    }
+
+    message_t* svcEpoll(){
+        int efd = epoll_create1(EPOLL_CLOEXEC);
+        if (efd < 0) {
+            error("Error creating the epoll instance (errno=%d)\n", errno);
+            return EOS;
+        }
+        struct epoll_event ev;
+        ev.events  = EPOLLIN;
+        ev.data.fd = this->listen_sck;
+        if (epoll_ctl(efd, EPOLL_CTL_ADD, this->listen_sck, &ev) < 0) {
+            error("Error adding the listen socket to epoll (errno=%d)\n", errno);
+            close(efd);
+            return EOS;
+        }
+        if (nthreads > 1) {
+            if (startIOThreads() < 0) {
+                stopIOThreads();
+                close(efd);
+                return EOS;
+            }
+            ev.events  = EPOLLIN;
+            ev.data.fd = notifyfd;
+            if (epoll_ctl(efd, EPOLL_CTL_ADD, notifyfd, &ev) < 0) {
+                error("Error adding the eventfd to epoll (errno=%d)\n", errno);
+                stopIOThreads();
+                close(efd);
+                return EOS;
+            }
+        }
+        auto unwatch = [efd](int fd) { epoll_ctl(efd, EPOLL_CTL_DEL, fd, NULL); };
+        auto deliver = [this](int sck, ChannelType t, int sender, int chid, char* buff, size_t sz) -> int {
+            return handleMessage(sck, t, sender, chid, buff, sz);
+        };
+
+        std::vector<struct epoll_event> events(MAX_EVENTS);
+        std::deque<int> ready;  // connections not yet drained
+        bool owing = false;     // credits not yet granted, the wait is bounded
+        while(neos < input_channels){
+            // the shared-memory rings are polled first
+            bool busy = pollShmChannels(unwatch);
+            if (neos >= input_channels) break;
+
+            bool armed = false;
+            if (!busy && ready.empty() && !shmChannels.empty()) {
+                armed = true;
+                busy  = !armShmChannels();
+            }
+            int n = epoll_wait(efd, events.data(), MAX_EVENTS, (busy || !ready.empty()) ? 0 : (owing ? 1 : -1));
+            if (armed)
+                for(auto& [sck, ch] : shmChannels) ch->endWait();
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                error("Error on epoll_wait (errno=%d)\n", errno);
+                break;
+            }
+
+            for(int i=0;i<n;++i) {
+                const int fd = events[i].data.fd;
+                if (fd == this->listen_sck) {
+                    int connfd = accept(this->listen_sck, (struct sockaddr*)NULL ,NULL);
+                    if (connfd == -1){
+                        error("Error accepting client\n");
+                        continue;
+                    }
+                    if (this->handshakeHandler(connfd) < 0) {
+                        close(connfd);
+                        continue;
+                    }
+                    ev.data.fd = connfd;
+                    if (shmChannels.contains(connfd)) ev.events = EPOLLIN; // doorbell only
+                    else if (!ioThreads.empty()) {
+                        if (handoff(connfd) < 0) { dropCredits(connfd); close(connfd); }
+                        continue;
+                    } else {
+                        fcntl(connfd, F_SETFL, fcntl(connfd, F_GETFL) | O_NONBLOCK);
+                        connections.try_emplace(connfd).first->second.t = sck2ChannelType[connfd];
+                        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+                        ready.push_back(connfd); // the first frames may have already arrived
+                    }
+                    if (epoll_ctl(efd, EPOLL_CTL_ADD, connfd, &ev) < 0)
+                        error("Error adding a connection to epoll (errno=%d)\n", errno);
+                    continue;
+                }
+                if (fd == notifyfd) {
+                    uint64_t v;
+                    if (read(notifyfd, &v, sizeof(v)) < 0 && errno != EAGAIN)
+                        error("Error reading from eventfd (errno=%d)\n", errno);
+                    continue;
+                }
+                if (shmChannels.contains(fd)) {
+                    if (!drainDoorbell(fd)) { unwatch(fd); dropCredits(fd); }
+                    continue;
+                }
+                ready.push_back(fd);
+            }
+            // the messages read by the I/O threads (after the eventfd has been reset)
+            drainIOThreads();
+
+            // one round over the connections with something to read
+            for(size_t k=ready.size(); k>0 && neos < input_channels; --k) {
+                const int fd = ready.front();
+                ready.pop_front();
+                auto it = connections.find(fd);
+                if (it == connections.end()) continue; // already closed
+                bool drained;
+                if (readConnection(fd, it->second, drained, deliver) < 0) {
+                    unwatch(fd);
+                    connections.erase(it);
+                    dropCredits(fd);
+                    close(fd);
+                    continue;
+                }
+                if (!drained && std::find(ready.begin(), ready.end(), fd) == ready.end())
+                    ready.push_back(fd);
+            }
+            owing = !owed.empty() && grantCredits();
+        }
+        stopIOThreads();
+        close(efd);
+        return this->EOS;
+    }
+#endif
+
 public:
     ff_dreceiver(ff_endpoint acceptAddr, size_t input_channels, std::map<int, int> routingTable = {std::make_pair(0,0)}, int coreid=-1)
 		: input_channels(input_channels), acceptAddr(acceptAddr), routingTable(routingTable), coreid(coreid) {}
 
+    /*
+     * Number of threads reading from the socket connections. With more
+     * than one, the connections accepted are handed round-robin to n I/O
+     * threads, each one with its own epoll instance, and the node only
+     * forwards the messages they have read. Only the epoll backend uses
+     * more threads, the connections using a shared-memory ring are always
+     * served by the node.
+     */
+    void setThreads(size_t n) {
+#if defined(DFF_RECEIVER_EPOLL)
+        nthreads = n ? n : 1;
+#endif
+    }
+
     int svc_init() {
   		if (coreid!=-1)
 			ff_mapThreadToCpu(coreid);
@@ -232,7 +898,12 @@ public:
     }
 
     void svc_end() {
-        close(this->listen_sck);		
+        close(this->listen_sck);
+        for(auto& [sck, ch] : shmChannels) { delete ch; close(sck); }
+        shmChannels.clear();
+#if defined(DFF_RECEIVER_EPOLL)
+        connections.clear();
+#endif
 #ifdef LOCAL
 		unlink(this->acceptAddr.address.c_str());
 #endif
@@ -242,6 +913,9 @@ public:
         Everything will be handled inside a while true in the body of this node where data is pulled from network
     */
     message_t *svc(message_t* task) {        
+#if defined(DFF_RECEIVER_EPOLL)
+        return svcEpoll();
+#else
         fd_set set, tmpset;
         // intialize both sets (master, temp)
         FD_ZERO(&set);
@@ -253,13 +927,41 @@ public:
         // hold the greater descriptor
         int fdmax = this->listen_sck; 
 
+        auto removeFromSet = [&](int fd) {
+            FD_CLR(fd, &set);
+            // update the maximum file descriptor
+            if (fd == fdmax)
+                for(int ii=(fdmax-1);ii>=0;--ii)
+                    if (FD_ISSET(ii, &set)){
+                        fdmax = ii;
+                        break;
+                    }
+        };
+
+        bool owing = false;
         while(neos < input_channels){
+            // the shared-memory rings are polled first, the select does not
+            // block if at least one of them had something to read
+            bool busy = pollShmChannels([&](int fd) { if (FD_ISSET(fd, &set)) removeFromSet(fd); });
+            if (neos >= input_channels) break;
+
+            bool armed = false;
+            if (!busy && !shmChannels.empty()) {
+                armed = true;
+                busy  = !armShmChannels();
+            }
+
             // copy the master set to the temporary
             tmpset = set;
+            struct timeval notimeout = {0, 0};
+            struct timeval retry     = {0, 1000}; // credits not yet granted
 
-            switch(select(fdmax+1, &tmpset, NULL, NULL, NULL)){
+            int r = select(fdmax+1, &tmpset, NULL, NULL, busy ? &notimeout : (owing ? &retry : NULL));
+            if (armed)
+                for(auto& [sck, ch] : shmChannels) ch->endWait();
+            switch(r){
                 case -1: error("Error on selecting socket\n"); return EOS;
-                case  0: continue;
+                case  0: owing = !owed.empty() && grantCredits(); continue;
             }
 
             for(int idx=0; idx <= fdmax; idx++){
@@ -276,26 +978,25 @@ public:
                         }
                         continue;
                     }
+
+                    if (shmChannels.contains(idx)) {
+                        if (!drainDoorbell(idx)) { removeFromSet(idx); dropCredits(idx); }
+                        continue;
+                    }
                     
                     if (this->handleBatch(idx) < 0){
+                        dropCredits(idx);
                         close(idx);
-                        FD_CLR(idx, &set);
-
-                        // update the maximum file descriptor
-                        if (idx == fdmax)
-                            for(int ii=(fdmax-1);ii>=0;--ii)
-                                if (FD_ISSET(ii, &set)){
-                                    fdmax = ii;
-                                    break;
-                                }
-						
+                        removeFromSet(idx);
                     }
 					
                 }
             }
+            owing = !owed.empty() && grantCredits();
         }
 		
         return this->EOS;
+#endif
     }
 
 protected:
@@ -306,6 +1007,11 @@ protected:
     std::map<int, int> routingTable;
 	int coreid;
     ack_t ACK;
+    // credit-based flow control (see ff_dsender), the key is (socket, logical channel)
+    std::map<int, size_t> creditConnections;   // socket -> credit window
+    std::map<std::pair<int,int>, int> owed;  // credits to grant back
+    static constexpr size_t NSENDLOCKS = 64;
+    std::mutex sendLocks[NSENDLOCKS];
 };
 
 
@@ -380,6 +1086,15 @@ class ff_dreceiverH : public ff_dreceiver {
         }
     }
 
+    // the internal messages go to the last output, the others to the remaining ones
+    bool destinationSpace(int sck, int chid, size_t& free, size_t& cap){
+        const size_t last   = this->get_num_outchannels()-1;
+        const size_t budget = creditConnections[sck];
+        if (sck2ChannelType[sck] == ChannelType::INT) return outputSpace(last, last+1, budget, free, cap);
+        if (chid == -1) return outputSpace(0, last, budget, free, cap);
+        return ff_dreceiver::destinationSpace(sck, chid, free, cap);
+    }
+
 public:
     ff_dreceiverH(ff_endpoint acceptAddr, size_t input_channels, std::map<int, int> routingTable = {{0,0}}, int coreid=-1) 
     : ff_dreceiver(acceptAddr, input_channels, routingTable, coreid){
@@ -102,11 +102,11 @@ public:
                     registerEOS(status.MPI_SOURCE);
                     continue;
                 }
-                char* buff = new char[sz];
+                char* buff = dataBuffer::allocPayload(sz);
                 if (MPI_Recv(buff,sz,MPI_BYTE, status.MPI_SOURCE, DFF_TASK_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE) != MPI_SUCCESS)
                     error("Error on Recv Receiver Payload\n");
                 
-                message_t* out = new message_t(buff, sz, true);
+                message_t* out = new message_t(buff, sz, true, true);
                 out->sender = headers[1];
                 out->chid   = headers[2];
                 out->feedback = feedback;
@@ -131,10 +131,10 @@ public:
                         assert(i+1 == (size_t)headers[0]);
                         break;
                     }
-                    char* outBuff = new char[sz];
+                    char* outBuff = dataBuffer::allocPayload(sz);
                     memcpy(outBuff, buff+head, sz);
                     head += sz;
-                    message_t* out = new message_t(outBuff, sz, true);
+                    message_t* out = new message_t(outBuff, sz, true, true);
                     out->sender = headers[3*i+1];
                     out->chid = headers[3*i+2];
                     out->feedback = feedback;
@@ -225,12 +225,11 @@ public:
                 continue;
             }
 
-            char* buff = new char [sz];
-			assert(buff);
+            char* buff = dataBuffer::allocPayload(sz);
 
             MPI_Recv(buff,sz,MPI_BYTE, status.MPI_SOURCE, DFF_TASK_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-            message_t* out = new message_t(buff, sz, true);
+            message_t* out = new message_t(buff, sz, true, true);
 			assert(out);
 			out->sender = header[1];
 			out->chid   = header[2];
@@ -30,6 +30,8 @@
 #include <ff/ff.hpp>
 #include <ff/distributed/ff_network.hpp>
 #include <ff/distributed/ff_batchbuffer.hpp>
+#include <ff/distributed/ff_shmchannel.hpp>
+#include <ff/distributed/ff_dprofile.hpp>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/uio.h>
@@ -38,6 +40,7 @@
 #include <netdb.h>
 #include <cmath>
 #include <thread>
+#include <deque>
 
 #include <cereal/cereal.hpp>
 #include <cereal/archives/portable_binary.hpp>
@@ -63,24 +66,125 @@ protected:
     int coreid;
     fd_set set, tmpset;
     int fdmax = -1;
-
+    size_t shmRingSize = DEFAULT_SHM_RING_SIZE;
+    std::map<int, ff_shmChannel*> shmChannels;
+    size_t batchBytes = DEFAULT_BATCH_BYTES;
+    long batchTimeout = DEFAULT_BATCH_TIMEOUT_US;
+    ff_batchPolicy::clock::time_point nextExpiryCheck;
+
+    // credit-based flow control, the key is (socket, logical channel)
+    using channel_t = std::pair<int, int>;
+    int channelCredits = DEFAULT_CHANNEL_CREDITS;
+    std::map<channel_t, int> credits;
+    std::map<channel_t, std::deque<message_t*>> parked;  // waiting for credits
+    size_t nparked = 0;
+    std::vector<int> controlSockets;         // where acks and credits come from
+    std::map<int, std::string> controlBytes; // incomplete records
+
+    /*
+     * The handshake carries the offer of a shared-memory ring (pid,
+     * descriptor and nonce of the segment, all 0 if there is no offer). If the
+     * receiver accepts it, the socket is used only as a doorbell.
+     * The last field is the credit window of the logical channels (0 if
+     * the flow control is disabled).
+     */
     virtual int handshakeHandler(const int sck, ChannelType t){
+        ff_shmChannel* ch = nullptr;
+        if (shmRingSize > 0 && ff_isLocalConnection(sck)) {
+            ch = new ff_shmChannel;
+            if (ch->create(shmRingSize) < 0) { delete ch; ch = nullptr; }
+        }
         size_t sz = htobe64(gName.size());
-        struct iovec iov[3];
+        int pid = htonl(ch ? (int)getpid() : 0);
+        int shmfd = htonl(ch ? ch->getFd() : 0);
+        uint64_t nonce = htobe64(ch ? ch->getNonce() : 0);
+        int window = htonl(channelCredits);
+        struct iovec iov[7];
         iov[0].iov_base = &t;
         iov[0].iov_len = sizeof(ChannelType);
         iov[1].iov_base = &sz;
         iov[1].iov_len = sizeof(sz);
         iov[2].iov_base = (char*)(gName.c_str());
         iov[2].iov_len = gName.size();
-
-        if (writevn(sck, iov, 3) < 0){
+        iov[3].iov_base = &pid;
+        iov[3].iov_len = sizeof(pid);
+        iov[4].iov_base = &shmfd;
+        iov[4].iov_len = sizeof(shmfd);
+        iov[5].iov_base = &nonce;
+        iov[5].iov_len = sizeof(nonce);
+        iov[6].iov_base = &window;
+        iov[6].iov_len = sizeof(window);
+
+        if (writevn(sck, iov, 7) < 0){
             error("Error writing on socket\n");
+            if (ch) delete ch;
             return -1;
         }
 
+        if (ch) {
+            char reply;
+            if (readn(sck, &reply, 1) != 1){
+                error("Error reading the shared-memory reply from socket\n");
+                delete ch;
+                return -1;
+            }
+            ch->closeFd(); // the receiver has already mapped the segment (if it could)
+            if (reply == 'Y') shmChannels[sck] = ch;
+            else delete ch;
+        }
         return 0;
     }
+
+    /*
+     * It connects the batch buffer of the connection sck to the transport:
+     * either the shared-memory ring or the socket with the acknowledgements.
+     */
+    std::function<bool(struct iovec*, int)> transportCallback(int sck){
+        auto it = shmChannels.find(sck);
+        if (it != shmChannels.end()) {
+            ff_shmChannel* ch = it->second;
+            return [ch, sck](struct iovec* v, int size) -> bool {
+                if (ch->writevn(sck, v, size) < 0){
+                    error("Error writing the iovector on the shared-memory channel!\n");
+                    return false;
+                }
+                return true;
+            };
+        }
+        return [this, sck](struct iovec* v, int size) -> bool {
+                
+                if (this->socketsCounters[sck] == 0 && this->waitAckFrom(sck) == -1){
+                    error("Errore waiting ack from socket inside the callback\n");
+                    return false;
+                }
+
+                if (writevn(sck, v, size) < 0){
+                    error("Error sending the iovector inside the callback (errno=%d)\n", errno);
+                    return false;
+                }
+
+                this->socketsCounters[sck]--;
+
+                return true;
+            };
+    }
+
+    // during a profiling run the traffic towards each group is counted
+    std::function<bool(struct iovec*, int)> batchCallback(int sck, const std::string& dest){
+        if (!ff_dprofile::instance()->enabled()) return transportCallback(sck);
+        return ff_dprofile::instance()->meter(dest, transportCallback(sck));
+    }
+
+    void watchControl(int sck){
+        controlSockets.push_back(sck);
+        FD_SET(sck, &set);
+        if (sck > fdmax) fdmax = sck;
+    }
+
+    void releaseShmChannels(){
+        for(auto& [sck, ch] : shmChannels) delete ch;
+        shmChannels.clear();
+    }
 	
     int create_connect(const ff_endpoint& destination){
         int socketFD;
@@ -176,21 +280,45 @@ protected:
         return 0;
     }
 
+    /*
+     * It consumes the acknowledgements and the credits already received on
+     * sck without blocking. It returns -1 if the connection has been closed.
+     */
+    int readControl(int sck){
+        std::string& bytes = controlBytes[sck];
+        char buf[256];
+        for(;;) {
+            ssize_t r = recv(sck, buf, sizeof(buf), MSG_DONTWAIT);
+            if (r > 0) { bytes.append(buf, r); continue; }
+            if (r == 0) return -1;
+            if (errno == EINTR) continue;
+            if (errno == EWOULDBLOCK || errno == EAGAIN) break;
+            return -1;
+        }
+        size_t off = 0;
+        while(off < bytes.size()) {
+            if (bytes[off] == credit_t::TAG) {
+                if (bytes.size() - off < credit_t::SIZE) break;
+                credit_t c;
+                c.decode(bytes.data() + off);
+                creditsOf({sck, c.chid}) += c.credits;
+                off += credit_t::SIZE;
+                continue;
+            }
+            socketsCounters[sck]++;   // ack_t
+            off += sizeof(ack_t);
+        }
+        bytes.erase(0, off);
+        return 0;
+    }
+
      int waitAckFrom(int sck){
         while (socketsCounters[sck] == 0){
-            for(auto& [sck_, counter] : socketsCounters){
-                int r; ack_t a;
-                if ((r = recvnnb(sck_, reinterpret_cast<char*>(&a), sizeof(ack_t))) != sizeof(ack_t)){
-                    if (errno == EWOULDBLOCK){
-                        assert(r == -1);
-                        continue;
-                    }
-                    perror("recvnnb ack");
+            for(int sck_ : controlSockets)
+                if (readControl(sck_) < 0){
+                    perror("reading the acknowledgements");
                     return -1;
-                } else 
-                    counter++;
-                
-            }
+                }
 			
             if (socketsCounters[sck] == 0){
                 tmpset = set;
@@ -203,6 +331,118 @@ protected:
         return 1;
     }
 
+    /*
+     * It flushes the batches whose first message is older than the timeout.
+     * It is called when the input channels are idle and, while the sender
+     * is busy, every half timeout so that the trickle destinations are not
+     * starved by the bursty ones.
+     */
+    void flushExpired() {
+        if (batchTimeout <= 0) return;
+        const auto now = ff_batchPolicy::clock::now();
+        for(auto& [sck, buffer] : batchBuffers)
+            if (buffer.flushExpired(now) < 0)
+                error("flushing the expired batch of socket %d (ff_dsender)\n", sck);
+        nextExpiryCheck = now + std::chrono::microseconds(batchTimeout/2);
+    }
+    inline void checkExpired() {
+        if (batchTimeout > 0 && ff_batchPolicy::clock::now() >= nextExpiryCheck) flushExpired();
+    }
+
+    // the credits of a logical channel start from the window
+    inline int& creditsOf(const channel_t& ch){
+        auto it = credits.find(ch);
+        if (it == credits.end()) it = credits.emplace(ch, channelCredits).first;
+        return it->second;
+    }
+
+    /*
+     * Credit-based flow control: a message is sent only if its logical
+     * channel has credits, otherwise it waits in the channel queue and the
+     * sender goes on with the other channels. The batch of the socket is
+     * flushed so that the receiver can grant the credits back.
+     * Too many waiting messages stop the sender.
+     */
+    int pushTask(int sck, message_t* task){
+        if (channelCredits <= 0) return batchBuffers[sck].push(task);
+
+        const channel_t ch(sck, task->chid);
+        auto it = parked.find(ch);
+        if ((it != parked.end() && !it->second.empty()) || creditsOf(ch) == 0) {
+            parked[ch].push_back(task);
+            ++nparked;
+            if (batchBuffers[sck].flush() < 0) return -1;
+            while(nparked > (size_t)(4*channelCredits))
+                if (waitCredits() < 0) return -1;
+            return 0;
+        }
+        --creditsOf(ch);
+        if (batchBuffers[sck].push(task) < 0) return -1;
+        if (nparked) {
+            for(int s : controlSockets) readControl(s);
+            return releaseParked();
+        }
+        return 0;
+    }
+
+    // it sends the waiting messages of the channels that got new credits
+    int releaseParked(){
+        for(auto& [ch, q] : parked) {
+            int& c = creditsOf(ch);
+            while(c > 0 && !q.empty()) {
+                message_t* task = q.front();
+                q.pop_front();
+                --nparked; --c;
+                if (batchBuffers[ch.first].push(task) < 0) return -1;
+            }
+        }
+        return 0;
+    }
+
+    // it blocks until some credits arrive and then releases the waiting messages
+    int waitCredits(){
+        for(auto& [sck, buffer] : batchBuffers)
+            if (buffer.flush() < 0) return -1;
+        for(int s : controlSockets)
+            if (readControl(s) < 0) {
+                error("connection closed while waiting for credits (ff_dsender)\n");
+                return -1;
+            }
+        const size_t before = nparked;
+        if (releaseParked() < 0) return -1;
+        if (nparked < before || nparked == 0) return 0;
+        tmpset = set;
+        if (select(fdmax + 1, &tmpset, NULL, NULL, NULL) == -1){
+            perror("select");
+            return -1;
+        }
+        return 0;
+    }
+
+    // the messages must not overtake the EOS
+    int drainParked(){
+        while(nparked)
+            if (waitCredits() < 0) return -1;
+        return 0;
+    }
+
+    /*
+     * For the tasks without a destination (farm and all-to-all) it skips the
+     * destinations that are out of credits. It returns -1 if there are none.
+     */
+    int getSckWithCredits(const std::vector<int>& candidates, ChannelType ct){
+        int sckMax = -1, sizeMax = -1;
+        for(int sck : candidates) {
+            auto& buffer = batchBuffers[sck];
+            if (buffer.ct != ct) continue;
+            const channel_t ch(sck, -1);
+            auto it = parked.find(ch);
+            if ((it != parked.end() && !it->second.empty()) || creditsOf(ch) == 0) continue;
+            if (buffer.size > sizeMax) { sckMax = sck; sizeMax = buffer.size; }
+        }
+        return sckMax;
+    }
+
     int getMostFilledBufferSck(bool feedback){
         int sckMax = 0;
         int sizeMax = 0;
@@ -228,7 +468,25 @@ public:
 
     ff_dsender( std::vector<std::pair<ChannelType, ff_endpoint>> dest_endpoints_, precomputedRT_t* rt, std::string gName = "", int batchSize = DEFAULT_BATCH_SIZE, int messageOTF = DEFAULT_MESSAGE_OTF, int coreid=-1) : dest_endpoints(std::move(dest_endpoints_)), precomputedRT(rt), gName(gName), batchSize(batchSize), messageOTF(messageOTF), coreid(coreid) {}
 
-    
+    /*
+     * Size of the shared-memory ring used towards the groups running on
+     * the same host, 0 forces the sockets.
+     */
+    void setSharedMemory(size_t ringSize) { shmRingSize = ringSize; }
+
+    /*
+     * Besides the batch size, a batch is flushed when it holds maxBytes
+     * bytes or when its first message is older than timeoutUs microseconds
+     * (0 disables the bound, and the adaptive batch size).
+     */
+    void setBatchBounds(size_t maxBytes, long timeoutUs) { batchBytes = maxBytes; batchTimeout = timeoutUs; }
+
+    /*
+     * Credits of each logical channel towards a group. The receivers grant
+     * them back in proportion to the free space of their queues, 0 disables
+     * the flow control.
+     */
+    void setCredits(int window) { channelCredits = window; }
 
     int svc_init() {
 		if (coreid!=-1)
@@ -242,35 +500,25 @@ public:
             int sck = tryConnect(ep);
             if (sck <= 0) return -1;
             sockets.push_back(sck);
-            socketsCounters[sck] = messageOTF;
-            batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, [this, sck](struct iovec* v, int size) -> bool {
-                
-                if (this->socketsCounters[sck] == 0 && this->waitAckFrom(sck) == -1){
-                    error("Errore waiting ack from socket inside the callback\n");
-                    return false;
-                }
-
-                if (writevn(sck, v, size) < 0){
-                    error("Error sending the iovector inside the callback!\n");
-                    return false;
-                }
 
-                this->socketsCounters[sck]--;
+            if (handshakeHandler(sck, ct) < 0) {
+				error("svc_init ff_dsender failed");
+				return -1;
+			}
 
-                return true;
-            }));
+            batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, batchCallback(sck, ep.groupName), batchBytes, batchTimeout));
 
             // compute the routing table!
             for(int dest : precomputedRT->operator[](ep.groupName).first)
                 dest2Socket[std::make_pair(dest, ct)] = sck;
 
-            if (handshakeHandler(sck, ct) < 0) {
-				error("svc_init ff_dsender failed");
-				return -1;
-			}
-
-            FD_SET(sck, &set);
-            if (sck > fdmax) fdmax = sck;
+            // the shared-memory channels do not use acknowledgements
+            if (shmChannels.contains(sck)) {
+                if (channelCredits > 0) watchControl(sck);
+                continue;
+            }
+            socketsCounters[sck] = messageOTF;
+            watchControl(sck);
         }
 
         // we can erase the list of endpoints
@@ -285,17 +533,29 @@ public:
         if (task->chid != -1)
             sck = dest2Socket[{task->chid, (task->feedback ? ChannelType::FBK : ChannelType::FWD)}];
         else {
-            sck = getMostFilledBufferSck(task->feedback); // get the most filled buffer socket or a rr socket
+            sck = (channelCredits > 0) ? getSckWithCredits(sockets, task->feedback ? ChannelType::FBK : ChannelType::FWD) : -1;
+            if (sck < 0) sck = getMostFilledBufferSck(task->feedback); // get the most filled buffer socket or a rr socket
         }
 
-        if (batchBuffers[sck].push(task) == -1) {
+        if (pushTask(sck, task) == -1) {
 			return EOS;
 		}
+        checkExpired();
 
         return this->GO_ON;
     }
 
+    void idlenotify() {
+        flushExpired();
+        if (nparked) {
+            for(int s : controlSockets) readControl(s);
+            if (releaseParked() < 0) error("sending the messages waiting for credits (ff_dsender)\n");
+        }
+    }
+
     void eosnotify(ssize_t id) {
+        if (drainParked() < 0)
+            error("sending the messages waiting for credits (ff_dsender)\n");
         for (const auto& sck : sockets)
             batchBuffers[sck].push(new message_t(id, -2));
 
@@ -311,34 +571,28 @@ public:
     }
 
 	void svc_end() {
-		// here we wait all acks from all connections
-		size_t totalack = sockets.size()*messageOTF;
+		// here we wait all acks from all socket connections
+		size_t totalack = socketsCounters.size()*messageOTF;
 		size_t currentack = 0;
 		for(const auto& [_, counter] : socketsCounters)
 			currentack += counter;
 
-		ack_t a;
 		while(currentack<totalack) {
 			for(auto scit = socketsCounters.begin(); scit != socketsCounters.end();) {
 				auto sck      = scit->first;
-				auto& counter = scit->second;
-				
-				switch(recvnnb(sck, (char*)&a, sizeof(a))) {
-				case 0:
-				case -1:
-					if (errno==EWOULDBLOCK) { ++scit; continue; }
-					currentack += (messageOTF-counter);
+				const unsigned int before = scit->second;
+
+				if (readControl(sck) < 0) {
+					currentack += (messageOTF-before);
 					socketsCounters.erase(scit++);
-					break;
-				default: {
-					currentack++;
-					counter++;
-					++scit;
-				}
+					continue;
 				}
+				currentack += scit->second - before;
+				++scit;
 			}
 		}
 		for(auto& sck : sockets) close(sck);
+		releaseShmChannels();
 	}
 };
 
@@ -410,31 +664,21 @@ public:
             bool isInternal = ct == ChannelType::INT;
             if (isInternal) internalSockets.push_back(sck);
             else sockets.push_back(sck);
-            socketsCounters[sck] = isInternal ? internalMessageOTF : messageOTF;
-            batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, [this, sck](struct iovec* v, int size) -> bool {
-                
-                if (this->socketsCounters[sck] == 0 && this->waitAckFrom(sck) == -1){
-                    error("Errore waiting ack from socket inside the callback\n");
-                    return false;
-                }
-
-                if (writevn(sck, v, size) < 0){
-                    error("Error sending the iovector inside the callback (errno=%d) %s\n", errno);
-                    return false;
-                }
 
-                this->socketsCounters[sck]--;
+            if (handshakeHandler(sck, ct) < 0) return -1;
 
-                return true;
-            })); // change with the correct size
+            batchBuffers.emplace(std::piecewise_construct, std::forward_as_tuple(sck), std::forward_as_tuple(this->batchSize, ct, batchCallback(sck, endpoint.groupName), batchBytes, batchTimeout)); // change with the correct size
 
              for(int dest : precomputedRT->operator[](endpoint.groupName).first)
                 dest2Socket[std::make_pair(dest, ct)] = sck;
 
-            if (handshakeHandler(sck, ct) < 0) return -1;
-
-            FD_SET(sck, &set);
-            if (sck > fdmax) fdmax = sck;
+            // the shared-memory channels do not use acknowledgements
+            if (shmChannels.contains(sck)) {
+                if (channelCredits > 0) watchControl(sck);
+                continue;
+            }
+            socketsCounters[sck] = isInternal ? internalMessageOTF : messageOTF;
+            watchControl(sck);
         }
 
         // we can erase the list of endpoints
@@ -449,13 +693,15 @@ public:
             // pick destination from the list of internal connections!
             if (task->chid != -1){ // roundrobin over the destinations
                 sck = dest2Socket[{task->chid, ChannelType::INT}];
-            } else
-                sck = getMostFilledInternalBufferSck();
-
+            } else {
+                sck = (channelCredits > 0) ? getSckWithCredits(internalSockets, ChannelType::INT) : -1;
+                if (sck < 0) sck = getMostFilledInternalBufferSck();
+            }
 
-            if (batchBuffers[sck].push(task) == -1) {
+            if (pushTask(sck, task) == -1) {
 				return EOS;
 			}
+            checkExpired();
 
             return this->GO_ON;
         }
@@ -464,6 +710,8 @@ public:
     }
 
      void eosnotify(ssize_t id) {
+         if (drainParked() < 0)
+             error("sending the messages waiting for credits (ff_dsenderH)\n");
          if (id == (ssize_t)(this->get_num_inchannels() - 1)){
             // send the EOS to all the internal connections
             if (squareBoxEOS) return;
@@ -490,44 +738,38 @@ public:
 	 }
 
 	void svc_end() {
-		// here we wait all acks from all connections
-		size_t totalack  = internalSockets.size()*internalMessageOTF;
-		totalack        += sockets.size()*messageOTF;
-		size_t currentack = 0;
+		// here we wait all acks from all socket connections
+		size_t totalack = 0, currentack = 0;
 		for(const auto& [sck, counter] : socketsCounters) {
+			if (std::find(internalSockets.begin(), internalSockets.end(), sck) != internalSockets.end())
+				totalack += internalMessageOTF;
+			else
+				totalack += messageOTF;
 			currentack += counter;
 		}
 		
-		ack_t a;
 		while(currentack<totalack) {
 			for(auto scit = socketsCounters.begin(); scit != socketsCounters.end();) {
 				auto sck      = scit->first;
-				auto& counter = scit->second;
-
-				switch(recvnnb(sck, (char*)&a, sizeof(a))) {
-				case 0:
-				case -1: {
-					if (errno == EWOULDBLOCK) {
-						++scit;
-						continue;
-					}
+				const unsigned int before = scit->second;
+
+				if (readControl(sck) < 0) {
 					decltype(internalSockets)::iterator it;
 					it = std::find(internalSockets.begin(), internalSockets.end(), sck);
 					if (it != internalSockets.end())
-						currentack += (internalMessageOTF-counter);
+						currentack += (internalMessageOTF-before);
 					else
-						currentack += (messageOTF-counter);
+						currentack += (messageOTF-before);
 					socketsCounters.erase(scit++);
-				} break;
-				default: {
-					currentack++;
-					counter++;
-					++scit;					
-				}					
+					continue;
 				}
+				currentack += scit->second - before;
+				++scit;
 			}
 		}
 		for(const auto& [sck, _] : socketsCounters) close(sck);
+		for(const auto& [sck, _] : shmChannels) close(sck);
+		releaseShmChannels();
 	}
 	
 };
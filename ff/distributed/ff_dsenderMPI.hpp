@@ -5,6 +5,7 @@
 #include <map>
 #include <ff/ff.hpp>
 #include <ff/distributed/ff_network.hpp>
+#include <ff/distributed/ff_batchbuffer.hpp>
 #include <sys/types.h>
 #include <netdb.h>
 #include <cmath>
@@ -28,8 +29,10 @@ protected:
         std::vector<char> buffer;
         std::vector<long> headers;
         MPI_Request headersR, datasR;
+        ff_batchPolicy policy;
     public:
-        batchBuffer(size_t size_, int rank) : rank(rank), size_(size_){
+        batchBuffer(size_t size_, int rank, size_t maxBytes = DEFAULT_BATCH_BYTES, long timeoutUs = DEFAULT_BATCH_TIMEOUT_US)
+            : rank(rank), size_(size_), policy((int)size_, maxBytes, timeoutUs) {
             headers.reserve(size_*3+1);
         }
         virtual void waitCompletion(){
@@ -52,20 +55,27 @@ protected:
 
             buffer.insert(buffer.end(), m->data.getPtr(), m->data.getPtr() + m->data.getLen());
 
+            const size_t len = m->data.getLen();
             delete m;
-            if (actualSize == size_) {
+            if (policy.added((int)actualSize, len)) {
                 this->flush();
                 return 1;
             }
             return 0;
         }
 
+        // the first message of the (non empty) batch has been waiting for too long
+        virtual bool expired(ff_batchPolicy::clock::time_point now) {
+            return actualSize > 0 && policy.expired(now);
+        }
+
         virtual void flush(){
             headers[0] = actualSize;
             MPI_Isend(headers.data(), actualSize*3+1, MPI_LONG, rank, DFF_HEADER_TAG, MPI_COMM_WORLD, &headersR);
             MPI_Isend(buffer.data(), buffer.size(), MPI_BYTE, rank, DFF_TASK_TAG, MPI_COMM_WORLD, &datasR);
             blocked = true;
             actualSize = 0;
+            policy.flushed();
         }
 
         virtual void pushEOS(){
@@ -118,6 +128,29 @@ protected:
     int batchSize;
     int messageOTF;
 	int coreid;
+    size_t batchBytes = DEFAULT_BATCH_BYTES;
+    long batchTimeout = DEFAULT_BATCH_TIMEOUT_US;
+    ff_batchPolicy::clock::time_point nextExpiryCheck;
+
+    inline batchBuffer* newBuffer(int rank) {
+        if (batchSize == 1) return new directBatchBuffer(rank);
+        return new batchBuffer(batchSize, rank, batchBytes, batchTimeout);
+    }
+
+    // see ff_dsender::flushExpired
+    void flushExpired() {
+        if (batchSize == 1 || batchTimeout <= 0) return;
+        const auto now = ff_batchPolicy::clock::now();
+        for(auto& [rank, buffs] : buffers)
+            if (buffs.second[buffs.first]->expired(now)) {
+                buffs.second[buffs.first]->flush();
+                buffs.first = (buffs.first + 1) % buffs.second.size();
+            }
+        nextExpiryCheck = now + std::chrono::microseconds(batchTimeout/2);
+    }
+    inline void checkExpired() {
+        if (batchSize > 1 && batchTimeout > 0 && ff_batchPolicy::clock::now() >= nextExpiryCheck) flushExpired();
+    }
 
     virtual int handshakeHandler(const int rank, ChannelType ct){
         MPI_Send(gName.c_str(), gName.size(), MPI_BYTE, rank, DFF_GROUP_NAME_TAG, MPI_COMM_WORLD);
@@ -154,6 +187,9 @@ public:
     ff_dsenderMPI( std::vector<std::pair<ChannelType, ff_endpoint>> destRanks_, precomputedRT_t* rt, std::string gName = "", int batchSize = DEFAULT_BATCH_SIZE, int messageOTF = DEFAULT_MESSAGE_OTF, int coreid=-1)
 		: rt(rt), destRanks(std::move(destRanks_)), gName(gName), batchSize(batchSize), messageOTF(messageOTF), coreid(coreid) {}
 
+    // see ff_dsender::setBatchBounds
+    void setBatchBounds(size_t maxBytes, long timeoutUs) { batchBytes = maxBytes; batchTimeout = timeoutUs; }
+
     int svc_init() {
 		if (coreid!=-1)
 			ff_mapThreadToCpu(coreid);
@@ -162,7 +198,7 @@ public:
            handshakeHandler(ep.getRank(), ct);
            ranks.push_back({ep.getRank(), ct});
            std::vector<batchBuffer*> appo;
-           for(int i = 0; i < messageOTF; i++) appo.push_back(batchSize == 1 ? new directBatchBuffer(ep.getRank()) : new batchBuffer(batchSize, ep.getRank()));
+           for(int i = 0; i < messageOTF; i++) appo.push_back(newBuffer(ep.getRank()));
            buffers.emplace(std::make_pair(ep.getRank(), std::make_pair(0, std::move(appo))));
 
            for(int dest : rt->operator[](ep.groupName).first)
@@ -190,10 +226,13 @@ public:
         assert(buffs.second.size() > 0);
         if (buffs.second[buffs.first]->push(task)) // the push triggered a flush, so we must go ion the next buffer
             buffs.first = (buffs.first + 1) % buffs.second.size(); // increment the used buffer of 1
+        checkExpired();
     
         return this->GO_ON;
     }
 
+    void idlenotify() { flushExpired(); }
+
      void eosnotify(ssize_t id) {
         for (auto& [rank, _] : ranks){
              auto& buffs = buffers[rank];
@@ -251,7 +290,7 @@ public:
                 ranks.push_back({rank, ct});
 
             std::vector<batchBuffer*> appo;
-            for(int i = 0; i < (isInternal ? internalMessageOTF : messageOTF); i++) appo.push_back(batchSize == 1 ? new directBatchBuffer(rank) : new batchBuffer(batchSize, rank));
+            for(int i = 0; i < (isInternal ? internalMessageOTF : messageOTF); i++) appo.push_back(newBuffer(rank));
             buffers.emplace(std::make_pair(rank, std::make_pair(0, std::move(appo))));
             
             if (handshakeHandler(rank, ct) < 0) return -1;
@@ -279,6 +318,7 @@ public:
             auto& buffs = buffers[rank];
             if (buffs.second[buffs.first]->push(task)) // the push triggered a flush, so we must go ion the next buffer
                 buffs.first = (buffs.first + 1) % buffs.second.size(); // increment the used buffer of 1
+            checkExpired();
 
             return this->GO_ON;
         }
@@ -0,0 +1,156 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Size-classed pool for the message_t objects and the serialisation buffers.
+ *
+ * The messages are allocated by the threads executing the wrappers and
+ * released by the sender thread after the write on the network (and the
+ * other way round on the receiver side), so the blocks are recycled with
+ * a per-thread magazine in front of a shared depot. A thread moves a whole
+ * magazine at a time to/from the depot, so the lock of the depot is taken
+ * once every MAGAZINE_SIZE operations. Blocks larger than the biggest size
+ * class are allocated with malloc.
+ */
+
+#ifndef FF_MSGPOOL_H
+#define FF_MSGPOOL_H
+
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <ff/spin-lock.hpp>
+
+namespace ff {
+
+class ff_msgPool {
+public:
+    enum { MIN_SHIFT = 7, MAX_SHIFT = 16, NCLASSES = MAX_SHIFT-MIN_SHIFT+1,
+           MAGAZINE_SIZE = 32, DEPOT_MAGAZINES = 64 };
+
+private:
+    // in front of each block, it keeps the size class (16 bytes to preserve the alignment)
+    struct alignas(16) header_t { int64_t cls; };
+    static constexpr size_t HDR = sizeof(header_t);
+
+    struct magazine_t {
+        void *items[MAGAZINE_SIZE];
+        int   n = 0;
+    };
+
+    struct depot_t {
+        depot_t() { init_unlocked(lock); }
+        lock_t              lock;
+        std::vector<void*>  blocks;
+    };
+
+    // per-thread magazines, they are returned to the depot when the thread exits
+    struct cache_t {
+        magazine_t mag[NCLASSES];
+        ~cache_t() {
+            for(int c=0;c<NCLASSES;++c)
+                if (mag[c].n) ff_msgPool::instance()->putMagazine(c, mag[c]);
+        }
+    };
+
+    static inline cache_t& cache() {
+        static thread_local cache_t C;
+        return C;
+    }
+
+    static inline int sizeClass(size_t size) {
+        size += HDR;
+        int c = 0;
+        while(c < NCLASSES && ((size_t)1 << (c+MIN_SHIFT)) < size) ++c;
+        return (c < NCLASSES) ? c : -1;
+    }
+
+    // it moves the magazine into the depot, the blocks in excess are freed
+    void putMagazine(int c, magazine_t& m) {
+        depot_t& d = depot[c];
+        spin_lock(d.lock);
+        const size_t room = (size_t)DEPOT_MAGAZINES*MAGAZINE_SIZE - d.blocks.size();
+        const size_t k = ((size_t)m.n < room) ? m.n : room;
+        d.blocks.insert(d.blocks.end(), m.items + (m.n - k), m.items + m.n);
+        spin_unlock(d.lock);
+        for(int i=0;i<m.n-(int)k;++i) ::free(m.items[i]);
+        m.n = 0;
+    }
+
+    // it refills the (empty) magazine from the depot
+    void getMagazine(int c, magazine_t& m) {
+        depot_t& d = depot[c];
+        spin_lock(d.lock);
+        const size_t k = (d.blocks.size() < (size_t)MAGAZINE_SIZE) ? d.blocks.size() : MAGAZINE_SIZE;
+        for(size_t i=0;i<k;++i) m.items[i] = d.blocks[d.blocks.size()-k+i];
+        d.blocks.resize(d.blocks.size()-k);
+        spin_unlock(d.lock);
+        m.n = (int)k;
+    }
+
+    depot_t depot[NCLASSES];
+
+    ff_msgPool() {}
+    ~ff_msgPool() {
+        for(int c=0;c<NCLASSES;++c)
+            for(void *p : depot[c].blocks) ::free(p);
+    }
+
+public:
+    static inline ff_msgPool* instance() {
+        static ff_msgPool P;
+        return &P;
+    }
+
+    // usable size of the block returned by alloc for the given request
+    static inline size_t capacity(size_t size) {
+        const int c = sizeClass(size);
+        return (c < 0) ? size : ((size_t)1 << (c+MIN_SHIFT)) - HDR;
+    }
+
+    void* alloc(size_t size) {
+        const int c = sizeClass(size);
+        header_t *h;
+        if (c < 0) h = (header_t*)::malloc(size + HDR);
+        else {
+            magazine_t& m = cache().mag[c];
+            if (m.n == 0) getMagazine(c, m);
+            h = (m.n > 0) ? (header_t*)m.items[--m.n]
+                          : (header_t*)::malloc((size_t)1 << (c+MIN_SHIFT));
+        }
+        if (!h) return nullptr;
+        h->cls = c;
+        return (char*)h + HDR;
+    }
+
+    void free(void* ptr) {
+        if (!ptr) return;
+        header_t *h = (header_t*)((char*)ptr - HDR);
+        const int c = (int)h->cls;
+        if (c < 0) { ::free(h); return; }
+        magazine_t& m = cache().mag[c];
+        if (m.n == MAGAZINE_SIZE) putMagazine(c, m);
+        m.items[m.n++] = h;
+    }
+};
+
+} // namespace ff
+
+#endif /* FF_MSGPOOL_H */
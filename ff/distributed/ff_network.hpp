@@ -36,6 +36,10 @@
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <arpa/inet.h>
+#include <cstring>
+#include <new>
+#include <functional>
+#include <ff/distributed/ff_msgpool.hpp>
 
 #define REMOTE
 
@@ -64,39 +68,65 @@
 enum Proto {TCP , MPI};
 enum ChannelType {FWD, INT, FBK};
 
+/*
+ * Serialisation buffer of a message. When it is written through a stream
+ * (e.g. by cereal) the bytes go into a block of the ff_msgPool that grows
+ * by size classes, otherwise it points to the memory given with setBuffer
+ * or with the constructor.
+ */
 class dataBuffer: public std::stringbuf {
 public:	
     dataBuffer()
         : std::stringbuf(std::ios::in | std::ios::out | std::ios::binary) {
+		// the first write goes into a pooled block (see overflow)
+		setp(nullptr, nullptr);
+		setg(nullptr, nullptr, nullptr);
 	}
     
-    dataBuffer(char p[], size_t len, bool cleanup=false)
+    dataBuffer(char p[], size_t len, bool cleanup=false, bool payload=false)
         : std::stringbuf(std::ios::in | std::ios::out | std::ios::binary),
-		  len(len),cleanup(cleanup) {
+		  len(len),cleanup(cleanup),payload(payload) {
         setg(p, p, p + len);
     }
 
 	~dataBuffer() {
+		releasePooled();
 		if (cleanup) {
 			cleanup = false;
 			if (freetaskF) {
 				freetaskF(getPtr());
-			} else
+			} else if (payload)
+				freePayload(getPtr());
+			else
 				delete [] getPtr();
 		}		
 	}
 
     void setBuffer(char p[], size_t len, bool cleanup=true){
+        releasePooled();
         setg(p, p, p+len);
         this->len = len;
         this->cleanup = cleanup;
+        this->payload = false;
     }
 
+	/*
+	 * Buffers of the received messages. They are allocated with the global
+	 * operator new so that, if the message holds a task of a trivially
+	 * copyable type, the buffer can be handed to the application as the
+	 * task itself and released with delete (see ff_typetraits.hpp).
+	 */
+	static inline char* allocPayload(size_t sz) { return (char*)::operator new(sz); }
+	static inline void  freePayload(char* p)    { ::operator delete(p); }
+	bool isPayload() const { return payload && !pooled; }
+
 	size_t getLen() const {
 		if (len>=0) return len;
+		if (pooled) return pptr()-pbase();
 		return str().length();
 	}
 	char* getPtr() const {
+		if (pooled) return pooled;
 		return eback();
 	}
 
@@ -107,16 +137,81 @@ public:
 	std::function<void(void*)> freetaskF;
 	
 protected:	
+	// the put area is full, the data is moved into a bigger pooled block
+	int_type overflow(int_type c) override {
+		if (len>=0) return traits_type::eof();  // external buffer
+		const size_t used = pooled ? (size_t)(pptr()-pbase()) : 0;
+		const size_t cap  = ff::ff_msgPool::capacity(used ? 2*used : 1);
+		char* p = (char*)ff::ff_msgPool::instance()->alloc(cap);
+		if (!p) return traits_type::eof();
+		if (used) memcpy(p, pooled, used);
+		const size_t goff = gptr() ? (size_t)(gptr()-eback()) : 0;
+		releasePooled();
+		pooled = p;
+		setp(p, p+cap);
+		pbump((int)used);
+		setg(p, p+goff, p+used);
+		if (!traits_type::eq_int_type(c, traits_type::eof())) {
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+	std::streamsize xsputn(const char* s, std::streamsize n) override {
+		std::streamsize done = 0;
+		while(done < n) {
+			std::streamsize room = epptr()-pptr();
+			if (room == 0) {
+				if (traits_type::eq_int_type(overflow(traits_type::to_int_type(s[done])), traits_type::eof())) break;
+				++done;
+				continue;
+			}
+			if (room > n-done) room = n-done;
+			memcpy(pptr(), s+done, room);
+			pbump((int)room);
+			done += room;
+		}
+		return done;
+	}
+	// what has been written can be read back
+	int_type underflow() override {
+		if (!pooled) return std::stringbuf::underflow();
+		char* cur = gptr();
+		if (cur < pptr()) {
+			setg(pooled, cur, pptr());
+			return traits_type::to_int_type(*cur);
+		}
+		return traits_type::eof();
+	}
+
+	void releasePooled() {
+		if (!pooled) return;
+		ff::ff_msgPool::instance()->free(pooled);
+		pooled = nullptr;
+		setp(nullptr, nullptr);
+		setg(nullptr, nullptr, nullptr);
+	}
+
 	ssize_t len=-1;
 	bool cleanup = false;
+	bool payload = false;
+	char* pooled = nullptr;
 };
 
 using ffDbuffer = std::pair<char*, size_t>;
 
 struct message_t {
+	// the messages are recycled through the pool of the process
+	static void* operator new(size_t sz) {
+		void* p = ff::ff_msgPool::instance()->alloc(sz);
+		if (!p) throw std::bad_alloc();
+		return p;
+	}
+	static void operator delete(void* p) { ff::ff_msgPool::instance()->free(p); }
+
 	message_t(){}
     message_t(int sender, int chid) : sender(sender), chid(chid) {}
-	message_t(char *rd, size_t size, bool cleanup=true) : data(rd,size,cleanup){}
+	message_t(char *rd, size_t size, bool cleanup=true, bool payload=false) : data(rd,size,cleanup,payload){}
 	
 	int           sender;
 	int           chid;
@@ -128,6 +223,30 @@ struct ack_t {
     char ack = 'A';
 };
 
+/*
+ * Credits granted by a receiver for the logical channel chid (see the
+ * credit-based flow control in ff_dsender). They are sent on the socket
+ * together with the acknowledgements, the first byte tells them apart.
+ */
+struct credit_t {
+    static constexpr char   TAG  = 'C';
+    static constexpr size_t SIZE = 1 + 2*sizeof(int32_t);
+
+    int32_t chid, credits;
+
+    void encode(char* p) const {
+        const int32_t c = htonl(chid), n = htonl(credits);
+        p[0] = TAG;
+        memcpy(p+1, &c, sizeof(c));
+        memcpy(p+1+sizeof(c), &n, sizeof(n));
+    }
+    void decode(const char* p) {
+        memcpy(&chid, p+1, sizeof(chid));
+        memcpy(&credits, p+1+sizeof(chid), sizeof(credits));
+        chid = ntohl(chid); credits = ntohl(credits);
+    }
+};
+
 struct ff_endpoint {
     ff_endpoint(){}
     ff_endpoint(std::string addr, int port) : address(std::move(addr)), port(port) {}
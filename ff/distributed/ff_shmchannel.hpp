@@ -0,0 +1,314 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Shared-memory transport between two groups running on the same host.
+ *
+ * The sender creates an anonymous memory file (memfd) containing a SPSC
+ * byte ring and offers it to the receiver during the handshake on the
+ * socket connection. The receiver maps it through /proc/<pid>/fd/<fd>;
+ * if this is not possible (e.g. different pid namespaces) the connection
+ * falls back to the socket.
+ * The pid comes from the peer, so the segment is accepted only if it holds
+ * the random nonce sent with the offer (and, on AF_UNIX sockets, if pid is
+ * the one of the peer): a peer cannot make the receiver map the segment of
+ * another process.
+ * The messages are written into the ring with the same wire format used on
+ * the sockets, so there are no system calls on the fast path. The socket
+ * connection is kept open and it is used only as a doorbell to wake up the
+ * receiver when it is sleeping in select, and to detect that the peer is
+ * gone.
+ */
+
+#ifndef FF_SHMCHANNEL_H
+#define FF_SHMCHANNEL_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <random>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ff/sysdep.h>
+#include <ff/config.hpp>
+#include <ff/utils.hpp>
+#include <ff/distributed/ff_network.hpp>
+
+#if defined(__linux__) && !defined(DFF_EXCLUDE_SHM)
+#define DFF_SHM
+#endif
+
+using namespace ff;
+
+/*
+ * It returns true if the peer of the connected socket sck is on this host.
+ */
+static inline bool ff_isLocalConnection(int sck) {
+    struct sockaddr_storage peer, self;
+    socklen_t plen = sizeof(peer), slen = sizeof(self);
+    if (getpeername(sck, (struct sockaddr*)&peer, &plen) < 0) return false;
+    if (peer.ss_family == AF_LOCAL) return true;
+    if (getsockname(sck, (struct sockaddr*)&self, &slen) < 0) return false;
+    if (peer.ss_family != self.ss_family) return false;
+
+    if (peer.ss_family == AF_INET) {
+        in_addr_t p = ntohl(((struct sockaddr_in*)&peer)->sin_addr.s_addr);
+        in_addr_t s = ntohl(((struct sockaddr_in*)&self)->sin_addr.s_addr);
+        return ((p >> 24) == 127) || (p == s);
+    }
+    if (peer.ss_family == AF_INET6) {
+        const struct in6_addr *p = &((struct sockaddr_in6*)&peer)->sin6_addr;
+        const struct in6_addr *s = &((struct sockaddr_in6*)&self)->sin6_addr;
+        if (IN6_IS_ADDR_LOOPBACK(p)) return true;
+        if (IN6_IS_ADDR_V4MAPPED(p) && p->s6_addr[12] == 127) return true;
+        return memcmp(p, s, sizeof(struct in6_addr)) == 0;
+    }
+    return false;
+}
+
+class ff_shmChannel {
+    enum { MAGIC = 0x4446464d, SPIN = 128 };
+
+    // the first bytes of the shared segment, the ring follows
+    struct header_t {
+        uint32_t magic;
+        uint64_t capacity;
+        uint64_t nonce;
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head;     // bytes written
+        alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail;     // bytes read
+        alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> sleeping; // the receiver waits for the doorbell
+    };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "the shared-memory channel needs lock-free 64-bit atomics");
+
+    header_t *hdr   = nullptr;
+    char     *data  = nullptr;
+    size_t    mapsz = 0;
+    uint64_t  mask  = 0;
+    uint64_t  pos   = 0;   // local copy of head (sender) or tail (receiver)
+    uint64_t  other = 0;   // last value read of tail (sender) or head (receiver)
+    int       fd    = -1;
+
+    int map(int fd_, size_t size, bool init, uint64_t nonce) {
+        void *p = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) return -1;
+        hdr   = (header_t*)p;
+        data  = (char*)p + sizeof(header_t);
+        mapsz = size;
+        if (init) {
+            hdr->capacity = size - sizeof(header_t);
+            hdr->nonce    = nonce;
+            hdr->head.store(0, std::memory_order_relaxed);
+            hdr->tail.store(0, std::memory_order_relaxed);
+            hdr->sleeping.store(0, std::memory_order_relaxed);
+            hdr->magic    = MAGIC;
+        } else if (hdr->magic != MAGIC || hdr->capacity != size - sizeof(header_t) || hdr->nonce != nonce) {
+            error("ff_shmChannel: invalid shared segment\n");
+            munmap(p, size);
+            hdr = nullptr; data = nullptr; mapsz = 0;
+            return -1;
+        }
+        mask = hdr->capacity - 1;
+        return 0;
+    }
+
+    // returns true if the peer has closed the socket connection
+    static inline bool peerClosed(int sck) {
+        char c;
+        ssize_t r = recv(sck, &c, 1, MSG_PEEK|MSG_DONTWAIT);
+        return r == 0 || (r < 0 && errno != EWOULDBLOCK && errno != EAGAIN && errno != EINTR);
+    }
+
+    // spin, then yield, then sleep. It returns false if the peer is gone.
+    static inline bool backoff(unsigned &n, int sck) {
+        if (++n < SPIN) { PAUSE(); return true; }
+        if (n < 2*SPIN) { std::this_thread::yield(); return true; }
+        if (peerClosed(sck)) return false;
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        return true;
+    }
+
+    inline void publish(int sck) {
+        hdr->head.store(pos, std::memory_order_seq_cst);
+        if (hdr->sleeping.load(std::memory_order_seq_cst) && hdr->sleeping.exchange(0)) {
+            const char c = 'D';
+            if (send(sck, &c, 1, MSG_NOSIGNAL) < 0 && errno != EWOULDBLOCK)
+                error("ff_shmChannel: sending the doorbell (errno=%d)\n", errno);
+        }
+    }
+
+    inline int put(int sck, const char *p, size_t n) {
+        const uint64_t cap = mask+1;
+        unsigned retries = 0;
+        while(n) {
+            uint64_t space = cap - (pos - other);
+            if (!space) {
+                other = hdr->tail.load(std::memory_order_acquire);
+                if (!(space = cap - (pos - other))) {
+                    publish(sck);  // the receiver must see what has been written so far
+                    if (!backoff(retries, sck)) return -1;
+                    continue;
+                }
+            }
+            const uint64_t off = pos & mask;
+            size_t len = std::min<uint64_t>(std::min<uint64_t>(n, space), cap - off);
+            memcpy(data + off, p, len);
+            pos += len; p += len; n -= len;
+        }
+        return 0;
+    }
+
+public:
+    ff_shmChannel() {}
+    ~ff_shmChannel() {
+        if (hdr) munmap(hdr, mapsz);
+        closeFd();
+    }
+    ff_shmChannel(const ff_shmChannel&) = delete;
+    ff_shmChannel& operator=(const ff_shmChannel&) = delete;
+
+    /*
+     * Sender side. It creates the segment, the ring size is rounded up to
+     * a power of two.
+     */
+    int create(size_t ringsize) {
+#if defined(DFF_SHM)
+        size_t cap = 4096;
+        while(cap < ringsize) cap <<= 1;
+        std::random_device rd;
+        const uint64_t nonce = ((uint64_t)rd() << 32) | rd();
+        if ((fd = memfd_create("dff_shm", MFD_CLOEXEC)) < 0) return -1;
+        if (ftruncate(fd, sizeof(header_t)+cap) < 0 || map(fd, sizeof(header_t)+cap, true, nonce) < 0) {
+            closeFd();
+            return -1;
+        }
+        return 0;
+#else
+        (void)ringsize;
+        return -1;
+#endif
+    }
+
+    /*
+     * Receiver side. It maps the segment created by the process pid, the
+     * offer has been received on the socket sck together with nonce.
+     */
+    int open(int sck, int pid, int fd_, uint64_t nonce) {
+#if defined(DFF_SHM)
+        struct sockaddr_storage peer;
+        socklen_t plen = sizeof(peer);
+        if (getpeername(sck, (struct sockaddr*)&peer, &plen) < 0) return -1;
+        if (peer.ss_family == AF_LOCAL) {
+            struct ucred cred;
+            socklen_t clen = sizeof(cred);
+            if (getsockopt(sck, SOL_SOCKET, SO_PEERCRED, &cred, &clen) < 0 || cred.pid != pid) {
+                error("ff_shmChannel: the segment is not offered by the peer\n");
+                return -1;
+            }
+        }
+        std::string path = "/proc/" + std::to_string(pid) + "/fd/" + std::to_string(fd_);
+        int f = ::open(path.c_str(), O_RDWR|O_CLOEXEC);
+        if (f < 0) return -1;
+        struct stat st;
+        int r = -1;
+        if (fstat(f, &st) == 0 && (size_t)st.st_size > sizeof(header_t))
+            r = map(f, st.st_size, false, nonce);
+        ::close(f);
+        return r;
+#else
+        (void)sck; (void)pid; (void)fd_; (void)nonce;
+        return -1;
+#endif
+    }
+
+    // the descriptor of the segment is needed only until the receiver has mapped it
+    int  getFd() const { return fd; }
+    // it has to be sent with the offer of the segment (see open)
+    uint64_t getNonce() const { return hdr ? hdr->nonce : 0; }
+    void closeFd() { if (fd >= 0) { ::close(fd); fd = -1; } }
+
+    /*
+     * Sender side. It writes the whole io vector into the ring, waiting for
+     * free space if needed, and then makes it visible to the receiver.
+     */
+    int writevn(int sck, const struct iovec *v, int count) {
+        for(int i=0;i<count;++i)
+            if (put(sck, (const char*)v[i].iov_base, v[i].iov_len) < 0) return -1;
+        publish(sck);
+        return 1;
+    }
+
+    /*
+     * Receiver side. Same semantics of the socket version: it returns 1 on
+     * success, 0 if the sender is gone.
+     */
+    ssize_t readn(int sck, char *p, size_t n) {
+        const uint64_t cap = mask+1;
+        unsigned retries = 0;
+        while(n) {
+            uint64_t avail = other - pos;
+            if (!avail) {
+                other = hdr->head.load(std::memory_order_acquire);
+                if (!(avail = other - pos)) {
+                    if (!backoff(retries, sck) && !readable()) return 0;
+                    continue;
+                }
+            }
+            const uint64_t off = pos & mask;
+            size_t len = std::min<uint64_t>(std::min<uint64_t>(n, avail), cap - off);
+            memcpy(p, data + off, len);
+            pos += len; p += len; n -= len;
+            hdr->tail.store(pos, std::memory_order_release);
+        }
+        return 1;
+    }
+    ssize_t readvn(int sck, struct iovec *v, int count) {
+        for(int i=0;i<count;++i)
+            if (readn(sck, (char*)v[i].iov_base, v[i].iov_len) <= 0) return 0;
+        return 1;
+    }
+
+    // Receiver side. There are bytes to read.
+    inline bool readable() const {
+        return hdr->head.load(std::memory_order_seq_cst) != pos;
+    }
+
+    /*
+     * Receiver side. It asks the sender to ring the doorbell at the next
+     * write. It returns false if the ring is not empty, in this case the
+     * receiver must not sleep.
+     */
+    inline bool prepareWait() {
+        hdr->sleeping.store(1, std::memory_order_seq_cst);
+        return !readable();
+    }
+    inline void endWait() {
+        if (hdr->sleeping.load(std::memory_order_relaxed))
+            hdr->sleeping.store(0, std::memory_order_relaxed);
+    }
+};
+
+#endif
@@ -2,6 +2,12 @@
 #define FF_TYPETRAITS_H
 
 #include <type_traits>
+#include <cstring>
+#include <cassert>
+#include <new>
+#include <algorithm>
+#include <ff/utils.hpp>
+#include <ff/distributed/ff_network.hpp>
 
 namespace ff{
 
@@ -31,17 +37,21 @@ template<class U, class = std::enable_if_t<std::is_same_v<void, decltype(deseria
 struct user_alloctask_test{};
 
 	
-template<class U, class = std::enable_if_t<std::is_same_v<std::pair<char*,size_t>, decltype(serializeWrapper<U>(std::declval<U*>(), std::declval<bool&>()))>>>
-struct serialize_test{};
+/*
+    The wrappers below are enabled exactly when the user's functions exist. They
+    are declared after these traits, so they cannot be looked up from here.
+*/
+template<class U>
+using serialize_test = user_serialize_test<U>;
 
-template<class U, class = std::enable_if_t<std::is_same_v<bool, decltype(deserializeWrapper<U>(std::declval<char*>(), std::declval<size_t&>(), std::declval<U*>()))>>>
-struct deserialize_test{};
+template<class U>
+using deserialize_test = user_deserialize_test<U>;
 
-template<class U, class = std::enable_if_t<std::is_same_v<void, decltype(freetaskWrapper<U>(std::declval<U*>()))>>>
-struct freetask_test{};
+template<class U>
+using freetask_test = user_freetask_test<U>;
 
-template<class U, class = std::enable_if_t<std::is_same_v<void, decltype(alloctaskWrapper<U>(std::declval<char*>(), std::declval<size_t&>(), std::declval<U*&>()))>>>
-struct alloctask_test{};
+template<class U>
+using alloctask_test = user_alloctask_test<U>;
 
    
 	
@@ -77,6 +87,27 @@ using has_alloctask = exists<T, alloctask_test>;
 template<class T>
 inline constexpr bool has_alloctask_v = has_alloctask<T>::value;
 
+/*
+    Tasks of trivially copyable types are sent as they are, without cereal (see
+    zerocopySerialize/zerocopyDeserialize). The groups must run on hosts with the
+    same data representation, otherwise compile with DFF_EXCLUDE_ZEROCOPY.
+    The types with class-specific allocation functions or over-aligned are
+    excluded because the receive buffer is released by the application with delete.
+*/
+template<class T, bool = std::is_trivially_copyable_v<T> && !std::is_pointer_v<T> && !std::is_member_pointer_v<T>>
+struct zerocopy_test: std::false_type {};
+
+template<class T>
+struct zerocopy_test<T, true>: std::bool_constant<alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__ &&
+                                                  !requires(size_t n) { T::operator new(n); }> {};
+
+template<class T>
+inline constexpr bool is_zerocopy_v =
+#if defined(DFF_EXCLUDE_ZEROCOPY)
+    false;
+#else
+    zerocopy_test<T>::value;
+#endif
 	
 }
 
@@ -106,6 +137,48 @@ void alloctaskWrapper(char* c, size_t s, T*& p){
     deserializealloctask<std::pair<char*, size_t>>(std::make_pair(c,s), p);
 }
 
+/*
+    Zero-serialisation of trivially copyable tasks. The message points to the task,
+    that is released by freetaskF after it has been written on the network (datacopied=false).
+    On the receiver side the buffer of the message becomes the task itself, or it is
+    copied into the task allocated by the user's alloctask. If the message has not the
+    size of the task (the sender uses another encoding) nullptr is returned.
+*/
+template<typename T>
+inline bool zerocopySerialize(T* in, dataBuffer& b){
+    b.setBuffer(reinterpret_cast<char*>(in), sizeof(T));
+    return false;
+}
+
+template<typename T>
+inline bool zerocopyCheck(dataBuffer& b){
+    if (b.getLen() == sizeof(T)) return true;
+    error("zerocopyDeserialize: received %ld bytes instead of %ld, the sender uses another encoding\n", (long)b.getLen(), (long)sizeof(T));
+    return false;
+}
+
+template<typename T>
+inline T* zerocopyDeserialize(dataBuffer& b, bool& datacopied){
+    if (!zerocopyCheck<T>(b)) return nullptr;
+    if (b.isPayload()) {
+        datacopied = false;
+        return std::launder(reinterpret_cast<T*>(b.getPtr()));
+    }
+    T* o = new T;
+    memcpy((void*)o, b.getPtr(), sizeof(T));
+    datacopied = true;
+    return o;
+}
+
+template<typename T, typename Alloc>
+inline T* zerocopyDeserialize(dataBuffer& b, bool& datacopied, Alloc&& alloctask){
+    if (!zerocopyCheck<T>(b)) return nullptr;
+    T* o = reinterpret_cast<T*>(alloctask(b.getPtr(), b.getLen()));
+    assert(o);
+    memcpy((void*)o, b.getPtr(), sizeof(T));
+    datacopied = true;
+    return o;
+}
 
 }
 #endif
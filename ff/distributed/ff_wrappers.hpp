@@ -91,6 +91,10 @@ public:
 		
 		bool datacopied=true;
 		void* inputData = this->n->deserializeF(msg->data, datacopied);
+		if (!inputData) {  // e.g. the sender uses another encoding (see zerocopyDeserialize)
+			error("WrapperIN: cannot deserialize the message from %d\n", msg->sender);
+			abort();
+		}
 		if (!datacopied) msg->data.doNotCleanup();
 		delete msg;	
 		return n->svc(inputData);
@@ -112,6 +116,7 @@ private:
 	int defaultDestination;
 	int myID;
 	int feedbackChannels, localFeedbacks, remoteFeedbacks;
+	ff_keyed_policy keyed;   // key-partitioned scheduling of the original a2a (if set)
 public:
 	
 	WrapperOUT(ff_node* n, int id, int outchannels=-1, int remoteFeedbacks = 0, bool cleanup=false, int defaultDestination = -1): internal_mo_transformer(this, false), outchannels(outchannels), defaultDestination(defaultDestination), myID(id), remoteFeedbacks(remoteFeedbacks){
@@ -119,8 +124,13 @@ public:
 		this->cleanup= cleanup;
 		registerCallback(ff_send_out_to_cbk, this);
 	}
+
+	void setKeyedPolicy(const ff_keyed_policy* P) { if (P) keyed = *P; }
 	
 	bool serialize(void* in, int id) {
+		// forward channels follow the feedback ones
+		if (id == -1 && keyed.enabled())
+			id = localFeedbacks + remoteFeedbacks + (int)keyed.select(in, outchannels);
 		if (localFeedbacks){
 			if (id < localFeedbacks) {
 				if (id == -1) return ff_send_out(in);
@@ -261,9 +271,14 @@ public:
 				mi->set_input_channelid(channelid, !msg->feedback);
 			}
 			bool datacopied=true;
-			out = n->svc(this->n->deserializeF(msg->data, datacopied));
+			void* inputData = this->n->deserializeF(msg->data, datacopied);
+			if (!inputData) {  // e.g. the sender uses another encoding (see zerocopyDeserialize)
+				error("WrapperINOUT: cannot deserialize the message from %d\n", msg->sender);
+				abort();
+			}
 			if (!datacopied) msg->data.doNotCleanup();
 			delete msg;
+			out = n->svc(inputData);
 		}  else // it can happen if we have a feedback channel
 			out = n->svc(nullptr);
         serialize(out, defaultDestination);
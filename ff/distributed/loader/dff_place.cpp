@@ -0,0 +1,341 @@
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Placement of the groups onto a list of hosts from a profiling run.
+ *
+ *   dff_run -P prof -f conf.json ./app        (profiling run, e.g. all groups on localhost)
+ *   dff_place -f conf.json -d prof -H host1,host2 -o placed.json
+ *   dff_run -f placed.json ./app
+ *
+ * Each group is a vertex weighted with its CPU time, each pair of groups is
+ * an edge weighted with the bytes exchanged. The groups are assigned to the
+ * hosts so that the bytes crossing the network (the cut) are minimised while
+ * the CPU time of each host stays within (1+eps) times the average. The
+ * groups on the same host then use the shared-memory transport.
+ * The initial assignment is greedy (the heaviest groups first, each on the
+ * host it exchanges most data with) and it is refined by moving and swapping
+ * groups as long as the cut decreases.
+ * The output is the input configuration with the new endpoints.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <algorithm>
+#include <cstring>
+
+#include <cereal/cereal.hpp>
+#include <cereal/archives/json.hpp>
+#include <cereal/types/string.hpp>
+#include <cereal/types/vector.hpp>
+
+std::vector<std::string> split (const std::string &s, char delim) {
+    std::vector<std::string> result;
+    std::stringstream ss(s);
+    std::string item;
+
+    while (getline (ss, item, delim))
+        result.push_back (item);
+
+    return result;
+}
+
+// the keys of a group that are copied unchanged to the output configuration
+static const char* stringKeys[] = {"preCmd", "threadMapping"};
+static const char* intKeys[]    = {"batchSize", "internalMessageOTF", "messageOTF", "shmRingSize",
+                                   "batchBytes", "batchTimeout", "channelCredits", "receiverThreads"};
+
+struct G {
+    std::string name, host;
+    int port = -1;
+    std::map<std::string, std::string> strings;
+    std::map<std::string, long> ints;
+
+    template <class Archive>
+    void load( Archive & ar ){
+        ar(cereal::make_nvp("name", name));
+
+        try {
+            std::string endpoint;
+            ar(cereal::make_nvp("endpoint", endpoint)); std::vector endp(split(endpoint, ':'));
+            host = endp[0];
+            if (endp.size() > 1) port = std::stoi(endp[1]);
+        } catch (cereal::Exception&) {
+            host = "127.0.0.1";
+            ar.setNextName(nullptr);
+        }
+        for(const char* k : stringKeys)
+            try {
+                std::string v; ar(cereal::make_nvp(k, v)); strings[k] = v;
+            } catch (cereal::Exception&) { ar.setNextName(nullptr); }
+        for(const char* k : intKeys)
+            try {
+                long v; ar(cereal::make_nvp(k, v)); ints[k] = v;
+            } catch (cereal::Exception&) { ar.setNextName(nullptr); }
+    }
+
+    template <class Archive>
+    void save( Archive & ar ) const {
+        ar(cereal::make_nvp("name", name));
+        ar(cereal::make_nvp("endpoint", host + ":" + std::to_string(port)));
+        for(auto& [k, v] : strings) ar(cereal::make_nvp(k, v));
+        for(auto& [k, v] : ints) ar(cereal::make_nvp(k, v));
+    }
+};
+
+// see ff_dprofile in ff/distributed/ff_dprofile.hpp
+struct Edge {
+    std::string to;
+    size_t bytes = 0, messages = 0;
+
+    template <class Archive>
+    void serialize(Archive& ar){
+        ar(cereal::make_nvp("to", to), cereal::make_nvp("bytes", bytes), cereal::make_nvp("messages", messages));
+    }
+};
+struct Profile {
+    std::string group;
+    double cpuTime = 0, wallTime = 0;
+    std::vector<Edge> edges;
+
+    template <class Archive>
+    void serialize(Archive& ar){
+        ar(cereal::make_nvp("group", group), cereal::make_nvp("cpuTime", cpuTime),
+           cereal::make_nvp("wallTime", wallTime), cereal::make_nvp("edges", edges));
+    }
+};
+
+struct Placement {
+    const std::vector<double>& w;                 // CPU time of the groups
+    const std::vector<std::vector<double>>& T;    // bytes exchanged by two groups
+    std::vector<int> host;                        // host of each group
+    std::vector<double> load;                     // CPU time of each host
+    double cap;
+
+    Placement(const std::vector<double>& w, const std::vector<std::vector<double>>& T, size_t nhosts, double cap)
+        : w(w), T(T), host(w.size(), -1), load(nhosts, 0), cap(cap) {}
+
+    // bytes exchanged by the group i with the groups on host h
+    double affinity(size_t i, int h) const {
+        double a = 0;
+        for(size_t j=0;j<w.size();++j)
+            if (j != i && host[j] == h) a += T[i][j];
+        return a;
+    }
+
+    double cut() const {
+        double c = 0;
+        for(size_t i=0;i<w.size();++i)
+            for(size_t j=i+1;j<w.size();++j)
+                if (host[i] != host[j]) c += T[i][j];
+        return c;
+    }
+
+    void assign(size_t i, int h) {
+        if (host[i] >= 0) load[host[i]] -= w[i];
+        host[i] = h;
+        load[h] += w[i];
+    }
+
+    void greedy() {
+        std::vector<size_t> order(w.size());
+        for(size_t i=0;i<order.size();++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return w[a] > w[b]; });
+        for(size_t i : order) {
+            int best = -1;
+            double bestA = -1;
+            for(int h=0;h<(int)load.size();++h) {
+                if (load[h] + w[i] > cap) continue;
+                const double a = affinity(i, h);
+                if (a > bestA || (a == bestA && load[h] < load[best])) { best = h; bestA = a; }
+            }
+            if (best < 0) // nothing fits, the least loaded host
+                best = std::min_element(load.begin(), load.end()) - load.begin();
+            assign(i, best);
+        }
+    }
+
+    // it moves and swaps groups as long as the cut decreases and the loads fit
+    void refine() {
+        bool improved = true;
+        for(int pass=0; improved && pass<100; ++pass) {
+            improved = false;
+            for(size_t i=0;i<w.size();++i) {
+                const int from = host[i];
+                const double stay = affinity(i, from);
+                for(int h=0;h<(int)load.size();++h) {
+                    if (h == from || load[h] + w[i] > cap) continue;
+                    if (affinity(i, h) > stay) { assign(i, h); improved = true; break; }
+                }
+            }
+            for(size_t i=0;i<w.size();++i)
+                for(size_t j=i+1;j<w.size();++j) {
+                    const int hi = host[i], hj = host[j];
+                    if (hi == hj) continue;
+                    if (load[hi] - w[i] + w[j] > cap || load[hj] - w[j] + w[i] > cap) continue;
+                    // gain of the swap, the edge between i and j stays in the cut
+                    const double gain = (affinity(i, hj) - T[i][j]) + (affinity(j, hi) - T[i][j])
+                                      - affinity(i, hi) - affinity(j, hj);
+                    if (gain > 0) { assign(i, hj); assign(j, hi); improved = true; }
+                }
+        }
+    }
+};
+
+static inline void usage(char* progname) {
+	std::cout << "\nUSAGE: " <<  progname << " -f <configFile> -d <profileDir> -H <host1>,...,<hostN> [Options]\n"
+			  << "Options: \n"
+			  << "\t -e <eps>         \t Max CPU time of a host over the average (default 0.1, i.e. 10%)\n"
+			  << "\t -b <port>        \t First port used when a port is already taken on a host (default 8000)\n"
+			  << "\t -o <file>        \t Output configuration file (default standard output)\n";
+	std::cout << "\n";
+}
+
+int main(int argc, char** argv) {
+    std::string configFile, profileDir, outFile;
+    std::vector<std::string> hosts;
+    double eps = 0.1;
+    int basePort = 8000;
+
+	for(int i=1;i<argc;++i) {
+		if (argv[i][0] != '-' || i+1 >= argc) { usage(argv[0]); exit(EXIT_FAILURE); }
+		switch(argv[i][1]) {
+		case 'f': configFile = argv[++i]; break;
+		case 'd': profileDir = argv[++i]; break;
+		case 'H': hosts = split(argv[++i], ','); break;
+		case 'e': eps = std::stod(argv[++i]); break;
+		case 'b': basePort = std::stoi(argv[++i]); break;
+		case 'o': outFile = argv[++i]; break;
+		default: usage(argv[0]); exit(EXIT_FAILURE);
+		}
+	}
+	if (configFile.empty() || profileDir.empty() || hosts.empty()) {
+		usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+    std::string protocol;
+    std::vector<G> groups;
+    {
+        std::ifstream is(configFile);
+        if (!is) {
+            std::cerr << "Unable to open the configuration file " << configFile << std::endl;
+            return -1;
+        }
+        try {
+            cereal::JSONInputArchive ar(is);
+            try {
+                ar(cereal::make_nvp("protocol", protocol));
+            } catch (cereal::Exception&) { ar.setNextName(nullptr); }
+            ar(cereal::make_nvp("groups", groups));
+        } catch (const cereal::Exception& e){
+            std::cerr << "Error parsing the JSON config file. Check syntax and structure of the file and retry!" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    const size_t n = groups.size();
+    std::map<std::string, size_t> index;
+    for(size_t i=0;i<n;++i) index[groups[i].name] = i;
+
+    std::vector<double> w(n, 0);
+    std::vector<std::vector<double>> T(n, std::vector<double>(n, 0));
+    for(size_t i=0;i<n;++i) {
+        const std::string file = profileDir + "/" + groups[i].name + ".json";
+        std::ifstream is(file);
+        if (!is) {
+            std::cerr << "Missing the profile of group " << groups[i].name << " (" << file << ")" << std::endl;
+            return -1;
+        }
+        Profile p;
+        try {
+            cereal::JSONInputArchive ar(is);
+            ar(cereal::make_nvp("profile", p));
+        } catch (const cereal::Exception& e){
+            std::cerr << "Error parsing the profile " << file << std::endl;
+            return -1;
+        }
+        w[i] = p.cpuTime;
+        for(const Edge& e : p.edges) {
+            auto it = index.find(e.to);
+            if (it == index.end() || it->second == i) continue;
+            T[i][it->second] += e.bytes;
+            T[it->second][i] += e.bytes;
+        }
+    }
+    // without a meaningful CPU time the groups are balanced by number
+    double total = 0;
+    for(double x : w) total += x;
+    if (total <= 0) { std::fill(w.begin(), w.end(), 1.0); total = n; }
+
+    // the current placement, for comparison
+    std::map<std::string, int> hostIndex;
+    Placement current(w, T, n, 0);
+    for(size_t i=0;i<n;++i) {
+        auto r = hostIndex.emplace(groups[i].host, (int)hostIndex.size());
+        current.assign(i, r.first->second);
+    }
+
+    Placement P(w, T, hosts.size(), (1.0 + eps) * total / hosts.size());
+    P.greedy();
+    P.refine();
+
+    // the endpoints, the ports must be unique on each host
+    std::map<std::string, std::set<int>> used;
+    for(size_t i=0;i<n;++i) {
+        G& g = groups[i];
+        g.host = hosts[P.host[i]];
+        std::set<int>& ports = used[g.host];
+        if (g.port < 0 || ports.contains(g.port)) {
+            g.port = basePort;
+            while(ports.contains(g.port)) ++g.port;
+        }
+        ports.insert(g.port);
+    }
+
+    std::cerr << "Cut: " << current.cut() << " bytes with the input placement, " << P.cut() << " bytes with the new one\n";
+    for(size_t h=0;h<hosts.size();++h) {
+        std::cerr << hosts[h] << " (CPU time " << P.load[h] << " s):";
+        for(size_t i=0;i<n;++i)
+            if (P.host[i] == (int)h) std::cerr << " " << groups[i].name;
+        std::cerr << "\n";
+    }
+
+    std::ofstream of;
+    if (!outFile.empty()) {
+        of.open(outFile);
+        if (!of) {
+            std::cerr << "Unable to write " << outFile << std::endl;
+            return -1;
+        }
+    }
+    {
+        cereal::JSONOutputArchive ar(outFile.empty() ? std::cout : of);
+        if (!protocol.empty()) ar(cereal::make_nvp("protocol", protocol));
+        ar(cereal::make_nvp("groups", groups));
+    }
+    if (outFile.empty()) std::cout << std::endl;
+    return 0;
+}
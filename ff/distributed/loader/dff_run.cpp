@@ -53,6 +53,7 @@ std::vector<std::string> viewGroups;
 char hostname[HOST_NAME_MAX];
 std::string configFile("");
 std::string executable;
+std::string profileArg("");   // profiling run (see dff_place)
 
 
 static inline unsigned long getusec() {
@@ -104,7 +105,7 @@ struct G {
     void run(){
         char b[1024]; // ssh -t // trovare MAX ARGV
         
-        sprintf(b, " %s %s %s %s %s --DFF_Config=%s --DFF_GName=%s %s 2>&1 %s", (isRemote() ? "ssh -T " : ""), (isRemote() ? host.c_str() : ""), (isRemote() ? "'" : ""), this->preCmd.c_str(),  executable.c_str(), configFile.c_str(), this->name.c_str(), toBePrinted(this->name) ? "" : "> /dev/null", (isRemote() ? "'" : ""));
+        sprintf(b, " %s %s %s %s %s --DFF_Config=%s --DFF_GName=%s%s %s 2>&1 %s", (isRemote() ? "ssh -T " : ""), (isRemote() ? host.c_str() : ""), (isRemote() ? "'" : ""), this->preCmd.c_str(),  executable.c_str(), configFile.c_str(), this->name.c_str(), profileArg.c_str(), toBePrinted(this->name) ? "" : "> /dev/null", (isRemote() ? "'" : ""));
        std::cout << "Executing the following command: " << b << std::endl;
         file = popen(b, "r");
         fd = fileno(file);
@@ -136,7 +137,8 @@ static inline void usage(char* progname) {
 			  << "Options: \n"
 			  << "\t -v <g1>,...,<g2> \t Prints the output of the specified groups\n"
 			  << "\t -V               \t Print the output of all groups\n"
-			  << "\t -p \"TCP|MPI\"   \t Force communication protocol\n";
+			  << "\t -p \"TCP|MPI\"   \t Force communication protocol\n"
+			  << "\t -P <dir>         \t Profiling run, each group writes its profile in dir (see dff_place)\n";
 	std::cout << "\n";
 		
 }
@@ -196,6 +198,17 @@ int main(int argc, char** argv) {
 				}
 				configFile = n_fs::absolute(n_fs::path(argv[++i])).string();
 			} break;
+			case 'P': {
+				if (argv[i+1] == NULL) {
+					std::cerr << "-P requires a directory\n";
+					usage(argv[0]);
+					exit(EXIT_FAILURE);
+				}
+				n_fs::path dir = n_fs::absolute(n_fs::path(argv[++i]));
+				std::error_code ec;
+				n_fs::create_directories(dir, ec);
+				profileArg = " --DFF_Profile=" + dir.string();
+			} break;
 			case 'V': {
 				seeAll=true;
 			} break;
@@ -312,7 +325,7 @@ int main(int argc, char** argv) {
 
         char command[350];
      
-        sprintf(command, "mpirun -np %lu --rankfile %s %s --DFF_Config=%s", parsedGroups.size(), rankFile.c_str(), executable.c_str(), configFile.c_str());
+        sprintf(command, "mpirun -np %lu --rankfile %s %s --DFF_Config=%s%s", parsedGroups.size(), rankFile.c_str(), executable.c_str(), configFile.c_str(), profileArg.c_str());
 
 		std::cout << "mpicommand: " << command << "\n";
 		
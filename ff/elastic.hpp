@@ -0,0 +1,221 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \file elastic.hpp
+ *  \ingroup building_blocks
+ *  \brief Elastic farm: run-time scaling of the number of active workers
+ *
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * The controller runs inside the load-balancer thread of the farm (see
+ * ff_farm::set_elastic), so that only the thread scheduling the tasks
+ * changes the number of active workers. It is executed before scheduling
+ * each task and while the load-balancer waits for input tasks (see
+ * ff_loadbalancer::idle), so that an idle farm shrinks too. At most every
+ * sampling_us/8 the backlog per active worker is sampled: the tasks queued
+ * in the input channels of the active workers plus the tasks waiting in
+ * the emitter's input channel (read from the channels' push/pop counters,
+ * see uSWSR_Ptr_Buffer::occupancy), divided by the number of active
+ * workers. Every sampling_us
+ * the average backlog is compared with the thresholds: after 'hysteresis'
+ * consecutive periods above 'high' one worker is resumed, after
+ * 'hysteresis' periods below 'low' the last active worker is parked.
+ *
+ * Parking worker k: the scheduling stops using it (running=k), then the
+ * worker receives an FF_GO_OUT after the tasks already in its input channel,
+ * so that no in-flight task is lost. The worker executes svc_end and
+ * sleeps on its condition variable (freezing), releasing its core.
+ * Resuming it executes svc_init again. All the parked workers are resumed
+ * before any broadcast (e.g. the EOS) and before sending them a task with
+ * ff_send_out_to. After a broadcast of a control message (e.g. the EOS) the
+ * controller is stopped until the next run.
+ *
+ * It cannot be used with the key-partitioned scheduling: the keys are
+ * hashed over the active workers and would move at each resize.
+ *
+ * The workers must be standard nodes. Worker utilisation is estimated from
+ * the backlog, the worker's counters (getworktime, getnumtask) are updated
+ * only at the end of the run (getnumtask only with TRACE_FASTFLOW).
+ */
+
+#ifndef FF_ELASTIC_HPP
+#define FF_ELASTIC_HPP
+
+#include <vector>
+#include <atomic>
+#include <ff/lb.hpp>
+#include <ff/utils.hpp>
+
+namespace ff {
+
+struct ff_elastic_params {
+    size_t        min_workers = 1;       ///< workers always active
+    size_t        max_workers = 0;       ///< if 0, all the workers of the farm
+    unsigned long sampling_us = 1000;    ///< control period
+    double        high        = 8.0;     ///< backlog per active worker above which one worker is added
+    double        low         = 0.5;     ///< backlog per active worker below which one worker is parked
+    size_t        hysteresis  = 3;       ///< consecutive periods above/below the thresholds
+};
+
+// it can be read while the farm is running
+struct ff_elastic_stats {
+    std::atomic<size_t> nactive{0};      ///< current number of active workers
+    std::atomic<size_t> ngrow{0};        ///< workers resumed
+    std::atomic<size_t> nshrink{0};      ///< workers parked
+    std::atomic<size_t> minactive{0};    ///< lowest number of active workers reached
+};
+
+template<typename LB>
+struct elastic_lb: LB {
+    template<typename... Args>
+    elastic_lb(const ff_elastic_params &p, Args&&... args):LB(std::forward<Args>(args)...),P(p) {}
+
+    const ff_elastic_stats& get_stats() const { return stats; }
+
+    inline bool schedule_task(void * task, unsigned long retry=((unsigned long)-1),
+                              unsigned long ticks=LB::TICKS2WAIT) {
+        control();
+        return LB::schedule_task(task, retry, ticks);
+    }
+    inline void broadcast_task(void * task) {
+        resume_all();
+        if (task >= FF_TAG_MIN) stopped = true;  // e.g. the EOS, the workers are leaving
+        LB::broadcast_task(task);
+    }
+    inline bool ff_send_out_to(void *task, int id, unsigned long retry=((unsigned long)-1),
+                               unsigned long ticks=LB::TICKS2WAIT) {
+        while((ssize_t)id >= (ssize_t)this->getnworkers() && resume()) {}
+        return LB::ff_send_out_to(task, id, retry, ticks);
+    }
+    int svc_init() {
+        const size_t nw = this->getnworkers();
+        maxw = P.max_workers ? (std::min)(P.max_workers, nw) : nw;
+        minw = (std::max)((size_t)1, (std::min)(P.min_workers, maxw));
+        parked.assign(nw, false);
+        wasfreezing.assign(nw, false);
+        above = below = 0; nsamples = 0; backlog = 0.0;
+        stopped = false;
+        tsample = tcontrol = getusec();
+        stats.nactive.store(nw);
+        stats.minactive.store(nw);
+        return LB::svc_init();
+    }
+    void svc_end() {
+        // e.g. the emitter returned GO_OUT, the parked workers go back waiting for tasks
+        resume_all();
+        LB::svc_end();
+    }
+    // the workers are thawed before the scheduler (the opposite of
+    // ff_loadbalancer::thaw), otherwise the controller may park a worker not
+    // thawed yet and the thaw would cancel the parking
+    void thaw(bool _freeze=false, ssize_t nw=-1) {
+        LB::thawWorkers(_freeze, nw);
+        ff_thread::thaw(_freeze);
+    }
+
+protected:
+    // no task in the input channels
+    inline void idle() {
+        control();
+        LB::idle();
+    }
+    inline void control() {
+        if (stopped) return;
+        const unsigned long now = getusec();
+        if (now - tsample < P.sampling_us/8) return;
+        tsample = now;
+        sample();
+        if (now - tcontrol < P.sampling_us) return;
+        tcontrol = now;
+        const double b = backlog / nsamples;
+        backlog = 0.0; nsamples = 0;
+        if (b > P.high)     { ++above; below = 0; }
+        else if (b < P.low) { ++below; above = 0; }
+        else above = below = 0;
+        const size_t running = this->getnworkers();
+        if (above >= P.hysteresis && running < maxw) {
+            if (resume()) stats.ngrow.fetch_add(1, std::memory_order_relaxed);
+            above = 0;
+        } else if (below >= P.hysteresis && running > minw) {
+            if (park()) stats.nshrink.fetch_add(1, std::memory_order_relaxed);
+            below = 0;
+        }
+    }
+    inline void sample() {
+        const svector<ff_node*> &W = this->getWorkers();
+        const size_t running = this->getnworkers();
+        double q = 0.0;
+        for(size_t i=0;i<running;++i) {
+            FFBUFFER *b = W[i]->get_in_buffer();
+            if (b) q += b->occupancy();
+        }
+        FFBUFFER *in = this->get_in_buffer();
+        if (in) q += in->occupancy();
+        backlog += q / running;
+        ++nsamples;
+    }
+    // it parks the last active worker
+    bool park() {
+        const svector<ff_node*> &W = this->getWorkers();
+        const size_t k = this->getnworkers()-1;
+        if (W[k]->getOSThreadId() == 0) return false;  // not started yet
+        wasfreezing[k] = this->isfrozen_worker(k);
+        this->set_running(k);
+        this->freeze_worker(k);
+        ff_loadbalancer::ff_send_out_to(FF_GO_OUT, (int)k);
+        if (this->batch_out) {
+            FFBUFFER *b = W[k]->get_in_buffer();
+            while(!b->flush()) this->losetime_out();
+        }
+        parked[k] = true;
+        stats.nactive.store(k);
+        if (k < stats.minactive.load()) stats.minactive.store(k);
+        return true;
+    }
+    // it resumes the first parked worker
+    bool resume() {
+        const size_t k = this->getnworkers();
+        if (k >= parked.size() || !parked[k]) return false;
+        // the worker may be still executing the tasks queued before the GO_OUT
+        if (this->thaw_worker(k, wasfreezing[k])<0) return false;
+        parked[k] = false;
+        this->set_running(k+1);
+        stats.nactive.store(k+1);
+        return true;
+    }
+    inline void resume_all() { while(resume()) {} }
+
+    const ff_elastic_params P;
+    ff_elastic_stats  stats;
+    size_t            minw = 1, maxw = 0;
+    size_t            above = 0, below = 0, nsamples = 0;
+    double            backlog = 0.0;
+    unsigned long     tsample = 0, tcontrol = 0;
+    std::vector<bool> parked, wasfreezing;
+    bool              stopped = false;
+};
+
+} // namespace ff
+
+#endif /* FF_ELASTIC_HPP */
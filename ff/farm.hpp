@@ -67,6 +67,8 @@
 #include <ff/node.hpp>
 #include <ff/multinode.hpp>
 #include <ff/ordering_policies.hpp>
+#include <ff/keyed_policies.hpp>
+#include <ff/elastic.hpp>
 #include <ff/all2all.hpp>
 
 namespace ff {
@@ -81,6 +83,18 @@ namespace ff {
 // forward decls
 class ff_farm;
 static inline int optimize_static(ff_farm&, const OptLevel&);
+
+/* 
+ * NUMA placement policies of the farm (see ff_farm::numa_mode):
+ *  - FF_NUMA_NONE:    no NUMA placement
+ *  - FF_NUMA_LOCAL:   the threads keep the default mapping, each channel is 
+ *                     placed on the memory node of its consumer
+ *  - FF_NUMA_COMPACT: as LOCAL, the workers fill the CPUs of one node before
+ *                     moving to the next one
+ *  - FF_NUMA_SCATTER: as LOCAL, the workers are spread round-robin across 
+ *                     the nodes
+ */
+enum ff_numa_policy { FF_NUMA_NONE=0, FF_NUMA_LOCAL, FF_NUMA_COMPACT, FF_NUMA_SCATTER };
     
 
 /*!
@@ -120,24 +134,12 @@ protected:
             if (blocking_out) {
                 size_t nw = getnworkers();
                 for(size_t i=victim;i<nw;++i) {
-                    while (!W[i]->put(task)) {
-                        pthread_mutex_lock(prod_m);
-                        struct timespec tv;
-                        timedwait_timeout(tv);
-                        pthread_cond_timedwait(prod_c, prod_m,&tv);
-                        pthread_mutex_unlock(prod_m); 
-                    }
-                    put_done(i);
+                    while (!W[i]->put(task))
+                        wait_output([&W,i]() { return W[i]->get_in_buffer()->available(); });
                 }
                 for(size_t i=0;i<victim;++i) {
-                    while (!W[i]->put(task)) {
-                        pthread_mutex_lock(prod_m);
-                        struct timespec tv;
-                        timedwait_timeout(tv);
-                        pthread_cond_timedwait(prod_c, prod_m,&tv);
-                        pthread_mutex_unlock(prod_m); 
-                    }
-                    put_done(i);
+                    while (!W[i]->put(task))
+                        wait_output([&W,i]() { return W[i]->get_in_buffer()->available(); });
                 }     
 #if defined(FF_TASK_CALLBACK)
                 callbackOut(this);
@@ -218,8 +220,13 @@ protected:
             error("FARM: wrong number of workers\n");
             return -1;
         }
+        // hierarchical farm
+        if (hier_fanout && nworkers > hier_fanout) {
+            if (build_hierarchy()<0) return -1;
+            nworkers = workers.size();
+        }
         for(size_t i=0;i<workers.size();++i) {
-            workers[i]->set_id(int(i));
+            workers[i]->set_id(first_worker_id + int(i));
         }
 
         // NOTE: if the farm is in a master-worker configuration, all workers must be either
@@ -251,8 +258,10 @@ protected:
                 ordered_gt* _gt= new ordered_gt(nworkers);
                 assert(_lb); assert(_gt);
                 ordering_Memory.resize(nworkers * (2*ff_farm::ondemand_buffer()+3)+ordering_memsize);
-                _lb->init(ordering_Memory.begin(), ordering_Memory.size());
-                _gt->init(ordering_memsize);
+                _gt->init(ordering_Memory.size());
+                // no back-pressure if the gatherer does not run (no collector)
+                _lb->init(ordering_Memory.begin(), ordering_Memory.size(),
+                          collector ? _gt->released() : nullptr);
                 setlb(_lb, true);
                 setgt(_gt, true);
                 
@@ -270,6 +279,67 @@ protected:
             }        
         }
 
+        // key-partitioned scheduling
+        if (keyed.enabled()) {
+            if (ordered) {
+                error("FARM: the key-partitioned scheduling cannot be used in an ordered farm\n");
+                return -1;
+            }
+            if (twochoices) {
+                error("FARM: the key-partitioned and the two-choices scheduling cannot be used together\n");
+                return -1;
+            }
+            // the keys are hashed over the active workers, parking/resuming
+            // a worker would move them
+            if (elastic) {
+                error("FARM: the key-partitioned scheduling cannot be used in an elastic farm\n");
+                return -1;
+            }
+            keyed_lb* _lb = new keyed_lb(max_nworkers, keyed);
+            assert(_lb);
+            setlb(_lb, true);
+        }
+
+        // power-of-two-choices scheduling
+        if (twochoices) {
+            if (ordered) {
+                error("FARM: the two-choices scheduling cannot be used in an ordered farm\n");
+                return -1;
+            }
+            if (!elastic) {
+                twochoices_lb* _lb = new twochoices_lb(max_nworkers, twochoices);
+                assert(_lb);
+                setlb(_lb, true);
+            }
+        }
+
+        // elastic farm
+        if (elastic) {
+            if (ordered) {
+                error("FARM: the elastic mode cannot be used in an ordered farm\n");
+                return -1;
+            }
+            for(size_t i=0;i<nworkers;++i)
+                if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isMultiInput()
+                    || workers[i]->isMultiOutput() || workers[i]->isAll2All() || workers[i]->isComp()) {
+                    error("FARM: the elastic mode is currently supported only for standard nodes\n");
+                    return -1;
+                }
+            if (twochoices) {
+                auto _lb = new elastic_lb<twochoices_lb>(elastic_params, max_nworkers, twochoices);
+                assert(_lb);
+                elastic_stats = &_lb->get_stats();
+                setlb(_lb, true);
+            } else {
+                auto _lb = new elastic_lb<ff_loadbalancer>(elastic_params, max_nworkers);
+                assert(_lb);
+                elastic_stats = &_lb->get_stats();
+                setlb(_lb, true);
+            }
+        }
+
+        if (numa_policy != FF_NUMA_NONE) numa_placement();
+
         // accelerator
         if (has_input_channel) { 
             if (create_input_buffer(in_buffer_entries, fixedsizeIN)<0) {
@@ -817,6 +887,11 @@ public:
         collector_removed = f.collector_removed;
         ordered           = f.ordered;
         ordering_memsize  = f.ordering_memsize;
+        keyed             = f.keyed;
+        twochoices        = f.twochoices;
+        hier_fanout       = f.hier_fanout;
+        elastic           = f.elastic;
+        elastic_params    = f.elastic_params;
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
         out_buffer_entries = f.out_buffer_entries;
         worker_cleanup = f.worker_cleanup; 
@@ -859,6 +934,11 @@ public:
         collector_removed = f.collector_removed;
         ordered           = f.ordered;
         ordering_memsize  = f.ordering_memsize;
+        keyed             = f.keyed;
+        twochoices        = f.twochoices;
+        hier_fanout       = f.hier_fanout;
+        elastic           = f.elastic;
+        elastic_params    = f.elastic_params;
         ordering_Memory   = std::move(f.ordering_Memory);
         ondemand = f.ondemand; in_buffer_entries = f.in_buffer_entries;
         out_buffer_entries = f.out_buffer_entries;
@@ -1088,6 +1168,85 @@ public:
         if (inbufferentries<=0) ondemand=1;
         else ondemand=inbufferentries;
     }
+
+    /**
+     * \brief Sets the key-partitioned scheduling policy.
+     *
+     * The data elements with the same key (extracted by the policy's key
+     * function) are always sent to the same worker, see keyed_policies.hpp.
+     * The policy cannot be used together with set_ordered.
+     */
+    void set_scheduling_keyed(const ff_keyed_policy &policy) {
+        if (prepared) {
+            error("FARM, set_scheduling_keyed, farm already prepared\n");
+            return;
+        }
+        keyed = policy;
+    }
+
+    /**
+     * \brief Sets the power-of-two-choices scheduling policy.
+     *
+     * Each task is sent to the less loaded of two workers chosen at random,
+     * the length of a worker's input queue is read again only after
+     * \param refresh tasks (see twochoices_lb in lb.hpp). It is useful with
+     * many workers and tasks of different cost.
+     */
+    void set_scheduling_twochoices(size_t refresh=16) {
+        if (prepared) {
+            error("FARM, set_scheduling_twochoices, farm already prepared\n");
+            return;
+        }
+        twochoices = (refresh>0) ? refresh : 1;
+    }
+
+    /**
+     * \brief Builds a tree of emitters and collectors.
+     *
+     * With more than \param fanout workers, the workers are split in groups
+     * of at most \param fanout workers (at least one group per socket), each
+     * group has its own emitter, fed by the farm's emitter, and its own
+     * collector (if the farm has a collector), that feeds the farm's
+     * collector. The threads of a group are placed on the same socket.
+     * The EOS, the on-demand and the key-partitioned/two-choices scheduling
+     * are applied at each level, get_my_id of the workers is not changed.
+     * NOTE: the channels seen by the emitter (ff_send_out_to) and by the
+     * collector are the groups and not the workers. It cannot be used with
+     * set_ordered, set_elastic and wrap_around, the workers must be
+     * standard nodes.
+     */
+    void set_hierarchical(size_t fanout=DEF_HIER_FANOUT) {
+        if (prepared) {
+            error("FARM, set_hierarchical, farm already prepared\n");
+            return;
+        }
+        hier_fanout = (fanout>1) ? fanout : 2;
+    }
+
+    /**
+     * \brief Enables the elastic mode.
+     *
+     * The number of active workers changes at run-time between
+     * params.min_workers and params.max_workers according to the tasks
+     * queued per active worker, the others are parked and release their
+     * cores, see elastic.hpp. It cannot be used together with set_ordered
+     * and set_scheduling_keyed, the workers must be standard nodes.
+     */
+    void set_elastic(const ff_elastic_params &params = ff_elastic_params()) {
+        if (prepared) {
+            error("FARM, set_elastic, farm already prepared\n");
+            return;
+        }
+        elastic = true;
+        elastic_params = params;
+    }
+
+    /**
+     * \brief Statistics of the elastic mode.
+     *
+     * \return nullptr if the elastic mode is not set or the farm is not prepared.
+     */
+    const ff_elastic_stats* get_elastic_stats() const { return elastic_stats; }
     /**
      * \brief Force ordering. 
      *  
@@ -1095,7 +1254,9 @@ public:
      * input ordering.
      *
      * The \param MemoryElements sets the maximum size of the buffer in the 
-     * collector when the scheduling of elements is on-demand.
+     * collector when the scheduling of elements is on-demand. The emitter
+     * waits when the elements in the farm and in the collector's reorder
+     * window reach this size (plus the workers' buffers).
      */
     void set_ordered(const size_t MemoryElements=DEF_OFARM_ONDEMAND_MEMORY) {
         if (prepared) {
@@ -1321,6 +1482,38 @@ public:
         lb->blocking_mode(blk);
         if (gt) gt->blocking_mode(blk);            
     }
+    /* WARNING: it must be called after the workers have been added
+     * and before the run() method. See ff_node::batched_mode.
+     */
+    virtual void batched_mode(bool onoff=true) {
+        ff_node::batched_mode(onoff);
+        lb->batched_mode(onoff);
+        if (gt) gt->batched_mode(onoff);
+        for(size_t i=0;i<workers.size();++i)
+            workers[i]->batched_mode(onoff);
+    }
+    /* WARNING: it must be called after the workers have been added
+     * and before the run() method. See ff_node::spinpark_mode.
+     * NOTE: the emitter and the collector keep spinning.
+     */
+    virtual void spinpark_mode(bool onoff=true) {
+        for(size_t i=0;i<workers.size();++i)
+            workers[i]->spinpark_mode(onoff);
+    }
+    /* WARNING: it must be called before the run() method.
+     * The NUMA placement is applied when the farm is prepared: with the
+     * COMPACT and SCATTER policies the CPUs of the emitter, collector and 
+     * sequential workers not explicitly mapped by the user are chosen 
+     * according to the policy, then each channel is placed on the memory 
+     * node of its consumer (see ff_node::numa_mode).
+     * The placement has no effect if the threads are not mapped (no_mapping).
+     */
+    virtual void numa_mode(bool onoff=true) {
+        numa_mode(onoff ? FF_NUMA_LOCAL : FF_NUMA_NONE);
+    }
+    void numa_mode(ff_numa_policy policy) {
+        numa_policy = policy;
+    }
     
     inline int cardinality() const { 
         int card=0;
@@ -1488,7 +1681,8 @@ public:
                 error("FARM, waiting freezing of worker thread, id = %d\n",workers[i]->get_my_id());
                 ret = -1;
             }
-        lb->running = -1;        
+        // running is reset by wait_lb_freezing: the emitter may still be
+        // absorbing the EOSs of the workers (see ff_loadbalancer::absorb_eos)
         if (lb->wait_lb_freezing()<0) ret=-1;
         if (!collector_removed && collector) if (gt->wait_freezing()<0) ret=-1;
         return ret; 
@@ -1548,18 +1742,9 @@ public:
 
         if (inbuffer) {
             if (blocking_out) {
-            _retry:
-                const bool empty=inbuffer->empty();
-                if (inbuffer->push(task)) {
-                    if (empty) pthread_cond_signal(p_cons_c);
-                    return true;
-                }
-                struct timespec tv;
-                timedwait_timeout(tv);                
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c, prod_m, &tv);
-                pthread_mutex_unlock(prod_m);
-                goto _retry;
+                while(!inbuffer->push(task))
+                    out_notifier(inbuffer)->wait([inbuffer]() { return inbuffer->available(); }, FF_TIMEDWAIT_NS);
+                return true;
             }
             for(unsigned long i=0;i<retry;++i) {
                 if (inbuffer->push(task)) return true;
@@ -1603,11 +1788,8 @@ public:
                 if ((*task != (void *)FF_EOS)) return true;
                 else return false;
             }
-            struct timespec tv;
-            timedwait_timeout(tv);
-            pthread_mutex_lock(cons_m);
-            pthread_cond_timedwait(cons_c, cons_m,&tv);
-            pthread_mutex_unlock(cons_m);
+            FFBUFFER * const outbuffer = gt->get_out_buffer();
+            in_notifier(outbuffer)->wait([outbuffer]() { return outbuffer && !outbuffer->empty(); }, FF_TIMEDWAIT_NS);
             goto _retry;
         }
         for(unsigned long i=0;i<retry;++i) {
@@ -2135,6 +2317,146 @@ protected:
     svector<ff_node*>  outputNodesFeedback;       
     svector<ff_node*>  internalSupportNodes;
     svector<ordering_pair_t>  ordering_Memory;     // used for ordering purposes
+    ff_keyed_policy    keyed;                      // key-partitioned scheduling
+    size_t             twochoices = 0;             // if >0, power-of-two-choices scheduling
+    bool               elastic = false;            // see set_elastic
+    ff_elastic_params  elastic_params;
+    const ff_elastic_stats *elastic_stats = nullptr;
+    size_t             hier_fanout = 0;            // if >0, see set_hierarchical
+    ssize_t            first_worker_id = 0;        // id of the first worker (sub-farms)
+    ff_numa_policy     numa_policy = FF_NUMA_NONE;
+
+private:
+    /*
+     * It replaces the workers with the sub-farms of a hierarchical farm
+     * (see set_hierarchical). The sub-farm g takes the workers
+     * [g*n/ngroups, (g+1)*n/ngroups), its threads are placed on the node
+     * g % nnodes. The emitter and the collector of the sub-farms have a
+     * forwarding filter only when they have to be pinned to a CPU.
+     */
+    int build_hierarchy() {
+        struct forwarder: ff_node {
+            void* svc(void *t) { return t; }
+        };
+        const size_t nworkers = workers.size();
+        if (ordered || elastic || lb->masterworker()) {
+            error("FARM: a hierarchical farm cannot be ordered, elastic or in master-worker configuration\n");
+            return -1;
+        }
+        for(size_t i=0;i<nworkers;++i)
+            if (workers[i]->isFarm() || workers[i]->isPipe() || workers[i]->isMultiInput()
+                || workers[i]->isMultiOutput() || workers[i]->isAll2All() || workers[i]->isComp()) {
+                error("FARM: the hierarchical farm is currently supported only for standard nodes\n");
+                return -1;
+            }
+        const ssize_t nsockets = ff_numSockets();
+        size_t ngroups = (nworkers + hier_fanout - 1) / hier_fanout;
+        if (nsockets > 1) ngroups = (std::max)(ngroups, (std::min)((size_t)nsockets, nworkers));
+
+        // the CPUs of each node that can be used by the mapper
+        std::vector<std::vector<int> > nodes;
+        if (default_mapping && nsockets > 1) {
+            std::vector<int> cpus;
+            for(int n=0;n<(int)(8*sizeof(unsigned long));++n) {
+                if (ff_numaNodeCpus(n, cpus)<=0) continue;
+                std::vector<int> C;
+                for(size_t j=0;j<cpus.size();++j)
+                    if (threadMapper::instance()->checkCPUId(cpus[j])) C.push_back(cpus[j]);
+                if (C.size()) nodes.push_back(C);
+            }
+            if (nodes.size() < 2) nodes.clear();
+        }
+        std::vector<size_t> next(nodes.size(), 0);
+        auto takeCPU = [&](size_t n) { return nodes[n][next[n]++ % nodes[n].size()]; };
+
+        const bool hascollector = collector && !collector_removed;
+        std::vector<ff_node*> groups;
+        for(size_t g=0, first=0; g<ngroups; ++g) {
+            const size_t last = (g+1)*nworkers/ngroups;
+            ff_farm *f = new ff_farm(false, in_buffer_entries, out_buffer_entries,
+                                     worker_cleanup, last-first);
+            assert(f);
+            std::vector<ff_node*> W(workers.begin()+first, workers.begin()+last);
+            if (f->add_workers(W)<0) { delete f; return -1; }
+            f->first_worker_id = first_worker_id + first;
+            f->setFixedSize(fixedsizeIN);
+            if (ondemand) f->set_scheduling_ondemand(ondemand);
+            if (keyed.enabled()) {
+                // the key's group must not determine its worker in the group
+                ff_keyed_policy P(keyed);
+                P.set_salt(keyed.get_salt() + 0x9E3779B97F4A7C15ULL);
+                f->set_scheduling_keyed(P);
+            }
+            if (twochoices) f->set_scheduling_twochoices(twochoices);
+            if (!default_mapping) f->no_mapping();
+            if (nodes.size()) {
+                const size_t n = g % nodes.size();
+                forwarder *e = new forwarder;
+                e->setAffinity(takeCPU(n));
+                f->add_emitter(e);
+                f->cleanup_emitter();
+                for(size_t i=0;i<W.size();++i)
+                    if (W[i]->getCPUId()<0) W[i]->setAffinity(takeCPU(n));
+                if (hascollector) {
+                    forwarder *c = new forwarder;
+                    c->setAffinity(takeCPU(n));
+                    f->add_collector(c, true);
+                }
+            } else if (hascollector) f->add_collector(nullptr);
+            groups.push_back(f);
+            first = last;
+        }
+        workers.clear();
+        add_workers(groups);
+        worker_cleanup = true;
+        return 0;
+    }
+
+    /*
+     * It chooses the CPUs of the farm's threads according to the NUMA 
+     * policy and enables the NUMA mode of the load-balancer, the gatherer
+     * and the workers. The emitter and the collector are placed on the first
+     * node, the threads already mapped by the user are not moved.
+     */
+    void numa_placement() {
+        ff_node::numa_mode(true);
+        if (emitter) emitter->numa_mode(true);  // it may create the farm's input channel
+        lb->numa_mode(true);
+        if (gt) gt->numa_mode(true);
+        for(size_t i=0;i<workers.size();++i) workers[i]->numa_mode(true);
+
+        if (numa_policy == FF_NUMA_LOCAL || !default_mapping) return;
+
+        // the CPUs of each node that can be used by the mapper
+        std::vector<std::vector<int> > nodes;
+        std::vector<int> cpus;
+        for(int n=0;n<(int)(8*sizeof(unsigned long));++n) {
+            if (ff_numaNodeCpus(n, cpus)<=0) continue;
+            std::vector<int> C;
+            for(size_t j=0;j<cpus.size();++j)
+                if (threadMapper::instance()->checkCPUId(cpus[j])) C.push_back(cpus[j]);
+            if (C.size()) nodes.push_back(C);
+        }
+        if (nodes.size()==0) return;
+        std::vector<size_t> next(nodes.size(), 0);
+        auto takeCPU = [&](size_t n) { return nodes[n][next[n]++ % nodes[n].size()]; };
+
+        auto placeable = [](ff_node *n) {
+            return n && !n->isFarm() && !n->isPipe() && !n->isAll2All() && n->getCPUId()<0;
+        };
+        if (placeable(emitter)) emitter->setAffinity(takeCPU(0));
+        if (!collector_removed && placeable(collector)) collector->setAffinity(takeCPU(0));
+        for(size_t i=0;i<workers.size();++i) {
+            ff_node *w = workers[i];
+            if (!placeable(w)) continue;
+            size_t n = i % nodes.size();
+            if (numa_policy == FF_NUMA_COMPACT) {
+                for(n=0; n<nodes.size() && next[n]>=nodes[n].size(); ++n);
+                if (n == nodes.size()) n = i % nodes.size();  // all CPUs taken
+            }
+            w->setAffinity(takeCPU(n));
+        }
+    }
 };
 
 
@@ -0,0 +1,172 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \file futex.hpp
+ * \ingroup aux_classes
+ *
+ * \brief Futex-based notification primitive used to park threads on channels
+ *
+ * @detail The \p ff_notifier is a single 32-bit word: the lowest bit tells
+ * whether there is at least one thread sleeping on the word, the remaining
+ * bits are a sequence number incremented at each wake-up. A thread parks
+ * only after having announced itself and checked again the waiting
+ * condition, and the notifier issues the wake-up system call only if
+ * somebody is actually sleeping.
+ *
+ * On non-Linux platforms the futex calls are emulated with short sleeps.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_FUTEX_HPP
+#define FF_FUTEX_HPP
+
+#include <stdint.h>
+#include <time.h>
+#include <climits>
+#include <atomic>
+#include <ff/sysdep.h>
+#include <ff/config.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+namespace ff {
+
+/*
+ * It waits on the word \p addr if its value is still \p val, for at
+ * most \p timeout_ns nanoseconds (it cannot be greater than 1 second).
+ * Spurious wake-ups are possible.
+ */
+static inline void ff_futex_wait(std::atomic<uint32_t> *addr, uint32_t val, long timeout_ns) {
+#if defined(__linux__)
+    struct timespec ts = { 0, timeout_ns };
+    syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+#else
+    if (addr->load(std::memory_order_relaxed) != val) return;
+    struct timespec ts = { 0, (timeout_ns < 50000) ? timeout_ns : 50000 };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+/*
+ * It wakes up at most \p n threads waiting on the word \p addr.
+ */
+static inline void ff_futex_wake(std::atomic<uint32_t> *addr, int n=INT_MAX) {
+#if defined(__linux__)
+    syscall(SYS_futex, (uint32_t*)addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+#else
+    (void)addr; (void)n;
+#endif
+}
+
+/*!
+ * \class ff_notifier
+ * \ingroup aux_classes
+ *
+ * \brief One 32-bit word on which one (or more) threads park waiting for
+ * a condition that is made true by other threads.
+ *
+ * The waiter calls \p wait passing the condition, the signaller makes the
+ * condition true (e.g. it pushes into a queue) and then calls \p notify.
+ * The waiter sets the sleeping bit before checking the condition and the
+ * signaller executes a full fence before checking the bit, so at least one
+ * of the two sees the other's store. The sleep is bounded by a timeout all
+ * the same.
+ */
+class ff_notifier {
+public:
+    ff_notifier():word(0),nwaits(0),nwakes(0) {}
+
+    /*
+     * It parks the calling thread for at most timeout_ns nanoseconds
+     * unless \p ready returns true after the thread has announced itself.
+     * \return true if the thread has actually been parked
+     */
+    template<typename Cond>
+    inline bool wait(Cond ready, long timeout_ns=FF_PARK_TIMEOUT_NS) {
+        const uint32_t v = word.fetch_or(1u) | 1u;  // full fence on x86
+        if (ready()) return false;
+        ++nwaits;
+        ff_futex_wait(&word, v, timeout_ns);
+        return true;
+    }
+
+    /*
+     * It wakes up all the threads sleeping on the word, if any.
+     * The cost is a fence and a load if nobody is sleeping, the channels
+     * call it only if a notifier is attached.
+     */
+    inline void notify() {
+        // StoreLoad: the store that made the condition true must be visible
+        // before the sleeping bit is read (see wait)
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint32_t v = word.load(std::memory_order_relaxed);
+        if (!(v & 1u)) return;
+        // clears the sleeping bit and moves the sequence number forward
+        if (word.exchange((v & ~1u) + 2u) & 1u) {
+            ++nwakes;
+            ff_futex_wake(&word);
+        }
+    }
+
+    inline bool sleeping() const { return word.load(std::memory_order_relaxed) & 1u; }
+
+    // statistics: the number of times a thread has been parked and the
+    // number of wake-up system calls
+    inline size_t get_nwaits() const { return nwaits; }
+    inline size_t get_nwakes() const { return nwakes.load(std::memory_order_relaxed); }
+
+protected:
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> word;
+    size_t                nwaits;   // written only by the waiter
+    std::atomic<size_t>   nwakes;
+};
+
+/*
+ * Helpers used by the run-time to attach the notifier of a thread to the
+ * channels it waits on. A channel has only one consumer and one producer,
+ * the store is executed only if the notifier is not already attached.
+ * The detach functions remove the notifier only if it is still attached.
+ */
+template<typename Buffer>
+static inline void ff_attach_cons(Buffer *b, ff_notifier *n) {
+    if (b && b->get_cons_notifier() != n) b->set_cons_notifier(n);
+}
+template<typename Buffer>
+static inline void ff_attach_prod(Buffer *b, ff_notifier *n) {
+    if (b && b->get_prod_notifier() != n) b->set_prod_notifier(n);
+}
+template<typename Buffer>
+static inline void ff_detach_cons(Buffer *b, ff_notifier *n) {
+    if (b && n && b->get_cons_notifier() == n) b->set_cons_notifier(nullptr);
+}
+template<typename Buffer>
+static inline void ff_detach_prod(Buffer *b, ff_notifier *n) {
+    if (b && n && b->get_prod_notifier() == n) b->set_prod_notifier(nullptr);
+}
+
+} // namespace ff
+
+#endif /* FF_FUTEX_HPP */
@@ -194,25 +194,78 @@ protected:
      * \return It returns the workers with a taks if successful. Otherwise -1
      * is returned.
      */
+    /*
+     * Blocking mode: the gatherer parks on ntf_in waiting for a task from
+     * any of the workers and on ntf_out waiting for a free slot in its output
+     * channel. The notifiers are attached to all the channels the first time
+     * the gatherer has to wait in a run and detached at the end of the run
+     * (detach_notifiers, see futex.hpp).
+     */
+    inline void attach_notifiers() {
+        if (!ntf_in)  ntf_in  = new ff_notifier;
+        if (!ntf_out) ntf_out = new ff_notifier;
+        for(size_t i=0;i<workers.size();++i)
+            ff_attach_cons(workers[i]->get_out_buffer(), ntf_in);
+        ff_attach_prod(filter ? filter->get_out_buffer() : buffer, ntf_out);
+        ntf_attached = true;
+    }
+    template<typename Cond>
+    inline void wait_input(Cond ready) {
+        if (!ntf_attached) attach_notifiers();
+        ntf_in->wait(ready, FF_TIMEDWAIT_NS);
+    }
+    template<typename Cond>
+    inline void wait_output(FFBUFFER *b, Cond ready) {
+        if (!ntf_attached) attach_notifiers();
+        ff_attach_prod(b, ntf_out);  // no-op if b is the output channel
+        ntf_out->wait(ready, FF_TIMEDWAIT_NS);
+    }
+    // true if there is at least one task in the workers' channels
+    inline bool input_ready() {
+        for(ssize_t i=0;i<running;++i) {
+            if (offline[i]) continue;
+            FFBUFFER *b = workers[i]->get_out_buffer();
+            if (b && !b->empty()) return true;
+        }
+        return false;
+    }
+    inline void detach_notifiers() {
+        for(size_t i=0;i<workers.size();++i)
+            ff_detach_cons(workers[i]->get_out_buffer(), ntf_in);
+        ff_detach_prod(filter ? filter->get_out_buffer() : buffer, ntf_out);
+        ntf_attached = false;
+        if (filter) filter->detach_notifiers();
+    }
+
     virtual ssize_t gather_task(void ** task) {
+        const bool batch_in = batched && !blocking_in;
+        if (mpop_first < mpop_last) { // tasks already drained from nextr
+            *task = mpop_buf[mpop_first++];
+            return nextr;
+        }
         unsigned int cnt;
         do {
             cnt=0;
             do {
                 nextr = selectworker();
                 //assert(offline[nextr]==false);
-                if (workers[nextr]->get(task)) {
-                    return nextr;
-                }
-                else if (++cnt == nattempts()) break;
+                if (batch_in) {
+                    mpop_last = workers[nextr]->mget(mpop_buf, FFBUFFER::MULTIPOP_BUFFER_SIZE);
+                    if (mpop_last) {
+                        mpop_first = 1;
+                        *task = mpop_buf[0];
+                        return nextr;
+                    }
+                } else 
+                    if (workers[nextr]->get(task)) {
+                        return nextr;
+                    }
+                if (++cnt == nattempts()) break;
             } while(1);
-            if (blocking_in) {
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m, &tv);
-                pthread_mutex_unlock(cons_m);
-            } else losetime_in();
+            flush_batch(); // the input channels are idle
+            if (filter) filter->idlenotify();
+            if (blocking_in) wait_input([this]() { return input_ready(); });
+            else losetime_in();
         } while(1);
         return -1;
     }
@@ -224,30 +277,21 @@ protected:
      */
     inline bool push(void * task, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
         if (blocking_out) {
-            if (!filter) {
-                bool empty=buffer->empty();
-                while(!buffer->push(task)) {
-                    empty = false;
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(prod_m);
-                    pthread_cond_timedwait(prod_c,prod_m, &tv);
-                    pthread_mutex_unlock(prod_m);  
-                }
-                if (empty) pthread_cond_signal(p_cons_c);
-            } else {
-                bool empty=filter->get_out_buffer()->empty();
-                while(!filter->push(task)) {
-                    empty=false;
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(prod_m);
-                    pthread_cond_timedwait(prod_c,prod_m,&tv);
-                    pthread_mutex_unlock(prod_m);      
+            // the next stage is woken up by the channel (if it is parked)
+            FFBUFFER * const b = filter ? filter->get_out_buffer() : buffer;
+            while(!(filter ? filter->push(task) : buffer->push(task)))
+                wait_output(b, [b]() { return b && b->available(); });
+            return true;
+        }
+        if (batched) {
+            FFBUFFER * const b = filter ? filter->get_out_buffer() : buffer;
+            if (b && (b->pushPMF == &FFBUFFER::push)) {
+                for(unsigned long i=0;i<retry;++i) {
+                    if (b->mpush(task)) return true;
+                    losetime_out(ticks);
                 }
-                if (empty) pthread_cond_signal(p_cons_c);
+                return false;
             }
-            return true;
         }
         if (!filter) {
             for(unsigned long i=0;i<retry;++i) {
@@ -262,6 +306,19 @@ protected:
         return false;        
     }
 
+    /**
+     * \brief Publishes the tasks kept in the output batch
+     *
+     * It is a no-op if the batched mode is not set (see batched_mode).
+     *
+     * \return \p false if the batch cannot be published (output channel full)
+     */
+    inline bool flush_batch() {
+        if (!batched || blocking_out) return true;
+        FFBUFFER * const b = filter ? filter->get_out_buffer() : buffer;
+        return b ? b->flush() : true;
+    }
+
     /**
      * \brief Pop a task out of the queue.
      *
@@ -347,21 +404,30 @@ public:
         buffer         = gtin.buffer;
         blocking_in    = gtin.blocking_in;
         blocking_out   = gtin.blocking_out;
+        batched        = gtin.batched;
+        numa           = gtin.numa;
         skip1pop       = gtin.skip1pop;
         frominput      = gtin.frominput;
         filter         = gtin.filter;
         workers        = gtin.workers;
         
+        ntf_in       = gtin.ntf_in;
+        ntf_out      = gtin.ntf_out;
+        
         gtin.cons_m = nullptr;
         gtin.cons_c = nullptr;
         gtin.prod_m = nullptr;
         gtin.prod_c = nullptr;
+        gtin.ntf_in = nullptr;
+        gtin.ntf_out= nullptr;
         
         gtin.set_barrier(nullptr);
         return *this;
     }
     
     virtual ~ff_gatherer() {
+        if (ntf_in)  delete ntf_in;
+        if (ntf_out) delete ntf_out;
         if (cons_m) {
             pthread_mutex_destroy(cons_m);
             free(cons_m);
@@ -543,6 +609,14 @@ public:
             if (filter) filter->setCPUId(cpuId);
         }
 #endif        
+        if (numa && this->get_mapping()) {
+            const int node = ff_numaNodeOfCpu((int)ff_getMyCore());
+            if (node>=0)
+                for(ssize_t i=0;i<running;++i) {
+                    FFBUFFER * const b = workers[i]->get_out_buffer();
+                    if (b) b->numa_bind(node);
+                }
+        }
         gettimeofday(&tstart,NULL);
         for(ssize_t i=0;i<running;++i)  offline[i]=false;
         if (filter) {
@@ -632,7 +706,7 @@ public:
                 }
 
                 // if the filter returns EOS or GO_OUT we exit immediatly
-                if (task == FF_GO_ON) continue;                
+                if (task == FF_GO_ON) { flush_batch(); continue; }
                 if ((task == FF_GO_OUT) || (task == FF_EOS_NOFREEZE) || (task == FF_EOSW) ) {
                     ret = task;
                     break;   // exiting from the loop without sending the task
@@ -665,6 +739,7 @@ public:
                 if (outpresent) push(FF_EOS);
         }
         if (ret == FF_EOSW) ret = FF_EOS; // EOSW is like an EOS but it is not propagated
+        while(!flush_batch()) losetime_out();
         
         gettimeofday(&wtstop,NULL);
         wttime+=diffmsec(wtstop,wtstart);
@@ -681,6 +756,7 @@ public:
      *
      */
     virtual void svc_end() {
+        detach_notifiers();
         if (filter) filter->svc_end();
         gettimeofday(&tstop,NULL);
     }
@@ -720,6 +796,23 @@ public:
         blocking_in = blocking_out = blk;
     }
 
+    /* 
+     * Batched channel mode (see ff_node::batched_mode): the output tasks are
+     * buffered and published in batches, the input channels are drained up to
+     * a cache line of slots at a time. It is used only in nonblocking mode.
+     */
+    void batched_mode(bool onoff=true) {
+        batched = onoff;
+    }
+
+    /*
+     * NUMA mode (see ff_node::numa_mode): the output channels of the
+     * workers are placed on the memory node of the collector's CPU.
+     */
+    void numa_mode(bool onoff=true) {
+        numa = onoff;
+    }
+
     void no_mapping() {
         default_mapping = false;
     }
@@ -731,6 +824,14 @@ public:
         return r;
     }
 
+    // the thread may be thawed again after the end (e.g. the collector of a
+    // farm that is a worker of another farm), see thaw
+    inline int wait() {
+        int r = ff_thread::wait();
+        running = -1;
+        return r;
+    }
+
     /**
      *
      * \brief It gathers all tasks.
@@ -767,11 +868,8 @@ public:
             }
             else {
                 if (blocking_in) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
+                    FFBUFFER *b = _workers[channelid]->get_out_buffer();
+                    wait_input([b]() { return b && !b->empty(); });
                 } else losetime_in();
             }
         }
@@ -916,8 +1014,17 @@ protected:
     pthread_mutex_t   *p_cons_m = nullptr;
     pthread_cond_t    *p_cons_c = nullptr;
 
+    // where the gatherer parks in blocking mode (see wait_input/wait_output)
+    ff_notifier       *ntf_in  = nullptr;
+    ff_notifier       *ntf_out = nullptr;
+    bool               ntf_attached = false;
+
     bool               blocking_in;
     bool               blocking_out;
+    bool               batched = false;  // see batched_mode
+    bool               numa = false;     // see numa_mode
+    size_t             mpop_first=0, mpop_last=0;
+    void             * mpop_buf[FFBUFFER::MULTIPOP_BUFFER_SIZE];
 
 #if defined(TRACE_FASTFLOW)
     unsigned long taskcnt;
@@ -0,0 +1,230 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \file keyed_policies.hpp
+ *  \ingroup building_blocks
+ *  \brief Implements the key-partitioned scheduling policy
+ *
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Key-partitioned scheduling: all the data elements with the same key are
+ * sent to the same destination, so that stateful workers see all the
+ * elements of their keys. The key is extracted by a user's function and
+ * mapped onto the destinations with the jump consistent hash (Lamping and
+ * Veach), therefore when the number of destinations changes from n to n+1
+ * only 1/(n+1) of the keys move. The mapping does not depend on the sender,
+ * all the senders of an all-to-all send a key to the same destination.
+ *
+ * Optionally the hot keys can be spread over more destinations: the keys
+ * receiving more than a given fraction of the elements of a window are
+ * detected with the space-saving algorithm and, starting from the next
+ * window, they are sent round-robin to 'fanout' consecutive destinations.
+ * The partial results of a hot key have then to be merged downstream, for
+ * example by an ff_key_combiner.
+ *
+ * Usage:
+ *    ff_keyed_policy P([](void *t) { return (uint64_t)((item_t*)t)->key; });
+ *    P.set_hotkeys(0.1, 2);          // optional
+ *    farm.set_scheduling_keyed(P);   // or a2a.set_scheduling_keyed(P)
+ */
+
+#ifndef FF_KEYED_POLICIES_HPP
+#define FF_KEYED_POLICIES_HPP
+
+#include <cstdint>
+#include <vector>
+#include <functional>
+#include <unordered_map>
+
+#include <ff/lb.hpp>
+#include <ff/multinode.hpp>
+
+namespace ff {
+
+// the jump consistent hash, it returns a destination in [0..n)
+static inline size_t ff_jump_hash(uint64_t key, size_t n) {
+    int64_t b = -1, j = 0;
+    while (j < (int64_t)n) {
+        b   = j;
+        key = key * 2862933555777941757ULL + 1;
+        j   = (int64_t)((b + 1) * (double(1LL << 31) / double((key >> 33) + 1)));
+    }
+    return (size_t)b;
+}
+
+// the keys are often small integers, they are mixed before the hashing
+static inline uint64_t ff_mix64(uint64_t k) {
+    k ^= k >> 30; k *= 0xbf58476d1ce4e5b9ULL;
+    k ^= k >> 27; k *= 0x94d049bb133111ebULL;
+    return k ^ (k >> 31);
+}
+
+/*
+ * The policy is stateful (hot-key detection), each sender has its own copy.
+ */
+class ff_keyed_policy {
+public:
+    typedef std::function<uint64_t(void*)> key_f;
+    enum { HOT_COUNTERS=32, HOT_WINDOW=4096 };
+
+    ff_keyed_policy() {}
+    ff_keyed_policy(key_f keyf):keyf(keyf) {}
+
+    /**
+     * \brief Enables the hot-key detection.
+     *
+     * A key receiving more than \param threshold (a fraction in (0,1)) of the
+     * elements of a window of \param window elements is sent to \param fanout
+     * destinations during the next window. Only the keys above 1/HOT_COUNTERS
+     * are surely detected.
+     */
+    void set_hotkeys(double threshold, size_t fanout=2, size_t window=HOT_WINDOW) {
+        hot_th = threshold; hot_fanout = fanout; hot_window = window;
+    }
+
+    bool enabled() const { return (bool)keyf; }
+
+    /**
+     * \brief Sets the salt mixed with the keys before the hashing.
+     *
+     * In a tree of schedulers (e.g. ff_farm::set_hierarchical) each level
+     * has to use a different salt: with the same hash the destination chosen
+     * at a level would determine the one chosen at the next level.
+     */
+    void set_salt(uint64_t s) { salt = s; }
+    uint64_t get_salt() const { return salt; }
+
+    // it returns the destination of task in [0..n)
+    inline size_t select(void *task, size_t n) {
+        const uint64_t key = keyf(task);
+        size_t d = ff_jump_hash(ff_mix64(key ^ salt), n);
+        if (hot_th > 0.0) {
+            for(auto &h: hot)
+                if (h.key == key) {
+                    const size_t f = (std::min)(hot_fanout, n);
+                    if (f > 1) {
+                        d = (d + (h.next++ % f)) % n;
+                        ++nsplit;
+                    }
+                    break;
+                }
+            sample(key);
+        }
+        return d;
+    }
+
+    // the hot keys of the current window
+    std::vector<uint64_t> hotkeys() const {
+        std::vector<uint64_t> r;
+        for(auto &h: hot) r.push_back(h.key);
+        return r;
+    }
+    // number of elements sent to a destination different from the key's one
+    size_t getnsplit() const { return nsplit; }
+
+protected:
+    // space-saving algorithm on HOT_COUNTERS counters
+    inline void sample(uint64_t key) {
+        if (++seen == hot_window) {
+            hot.clear();
+            for(auto &c: C)
+                if ((double)(c.count - c.err) > hot_th * hot_window) hot.push_back({c.key, 0});
+            C.clear();
+            seen = 0;
+            return;
+        }
+        for(auto &c: C)
+            if (c.key == key) { ++c.count; return; }
+        if (C.size() < HOT_COUNTERS) { C.push_back({key, 1, 0}); return; }
+        counter_t *m = &C[0];
+        for(auto &c: C)
+            if (c.count < m->count) m = &c;
+        *m = {key, m->count+1, m->count};
+    }
+
+    struct counter_t { uint64_t key; size_t count, err; };
+    struct hotkey_t  { uint64_t key; size_t next; };
+
+    key_f  keyf;
+    uint64_t salt     = 0;
+    double hot_th     = 0.0;
+    size_t hot_fanout = 2;
+    size_t hot_window = HOT_WINDOW;
+    size_t seen       = 0;
+    size_t nsplit     = 0;
+    std::vector<counter_t> C;
+    std::vector<hotkey_t>  hot;
+};
+
+// load balancer used by the farm and by the nodes of the first set of the
+// all-to-all when the key-partitioned scheduling is set
+struct keyed_lb: ff_loadbalancer {
+    keyed_lb(int max_num_workers, const ff_keyed_policy &P):ff_loadbalancer(max_num_workers),P(P) {}
+
+    inline bool schedule_task(void * task, unsigned long retry, unsigned long ticks) {
+        // the first get_num_feedbackchannels() channels are feedback channels
+        const size_t fb = get_num_feedbackchannels();
+        const size_t n  = fb ? getNWorkers()-fb : getnworkers();
+        return ff_loadbalancer::ff_send_out_to(task, int(fb + P.select(task, n)), retry, ticks);
+    }
+    ff_keyed_policy P;
+};
+
+/*
+ * Multi-input node merging the partial results of the keys spread over more
+ * workers (see ff_keyed_policy::set_hotkeys). The results with the same key
+ * are merged with the user's function, the merged results are sent out when
+ * the EOS has been received from all the input channels.
+ */
+template<typename T>
+struct ff_key_combiner: ff_minode_t<T> {
+    typedef std::function<uint64_t(const T&)>  key_f;
+    typedef std::function<void(T&, const T&)>  merge_f;
+
+    ff_key_combiner(key_f keyf, merge_f mergef):keyf(keyf),mergef(mergef) {}
+
+    int svc_init() { neos = 0; return 0; }
+    T* svc(T *in) {
+        const uint64_t k = keyf(*in);
+        auto it = M.find(k);
+        if (it == M.end()) M.emplace(k, std::move(*in));
+        else mergef(it->second, *in);
+        delete in;
+        return this->GO_ON;
+    }
+    void eosnotify(ssize_t) {
+        if (++neos < this->get_num_inchannels()) return;
+        for(auto &p: M) this->ff_send_out(new T(std::move(p.second)));
+        M.clear();
+    }
+
+    key_f   keyf;
+    merge_f mergef;
+    size_t  neos = 0;
+    std::unordered_map<uint64_t, T> M;
+};
+
+} // namespace ff
+
+#endif /* FF_KEYED_POLICIES_HPP */
@@ -37,6 +37,7 @@
 
 #include <iosfwd>
 #include <deque>
+#include <vector>
 
 #include <ff/utils.hpp>
 #include <ff/node.hpp>
@@ -79,9 +80,57 @@ public:
     enum {TICKS2WAIT=1000};
 protected:
 
-    inline void put_done(int id) {
-        // here we access the cond variable of the worker, that must be initialized
-        pthread_cond_signal(&workers[id]->get_cons_c());
+    /*
+     * Blocking mode: the load-balancer parks on ntf_in waiting for a task on
+     * any of its input channels and on ntf_out waiting for a free slot in the
+     * workers' input channels. The notifiers are attached to all the channels
+     * the first time the load-balancer has to wait in a run and detached at
+     * the end of the run (detach_notifiers), the threads on the other side
+     * of the channels wake it up only if it is actually parked (see futex.hpp).
+     */
+    inline void attach_notifiers() {
+        if (!ntf_in)  ntf_in  = new ff_notifier;
+        if (!ntf_out) ntf_out = new ff_notifier;
+        ntf_cons.resize(0);
+        if (buffer) ntf_cons.push_back(buffer);
+        for(size_t i=0;i<availworkers.size();++i) {
+            FFBUFFER *b = availworkers[i]->get_out_buffer();
+            if (b) ntf_cons.push_back(b);
+        }
+        for(size_t i=0;i<ntf_cons.size();++i)
+            ff_attach_cons(ntf_cons[i], ntf_in);
+        for(size_t i=0;i<workers.size();++i)
+            ff_attach_prod(workers[i]->get_in_buffer(), ntf_out);
+        ntf_attached = true;
+    }
+    template<typename Cond>
+    inline void wait_input(Cond ready) {
+        if (!ntf_attached) attach_notifiers();
+        ntf_in->wait(ready, FF_TIMEDWAIT_NS);
+    }
+    template<typename Cond>
+    inline void wait_output(Cond ready) {
+        if (!ntf_attached) attach_notifiers();
+        ntf_out->wait(ready, FF_TIMEDWAIT_NS);
+    }
+    // true if there is at least one task in the input channels
+    inline bool input_ready() {
+        if (buffer && !buffer->empty()) return true;
+        for(size_t i=0;i<availworkers.size();++i) {
+            FFBUFFER *b = availworkers[i]->get_out_buffer();
+            if (b && !b->empty()) return true;
+        }
+        return false;
+    }
+    inline void detach_notifiers() {
+        // availworkers shrinks during the run, the attached channels are recorded
+        for(size_t i=0;i<ntf_cons.size();++i)
+            ff_detach_cons(ntf_cons[i], ntf_in);
+        ntf_cons.resize(0);
+        for(size_t i=0;i<workers.size();++i)
+            ff_detach_prod(workers[i]->get_in_buffer(), ntf_out);
+        ntf_attached = false;
+        if (filter) filter->detach_notifiers();
     }
     
     inline bool init_input_blocking(pthread_mutex_t   *&m,
@@ -148,6 +197,29 @@ protected:
     }
 
     void propagateEOS(void *task=FF_EOS) { push_eos(task); }
+
+    /**
+     * \brief Publishes the batches kept in the workers' input channels
+     *
+     * It is a no-op if the batched mode is not active (see batched_mode).
+     */
+    inline void flush_batch() {
+        if (!batch_out) return;
+        for(ssize_t i=0;i<running;++i) {
+            FFBUFFER * const b = workers[i]->get_in_buffer();
+            while(!b->flush()) losetime_out();
+        }
+    }
+
+    // batched mode is used only on SWSR (nonblocking) channels
+    inline bool batchable() {
+        if (!batched || blocking_out || feedbackid>0) return false;
+        for(ssize_t i=0;i<running;++i) {
+            FFBUFFER * const b = workers[i]->get_in_buffer();
+            if (!b || (b->pushPMF != &FFBUFFER::push)) return false;
+        }
+        return true;
+    }
     
     /** 
      * \brief Virtual function that can be redefined to implement a new scheduling
@@ -224,6 +296,16 @@ protected:
 #endif /* SPIN_USE_PAUSE */
     }
 
+    /**
+     * \brief Called each time the load-balancer finds no task in its input
+     * channels, before waiting (in blocking mode it is called again at
+     * least every FF_TIMEDWAIT_NS while the channels stay empty).
+     *
+     * It can be redefined to do some work while the farm is idle (e.g. the
+     * elastic farm runs its controller, see elastic.hpp).
+     */
+    virtual inline void idle() {}
+
     /** 
      * \brief Scheduling of tasks
      *
@@ -251,10 +333,8 @@ protected:
 #if defined(LB_CALLBACK)
                     task = callback(nextw, task);
 #endif
-                    bool empty=workers[nextw]->get_in_buffer()->empty();
                     if(workers[nextw]->put(task)) {
                         FFTRACE(++taskcnt);
-                        if (empty) put_done(nextw);
                         return true;
                     } 
                     ++cnt;
@@ -263,11 +343,8 @@ protected:
 
                 if (++r >= retry) return false;
                 
-                struct timespec tv;
-                timedwait_timeout(tv);                
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c, prod_m, &tv);
-                pthread_mutex_unlock(prod_m);
+                const ssize_t w = nextw;
+                wait_output([this,w]() { return workers[w]->get_in_buffer()->available(); });
             } while(1);
             return true;
         } // blocking 
@@ -279,7 +356,8 @@ protected:
 #if defined(LB_CALLBACK)
                 task = callback(nextw, task);
 #endif
-                if(workers[nextw]->put(task)) {
+                if(batch_out ? workers[nextw]->get_in_buffer()->mpush(task) :
+                               workers[nextw]->put(task)) {
                     FFTRACE(++taskcnt);
                     return true;
                 }
@@ -350,13 +428,9 @@ protected:
                     }
                 }
             } while(1);
-            if (blocking_in) {
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m, &tv);
-                pthread_mutex_unlock(cons_m);
-            } else losetime_in();
+            idle();
+            if (blocking_in) wait_input([this]() { return input_ready(); });
+            else losetime_in();
         } while(1);
         return ite;
     }
@@ -375,21 +449,15 @@ protected:
         if (blocking_in) {
             if (!filter) {
                 while (! buffer->pop(task)) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
-                } // while
+                    idle();
+                    wait_input([this]() { return !buffer->empty(); });
+                }
             } else  {                
                 if (cons_m) {                
                     while (! filter->pop(task)) {
-                        struct timespec tv;
-                        timedwait_timeout(tv);
-                        pthread_mutex_lock(cons_m);
-                        pthread_cond_timedwait(cons_c, cons_m, &tv);
-                        pthread_mutex_unlock(cons_m);
-                    } //while 
+                        idle();
+                        wait_input([this]() { return filter->in_active && input_ready(); });
+                    }
                 } else {
                     // NOTE:
                     // it may happen that the filter has been transformed
@@ -404,9 +472,9 @@ protected:
             return true;
         }
         if (!filter) 
-            while (! buffer->pop(task)) losetime_in();
+            while (! buffer->pop(task)) { flush_batch(); idle(); losetime_in(); }
         else 
-            while (! filter->pop(task)) losetime_in();
+            while (! filter->pop(task)) { flush_batch(); idle(); losetime_in(); }
         return true;
     }
     
@@ -509,15 +577,22 @@ public:
         buffer         = lbin.buffer;
         blocking_in    = lbin.blocking_in;
         blocking_out   = lbin.blocking_out;
+        batched        = lbin.batched;
+        numa           = lbin.numa;
         skip1pop       = lbin.skip1pop;
         filter         = lbin.filter;
         workers        = lbin.workers;
         manager        = lbin.manager;
         
+        ntf_in       = lbin.ntf_in;
+        ntf_out      = lbin.ntf_out;
+        
         lbin.cons_m = nullptr;
         lbin.cons_c = nullptr;
         lbin.prod_m = nullptr;
         lbin.prod_c = nullptr;
+        lbin.ntf_in = nullptr;
+        lbin.ntf_out= nullptr;
         lbin.set_barrier(nullptr);
         return *this;
     }
@@ -528,6 +603,8 @@ public:
      *  It deallocates dynamic memory spaces previoulsy allocated for workers.
      */
     virtual ~ff_loadbalancer() {
+        if (ntf_in)  delete ntf_in;
+        if (ntf_out) delete ntf_out;
         if (cons_m) {
             pthread_mutex_destroy(cons_m);
             free(cons_m);
@@ -681,6 +758,24 @@ public:
         blocking_in = blocking_out = blk;
     }
 
+    /* 
+     * Batched channel mode (see ff_node::batched_mode): tasks are buffered 
+     * in the workers' input channels and published in batches. 
+     * It is used only in nonblocking mode when there are neither feedback
+     * nor multiple input channels.
+     */
+    void batched_mode(bool onoff=true) {
+        batched = onoff;
+    }
+
+    /*
+     * NUMA mode (see ff_node::numa_mode): the input channel of the
+     * load-balancer is placed on the memory node of its CPU.
+     */
+    void numa_mode(bool onoff=true) {
+        numa = onoff;
+    }
+
     void no_mapping() {
         default_mapping = false;
     }
@@ -739,17 +834,11 @@ public:
         if (blocking_out) {
             unsigned long r=0;
         _retry:
-            bool empty=workers[id]->get_in_buffer()->empty();
             if (workers[id]->put(task)) {
                 FFTRACE(++taskcnt);
-                if (empty) put_done(id);
             } else {
                 if (++r >= retry) return false;
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c, prod_m, &tv);
-                pthread_mutex_unlock(prod_m);     
+                wait_output([this,id]() { return workers[id]->get_in_buffer()->available(); });
                 goto _retry;
             }
 #if defined(FF_TASK_CALLBACK)
@@ -758,7 +847,8 @@ public:
             return true;
         }
         for(unsigned long i=0;i<retry;++i) {
-            if (workers[id]->put(task)) {
+            if (batch_out ? workers[id]->get_in_buffer()->mpush(task) :
+                            workers[id]->put(task)) {
                 FFTRACE(++taskcnt);
 #if defined(FF_TASK_CALLBACK)
                 callbackOut(this);
@@ -779,29 +869,20 @@ public:
        std::vector<size_t> retry;
        if (blocking_out) {
            for(ssize_t i=0;i<running;++i) {
-               bool empty=workers[i]->get_in_buffer()->empty();
                if(!workers[i]->put(task))
                    retry.push_back(i);
-               else if (empty) put_done(i);
            }
            while(retry.size()) {
-               bool empty=workers[retry.back()]->get_in_buffer()->empty();
-               if(workers[retry.back()]->put(task)) {
-                   if (empty) put_done(retry.back());
-                   retry.pop_back();
-               } else {
-                   struct timespec tv;
-                   timedwait_timeout(tv);
-                   pthread_mutex_lock(prod_m);
-                   pthread_cond_timedwait(prod_c, prod_m, &tv);
-                   pthread_mutex_unlock(prod_m); 
-               }
+               const size_t w = retry.back();
+               if(workers[w]->put(task)) retry.pop_back();
+               else wait_output([this,w]() { return workers[w]->get_in_buffer()->available(); });
            }           
 #if defined(FF_TASK_CALLBACK)
            callbackOut(this);
 #endif
            return;
        }
+       flush_batch(); // the task must follow the batched ones
        for(ssize_t i=0;i<running;++i) {
            if(!workers[i]->put(task))
                retry.push_back(i);
@@ -843,11 +924,8 @@ public:
             }
             else {
                 if (blocking_in) {
-                    struct timespec tv;
-                    timedwait_timeout(tv);
-                    pthread_mutex_lock(cons_m);
-                    pthread_cond_timedwait(cons_c, cons_m, &tv);
-                    pthread_mutex_unlock(cons_m);
+                    FFBUFFER *b = _workers[input_channelid]->get_out_buffer();
+                    wait_input([b]() { return b && !b->empty(); });
                 } else losetime_in();
             }
         }
@@ -914,6 +992,7 @@ public:
             // therefore multiple node write in that queue and so the EOS has to be
             // notified only when 'neos' EOSs have been received. By default neos = 1
             int neos = filter?filter->neos:1;
+            batch_out = batchable();
             
             do {
 #ifdef DFF_ENABLED
@@ -958,7 +1037,7 @@ public:
                     ticksmax=(std::max)(ticksmax,diff);
 #endif  
 
-                    if (task == FF_GO_ON) continue;
+                    if (task == FF_GO_ON) { flush_batch(); continue; }
                     if ((task == FF_GO_OUT) || (task == FF_EOS_NOFREEZE)) {
                         ret = task;
                         break; // exiting from the loop without sending out the task
@@ -983,6 +1062,8 @@ public:
                 callbackOut(this);
 #endif
             } while(true);
+            flush_batch();
+            batch_out = false;
         } else {
             size_t nw=0;
             availworkers.resize(0);
@@ -1125,6 +1206,10 @@ public:
             if (filter) filter->setCPUId(cpuId);
         }
 #endif        
+        if (numa && buffer && this->get_mapping()) {
+            const int node = ff_numaNodeOfCpu((int)ff_getMyCore());
+            if (node>=0) buffer->numa_bind(node);
+        }
         gettimeofday(&tstart,NULL);
         if (filter) {
             if (filter->svc_init() <0) return -1;
@@ -1140,6 +1225,7 @@ public:
      *
      */
     virtual void svc_end() {
+        detach_notifiers();
         if (filter) filter->svc_end();        
         gettimeofday(&tstop,NULL);
     }
@@ -1504,8 +1590,36 @@ private:
     pthread_mutex_t    *prod_m = nullptr;
     pthread_cond_t     *prod_c = nullptr;
 
+    // where the load-balancer parks in blocking mode (see wait_input/wait_output)
+    ff_notifier        *ntf_in  = nullptr;
+    ff_notifier        *ntf_out = nullptr;
+    svector<FFBUFFER*>  ntf_cons;           // channels ntf_in is attached to
+    bool                ntf_attached = false;
+
     bool               blocking_in;
     bool               blocking_out;
+    bool               batched   = false;   // batched mode requested
+    bool               numa      = false;   // see numa_mode
+    bool               batch_out = false;   // batched mode active in the current run
+
+    // used by the elastic farm (see elastic.hpp) to park/resume the last workers
+    inline void set_running(ssize_t r) { running = r; }
+    inline bool isfrozen_worker(size_t i) const { return workers[i]->isfrozen(); }
+    inline void freeze_worker(size_t i) { workers[i]->freeze(); }
+    // the worker is thawed once it has reached the frozen state after having
+    // consumed its input channel (the FF_GO_OUT is the last task): if it was
+    // frozen again before waking up from the previous thaw, it is thawed
+    // (keeping the freezing) until it reaches the FF_GO_OUT
+    inline int thaw_worker(size_t i, bool _freeze) {
+        FFBUFFER * const b = workers[i]->get_in_buffer();
+        while(1) {
+            if (workers[i]->wait_freezing()<0) return -1;
+            if (!b || b->empty()) break;
+            workers[i]->thaw(true);
+        }
+        workers[i]->thaw(_freeze);
+        return 0;
+    }
 
 #ifdef DFF_ENABLED
     bool               _skipallpop = false;    
@@ -1523,6 +1637,63 @@ private:
 #endif
 };
 
+/*!
+ *  \class twochoices_lb
+ *  \ingroup building_blocks
+ *
+ *  \brief Load balancer implementing the power-of-two-choices scheduling
+ *
+ *  For each task two distinct workers are chosen at random and the task
+ *  is sent to the one with the shorter input queue. The lengths of the
+ *  queues are cached in the load-balancer: the length of a worker's queue
+ *  is read again (touching the pop counter written by the worker, see
+ *  uSWSR_Ptr_Buffer::occupancy) only if it has been read more than
+ *  \p refresh tasks before, in the meantime the cached value is
+ *  incremented for each task sent to the worker.
+ *  The selection costs O(1) independently of the number of workers.
+ *
+ *  It is used by the farm when set_scheduling_twochoices is called.
+ *
+ *  This class is defined in \ref lb.hpp
+ */
+class twochoices_lb: public ff_loadbalancer {
+public:
+    twochoices_lb(int max_num_workers, size_t refresh=16):
+        ff_loadbalancer(max_num_workers),refresh(refresh),ntasks(refresh) {}
+
+protected:
+    inline size_t selectworker() {
+        const size_t n = getnworkers();
+        if (n <= 1) return 0;
+        if (hints.size() < n) hints.resize(n, {0, 0});
+        ++ntasks;
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+        const size_t a = seed % n;
+        const size_t b = (a + 1 + (seed >> 32) % (n-1)) % n;
+        const size_t w = (length(a) <= length(b)) ? a : b;
+        ++hints[w].len;
+        return w;
+    }
+
+    // cached length of the input queue of worker i
+    inline unsigned long length(size_t i) {
+        hint_t &h = hints[i];
+        if (ntasks - h.stamp >= refresh) {
+            const FFBUFFER *b = getWorkers()[i]->get_in_buffer();
+            // not length(): the worker may release the buffer it dereferences
+            h.len   = b ? b->occupancy() : 0;
+            h.stamp = ntasks;
+        }
+        return h.len;
+    }
+
+    struct hint_t { unsigned long len, stamp; };
+
+    const size_t        refresh;
+    unsigned long       ntasks;            // the first lengths are read at the first tasks
+    uint64_t            seed   = 0x9E3779B97F4A7C15ULL;
+    std::vector<hint_t> hints;
+};
 
 } // namespace ff
 
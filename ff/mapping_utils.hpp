@@ -44,6 +44,8 @@
 
 #include <climits>
 #include <set>
+#include <vector>
+#include <string>
 #include <algorithm>
 #include <iosfwd>
 #include <errno.h>
@@ -347,6 +349,88 @@ static inline ssize_t ff_numSockets() {
 }
 
 
+/**
+ *  \brief Returns the number of NUMA memory nodes on the system.
+ *
+ *  It counts the nodes listed in /sys/devices/system/node. It works on Linux
+ *  OS, on the other systems (or if the kernel does not export the NUMA
+ *  topology) a single node is assumed.
+ *
+ *  \return An integer value showing the number of NUMA nodes.
+ */
+static inline ssize_t ff_numNumaNodes() {
+    ssize_t n=0;
+#if defined(__linux__)
+    for(int i=0;i<(int)(8*sizeof(unsigned long));++i) {
+        std::string str="/sys/devices/system/node/node"+std::to_string(i)+"/cpulist";
+        FILE *f = fopen(str.c_str(), "r");
+        if (!f) continue;   // node ids might not be contiguous
+        fclose(f);
+        ++n;
+    }
+#endif
+    return (n>0)?n:1;
+}
+
+/**
+ *  \brief Returns the CPUs of the given NUMA node
+ *
+ *  It parses the cpulist file (e.g. "0-7,16-23") of the node \p node.
+ *  It works on Linux OS.
+ *
+ *  \param node the NUMA node
+ *  \param cpus output vector, it contains the CPU ids in increasing order
+ *
+ *  \return the number of CPUs found, -1 if the node does not exist.
+ */
+static inline ssize_t ff_numaNodeCpus(int node, std::vector<int> &cpus) {
+    cpus.clear();
+#if defined(__linux__)
+    std::string str="/sys/devices/system/node/node"+std::to_string(node)+"/cpulist";
+    FILE *f = fopen(str.c_str(), "r");
+    if (!f) return -1;
+    int first, last;
+    while(fscanf(f, "%d", &first) == 1) {
+        last = first;
+        int c = fgetc(f);
+        if (c == '-') {
+            if (fscanf(f, "%d", &last) != 1) break;
+            c = fgetc(f);
+        }
+        for(int i=first;i<=last;++i) cpus.push_back(i);
+        if (c != ',') break;
+    }
+    fclose(f);
+    return cpus.size();
+#else
+    (void)node;
+    return -1;
+#endif
+}
+
+/**
+ *  \brief Returns the NUMA node of the given CPU
+ *
+ *  It works on Linux OS.
+ *
+ *  \param cpu_id the CPU id
+ *
+ *  \return the node to which the CPU belongs, -1 if it cannot be found.
+ */
+static inline int ff_numaNodeOfCpu(int cpu_id) {
+#if defined(__linux__)
+    if (cpu_id<0) return -1;
+    std::vector<int> cpus;
+    for(int i=0;i<(int)(8*sizeof(unsigned long));++i) {
+        if (ff_numaNodeCpus(i, cpus)<0) continue;
+        if (std::find(cpus.begin(), cpus.end(), cpu_id) != cpus.end()) return i;
+    }
+#else
+    (void)cpu_id;
+#endif
+    return -1;
+}
+
 /**
  * \brief Sets the scheduling priority
  *
@@ -72,6 +72,7 @@ protected:
         virtual inline void setMaxTasks(size_t) {}
         virtual inline void activate(bool) {}
         virtual inline void alloc_and_send(std::vector<param_info> &, base_f_t *) {}
+        virtual inline void setRuntime(TaskWSRuntime *) {}
         virtual inline void thaw(bool /*freeze*/=false,ssize_t=-1) {};
         virtual inline int  wait_freezing() { return 0; };
     };
@@ -79,17 +80,19 @@ protected:
     class GD: public base_gd {
     public:
         GD(void(*F)(T*const), T*const args):
-            active(false),F(F),args(args),ntasks(0),maxMsgs(DEFAULT_OUTSTANDING_TASKS),TASKS(maxMsgs) {}
+            active(false),F(F),args(args),ntasks(0),maxMsgs(DEFAULT_OUTSTANDING_TASKS),TASKS(maxMsgs),rt(nullptr) {}
 
         void setMaxTasks(size_t maxtasks) {
             maxMsgs = maxtasks;
             TASKS.resize(maxMsgs);
         }
         void activate(bool a) { active=a;}
+        void setRuntime(TaskWSRuntime *r) { rt=r; }
         void thaw(bool freeze=false,ssize_t=-1) { ff_node::thaw(freeze); };
         int  wait_freezing() { return ff_node::wait_freezing(); };
         int  wait() { return ff_node::wait(); }
         inline void alloc_and_send(std::vector<param_info> &P, base_f_t *wtask) {
+            if (wtask && rt->enabled()) { rt->submit(P, wtask); return; }
             task_f_t *task = &(TASKS[ntasks++ % maxMsgs]);
             task->P     = P;
             task->wtask = wtask;
@@ -98,8 +101,15 @@ protected:
 
         void *svc(void *) {
             if (!active) return EOS;
-            F(args);
             std::vector<param_info> useless;
+            if (rt->enabled()) { // it starts the workers, the tasks go directly to the runtime
+                while(!ff_send_out(TaskWSRuntime::token(), -1, 1)) ff_relax(1);
+                F(args);
+                rt->close();
+                alloc_and_send(useless, nullptr); // END task
+                return EOS;
+            }
+            F(args);
             alloc_and_send(useless, nullptr); // END task
             return EOS;
         }
@@ -110,6 +120,7 @@ protected:
         T*const args;      // F's arguments
         unsigned long ntasks, maxMsgs;
         std::vector<task_f_t> TASKS;    // FIX: svector should be used here
+        TaskWSRuntime *rt;
     };
         
     /* --------------  scheduler ----------------------------- */
@@ -122,24 +133,55 @@ protected:
         using baseSched::handleCompletedTask;
         enum { RELAX_MIN_BACKOFF=1, RELAX_MAX_BACKOFF=32};
     public:
-        Scheduler(ff_loadbalancer* lb, const int maxnw, void (*schedRelaxF)(unsigned long)):
+        Scheduler(ff_loadbalancer* lb, const int maxnw, void (*schedRelaxF)(unsigned long),
+                  TaskWSRuntime *rt, const size_t *localityTh):
             TaskFScheduler<task_f_t, compare_t>(lb,maxnw),
             task_numb(0),task_completed(0),bk_count(0),schedRelaxF(schedRelaxF),
-            gd_ended(false) {
+            gd_ended(false),wsactive(0),rt(rt),localityTh(localityTh) {
         }
         virtual ~Scheduler() {}
 
         int svc_init() {
+            baseSched::setLocality(*localityTh);
             if (baseSched::svc_init()<0) return -1;
             ff_node::input_active(true);
 
             task_numb = task_completed = 0, bk_count = 0;
-            m=0; gd_ended = false;
+            m=0; gd_ended = false; wsactive = 0;
 
             return 0;
         }
 
+        /*
+         * Work-stealing mode: from the input it receives the task that
+         * starts the workers and the END task, from the workers the token
+         * when they leave the runtime.
+         */
+        task_f_t* svc_ws(task_f_t* task) {
+            if (!task) {
+                if (schedRelaxF) schedRelaxF(++bk_count);
+                else ff_relax(RELAX_MIN_BACKOFF);
+                return baseSched::GO_ON;
+            }
+            if (baseSched::fromInput()) {
+                if ((void*)task == TaskWSRuntime::token()) {
+                    wsactive = lb->getnworkers();
+                    rt->start(wsactive);
+                    lb->broadcast_task(TaskWSRuntime::token());
+                    return baseSched::GO_ON;
+                }
+                gd_ended = true;
+                ff_node::input_active(false); // we don't want to read FF_EOS
+            } else --wsactive;
+            if (gd_ended && wsactive == 0) {
+                rt->reset();
+                return baseSched::EOS;
+            }
+            return baseSched::GO_ON;
+        }
+
         task_f_t* svc(task_f_t* task) {
+            if (rt->enabled()) return svc_ws(task);
             if (!task) {
                 if (!gd_ended && (task_numb-task_completed)<(unsigned long)baseSched::LOWER_TH)
                     ff_node::input_active(true); // start receiveing from input channel again
@@ -180,6 +222,9 @@ protected:
         size_t                         task_numb, task_completed, bk_count,m;
         void                         (*schedRelaxF)(unsigned long);
         bool                           gd_ended;
+        size_t                         wsactive;
+        TaskWSRuntime                 *rt;
+        const size_t                  *localityTh;
     };
 
     inline void reset() {
@@ -188,10 +233,16 @@ protected:
 	
     /* --------------  worker ------------------------------- */
     struct TaskFWorker: ff_node_t<hash_task_t> {
+        TaskFWorker(TaskWSRuntime *const rt):rt(rt) {}
         inline hash_task_t *svc(hash_task_t *task) {
+            if ((void*)task == TaskWSRuntime::token()) { // work-stealing mode
+                rt->run(get_my_id());
+                return task;
+            }
             task->wtask->call();
             return task;
         }
+        TaskWSRuntime *const rt;
     };
 
     /// task function
@@ -217,16 +268,18 @@ public:
     template<typename T1, typename compare_t = CompareTask_Par>
     ff_mdf(void (*F)(T1*const), T1*const args, size_t outstandingTasks=DEFAULT_OUTSTANDING_TASKS,
            int maxnw=ff_realNumCores(), void (*schedRelaxF)(unsigned long)=NULL):
-        ff_pipeline(false,outstandingTasks), farmworkers(maxnw) { //NOTE: pipe has fixed size queue by default 
+        ff_pipeline(false,outstandingTasks,outstandingTasks,true), farmworkers(maxnw), localityTh(0), wsrt(maxnw) { //NOTE: the GD ring (TASKS) relies on a fixed size queue
         GD<T1> *_gd   = new GD<T1>(F,args);
         _gd->setMaxTasks(outstandingTasks+16); // NOTE: TASKS must be greater than pipe's queue!
+        _gd->setRuntime(&wsrt);
+        wsrt.setMaxOutstanding((std::max)(outstandingTasks, (size_t)1024));
         farm = new ff_farm(false,640*maxnw,1024*maxnw,true,maxnw,true);
 	    
         std::vector<ff_node *> w;
         // NOTE: Worker objects are going to be destroyed by the farm destructor
-        for(int i=0;i<maxnw;++i) w.push_back(new TaskFWorker);
+        for(int i=0;i<maxnw;++i) w.push_back(new TaskFWorker(&wsrt));
         farm->add_workers(w);
-        farm->add_emitter(sched = new Scheduler<compare_t>(farm->getlb(), maxnw, schedRelaxF));
+        farm->add_emitter(sched = new Scheduler<compare_t>(farm->getlb(), maxnw, schedRelaxF, &wsrt, &localityTh));
         farm->wrap_around();
 	    
         ff_pipeline::add_stage(_gd);
@@ -259,6 +312,24 @@ public:
         farmworkers=(std::min)(ff_numCores(),nw); 
     }	
     void setThreshold(size_t /*th*/=0) {} // FIX: 
+
+    /**
+     * Work-stealing mode: the graph descriptor inserts the tasks directly
+     * into a runtime with per-worker deques and a sharded dependency table,
+     * the worker that completes a task schedules its ready successors.
+     * It is meant for fine-grained tasks, for which the single scheduler
+     * thread is the bottleneck. It can be changed only between two runs.
+     */
+    inline void enableWorkStealing(bool onoff=true) { wsrt.enable(onoff); }
+
+    /**
+     * Locality-aware dispatch: a ready task is sent to the worker that
+     * executed the last writer of its input parameters, so that it finds
+     * the data in that worker's cache, as long as the worker has less than
+     * th tasks scheduled. Otherwise it goes to the least loaded worker.
+     * 0 disables it (default). It can be changed only between two runs.
+     */
+    inline void setLocality(size_t th=2) { localityTh = th; }
 	
 
     // FIX: TODO
@@ -276,7 +347,9 @@ public:
     virtual inline int run_then_freeze(ssize_t nw=-1) {
         if (nw>0) setNumWorkers(nw);
         ff_pipeline::thaw(true, farmworkers);
-        return ff_pipeline::wait_freezing();
+        const int r = ff_pipeline::wait_freezing();
+        reset();  // the scheduler does not read the EOS of the graph descriptor
+        return r;
     }
 
     double ffTime() { return ff_pipeline::ffTime(); }
@@ -284,9 +357,11 @@ public:
     
 protected:
     int farmworkers;   // n. of workers in the farm
+    size_t localityTh; // locality-aware dispatch threshold (0 disabled)
     base_gd   *gd;     // first stage
     ff_farm   *farm;   // second stage
     ff_node   *sched;  // farm's scheduler
+    TaskWSRuntime wsrt;
 };
 
 } // namespace
@@ -899,6 +899,10 @@ struct ff_minode_t: ff_minode {
                                b.setBuffer(p.first, p.second);
                                return datacopied;
                            };
+    } else if constexpr (traits::is_zerocopy_v<OUT_t>) {
+        this->serializeF = [](void* o, dataBuffer& b) -> bool {
+                               return zerocopySerialize<OUT_t>(reinterpret_cast<OUT_t*>(o), b);
+                           };
     } else if constexpr (cereal::traits::is_output_serializable<OUT_t, cereal::PortableBinaryOutputArchive>::value) {
         this->serializeF = [](void* o, dataBuffer& b) -> bool {
                                std::ostream oss(&b);
@@ -916,6 +920,16 @@ struct ff_minode_t: ff_minode {
                                  assert(ptr);
                                  return ptr;
                              };
+    } else if constexpr (traits::is_zerocopy_v<IN_t>) {
+        // same predicate of the sender, the user's alloctask is honoured (copy)
+        if constexpr (traits::has_alloctask_v<IN_t>)
+            this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
+                                     return zerocopyDeserialize<IN_t>(b, datacopied, this->alloctaskF);
+                                 };
+        else
+            this->deserializeF = [](dataBuffer& b, bool& datacopied) -> void* {
+                                     return zerocopyDeserialize<IN_t>(b, datacopied);
+                                 };
     } else if constexpr(cereal::traits::is_input_serializable<IN_t, cereal::PortableBinaryInputArchive>::value) {
             this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
                                      std::istream iss(&b);
@@ -1001,6 +1015,10 @@ struct ff_monode_t: ff_monode {
                                b.setBuffer(p.first, p.second);
                                return datacopied;
                            };
+    } else if constexpr (traits::is_zerocopy_v<OUT_t>) {
+        this->serializeF = [](void* o, dataBuffer& b) -> bool {
+                               return zerocopySerialize<OUT_t>(reinterpret_cast<OUT_t*>(o), b);
+                           };
     } else if constexpr (cereal::traits::is_output_serializable<OUT_t, cereal::PortableBinaryOutputArchive>::value) {
             this->serializeF = [](void* o, dataBuffer& b) -> bool {
                                    std::ostream oss(&b);
@@ -1018,6 +1036,16 @@ struct ff_monode_t: ff_monode {
                                  assert(ptr);
                                  return ptr;
                              };
+    } else if constexpr (traits::is_zerocopy_v<IN_t>) {
+        // same predicate of the sender, the user's alloctask is honoured (copy)
+        if constexpr (traits::has_alloctask_v<IN_t>)
+            this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
+                                     return zerocopyDeserialize<IN_t>(b, datacopied, this->alloctaskF);
+                                 };
+        else
+            this->deserializeF = [](dataBuffer& b, bool& datacopied) -> void* {
+                                     return zerocopyDeserialize<IN_t>(b, datacopied);
+                                 };
     } else if constexpr(cereal::traits::is_input_serializable<IN_t, cereal::PortableBinaryInputArchive>::value){
             this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
                                      std::istream iss(&b);cereal::PortableBinaryInputArchive ar(iss);
@@ -1073,6 +1101,7 @@ struct internal_mo_transformer: ff_monode {
     inline void* svc(void* task) { return n->svc(task);}
     inline void svc_end() { return n->svc_end(); }
     inline void eosnotify(ssize_t id) { n->eosnotify(id); }
+    inline void idlenotify() { n->idlenotify(); }
 
     int create_input_buffer(int nentries, bool fixedsize=FF_FIXED_SIZE) {
         int r= ff_monode::create_input_buffer(nentries,fixedsize);
@@ -1217,6 +1246,7 @@ struct internal_mi_transformer: ff_minode {
     }
         
     inline void eosnotify(ssize_t id) { n->eosnotify(id); }
+    inline void idlenotify() { n->idlenotify(); }
 
     void set_id(ssize_t id) {
         if (n) n->set_id(id);
@@ -46,6 +46,7 @@
 #include <ff/config.hpp>
 #include <ff/svector.hpp>
 #include <ff/barrier.hpp>
+#include <ff/spinpark.hpp>
 #include <atomic>
 
 /* #include added to print sched_attr */
@@ -347,7 +348,7 @@ public:
 
         int CPUId = -1;
         if (default_mapping)
-            init_thread_affinity(attr, cpuId);
+            CPUId = init_thread_affinity(attr, cpuId);
         if (CPUId==-2) return -2;
 
         if (barrier)
@@ -536,6 +537,14 @@ private:
 
     bool              in_active;    // allows to disable/enable input tasks receiving   
     bool              my_own_thread;
+    bool              batched=false; // batched channel mode (see batched_mode)
+    bool              numa=false;    // NUMA placement of the input channel (see numa_mode)
+    size_t            mpop_first=0, mpop_last=0;
+    void            * mpop_buf[FFBUFFER::MULTIPOP_BUFFER_SIZE];
+    ff_spinpark     * park_in  = nullptr;  // adaptive waiting (see spinpark_mode)
+    ff_spinpark     * park_out = nullptr;
+    ff_notifier     * ntf_in   = nullptr;  // where the node parks (see futex.hpp)
+    ff_notifier     * ntf_out  = nullptr;
 
     ff_thread       * thread;       /// A \p thWorker object, which extends the \p ff_thread class 
     bool (*callback)(void *, int, unsigned long,unsigned long, void *);
@@ -559,28 +568,68 @@ protected:
     virtual inline bool push(void * ptr) { return out->push(ptr); }
     virtual inline bool pop(void ** ptr) { 
         if (!in_active) return false; // it does not want to receive data
+        if (batched) { // drains up to a cache line of slots at a time
+            if (mpop_first == mpop_last) {
+                mpop_first = 0;
+                mpop_last  = in->multipop(mpop_buf, FFBUFFER::MULTIPOP_BUFFER_SIZE);
+                if (!mpop_last) return false;
+            }
+            *ptr = mpop_buf[mpop_first++];
+            return true;
+        }
         return in->pop(ptr);
     }
+    // publishes the tasks kept in the output batch (see batched_mode)
+    virtual inline bool flush_batch() {
+        return (!batched || !out) ? true : out->flush();
+    }
+    // the notifiers are attached to the channels the first time the node
+    // has to wait, the consumer (producer) wakes up the node only if it
+    // is actually parked. The channel is not the node's one when the
+    // waiting thread is the one offloading tasks to an accelerator.
+    inline ff_notifier * in_notifier(FFBUFFER *b) {
+        if (!ntf_in) ntf_in = new ff_notifier;
+        ff_attach_cons(b, ntf_in);
+        return ntf_in;
+    }
+    inline ff_notifier * out_notifier(FFBUFFER *b) {
+        if (!ntf_out) ntf_out = new ff_notifier;
+        ff_attach_prod(b, ntf_out);
+        return ntf_out;
+    }
+    inline ff_notifier * in_notifier()  { return in_notifier(in);   }
+    inline ff_notifier * out_notifier() { return out_notifier(out); }
+    virtual inline void detach_notifiers() {
+        ff_detach_cons(in,  ntf_in);
+        ff_detach_prod(out, ntf_out);
+    }
+
+    // NUMA mode: called by the node's thread after it has been mapped
+    virtual void numa_bind_input() {
+        if (!in || !default_mapping) return;
+        const int node = ff_numaNodeOfCpu((int)ff_getMyCore());
+        if (node>=0) in->numa_bind(node);
+    }
+
     virtual inline bool Push(void *ptr, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
         if (blocking_out) {
-        retry:
-            bool empty=out->empty();
-            bool r = push(ptr);
-            if (r) { // OK
-                if (empty) pthread_cond_signal(p_cons_c);
-            } else { // FULL
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(prod_m);
-                pthread_cond_timedwait(prod_c,prod_m,&tv);
-                pthread_mutex_unlock(prod_m);
-                goto retry;
-            }
+            // the consumer is woken up by the channel (if it is parked)
+            while(!push(ptr))  // FULL
+                out_notifier()->wait([this]() { return out->available(); }, FF_TIMEDWAIT_NS);
             return true;
         }
+        if (batched && (out->pushPMF == &FFBUFFER::push)) {
+            for(unsigned long i=0;i<retry;++i) {
+                if (out->mpush(ptr)) { if (park_out) park_out->done(); return true; }
+                if (park_out) park_out->idle(*out_notifier(), [this]() { return out->available(); });
+                else losetime_out(ticks);
+            }     
+            return false;
+        }
         for(unsigned long i=0;i<retry;++i) {
-            if (push(ptr)) return true;
-            losetime_out(ticks);
+            if (push(ptr)) { if (park_out) park_out->done(); return true; }
+            if (park_out) park_out->idle(*out_notifier(), [this]() { return out->available(); });
+            else losetime_out(ticks);
         }     
         return false;
     }
@@ -588,22 +637,19 @@ protected:
     virtual inline bool Pop(void **ptr, unsigned long retry=((unsigned long)-1), unsigned long ticks=(TICKS2WAIT)) {
         if (blocking_in) {
             if (!in_active) { *ptr=NULL; return false; }
-        retry:
-            bool r = in->pop(ptr);
-            if (!r) { // EMPTY                
-                struct timespec tv;
-                timedwait_timeout(tv);
-                pthread_mutex_lock(cons_m);
-                pthread_cond_timedwait(cons_c, cons_m,&tv);
-                pthread_mutex_unlock(cons_m);
-                goto retry;
+            while(!in->pop(ptr)) { // EMPTY
+                idlenotify();
+                in_notifier()->wait([this]() { return !in->empty(); }, FF_TIMEDWAIT_NS);
             }
             return true;
         }
         for(unsigned long i=0;i<retry;++i) {
             if (!in_active) { *ptr=NULL; return false; }
-            if (pop(ptr)) return true;
-            losetime_in(ticks);
+            if (pop(ptr)) { if (park_in) park_in->done(); return true; }
+            if (batched) flush_batch(); // the input is idle
+            idlenotify();
+            if (park_in) park_in->idle(*in_notifier(), [this]() { return !in_active || !in->empty(); });
+            else losetime_in(ticks);
         } 
         return true;
     }
@@ -708,6 +754,12 @@ protected:
         in = new FFBUFFER(nentries,fixedsize);
         if (!in) return -1;
         myinbuffer=true;
+        // if the CPU of the node is already known, the storage is allocated on its
+        // node, otherwise on whole pages so that it can be moved (numa_bind_input)
+        if (numa) {
+            in->set_numa_pages();
+            if (CPUId>=0) in->numa_bind(ff_numaNodeOfCpu(CPUId));
+        }
         if (!in->init()) return -1;
         return 0;
     }
@@ -735,6 +787,8 @@ protected:
         out = new FFBUFFER(nentries,fixedsize); 
         if (!out) return -1;
         myoutbuffer=true;
+        // it may be moved to the node of the consumer (e.g. the gatherer)
+        if (numa) out->set_numa_pages();
         if (!out->init()) return -1;
         return 0;
     }
@@ -937,6 +991,10 @@ public:
     virtual  ~ff_node() {
         if (in && myinbuffer) delete in;
         if (out && myoutbuffer) delete out;
+        if (park_in)  delete park_in;
+        if (park_out) delete park_out;
+        if (ntf_in)   delete ntf_in;
+        if (ntf_out)  delete ntf_out;
         if (thread && my_own_thread) delete reinterpret_cast<thWorker*>(thread);
         if (cons_c && cons_m) {
             pthread_cond_destroy(cons_c);
@@ -1018,6 +1076,17 @@ public:
      */
     virtual void eosnotify(ssize_t /*id*/=-1) {}
 
+    /**
+     * \brief Idle callback
+     *
+     * This method is called by the node's thread when its input channels are empty,
+     * before waiting for new data. In blocking mode it is called again at least every
+     * FF_TIMEDWAIT_NS nanoseconds while the node keeps waiting, so it can be used
+     * to run time-driven actions (e.g. flushing a partially filled batch).
+     * It must not block and it cannot call ff_send_out.
+     */
+    virtual void idlenotify() {}
+
     /**
      * \brief Returns the number of EOS the node has to receive before terminating.
      */    
@@ -1122,6 +1191,17 @@ public:
      *
      */
     virtual inline bool  get(void **ptr) { return out->pop(ptr);}
+
+    /**
+     * \brief Nonblocking multi-pop from the output channel
+     *
+     * It pops at most \p len tasks updating the channel read index once.
+     *
+     * \return the number of tasks popped
+     */
+    virtual inline unsigned long mget(void **ptr, unsigned long len) { 
+        return out->multipop(ptr,len);
+    }
    
     virtual inline void losetime_out(unsigned long ticks=ff_node::TICKS2WAIT) {
         FFTRACE(lostpushticks+=ticks; ++pushwait);
@@ -1161,6 +1241,23 @@ public:
      */
     virtual FFBUFFER * get_out_buffer() const { return out;}
 
+    /**
+     * \brief Gets the adaptive waiting policy of the input (output) channel
+     *
+     * \return nullptr if the spinpark mode is not enabled
+     */
+    const ff_spinpark * get_spinpark_in()  const { return park_in; }
+    const ff_spinpark * get_spinpark_out() const { return park_out; }
+
+    /**
+     * \brief Gets the notifier on which the node parks waiting for the
+     * input (output) channel
+     *
+     * \return nullptr if the node has never waited on the channel
+     */
+    const ff_notifier * get_notifier_in()  const { return ntf_in; }
+    const ff_notifier * get_notifier_out() const { return ntf_out; }
+
     virtual const struct timeval getstarttime() const { return tstart;}
 
     virtual const struct timeval getstoptime()  const { return tstop;}
@@ -1212,6 +1309,7 @@ public:
     virtual void reset() {
         if (in)  in->reset();
         if (out) out->reset();
+        mpop_first = mpop_last = 0;
     }
 
     /** 
@@ -1345,6 +1443,12 @@ protected:
         blocking_out = n.blocking_out;
         default_mapping = n.default_mapping;
         in_active = n.in_active;
+        batched = n.batched;
+        numa = n.numa;
+        park_in = n.park_in;   park_out = n.park_out;
+        n.park_in = nullptr;   n.park_out = nullptr;
+        ntf_in  = n.ntf_in;    ntf_out  = n.ntf_out;
+        n.ntf_in  = nullptr;   n.ntf_out  = nullptr;
         cons_m = n.cons_m;  cons_c = n.cons_c;
         prod_m = n.prod_m;  prod_c = n.prod_c;
         barrier = n.barrier;
@@ -1384,6 +1488,44 @@ protected:
     virtual void blocking_mode(bool blk=true) {
         blocking_in = blocking_out = blk;
     }
+    /* 
+     * Batched channel mode: output tasks are buffered in the output channel
+     * (mpush) and published in batches, the batch is flushed when it is full,
+     * when svc returns GO_ON, when the input channel is idle and at the end
+     * of the stream. Input tasks are popped up to a cache line of slots at a 
+     * time (multipop). It is used only in nonblocking mode and it is not 
+     * suitable for multi-producer channels and on-demand scheduling.
+     */
+    virtual void batched_mode(bool onoff=true) {
+        batched = onoff;
+    }
+    /*
+     * Adaptive spin-then-park waiting: in nonblocking mode, when the input
+     * channel is empty (or the output channel is full) the node spins for a
+     * window learned from the waiting times observed so far and then parks
+     * on a futex until the other side of the channel wakes it up.
+     * See spinpark.hpp.
+     */
+    virtual void spinpark_mode(bool onoff=true) {
+        if (onoff) {
+            if (!park_in)  park_in  = new ff_spinpark;
+            if (!park_out) park_out = new ff_spinpark;
+            return;
+        }
+        if (park_in)  { delete park_in;  park_in  = nullptr; }
+        if (park_out) { delete park_out; park_out = nullptr; }
+    }
+    /*
+     * NUMA mode: the storage of the input channel (and of the buffers the
+     * producer will add to it if the channel is unbounded) is placed on the
+     * memory node of the CPU the node's thread is pinned to. The binding is
+     * done by the thread itself once it has been mapped; it has no effect if
+     * the thread is not mapped (no_mapping) or if the kernel does not support
+     * NUMA policies.
+     */
+    virtual void numa_mode(bool onoff=true) {
+        numa = onoff;
+    }
     virtual void no_barrier() {
         initial_barrier=false;
     }
@@ -1419,6 +1561,8 @@ private:
 
         inline bool get(void **ptr) { return filter->get(ptr);}
 
+        inline unsigned long mget(void **ptr, unsigned long len) { return filter->mget(ptr,len);}
+
         inline void* svc(void * ) {
             void * task = NULL;
             void * ret  = FF_EOS;
@@ -1475,6 +1619,7 @@ private:
                 filter->ticksmax=(std::max)(filter->ticksmax,diff);
 #endif           
 
+                if (ret == FF_GO_ON && filter->batched) filter->flush_batch();
                 if (ret == FF_GO_OUT) break;     
                 if (!ret || (ret >= FF_EOSW)) { // EOS or EOS_NOFREEZE or EOSW
                     // NOTE: The EOS is gonna be produced in the output queue
@@ -1490,6 +1635,9 @@ private:
 #endif
                 }
             } while(!exit);
+
+            if (filter->batched)
+                while(!filter->flush_batch()) filter->losetime_out();
             
             gettimeofday(&filter->wtstop,NULL);
             filter->wttime+=diffmsec(filter->wtstop,filter->wtstart);
@@ -1506,11 +1654,13 @@ private:
                 filter->setCPUId(cpuId);
             }
 #endif
+            if (filter->numa) filter->numa_bind_input();
             gettimeofday(&filter->tstart,NULL);
             return filter->svc_init();
         }
         
         void svc_end() {
+            filter->detach_notifiers();
             filter->svc_end();
             gettimeofday(&filter->tstop,NULL);            
         }
@@ -1652,6 +1802,10 @@ struct ff_node_t: ff_node {
                                b.setBuffer(p.first, p.second);
                                return datacopied;
                            };
+    } else if constexpr (traits::is_zerocopy_v<OUT_t>) {
+        this->serializeF = [](void* o, dataBuffer& b) -> bool {
+                               return zerocopySerialize<OUT_t>(reinterpret_cast<OUT_t*>(o), b);
+                           };
     } else if constexpr (cereal::traits::is_output_serializable<OUT_t, cereal::PortableBinaryOutputArchive>::value){
         this->serializeF = [](void* o, dataBuffer& b) -> bool {
                                std::ostream oss(&b);
@@ -1669,6 +1823,16 @@ struct ff_node_t: ff_node {
                                  assert(ptr);
                                  return ptr;
                              };
+    } else if constexpr (traits::is_zerocopy_v<IN_t>) {
+        // same predicate of the sender, the user's alloctask is honoured (copy)
+        if constexpr (traits::has_alloctask_v<IN_t>)
+            this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
+                                     return zerocopyDeserialize<IN_t>(b, datacopied, this->alloctaskF);
+                                 };
+        else
+            this->deserializeF = [](dataBuffer& b, bool& datacopied) -> void* {
+                                     return zerocopyDeserialize<IN_t>(b, datacopied);
+                                 };
     } else if constexpr(cereal::traits::is_input_serializable<IN_t, cereal::PortableBinaryInputArchive>::value){
             this->deserializeF = [this](dataBuffer& b, bool& datacopied) -> void* {
                                      std::istream iss(&b);
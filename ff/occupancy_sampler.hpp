@@ -0,0 +1,434 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \file occupancy_sampler.hpp
+ * \ingroup aux_classes
+ *
+ * \brief Low-overhead sampler of the channels occupancy
+ *
+ * @detail The \p ff_occupancy_sampler is a stand-alone thread that
+ * periodically reads the length of every channel (FFBUFFER) of a building
+ * block and stores one fixed-size record per sampling period into a
+ * lock-free ring. The ring has a single writer (the sampler) and any
+ * number of readers. The ring can be placed in a file (MAP_SHARED), so
+ * that an external process can follow the samples while the application
+ * is running (see \p ff_occupancy_reader).
+ *
+ * The sampler never writes into the channels and never touches their
+ * internal buffers (the consumer of an unbounded channel may release
+ * them at any time): for each sample it reads once the push counter
+ * published by the producer and the pop counter published by the
+ * consumer (see uSWSR_Ptr_Buffer::occupancy). Each counter has its own
+ * cache line, so the producer and the consumer keep their lines in
+ * exclusive state except for one shared read per sampling period.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_OCCUPANCY_SAMPLER_HPP
+#define FF_OCCUPANCY_SAMPLER_HPP
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <time.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include <ff/node.hpp>
+#include <ff/multinode.hpp>
+#include <ff/pipeline.hpp>
+#include <ff/farm.hpp>
+#include <ff/all2all.hpp>
+
+namespace ff {
+
+/*
+ * Layout of the ring (both in memory and on file):
+ *
+ *   +--------------------+  offset 0
+ *   | ff_occ_header      |  (2 cache lines, 'head' is in the second one)
+ *   +--------------------+  channels_offset
+ *   | ff_occ_channel[nc] |  (64 bytes each)
+ *   +--------------------+  ring_offset
+ *   | record[capacity]   |  (record_size bytes each)
+ *   +--------------------+
+ *
+ * Each record is: uint64_t seq | uint64_t timestamp (ns) | uint32_t length[nc]
+ * The writer sets seq to FF_OCC_INVALID before updating the record and to
+ * the record sequence number afterwards, a reader accepts a record only if
+ * it reads the same (valid) sequence number before and after the copy.
+ * All fields are in the host byte order.
+ */
+static const char     FF_OCC_MAGIC[8] = {'F','F','O','C','C','R','N','G'};
+static const uint32_t FF_OCC_VERSION  = 1;
+static const uint64_t FF_OCC_INVALID  = (uint64_t)-1;
+
+struct ff_occ_header {
+    char      magic[8];
+    uint32_t  version;
+    uint32_t  nchannels;
+    uint64_t  capacity;          // number of records, power of 2
+    uint64_t  record_size;       // in bytes
+    uint64_t  sampling_ns;
+    uint64_t  channels_offset;
+    uint64_t  ring_offset;
+    uint64_t  total_size;
+    alignas(CACHE_LINE_SIZE)
+    std::atomic<uint64_t> head;  // sequence number of the next record to write
+};
+
+struct ff_occ_channel {
+    uint64_t  capacity;          // 0 if the channel is unbounded
+    char      name[56];
+};
+
+/*!
+ * \class ff_occupancy_ring
+ * \ingroup aux_classes
+ *
+ * \brief Single-writer multi-reader ring of fixed-size occupancy records.
+ *
+ * It does not own the memory, see \p ff_occupancy_sampler and
+ * \p ff_occupancy_reader.
+ */
+class ff_occupancy_ring {
+public:
+    static inline size_t record_size(size_t nchannels) {
+        return 2*sizeof(uint64_t) + ((nchannels*sizeof(uint32_t) + 7) & ~(size_t)7);
+    }
+    static inline size_t total_size(size_t nchannels, size_t capacity) {
+        const size_t chsz = (nchannels*sizeof(ff_occ_channel) + CACHE_LINE_SIZE-1) & ~(size_t)(CACHE_LINE_SIZE-1);
+        return sizeof(ff_occ_header) + chsz + capacity*record_size(nchannels);
+    }
+
+    /* it formats an empty ring in the memory pointed by base */
+    static void format(void* base, size_t nchannels, size_t capacity, uint64_t sampling_ns) {
+        ff_occ_header* h = reinterpret_cast<ff_occ_header*>(base);
+        memset(base, 0, sizeof(ff_occ_header));
+        memcpy(h->magic, FF_OCC_MAGIC, sizeof(FF_OCC_MAGIC));
+        h->version         = FF_OCC_VERSION;
+        h->nchannels       = (uint32_t)nchannels;
+        h->capacity        = capacity;
+        h->record_size     = record_size(nchannels);
+        h->sampling_ns     = sampling_ns;
+        h->channels_offset = sizeof(ff_occ_header);
+        h->ring_offset     = total_size(nchannels, 0);
+        h->total_size      = total_size(nchannels, capacity);
+        new (&h->head) std::atomic<uint64_t>(0);
+        char* ring = reinterpret_cast<char*>(base) + h->ring_offset;
+        for(size_t i=0;i<capacity;++i)
+            new (ring + i*h->record_size) std::atomic<uint64_t>(FF_OCC_INVALID);
+    }
+
+    bool attach(void* base) {
+        h = reinterpret_cast<ff_occ_header*>(base);
+        if (memcmp(h->magic, FF_OCC_MAGIC, sizeof(FF_OCC_MAGIC)) || h->version != FF_OCC_VERSION) {
+            h = nullptr;
+            return false;
+        }
+        channels = reinterpret_cast<ff_occ_channel*>(reinterpret_cast<char*>(base) + h->channels_offset);
+        ring     = reinterpret_cast<char*>(base) + h->ring_offset;
+        return true;
+    }
+
+    size_t get_num_channels() const { return h->nchannels; }
+    size_t get_capacity()     const { return h->capacity; }
+    const char* get_channel_name(size_t i) const { return channels[i].name; }
+    uint64_t get_channel_capacity(size_t i) const { return channels[i].capacity; }
+    /// sequence number of the next record that will be written
+    uint64_t get_head() const { return h->head.load(std::memory_order_acquire); }
+
+    /**
+     * \brief Pulls the records from \p cursor on.
+     *
+     * At most \p maxrecords records are copied: timestamps into \p ts and
+     * lengths into \p lengths (row-major, nchannels entries per record).
+     * If the records starting from \p cursor have already been overwritten,
+     * \p cursor is moved to the oldest record still available.
+     * On return \p cursor is the sequence number of the next record to pull.
+     *
+     * \return the number of records copied
+     */
+    size_t pull(uint64_t& cursor, uint64_t* ts, uint32_t* lengths, size_t maxrecords) const {
+        const uint64_t head = get_head();
+        if (head > h->capacity && cursor < head - h->capacity) cursor = head - h->capacity;
+        const size_t nc = h->nchannels;
+        size_t n = 0;
+        while(cursor < head && n < maxrecords) {
+            const char* r = record(cursor);
+            const std::atomic<uint64_t>* seq = reinterpret_cast<const std::atomic<uint64_t>*>(r);
+            if (seq->load(std::memory_order_acquire) != cursor) { ++cursor; continue; }
+            ts[n] = *reinterpret_cast<const uint64_t*>(r + sizeof(uint64_t));
+            memcpy(&lengths[n*nc], r + 2*sizeof(uint64_t), nc*sizeof(uint32_t));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq->load(std::memory_order_relaxed) == cursor) ++n;  // otherwise torn, skip it
+            ++cursor;
+        }
+        return n;
+    }
+
+protected:
+    inline char* record(uint64_t seq) const {
+        return ring + (seq & (h->capacity-1)) * h->record_size;
+    }
+
+    ff_occ_header   *h        = nullptr;
+    ff_occ_channel  *channels = nullptr;
+    char            *ring     = nullptr;
+};
+
+/*!
+ * \class ff_occupancy_reader
+ * \ingroup aux_classes
+ *
+ * \brief Read-only access to a ring written on file by a \p ff_occupancy_sampler
+ * (possibly running in another process).
+ */
+class ff_occupancy_reader: public ff_occupancy_ring {
+public:
+    ff_occupancy_reader() {}
+    ~ff_occupancy_reader() { close(); }
+
+    bool open(const std::string& path) {
+#if defined(_WIN32)
+        (void)path;
+        return false;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd<0) { perror("ff_occupancy_reader, open"); return false; }
+        struct stat st;
+        if (fstat(fd, &st)<0 || (size_t)st.st_size < sizeof(ff_occ_header)) { ::close(fd); return false; }
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) { perror("ff_occupancy_reader, mmap"); return false; }
+        if (!attach(p) || h->total_size > (uint64_t)st.st_size) {
+            munmap(p, st.st_size);
+            h = nullptr;
+            return false;
+        }
+        base = p; length = st.st_size;
+        return true;
+#endif
+    }
+    void close() {
+#if !defined(_WIN32)
+        if (base) munmap(base, length);
+#endif
+        base = nullptr; h = nullptr;
+    }
+protected:
+    void*  base   = nullptr;
+    size_t length = 0;
+};
+
+
+/*!
+ *  \class ff_occupancy_sampler
+ *  \ingroup aux_classes
+ *
+ *  \brief Thread sampling the length of all channels of a building block.
+ *
+ *  Usage:
+ *  \code
+ *    ff_occupancy_sampler sampler(pipe, 4096, 1000000, "/tmp/pipe.occ");
+ *    pipe.run();
+ *    sampler.run();
+ *    ...  sampler.pull(cursor, ts, lengths, n);
+ *    pipe.wait();
+ *    sampler.stop(); sampler.wait();
+ *  \endcode
+ *
+ *  The sampler has to be started after the building block because the
+ *  channels are created when the building block is prepared.
+ *
+ *  This class is defined in \ref occupancy_sampler.hpp
+ */
+class ff_occupancy_sampler: public ff_thread, public ff_occupancy_ring {
+protected:
+    inline void add_channel(FFBUFFER* b, const std::string& name) {
+        if (!b) return;
+        for(size_t i=0;i<buffers.size();++i) if (buffers[i]==b) return;
+        buffers.push_back(b);
+        names.push_back(name);
+    }
+
+    /*
+     * Visits the building block collecting each channel once. The name
+     * of a channel is the path of the node that consumes (in) or produces
+     * (out) it, e.g. "pipe.2.farm.w1.in".
+     */
+    void collect(ff_node* n, const std::string& path) {
+        if (n->isPipe()) {
+            const svector<ff_node*>& V = reinterpret_cast<ff_pipeline*>(n)->getStages();
+            for(size_t i=0;i<V.size();++i) collect(V[i], path + "." + std::to_string(i));
+            return;
+        }
+        if (n->isFarm()) {
+            ff_farm* farm = reinterpret_cast<ff_farm*>(n);
+            add_channel(farm->getlb()->get_in_buffer(), path + ".emitter.in");
+            const svector<ff_node*>& W = farm->getWorkers();
+            for(size_t i=0;i<W.size();++i) collect(W[i], path + ".w" + std::to_string(i));
+            if (farm->hasCollector())
+                add_channel(farm->getgt()->get_out_buffer(), path + ".collector.out");
+            return;
+        }
+        if (n->isAll2All()) {
+            ff_a2a* a2a = reinterpret_cast<ff_a2a*>(n);
+            const svector<ff_node*>& L = a2a->getFirstSet();
+            const svector<ff_node*>& R = a2a->getSecondSet();
+            for(size_t i=0;i<L.size();++i) collect(L[i], path + ".L" + std::to_string(i));
+            for(size_t i=0;i<R.size();++i) collect(R[i], path + ".R" + std::to_string(i));
+            return;
+        }
+        add_channel(n->get_in_buffer(),  path + ".in");
+        add_channel(n->get_out_buffer(), path + ".out");
+    }
+
+    int create_ring() {
+        const size_t nc = buffers.size();
+        const size_t sz = total_size(nc, capacity);
+        if (filename.size()) {
+#if defined(_WIN32)
+            error("ff_occupancy_sampler: file output not supported on this platform\n");
+            return -1;
+#else
+            int fd = ::open(filename.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+            if (fd<0) { perror("ff_occupancy_sampler, open"); return -1; }
+            if (ftruncate(fd, sz)<0) { perror("ff_occupancy_sampler, ftruncate"); ::close(fd); return -1; }
+            void* p = mmap(NULL, sz, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (p == MAP_FAILED) { perror("ff_occupancy_sampler, mmap"); return -1; }
+            base = p; mapped = true;
+#endif
+        } else {
+            base = getAlignedMemory(CACHE_LINE_SIZE, sz);
+            if (!base) return -1;
+        }
+        basesize = sz;
+        format(base, nc, capacity, sampling_ns);
+        ff_occ_channel* ch = reinterpret_cast<ff_occ_channel*>(reinterpret_cast<char*>(base) + sizeof(ff_occ_header));
+        for(size_t i=0;i<nc;++i) {
+            ch[i].capacity = buffers[i]->isFixedSize() ? buffers[i]->buffersize() : 0;
+            strncpy(ch[i].name, names[i].c_str(), sizeof(ch[i].name)-1);
+        }
+        attach(base);
+        return 0;
+    }
+
+    static inline size_t ring_capacity(size_t n) {
+        if (n<2) return 2;
+        return isPowerOf2(n) ? n : nextPowerOf2(n);
+    }
+
+    static inline uint64_t now_ns() {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return (uint64_t)t.tv_sec*1000000000ULL + t.tv_nsec;
+    }
+
+    // the only writer of the ring
+    inline void sample() {
+        const uint64_t s = h->head.load(std::memory_order_relaxed);
+        char* r = record(s);
+        std::atomic<uint64_t>* seq = reinterpret_cast<std::atomic<uint64_t>*>(r);
+        seq->store(FF_OCC_INVALID, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        *reinterpret_cast<uint64_t*>(r + sizeof(uint64_t)) = now_ns();
+        uint32_t* L = reinterpret_cast<uint32_t*>(r + 2*sizeof(uint64_t));
+        for(size_t i=0;i<buffers.size();++i) L[i] = (uint32_t)buffers[i]->occupancy();
+        seq->store(s, std::memory_order_release);
+        h->head.store(s+1, std::memory_order_release);
+    }
+
+public:
+    /**
+     * \param bb the building block whose channels have to be sampled
+     * \param capacity number of records of the ring (rounded to a power of 2)
+     * \param sampling_ns sampling period in nanoseconds
+     * \param filename if not empty the ring is created on that file (mmap)
+     */
+    ff_occupancy_sampler(ff_node& bb, size_t capacity=4096, long sampling_ns=1000000,
+                         const std::string& filename=""):
+        ff_thread(nullptr, false), bb(&bb),
+        capacity(ring_capacity(capacity)),
+        sampling_ns(sampling_ns), filename(filename) {}
+
+    virtual ~ff_occupancy_sampler() {
+        if (!base) return;
+#if !defined(_WIN32)
+        if (mapped) { munmap(base, basesize); return; }
+#endif
+        freeAlignedMemory(base);
+    }
+
+    /**
+     * \brief Creates the ring and starts the sampler thread.
+     *
+     * \return 0 success, -1 otherwise
+     */
+    int run(bool=false) {
+        if (!base) {
+            collect(bb, bb->isPipe() ? "pipe" : (bb->isFarm() ? "farm" : (bb->isAll2All() ? "a2a" : "node")));
+            if (buffers.size()==0) {
+                error("ff_occupancy_sampler: no channels to sample\n");
+                return -1;
+            }
+            if (create_ring()<0) return -1;
+        }
+        return (ff_thread::spawn()==-2) ? -1 : 0;
+    }
+
+    void* svc(void*) {
+        struct timespec waiter = { sampling_ns / 1000000000L, sampling_ns % 1000000000L };
+        while(!terminate.load()) {
+            sample();
+            nanosleep(&waiter, NULL);
+        }
+        sample(); // last one
+        return FF_EOS;
+    }
+
+    /**
+     * \brief Asks the sampler to terminate, the thread has to be joined with \p wait.
+     */
+    void stop() { terminate.store(true); ff_thread::stop(); }
+
+protected:
+    ff_node                *bb;
+    const size_t            capacity;
+    const long              sampling_ns;
+    const std::string       filename;
+    std::atomic<bool>       terminate{false};
+    svector<FFBUFFER*>      buffers;
+    std::vector<std::string> names;
+    void                   *base     = nullptr;
+    size_t                  basesize = 0;
+    bool                    mapped   = false;
+};
+
+} // namespace ff
+
+#endif /* FF_OCCUPANCY_SAMPLER_HPP */
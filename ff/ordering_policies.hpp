@@ -37,6 +37,7 @@
 
 #include <vector>
 #include <queue>
+#include <atomic>
 
 #include <ff/lb.hpp>
 #include <ff/gt.hpp>
@@ -50,12 +51,53 @@ namespace ff {
 // second.second is used to store the sender
 using ordering_pair_t = std::pair<size_t, std::pair<void*,ssize_t> >;
 
+/*
+ * Reorder window of the ordered farm with on-demand scheduling.
+ * The element with sequence number s is parked in the slot s % size, so
+ * that parking and releasing an element are O(1). The emitter (ordered_lb)
+ * does not assign the sequence number s before s-size has been released
+ * (back-pressure), therefore a slot is never used by two elements and the
+ * emitter's circular memory of the same size is never overwritten.
+ */
+struct ordering_window {
+    void init(const size_t size) {
+        W.assign(size, nullptr);
+        cnt = 0;
+        released.store(0);
+    }
+    // true if in is the next element to be released
+    inline bool isnext(const ordering_pair_t* in) const { return in->first == cnt; }
+    inline void park(ordering_pair_t* in) { W[in->first % W.size()] = in; }
+    // the next element if it has been parked, it has to be released after its use
+    inline ordering_pair_t* next() {
+        ordering_pair_t *&p = W[cnt % W.size()];
+        ordering_pair_t *r  = p;
+        p = nullptr;
+        return r;
+    }
+    inline void release() { released.store(++cnt, std::memory_order_release); }
+
+    size_t cnt = 0;                    // next sequence number to release
+    std::vector<ordering_pair_t*> W;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> released{0};
+};
+
 struct ordered_lb:ff_loadbalancer {
+    enum { WINDOW_SPINS=64 };
     ordered_lb(int max_num_workers):ff_loadbalancer(max_num_workers) {}
-    void init(ordering_pair_t* v, const size_t size) {
-        _M=v; _M_size=size; cnt=0; idx=0;
+    void init(ordering_pair_t* v, const size_t size, const std::atomic<size_t>* rel=nullptr) {
+        _M=v; _M_size=size; cnt=0; idx=0; released=rel;
+    }
+    // back-pressure: the slot idx can be reused once cnt-_M_size has been released
+    inline void wait_window() {
+        if (!released) return;
+        for(size_t i=0; cnt - released->load(std::memory_order_acquire) >= _M_size; ++i) {
+            if (i < WINDOW_SPINS) losetime_out();
+            else ff_relax(1);  // the window is full for a long-tail element
+        }
     }
     inline bool schedule_task(void * task, unsigned long retry, unsigned long ticks) {
+        wait_window();
         _M[idx].first  = cnt;
         _M[idx].second.first = task;
         auto r = ff_loadbalancer::schedule_task(&_M[idx], retry, ticks);
@@ -68,6 +110,7 @@ struct ordered_lb:ff_loadbalancer {
             ff_loadbalancer::broadcast_task(task);
             return;
         }
+        wait_window();
         _M[idx].first  = cnt;
         _M[idx].second.first = task;
         ff_loadbalancer::broadcast_task(&_M[idx]);
@@ -75,6 +118,7 @@ struct ordered_lb:ff_loadbalancer {
     }
     inline bool ff_send_out_to(void *task, int id, unsigned long retry, unsigned long ticks) {
         assert(task<FF_TAG_MIN);
+        wait_window();
         _M[idx].first  = cnt;
         _M[idx].second.first = task;
         auto r = ff_loadbalancer::ff_send_out_to(&_M[idx], id, retry, ticks);
@@ -83,39 +127,33 @@ struct ordered_lb:ff_loadbalancer {
     }        
     size_t idx,cnt,_M_size=0;
     ordering_pair_t* _M=nullptr;    
+    const std::atomic<size_t>* released=nullptr;  // released by the gatherer
 };
 
 struct ordered_gt: ff_gatherer {
-    struct PairCmp {
-        bool operator()(const ordering_pair_t* lhs, const ordering_pair_t* rhs) const { 
-            return lhs->first > rhs->first;
-        }
-    };
     ordered_gt(int max_num_workers): ff_gatherer(max_num_workers) {}
-    void init(const size_t size) { MemSize=size; cnt =0; }
+    // size must be the size of the emitter's memory
+    void init(const size_t size) { W.init(size); }
+    const std::atomic<size_t>* released() const { return &W.released; }
+
     inline ssize_t gather_task(void ** task) {
-        if (!Q.empty()) {
-	    auto next = Q.top();
-	    if (cnt == next->first) {
-            ++cnt;
+        ordering_pair_t *next = W.next();
+        if (next) {
             *task = next->second.first;
-            Q.pop();
-            return next->second.second;
-	    }
+            const ssize_t sender = next->second.second;
+            W.release();
+            return sender;
         }
         ssize_t nextr=  ff_gatherer::gather_task(task);
         if (*task < FF_TAG_MIN) {
             ordering_pair_t *in =  reinterpret_cast<ordering_pair_t*>(*task);
-            if (cnt == in->first) { // it's the next to send out
-                cnt++;
+            if (W.isnext(in)) { // it's the next to send out
                 *task = in->second.first;
+                W.release();
                 return nextr;
             }
             in->second.second = nextr;
-            Q.push(in);
-            if (Q.size()>MemSize) {
-                error("FATAL ERROR: OFARM, ondemand, not enough memory, increase MemoryElements\n");
-            }
+            W.park(in);
             *task = FF_GO_ON;
         }
         return nextr;                            
@@ -133,9 +171,7 @@ struct ordered_gt: ff_gatherer {
         return r;
     }
     
-    size_t cnt;
-    std::priority_queue<ordering_pair_t*,std::vector<ordering_pair_t*>, PairCmp> Q;
-    size_t MemSize;       
+    ordering_window W;
 };
 // Worker wrapper to be used when ordering_pair_t is added to the data elements
 class OrderedWorkerWrapper: public ff_node {
@@ -185,42 +221,27 @@ public:
 };
     
 // A node that removes the ordering_pair_t around the data element
+// (it uses the reorder window, see ordering_window)
 class OrderedCollectorWrapper: public ff_node {
 public:
-    struct PairCmp {
-        bool operator()(const ordering_pair_t* lhs, const ordering_pair_t* rhs) const { 
-            return lhs->first > rhs->first;
-        }
-    };
-    OrderedCollectorWrapper(const size_t size):cnt(0),MemSize(size) {}
-    int svc_init() {
-        cnt=0;
-        return 0;
-    } 
+    // size must be the size of the emitter's memory
+    OrderedCollectorWrapper(const size_t size) { W.init(size); }
+    const std::atomic<size_t>* released() const { return &W.released; }
+
     inline void* svc(void *t) {
         ordering_pair_t *in = reinterpret_cast<ordering_pair_t*>(t);
-        if (cnt == in->first) { // it's the next to send out
-            ff_send_out(in->second.first);
-            cnt++;
-            while(!Q.empty()) {
-                auto next = Q.top();
-                if (cnt == next->first) {
-                    ff_send_out(next->second.first);
-                    ++cnt;
-                    Q.pop();
-                } else break;
-            }
+        if (!W.isnext(in)) {
+            W.park(in);
             return GO_ON;
         }
-        Q.push(in);
-        if (Q.size()>MemSize) {
-            error("FATAL ERROR: OFARM, ondemand, not enough memory, increase MemoryElements\n");
-        }
+        do { // it's the next to send out
+            void *out = in->second.first;
+            W.release();
+            ff_send_out(out);
+        } while((in = W.next()));
         return GO_ON;
     }
-    size_t cnt;
-    std::priority_queue<ordering_pair_t*,std::vector<ordering_pair_t*>, PairCmp> Q;
-    size_t MemSize;       
+    ordering_window W;
 };
 
     
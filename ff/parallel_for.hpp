@@ -99,6 +99,7 @@
 
 #include <ff/pipeline.hpp>
 #include <ff/parallel_for_internals.hpp>
+#include <ff/reduce_kernels.hpp>
 
 namespace ff {
 
@@ -173,6 +174,21 @@ public:
         ff_forall_farm<forallreduce_W<int> >::disableScheduler(onoff);
     }
 
+    /**
+     * \brief Enable work-stealing scheduling of dynamic loops
+     *
+     * The iterations of the loops with dynamic scheduling (grain > 0) are
+     * distributed by work-stealing instead of using the active scheduler:
+     * each worker starts with a contiguous block of chunks of the iteration
+     * space and, once it is done, it steals half of the remaining chunks of
+     * a randomly selected worker. No scheduler thread is used. It is useful
+     * for irregular loops where the cost of the iterations is skewed.
+     * \param onoff <b>true</b> enable work-stealing, <b>false</b> disable it
+     */
+    inline void enableWorkStealing(bool onoff=true) { 
+        ff_forall_farm<forallreduce_W<int> >::enableWorkStealing(onoff);
+    }
+
     // It puts all spinning threads to sleep. It does not disable the spinWait flag
     // so at the next call, threads start spinning again.
     inline int threadPause() {
@@ -399,6 +415,13 @@ public:
         ff_forall_farm<forallreduce_W<T> >::disableScheduler(onoff);
     }
 
+    // By calling this method with 'true' the loops with dynamic scheduling
+    // are executed by work-stealing without the scheduler thread
+    // (see ParallelFor::enableWorkStealing)
+    inline void enableWorkStealing(bool onoff=true) { 
+        ff_forall_farm<forallreduce_W<T> >::enableWorkStealing(onoff);
+    }
+
     // It puts all spinning threads to sleep. It does not disable the spinWait flag
     // so at the next call, threads start spinning again.
     inline int threadPause() {
@@ -692,7 +715,56 @@ public:
             } FF_PARFORREDUCE_F_STOP(this, var, finalreduce);
         }
     }
-    
+
+    /* ------------------ bulk reductions ------------------- */
+    /**
+     * \brief Parallel reduce of a contiguous array
+     *
+     * It reduces the n elements starting from \p ptr with one of the
+     * built-in operations reduce_sum, reduce_min and reduce_max.
+     * Data is statically partitioned in blocks, each worker reduces its
+     * block with a SIMD kernel (see reduce_kernels.hpp) and it updates its
+     * partial result once per block, there is no call per element.
+     *
+     * \param ptr first element of the array
+     * \param n number of elements
+     * \param op reduction operation (e.g. reduce_sum())
+     * \param nw number of worker threads
+     * \return the result, the identity of \p op if \p n is 0
+     */
+    template <typename Op>
+    inline T parallel_reduce_range(const T* ptr, const long n, const Op& op, const long nw=FF_AUTO) {
+        static_assert(std::is_arithmetic<T>::value, "parallel_reduce_range: T must be an arithmetic type");
+        T var = Op::template identity<T>();
+        if (n<=0) return var;
+        auto freduce = [&op](T& v, const T& elem) { v = op(v, elem); };
+        FF_PARFORREDUCE_START_IDX(this, var, Op::template identity<T>(), idx, 0, n, 1, PARFOR_STATIC(0), nw) {
+            var = op(var, reduce_kernel(ptr+ff_start_idx, ff_stop_idx-ff_start_idx, op));
+        } FF_PARFORREDUCE_F_STOP(this, var, freduce);
+        return var;
+    }
+
+    /**
+     * \brief Parallel dot product of two contiguous arrays
+     *
+     * It computes the sum of x[i]*y[i] for i in [0,n), like
+     * parallel_reduce_range with reduce_sum.
+     *
+     * \param x first array
+     * \param y second array
+     * \param n number of elements
+     * \param nw number of worker threads
+     */
+    inline T parallel_dot(const T* x, const T* y, const long n, const long nw=FF_AUTO) {
+        static_assert(std::is_arithmetic<T>::value, "parallel_dot: T must be an arithmetic type");
+        T var = T(0);
+        if (n<=0) return var;
+        auto freduce = [](T& v, const T& elem) { v += elem; };
+        FF_PARFORREDUCE_START_IDX(this, var, T(0), idx, 0, n, 1, PARFOR_STATIC(0), nw) {
+            var += dot_kernel(x+ff_start_idx, y+ff_start_idx, ff_stop_idx-ff_start_idx);
+        } FF_PARFORREDUCE_F_STOP(this, var, freduce);
+        return var;
+    }
 };
 
 
@@ -761,6 +833,11 @@ public:
         pfr.disableScheduler(onoff);
     }
 
+    // work-stealing scheduling of the Map part (see ParallelFor::enableWorkStealing)
+    inline void enableWorkStealing(bool onoff=true) { 
+        pfr.enableWorkStealing(onoff);
+    }
+
     // It puts all spinning threads to sleep. It does not disable the spinWait flag
     // so at the next call, threads start spinning again.
     inline int threadPause() {
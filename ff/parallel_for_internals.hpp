@@ -66,6 +66,7 @@
 #include <ff/node.hpp>
 #include <ff/farm.hpp>
 #include <ff/spin-lock.hpp>
+#include <ff/wsdeque.hpp>
 
 enum {FF_AUTO=-1};
 
@@ -455,6 +456,14 @@ static inline void workerlosetime_in(const bool aggressive) {
 }
 
 
+// per-worker state of the work-stealing mode, the deque contains ranges
+// of chunks [begin,end( encoded in a single 64-bit word
+struct ws_worker_t {
+    ws_worker_t(unsigned long seed):seed(seed) {}
+    ff_wsdeque<uint64_t> q;
+    unsigned long        seed;  // used only by the owner to select the victims
+};
+
 // parallel for/reduce task scheduler
 class forall_Scheduler: public ff_node {
 protected:
@@ -464,7 +473,62 @@ protected:
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
     std::atomic_long       _nextIteration;
 #endif
+    std::vector<ws_worker_t*> wsw;   // see setWorkStealing
 protected:
+    static inline uint64_t ws_range(uint64_t b, uint64_t e) { return (b<<32) | e; }
+
+    // work-stealing mode: worker i starts with the i-th contiguous block of
+    // chunks of the iteration space
+    inline void init_ws() {
+        const long numtasks  = std::lrint(std::ceil((_stop-_start)/(double)_step));
+        const uint64_t nchunks = std::lrint(std::ceil(numtasks/(double)_chunk));
+        while(wsw.size() < _nw) wsw.push_back(new ws_worker_t(0x9E3779B97F4A7C15UL*(wsw.size()+1)));
+        for(size_t i=0;i<_nw;++i) {
+            wsw[i]->q.reset();
+            const uint64_t b = (nchunks*i)/_nw, e = (nchunks*(i+1))/_nw;
+            if (b<e) wsw[i]->q.push(ws_range(b,e));
+        }
+    }
+    /* 
+     * Work-stealing mode: the worker takes the last range pushed into its
+     * deque (or steals the oldest one from a victim), keeps the first chunk
+     * and pushes back the upper halves. The owner walks the chunks in order
+     * while the thieves steal the biggest ranges, far from the owner.
+     */
+    inline bool nextTaskStealing(forall_task_t *task, const int wid, const bool steal=true) {
+        ws_worker_t &me = *wsw[wid];
+        uint64_t r;
+        if (!me.q.take(r) && (!steal || !stealTask(wid, r))) return false;
+        uint64_t b = r >> 32, e = r & 0xffffffffUL;
+        while (e-b > 1) {
+            const uint64_t m = b + ((e-b)>>1);
+            me.q.push(ws_range(m,e));
+            e = m;
+        }
+        const long start = _start + long(b)*_chunk*_step;
+        task->set(start, (std::min)(start + (_chunk-1)*_step + 1, _stop));
+        return true;
+    }
+    // it visits all the other workers starting from a random one, it gives
+    // up when all deques have been found empty twice
+    inline bool stealTask(const int wid, uint64_t &r) {
+        if (_nw < 2) return false;
+        unsigned long &seed = wsw[wid]->seed;
+        for(int round=0; round<2; ++round) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;  // xorshift64
+            size_t v = seed % _nw;
+            for(size_t i=0;i<_nw;++i, v=(v+1)%_nw) {
+                if (v == (size_t)wid) continue;
+                ff_wsdeque<uint64_t> &q = wsw[v]->q;
+                while(!q.empty()) {
+                    if (q.steal(r)) return true;
+                    workerlosetime_in(true);
+                }
+            }
+        }
+        return false;
+    }
+
     // initialize the data vector
     virtual inline size_t init_data(ssize_t start, ssize_t stop) {
         static_scheduling = false;  // enable work stealing in the nextTaskConcurrent
@@ -575,6 +639,9 @@ public:
         totaltasks = init_data(0,0);
         assert(totaltasks==0);
     }
+    ~forall_Scheduler() {
+        for(size_t i=0;i<wsw.size();++i) delete wsw[i];
+    }
 
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
     inline bool canUseNoStealing(){
@@ -591,6 +658,15 @@ public:
         return true;
         }
 #endif
+        if (ws_active) {
+            // the first chunk of each worker, the workers are not running yet
+            for(size_t wid=0;wid<_nw;++wid) {
+                if (!nextTaskStealing(&taskv[wid], (int)wid, false)) taskv[wid].set(0,0);
+                lb->ff_send_out_to(&taskv[wid], (int) wid);
+                eossent[wid]=false;
+            }
+            return false;
+        }
         size_t remaining    = totaltasks;
         const long endchunk = (_chunk-1)*_step + 1;
 
@@ -646,6 +722,7 @@ public:
             return nextTaskConcurrentNoStealing(task, wid);
         }
 #endif
+        if (ws_active) return nextTaskStealing(task, wid);
         const long endchunk = (_chunk-1)*_step + 1; // next end-point
         auto id  = wid;
     L1:
@@ -823,6 +900,11 @@ public:
         // adjust the number of workers that have to be started
         if ( (totaltasks/(double)_nw) <= 1.0 || (totaltasks==1) )
            _nw = totaltasks;
+
+        // the chunk indexes of a range must fit in 32 bits
+        ws_active = wsmode && !static_scheduling && (_step > 0) &&
+            ((stop-start)/(_chunk*_step) < 0xffffffffL);
+        if (ws_active) init_ws();
     }
 
     inline long startIdx() const { return _start;}
@@ -830,6 +912,10 @@ public:
     inline long stepIdx()  const { return _step;}
     inline size_t running() const { return _nw; }
     inline void workersSpinWait() { workersspinwait=true;}
+    // work-stealing mode, used only for dynamic scheduling (chunk>0) and
+    // when the scheduler thread is not running
+    inline void setWorkStealing(bool onoff) { wsmode=onoff; }
+    inline bool workStealing() const { return wsmode; }
     inline size_t getnumtasks() const { return totaltasks;}
 protected:
     // the following fields are used only by the scheduler thread
@@ -842,6 +928,8 @@ protected:
     bool             skip1;
     bool             workersspinwait;
     bool             static_scheduling;
+    bool             wsmode    = false;  // work-stealing requested
+    bool             ws_active = false;  // work-stealing used for the current loop
     std::vector<forall_task_t> taskv;
 };
 
@@ -905,7 +993,7 @@ protected:
 protected:
     bool spinwait,aggressive;
     F_t  F;
-    Tres res;
+    alignas(CACHE_LINE_SIZE) Tres res;  // partial result, on its own cache line
 };
 
 
@@ -1075,6 +1163,15 @@ public:
     // ff_numCores() > ff_realNumCores() (i.e. HT or SMT is enabled)
     inline void disableScheduler(bool onoff=true) { removeSched=onoff; }
 
+    // By calling this method with 'true' the iterations of the loops with
+    // dynamic scheduling (i.e. chunk>0) are distributed by work-stealing: each
+    // worker starts with a contiguous block of chunks and, when it has finished
+    // its own chunks, it steals half of the remaining chunks of a random victim.
+    // The scheduler thread is never started in this mode.
+    inline void enableWorkStealing(bool onoff=true) {
+        ((forall_Scheduler*)getEmitter())->setWorkStealing(onoff);
+    }
+
     inline int run_then_freeze(ssize_t nw_=-1) {
         assert(skipwarmup == false);
         const ssize_t nwtostart = (nw_ == -1)?getNWorkers():nw_;
@@ -1173,7 +1270,8 @@ public:
         const bool mode = (nw <= numCores);
     
         // NOTE: in case of static scheduling, the scheduler is never started !
-        schedRunning = (!removeSched && startScheduler(nw, ((forall_Scheduler*)getEmitter())->getnumtasks()));
+        const forall_Scheduler *sched = (const forall_Scheduler*)getEmitter();
+        schedRunning = (!removeSched && !sched->workStealing() && startScheduler(nw, sched->getnumtasks()));
 
 #ifdef FF_PARFOR_PASSIVE_NOSTEALING
         globalSchedRunning = schedRunning;
@@ -1176,6 +1176,17 @@ public:
     void blocking_mode(bool blk=true) {
         blocking_in = blocking_out = blk;
     }
+    /* it must be called after the stages have been added (see ff_node::batched_mode) */
+    void batched_mode(bool onoff=true) {
+        ff_node::batched_mode(onoff);
+        for(size_t i=0;i<nodes_list.size();++i)
+            nodes_list[i]->batched_mode(onoff);
+    }
+    /* it must be called after the stages have been added (see ff_node::spinpark_mode) */
+    void spinpark_mode(bool onoff=true) {
+        for(size_t i=0;i<nodes_list.size();++i)
+            nodes_list[i]->spinpark_mode(onoff);
+    }
     void no_barrier() {
         initial_barrier = false;
     }
@@ -1409,17 +1420,9 @@ public:
          assert(inbuffer != NULL);
 
          if (ff_node::blocking_out) {
-         _retry:
-             if (inbuffer->push(task)) {
-                 pthread_cond_signal(p_cons_c);
-                 return true;
-             } 
-             struct timespec tv;
-             timedwait_timeout(tv);             
-             pthread_mutex_lock(prod_m);
-             pthread_cond_timedwait(prod_c, prod_m, &tv);
-             pthread_mutex_unlock(prod_m);
-             goto _retry;
+             while(!inbuffer->push(task))
+                 out_notifier(inbuffer)->wait([inbuffer]() { return inbuffer->available(); }, FF_TIMEDWAIT_NS);
+             return true;
          }
          for(unsigned long i=0;i<retry;++i) {
             if (inbuffer->push(task)) return true;
@@ -1460,11 +1463,7 @@ public:
                 if ((*task != (void *)FF_EOS)) return true;
                 else return false;
             }
-            struct timespec tv;
-            timedwait_timeout(tv);
-            pthread_mutex_lock(cons_m);
-            pthread_cond_timedwait(cons_c, cons_m, &tv);
-            pthread_mutex_unlock(cons_m);
+            in_notifier(outbuffer)->wait([outbuffer]() { return !outbuffer->empty(); }, FF_TIMEDWAIT_NS);
             goto _retry;
         }
         for(unsigned long i=0;i<retry;++i) {
@@ -0,0 +1,157 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ *  \link
+ *  \file reduce_kernels.hpp
+ *  \ingroup aux_classes
+ *
+ *  \brief SIMD kernels of the bulk reductions of ParallelForReduce.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+/*
+ * Kernels used by ParallelForReduce::parallel_reduce_range and
+ * ParallelForReduce::parallel_dot on contiguous arrays of arithmetic types.
+ *
+ * The vector width is selected at compile time: 64 bytes with AVX-512,
+ * 32 bytes with AVX/AVX2, 16 bytes with SSE2 or NEON. The kernels are
+ * written with the GCC/clang vector extensions, so the same code is
+ * compiled to the instructions of the target (e.g. -mavx2, -march=native).
+ * The head of the array is reduced element by element up to the first
+ * aligned address, the body with aligned vector loads on 4 independent
+ * accumulators and the tail element by element again.
+ * Defining FF_NO_SIMD_REDUCE (or with other compilers) they are plain loops.
+ *
+ * NOTE: the order of the operations is not the sequential one, with
+ * floating point types the sum may differ in the last bits. NaNs are not
+ * handled by reduce_min/reduce_max.
+ */
+
+#ifndef FF_REDUCE_KERNELS_HPP
+#define FF_REDUCE_KERNELS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if !defined(FF_NO_SIMD_REDUCE) && defined(__GNUC__)
+#if defined(__AVX512F__)
+#define FF_SIMD_BYTES 64
+#elif defined(__AVX__)
+#define FF_SIMD_BYTES 32
+#elif defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define FF_SIMD_BYTES 16
+#endif
+#endif
+
+namespace ff {
+
+/* ------------- built-in reduction operations ------------- */
+
+struct reduce_sum {
+    template<typename T> static T identity() { return T(0); }
+    template<typename V> inline V operator()(const V& a, const V& b) const { return a + b; }
+};
+struct reduce_min {
+    template<typename T> static T identity() {
+        return std::numeric_limits<T>::has_infinity ?
+            std::numeric_limits<T>::infinity() : (std::numeric_limits<T>::max)();
+    }
+    template<typename V> inline V operator()(const V& a, const V& b) const { return b < a ? b : a; }
+};
+struct reduce_max {
+    template<typename T> static T identity() {
+        return std::numeric_limits<T>::has_infinity ?
+            -std::numeric_limits<T>::infinity() : std::numeric_limits<T>::lowest();
+    }
+    template<typename V> inline V operator()(const V& a, const V& b) const { return a < b ? b : a; }
+};
+
+/* --------------------- kernels --------------------------- */
+
+// it reduces p[0..n) with op starting from the identity of op
+template<typename T, typename Op>
+static inline T reduce_kernel(const T *p, long n, const Op& op) {
+    T r = Op::template identity<T>();
+#if defined(FF_SIMD_BYTES)
+    if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+                  (FF_SIMD_BYTES % sizeof(T)) == 0) {
+        typedef T vec_t __attribute__((vector_size(FF_SIMD_BYTES), __may_alias__));
+        const long W = FF_SIMD_BYTES/sizeof(T);
+        for(; n>0 && ((uintptr_t)p % FF_SIMD_BYTES); --n) r = op(r, *p++);
+        if (n >= W) {
+            vec_t a0 = {}, a1, a2, a3;
+            for(long i=0;i<W;++i) a0[i] = Op::template identity<T>();
+            a1 = a2 = a3 = a0;
+            const vec_t *v = (const vec_t*)p;
+            for(; n >= 4*W; n -= 4*W, v += 4) {
+                a0 = op(a0, v[0]); a1 = op(a1, v[1]);
+                a2 = op(a2, v[2]); a3 = op(a3, v[3]);
+            }
+            a0 = op(op(a0, a1), op(a2, a3));
+            for(; n >= W; n -= W, ++v) a0 = op(a0, v[0]);
+            for(long i=0;i<W;++i) r = op(r, (T)a0[i]);
+            p = (const T*)v;
+        }
+    }
+#endif
+    for(; n>0; --n) r = op(r, *p++);
+    return r;
+}
+
+// sum of x[i]*y[i] for i in [0..n)
+template<typename T>
+static inline T dot_kernel(const T *x, const T *y, long n) {
+    T r = T(0);
+#if defined(FF_SIMD_BYTES)
+    if constexpr (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+                  (FF_SIMD_BYTES % sizeof(T)) == 0) {
+        typedef T vec_t __attribute__((vector_size(FF_SIMD_BYTES), __may_alias__));
+        const long W = FF_SIMD_BYTES/sizeof(T);
+        // x is aligned, the loads from y are unaligned
+        for(; n>0 && ((uintptr_t)x % FF_SIMD_BYTES); --n) r += *x++ * *y++;
+        if (n >= W) {
+            vec_t a0 = {}, a1 = {}, a2 = {}, a3 = {}, b0, b1, b2, b3;
+            const vec_t *v = (const vec_t*)x;
+            for(; n >= 4*W; n -= 4*W, v += 4, y += 4*W) {
+                std::memcpy(&b0, y,     sizeof(vec_t)); std::memcpy(&b1, y+W,   sizeof(vec_t));
+                std::memcpy(&b2, y+2*W, sizeof(vec_t)); std::memcpy(&b3, y+3*W, sizeof(vec_t));
+                a0 += v[0]*b0; a1 += v[1]*b1; a2 += v[2]*b2; a3 += v[3]*b3;
+            }
+            a0 = (a0 + a1) + (a2 + a3);
+            for(; n >= W; n -= W, ++v, y += W) {
+                std::memcpy(&b0, y, sizeof(vec_t));
+                a0 += v[0]*b0;
+            }
+            for(long i=0;i<W;++i) r += a0[i];
+            x = (const T*)v;
+        }
+    }
+#endif
+    for(; n>0; --n) r += *x++ * *y++;
+    return r;
+}
+
+} // namespace ff
+
+#endif /* FF_REDUCE_KERNELS_HPP */
@@ -17,6 +17,8 @@
  * UPDATE: Older versions may cause issues with library inclusion. */
 #include <linux/sched/types.h>
 #include <stdio.h>
+#include <string.h>
+#include <iostream>
 #include <errno.h>
 #include <sched.h>
 #include <sys/syscall.h>
@@ -32,7 +34,7 @@
  * @param mask The cpu_set_t param used to set the affinity. See man cpu_set for details
  * @returns 0 - For success \\
  * @returns Otherwise - The error returned by the syscall `sched_setaffinity()` */
-int set_sched_affinity(pid_t pid, cpu_set_t * mask) {
+static inline int set_sched_affinity(pid_t pid, cpu_set_t * mask) {
     int res = 0;
     if ((res = sched_setaffinity(pid, sizeof(cpu_set_t), mask)))
         perror("set_sched_affinity");
@@ -45,7 +47,7 @@ int set_sched_affinity(pid_t pid, cpu_set_t * mask) {
  * @param ret the sched_attr structure reference into which to return the Thread attributes.
  * @returns 0 - For success \\
  * @returns Otherwise - The error returned by the syscall `SYS_sched_getattr` */
-int get_sched_attributes(pid_t tid, struct sched_attr * ret) {
+static inline int get_sched_attributes(pid_t tid, struct sched_attr * ret) {
     int res = 0;
     if ((res = syscall(SYS_sched_getattr, tid, ((struct sched_attr *)ret), sizeof(struct sched_attr), 0))) {
         perror("get_sched_attributes");
@@ -59,7 +61,7 @@ int get_sched_attributes(pid_t tid, struct sched_attr * ret) {
  * @returns 0 - Success \\
  * @returns Otherwise - The error returned by the system call.
  * @note I preferred to use the thread_id already stored in the "ff/node.hpp" to avoid issues about it. */
-int print_thread_attributes(FILE * file_ptr, size_t thread_id) {
+static inline int print_thread_attributes(FILE * file_ptr, size_t thread_id) {
     struct sched_attr printable;
     int result = 0;
     if ((result = syscall(SYS_sched_getattr, thread_id, ((struct sched_attr *)&printable), sizeof(struct sched_attr), 0)) != 0) {
@@ -87,7 +89,7 @@ int print_thread_attributes(FILE * file_ptr, size_t thread_id) {
  * @param set_affinity true to set the affinity (first call), Otherwise false (unnecessary syscall).
  * @returns 0 - For success \\
  * @returns Otherwise - The error returned by the system call. */
-int set_scheduling_out(struct sched_attr * attr, size_t thread_id, bool set_affinity) {
+static inline int set_scheduling_out(struct sched_attr * attr, size_t thread_id, bool set_affinity) {
     if (attr == NULL) {
         perror("NULL attr in set_scheduling_out");
         return -1;
@@ -119,7 +121,7 @@ int set_scheduling_out(struct sched_attr * attr, size_t thread_id, bool set_affi
  * @param period_deadline value to set as `period` and `deadline` of the sched attr
  * @param runtime the runtime value to set. If 0, it will be set as `period_deadline/n_threads` 
  * @param thread_id the thread id to which set the attr struct. */
-int set_deadline_attr(size_t n_threads, size_t period_deadline, size_t runtime, size_t thread_id) {
+static inline int set_deadline_attr(size_t n_threads, size_t period_deadline, size_t runtime, size_t thread_id) {
     struct sched_attr attr = {0};
     attr.size = sizeof(struct sched_attr);
     attr.sched_flags = 0;
@@ -141,7 +143,7 @@ int set_deadline_attr(size_t n_threads, size_t period_deadline, size_t runtime,
  * @param time1 the end of time period 
  * @param time0 the start of time period
  * @returns A double representing the difference in secs. */
-double diff_timespec(const struct timespec & time1, const struct timespec & time0) {
+static inline double diff_timespec(const struct timespec & time1, const struct timespec & time0) {
   return (time1.tv_sec - time0.tv_sec)
       + (time1.tv_nsec - time0.tv_nsec) / 1e9;
 }
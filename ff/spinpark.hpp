@@ -0,0 +1,124 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \file spinpark.hpp
+ * \ingroup aux_classes
+ *
+ * \brief Adaptive spin-then-park waiting policy for the nonblocking channels
+ *
+ * @detail A thread waiting on an empty (or full) channel first spins with an
+ * exponential PAUSE backoff for a time window and then parks on the
+ * \p ff_notifier attached to the channel. The window is learned online from
+ * the waiting times observed so far: if the channel is usually ready within
+ * \p FF_SPIN_MAX_TICKS it is worth spinning (for twice the average waiting
+ * time), otherwise the thread spins for \p FF_SPIN_MIN_TICKS and then parks.
+ * Busy stages do not pay the wake-up latency and idle stages do not burn
+ * their core.
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_SPINPARK_HPP
+#define FF_SPINPARK_HPP
+
+#include <ff/sysdep.h>
+#include <ff/config.hpp>
+#include <ff/cycle.h>
+#include <ff/futex.hpp>
+
+namespace ff {
+
+/*!
+ * \class ff_spinpark
+ * \ingroup aux_classes
+ *
+ * \brief One side (input or output) of the adaptive waiting policy of a node.
+ *
+ * The owner calls \p idle each time the channel is not ready and \p done
+ * as soon as it is ready again. It is not thread-safe, only the owner
+ * thread can call \p idle and \p done. The notifier on which the thread
+ * parks is the one the owner has attached to the channel.
+ */
+class ff_spinpark {
+    enum { MAX_BACKOFF = 64 };  // max number of PAUSE per spin iteration
+public:
+    ff_spinpark(ticks min_spin=FF_SPIN_MIN_TICKS, ticks max_spin=FF_SPIN_MAX_TICKS,
+                long park_ns=FF_PARK_TIMEOUT_NS):
+        min_spin(min_spin), max_spin(max_spin), park_ns(park_ns),
+        avg(max_spin/2), window(max_spin), start(0), nparks(0), backoff(1), waiting(false) {}
+
+    /*
+     * The channel is not ready. The first call of a waiting period just
+     * starts the clock, then the thread spins until the window expires and
+     * then it parks until either it is notified, the timeout expires or
+     * \p ready returns true.
+     */
+    template<typename Cond>
+    inline void idle(ff_notifier &ntf, Cond ready) {
+        if (!waiting) {
+            waiting = true;
+            backoff = 1;
+            start   = getticks();
+            return;
+        }
+        if ((getticks()-start) < window) {
+            for(unsigned i=0;i<backoff;++i) PAUSE();
+            if (backoff < MAX_BACKOFF) backoff <<= 1;
+            return;
+        }
+        if (ntf.wait(ready, park_ns)) ++nparks;
+    }
+
+    /*
+     * The channel is ready, the length of the waiting period (if any)
+     * updates the average waiting time and the spin window.
+     */
+    inline void done() {
+        if (!waiting) return;
+        waiting = false;
+        ticks gap = getticks()-start;
+        // long waiting times are clamped so that the average can quickly recover
+        if (gap > 4*max_spin) gap = 4*max_spin;
+        avg = avg - (avg>>3) + (gap>>3);  // EWMA, weight 1/8
+        if (2*avg <= max_spin) window = (2*avg > min_spin) ? 2*avg : min_spin;
+        else window = min_spin;
+    }
+
+    // current spin window and average waiting time (in ticks)
+    inline ticks  get_window()   const { return window; }
+    inline ticks  get_avgwait()  const { return avg;    }
+    // number of times the owner has been parked
+    inline size_t get_nparks()   const { return nparks; }
+
+protected:
+    const ticks  min_spin, max_spin;
+    const long   park_ns;
+    ticks        avg;
+    ticks        window;
+    ticks        start;
+    size_t       nparks;
+    unsigned     backoff;
+    bool         waiting;
+};
+
+} // namespace ff
+
+#endif /* FF_SPINPARK_HPP */
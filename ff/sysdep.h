@@ -37,6 +37,12 @@
 #ifndef FF_SPIN_SYSDEP_H
 #define FF_SPIN_SYSDEP_H
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
 #if defined(__APPLE__)
 #include <AvailabilityMacros.h>
 #endif
@@ -247,4 +253,39 @@ static inline void freeAlignedMemory(void* ptr) {
 #endif  
 }
 
+static inline size_t ff_page_size() {
+#if defined(__linux__) || defined(__APPLE__)
+    static const long sz = sysconf(_SC_PAGESIZE);
+    return (sz>0) ? (size_t)sz : 4096;
+#else
+    return 4096;
+#endif
+}
+
+/*
+ * It sets the NUMA policy of the pages spanned by [ptr, ptr+size) so that
+ * they are allocated on the memory node \p node. If \p move is true, the
+ * pages already touched are migrated to the node. The range is rounded to
+ * whole pages, so the policy also applies to data sharing the first and the
+ * last page with the range.
+ * It uses the mbind system call directly so that there is no dependency on
+ * libnuma. It returns -1 if the kernel does not support NUMA policies.
+ */
+static inline int ff_numa_bind(void *ptr, size_t size, int node, bool move=false) {
+#if defined(__linux__) && defined(SYS_mbind)
+    const int MPOL_PREFERRED_ = 1, MPOL_MF_MOVE_ = (1<<1);
+    if (!ptr || !size || node<0 || node>=(int)(8*sizeof(unsigned long))) return -1;
+    const unsigned long pagesz = ff_page_size();
+    const unsigned long start  = (unsigned long)ptr & ~(pagesz-1);
+    const unsigned long end    = ((unsigned long)ptr + size + pagesz-1) & ~(pagesz-1);
+    unsigned long nodemask = 1UL << node;
+    if (syscall(SYS_mbind, start, end-start, MPOL_PREFERRED_, &nodemask,
+                8*sizeof(unsigned long), move ? MPOL_MF_MOVE_ : 0) != 0) return -1;
+    return 0;
+#else
+    (void)ptr; (void)size; (void)node; (void)move;
+    return -1;
+#endif
+}
+
 #endif /* FF_SPIN_SYSDEP_H */
@@ -41,8 +41,12 @@
 #include <vector>
 #include <deque>
 #include <queue>
+#include <atomic>
+#include <thread>
 #include <ff/allocator.hpp>
-#include "icl_hash.h"
+#include <ff/spin-lock.hpp>
+#include <ff/wsdeque.hpp>
+#include <ff/deptable.hpp>
 
 namespace ff {
 
@@ -146,6 +150,7 @@ struct hash_task_t {
             unsigned long id;
             task_status_t status;
             bool     is_dummy;
+            short    worker;         // worker of the task (-1 if not yet known)
             long     remaining_dep;  // dependencies counter
             long     unblock_numb;   // task list counter
             long     num_out;        // output edges
@@ -207,7 +212,7 @@ protected:
     // FIX: needed to deallocate address hash !!
 
     inline void task_hash_delete(hash_task_t *t) {
-        icl_hash_delete(task_set,&t->id,NULL,NULL);
+        task_set.erase(t->id);
         TASK_FREE(t->unblock_task_ids); TASK_FREE(t);
     }
            
@@ -220,11 +225,22 @@ protected:
         t->unblock_numb++;
     }
 
+    // last task that has written the data d (0 if none)
+    inline unsigned long lastWriter(uintptr_t d) const {
+        unsigned long id;
+        return address_set.find(d, id) ? id : 0;
+    }
+    // NULL if the task has been deleted
+    inline hash_task_t *findTask(unsigned long id) const {
+        hash_task_t *t;
+        return (id && task_set.find(id, t)) ? t : NULL;
+    }
+
     inline hash_task_t* createTask(unsigned long id, task_status_t status, base_f_t *wtask) {
         hash_task_t *t=(hash_task_t*)TASK_MALLOC(sizeof(hash_task_t));
         
         t->id=id;  t->status=status;  t->remaining_dep=0;
-        t->unblock_numb=0; t->wtask=wtask; t->is_dummy=false;
+        t->unblock_numb=0; t->wtask=wtask; t->is_dummy=false; t->worker=-1;
         t->unblock_task_ids=(unsigned long *)TASK_MALLOC(UNBLOCK_SIZE*sizeof(unsigned long));
         t->unblock_act_numb=UNBLOCK_SIZE;  t->num_out=0;
         return t;        
@@ -234,17 +250,17 @@ protected:
                                    hash_task_t *waittask=nullptr) {
         unsigned long act_id=task_id++;
         hash_task_t *act_task=createTask(act_id,NOT_READY,msg->wtask);	    
-        icl_hash_insert(task_set, &act_task->id, act_task); 
+        task_set.insert(act_task->id, act_task); 
         
         for (auto p: msg->P) {
             auto d    = p.tag;
             auto dir  = p.dir;
             if(dir==INPUT) {
                 //hash_task_t * t=(hash_task_t *)icl_hash_find(address_set,(void*)d);		
-                unsigned long t_id=(unsigned long)icl_hash_find(address_set,(void *)d);
+                unsigned long t_id=lastWriter(d);
                 hash_task_t * t=NULL;
                 if(t_id)    //t_id==0 if the hash table does not contains info for d
-                    t=(hash_task_t *)icl_hash_find(task_set,&t_id);
+                    t=findTask(t_id);
 
 
 	    
@@ -252,12 +268,12 @@ protected:
                     hash_task_t *dummy=createTask(task_id,DONE,NULL);
                     dummy->is_dummy=true;
                     // the dummy task uses current data
-                    icl_hash_insert(address_set,(void*)d,(void*)(dummy->id));
+                    address_set.insert(d, dummy->id);
                     // the dummy task unblocks the current data
                     dummy->unblock_task_ids[dummy->unblock_numb]=act_id;
                     dummy->unblock_numb++;
                     dummy->num_out++;
-                    icl_hash_insert(task_set,&dummy->id,dummy);
+                    task_set.insert(dummy->id, dummy);
                     task_id++;
                 } else {
                     if(t->unblock_numb == t->unblock_act_numb) {
@@ -267,20 +283,21 @@ protected:
                     t->unblock_task_ids[t->unblock_numb]=act_id;
                     t->unblock_numb++;
                     if(t->status!=DONE) act_task->remaining_dep++;
+                    if(t->worker>=0) act_task->worker=t->worker;
                 }
             } else
                 if (dir==OUTPUT) {
                     hash_task_t * t=NULL;
-                    unsigned long t_id = (unsigned long)icl_hash_find(address_set,(void*)d);
+                    unsigned long t_id = lastWriter(d);
 
-                    if (t_id) t=(hash_task_t *)icl_hash_find(task_set,&t_id);
+                    if (t_id) t=findTask(t_id);
 
                     // the task has been already written 
                     if(t != NULL) {
                         if (t->unblock_numb>0) {
                             // for each unblocked task, checks if that task unblock also act_task (WAR dependency)
                             for(long ii=0;ii<t->unblock_numb;ii++) {							
-                                hash_task_t* t2=(hash_task_t*)icl_hash_find(task_set,&t->unblock_task_ids[ii]);
+                                hash_task_t* t2=findTask(t->unblock_task_ids[ii]);
                                 if(t2!=NULL && t2!=act_task && t2->status!=DONE) {
                                     if(t2->unblock_numb == t2->unblock_act_numb) {
                                         t2->unblock_act_numb+=UNBLOCK_SIZE;
@@ -302,22 +319,63 @@ protected:
                         if (t->status==DONE && t->num_out==0)
                             task_hash_delete(t);
                     }
-                    if(t_id) icl_hash_delete(address_set,(void *)d,NULL,NULL);
-                    icl_hash_insert(address_set, (void*)d,(void *)(act_task->id));
+                    address_set.insert(d, act_task->id);
                     act_task->num_out++;
                 }
         }
         if ((act_task->remaining_dep==0) && !waittask) {
             act_task->status=READY;
             readytasks++;
-            ready_queues[m].push(act_task);
-            m = (m + 1) % runningworkers;
+            if (locality_th>0 && act_task->worker>=0)
+                ready_queues[act_task->worker].push(act_task);
+            else {
+                ready_queues[m].push(act_task);
+                m = (m + 1) % runningworkers;
+            }
         }
         return act_task;
     }
 
+    inline void dispatch(hash_task_t *t, size_t i) {
+        assert(t->status == READY);
+        t->worker = (short)i;
+        lb->ff_send_out_to(t,i);
+        ++nscheduled[i], --readytasks;
+    }
+
+    /*
+     * Locality-aware dispatch: the ready queue i holds the tasks whose
+     * input parameters have been last written by the worker i. They are
+     * sent to the worker i as long as it has less than locality_th tasks
+     * scheduled, the remaining ones go to the least loaded worker if it
+     * has no more than th tasks scheduled.
+     */
+    inline bool schedule_task_locality(const unsigned long th) {
+        bool ret = false;
+        for(size_t i=0;(readytasks>0)&&(i<runningworkers);i++) {
+            while(ready_queues[i].size()>0 && nscheduled[i]<locality_th) {
+                dispatch(ready_queues[i].top(), i);
+                ready_queues[i].pop();
+                ret = true;
+            }
+        }
+        while(readytasks>0) {
+            size_t j=0;
+            for(size_t i=1;i<runningworkers;i++)
+                if (nscheduled[i]<nscheduled[j]) j=i;
+            if (nscheduled[j]>th) break;
+            while(ready_queues[mmax].size()==0) mmax = (mmax + 1) % runningworkers;
+            dispatch(ready_queues[mmax].top(), j);
+            ready_queues[mmax].pop();
+            mmax = (mmax + 1) % runningworkers;
+            ret = true;
+        }
+        return ret;
+    }
+
     // try to send at least one task to workers
     inline bool schedule_task(const unsigned long th) {
+        if (locality_th>0) return schedule_task_locality(th);
         bool ret = false;
         for(size_t i=0;(readytasks>0)&&(i<runningworkers);i++){
             if(nscheduled[i]<=th){
@@ -353,7 +411,7 @@ protected:
     
     inline void handleTask(hash_task_t *t, int workerid) {
          for(long i=0;i<t->unblock_numb;i++) {
-             hash_task_t *tmp=(hash_task_t*)icl_hash_find(task_set,&t->unblock_task_ids[i]);
+             hash_task_t *tmp=findTask(t->unblock_task_ids[i]);
              assert(tmp);
              tmp->remaining_dep--;
              if(tmp->remaining_dep==0) {
@@ -363,7 +421,10 @@ protected:
                      if (tmp->status == NOT_READY) {
                          tmp->status=READY;
                          ++readytasks;
-                         ready_queues[workerid].push(tmp);
+                         if (locality_th>0 && tmp->worker>=0)
+                             ready_queues[tmp->worker].push(tmp);
+                         else
+                             ready_queues[workerid].push(tmp);
                      }
                  }
              }
@@ -387,7 +448,8 @@ protected:
     
 public:       
     TaskFScheduler(ff_loadbalancer* lb, const int maxnw):
-        lb(lb),ffalloc(NULL),runningworkers(0),address_set(NULL),task_set(NULL),
+        lb(lb),ffalloc(NULL),runningworkers(0),locality_th(0),
+        address_set(0x01<<12),task_set((std::max)(1024, TASK_PER_WORKER*maxnw)*8, 0),
         ready_queues(maxnw),nscheduled(maxnw) /* ,taskscheduled(maxnw) */ {
 #if !defined(DONT_USE_FFALLOC)
         ffalloc=new ff_allocator;
@@ -406,18 +468,22 @@ public:
 #if !defined(DONT_USE_FFALLOC)
         if (ffalloc) delete ffalloc;
 #endif
-        if (task_set)    icl_hash_destroy(task_set,NULL,NULL);
-        if (address_set) icl_hash_destroy(address_set,NULL,NULL);
     }
     
+    /**
+     * It enables the locality-aware dispatch of the ready tasks (th>0, see
+     * schedule_task_locality), th is the maximum number of tasks scheduled
+     * to a worker before its tasks are given to the least loaded one.
+     * 0 disables it. It has to be set before the scheduler starts.
+     */
+    void setLocality(size_t th) { locality_th = th; }
+
     virtual int svc_init() {
         runningworkers = lb->getnworkers();
         mmax = readytasks = m = 0;        
         task_id = 1;
-        if (task_set) icl_hash_destroy(task_set,NULL,NULL);
-        if (task_set) icl_hash_destroy(address_set,NULL,NULL);
-        task_set    = icl_hash_create( UPPER_TH*8, ulong_hash_function, ulong_key_compare ); 
-        address_set = icl_hash_create( 0x01<<12, address_hash_function, address_key_compare);
+        task_set.clear();
+        address_set.clear();
         const size_t maxnw = nscheduled.size();
         for(size_t i=0; i<maxnw;++i) { 
             nscheduled[i]    = 0;
@@ -429,8 +495,9 @@ public:
 protected:
     ff_loadbalancer               *lb;
     ff_allocator                  *ffalloc;
-    size_t                         task_id, runningworkers;
-    icl_hash_t                    *address_set, *task_set;
+    size_t                         task_id, runningworkers, locality_th;
+    ff_deptable<unsigned long>     address_set;  // data -> id of the last writer
+    ff_deptable<hash_task_t*>      task_set;     // id -> task
     int                            mmax, readytasks,m;
     int                            LOWER_TH, UPPER_TH;
     std::vector<priority_queue_t>  ready_queues;
@@ -440,6 +507,259 @@ protected:
 
 /* ------------------------------------------------------ */
 
+/*
+ * Work-stealing runtime (see ff_taskf::enableWorkStealing and
+ * ff_mdf::enableWorkStealing).
+ *
+ * There is no central scheduler: each worker has its own deque and, when a
+ * task completes, the worker that executed it decrements the counters of
+ * the successors and pushes the ones that become ready into its own deque.
+ * The idle workers steal from a random victim. The tasks submitted by the
+ * application thread go into a shared injection queue, the ones submitted
+ * by a running task go into the deque of the worker executing it.
+ * The dependency table (address -> ids of the last writer and of the
+ * readers) and the table of the running tasks (id -> task) are
+ * ff_deptables, each task keeps the list of its successors. The rules are
+ * the same of TaskFScheduler::insertTask. A completed task is removed from
+ * the table of the running tasks and released through ff_epoch, since a
+ * submitter might be linking it as predecessor.
+ */
+struct ws_task_t {
+    ws_task_t(unsigned long id, base_f_t *wtask):id(id),wtask(wtask),remaining(1),done(false) { init_unlocked(lock); }
+    static void destroy(void *p) { delete (ws_task_t*)p; }
+
+    const unsigned long     id;
+    base_f_t               *wtask;
+    std::atomic<long>       remaining;  // predecessors not completed (+1 during the insertion)
+    bool                    done;
+    lock_t                  lock;       // it protects succ and done
+    std::vector<ws_task_t*> succ;
+};
+
+class TaskWSRuntime {
+    enum { SPIN=64 };
+
+    struct entry_t {
+        unsigned long              writer = 0;
+        std::vector<unsigned long> readers;   // readers after the last writer
+    };
+    struct worker_t {
+        worker_t(unsigned long seed):seed(seed) {}
+        ff_wsdeque<ws_task_t*> q;
+        unsigned long          seed;  // used only by the owner to select the victims
+    };
+    // runtime and worker id of the calling thread (wid is -1 outside the workers)
+    struct self_t {
+        TaskWSRuntime *rt;
+        ssize_t        wid;
+    };
+    static inline self_t& self() {
+        static thread_local self_t S = {nullptr, -1};
+        return S;
+    }
+
+    static inline void backoff(unsigned &n) {
+        if (++n < SPIN)   { PAUSE(); return; }
+        if (n < 2*SPIN)   { std::this_thread::yield(); return; }
+        ff_relax(1);
+    }
+
+    // NULL if the task has completed (called inside an epoch critical section)
+    inline ws_task_t *findTask(unsigned long id) const {
+        ws_task_t *t;
+        return (id && tasks.find(id, t)) ? t : nullptr;
+    }
+
+    // t must wait for the completion of the task id
+    inline void addSucc(unsigned long id, ws_task_t *t) {
+        ws_task_t *pred = findTask(id);
+        if (!pred) return;
+        spin_lock(pred->lock);
+        if (!pred->done) {
+            pred->succ.push_back(t);
+            t->remaining.fetch_add(1);
+        }
+        spin_unlock(pred->lock);
+    }
+
+    inline void ready(ws_task_t *t) {
+        const self_t &me = self();
+        if (me.rt == this && me.wid >= 0) { W[me.wid]->q.push(t); return; }
+        spin_lock(injlock);
+        injected.push_back(t);
+        ninjected.fetch_add(1);
+        spin_unlock(injlock);
+    }
+
+    inline bool popInjected(ws_task_t *&t) {
+        if (ninjected.load(std::memory_order_relaxed) == 0) return false;
+        bool r = false;
+        spin_lock(injlock);
+        if (!injected.empty()) {
+            t = injected.front();
+            injected.pop_front();
+            ninjected.fetch_sub(1);
+            r = true;
+        }
+        spin_unlock(injlock);
+        return r;
+    }
+
+    // it visits all the other workers starting from a random one
+    inline bool steal(const size_t wid, ws_task_t *&t) {
+        const size_t nw = nworkers;
+        if (nw < 2) return false;
+        unsigned long &seed = W[wid]->seed;
+        seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;  // xorshift64
+        size_t v = seed % nw;
+        for(size_t i=0;i<nw;++i, v=(v+1)%nw) {
+            if (v == wid) continue;
+            ff_wsdeque<ws_task_t*> &q = W[v]->q;
+            while(!q.empty())
+                if (q.steal(t)) return true;
+        }
+        return false;
+    }
+
+    // the successors that become ready are pushed into the deque of the worker
+    inline void complete(ws_task_t *t, worker_t &w) {
+        delete t->wtask;
+        t->wtask = nullptr;
+        std::vector<ws_task_t*> succ;
+        spin_lock(t->lock);
+        t->done = true;
+        succ.swap(t->succ);
+        spin_unlock(t->lock);
+        for(ws_task_t *s: succ)
+            if (s->remaining.fetch_sub(1) == 1) w.q.push(s);
+        tasks.erase(t->id);
+        ff_epoch::instance()->retire(t, ws_task_t::destroy);
+        outstanding.fetch_sub(1);
+    }
+
+public:
+    TaskWSRuntime(const size_t maxnw):
+        wsmode(false),active(false),closed(false),nworkers(0),maxOutstanding(0),
+        nextid(1),outstanding(0),ninjected(0),deps(0x01<<12),tasks(0x01<<12, 0) {
+        init_unlocked(injlock);
+        for(size_t i=0;i<maxnw;++i)
+            W.push_back(new worker_t(0x9E3779B97F4A7C15UL*(i+1)));
+    }
+    ~TaskWSRuntime() {
+        reset();
+        for(size_t i=0;i<W.size();++i) delete W[i];
+    }
+
+    // the token sent by the scheduler to the workers to enter the runtime
+    static inline void* token() {
+        static char T;
+        return &T;
+    }
+
+    inline void enable(bool onoff) { wsmode = onoff; }
+    inline bool enabled() const    { return wsmode; }
+
+    // max number of tasks not yet completed before the submitter is stopped (0 means no limit)
+    inline void setMaxOutstanding(size_t n) { maxOutstanding = n; }
+
+    // the scheduler is going to send the token to nw workers
+    inline void start(size_t nw) {
+        nworkers = (std::min)(nw, W.size());
+        active.store(true);
+    }
+    // no more tasks from the application thread, the workers leave when all tasks have been executed
+    inline void close() { closed.store(true); }
+
+    /*
+     * It clears the dependency table at the end of a run. It is not
+     * thread-safe, it must be called when all workers have left the runtime.
+     */
+    void reset() {
+        deps.for_each([](uintptr_t, entry_t *e) { delete e; });
+        deps.clear();
+        tasks.clear();
+        for(size_t i=0;i<W.size();++i) W[i]->q.reset();
+        active.store(false);
+        closed.store(false);
+    }
+
+    /*
+     * It adds a task, the dependencies are computed from P. It can be
+     * called by the application thread or by a running task.
+     */
+    void submit(const std::vector<param_info> &P, base_f_t *wtask) {
+        if (self().rt != this) {   // the application thread is stopped if there are too many tasks
+            unsigned n = 0;
+            while(maxOutstanding && active.load(std::memory_order_relaxed) &&
+                  outstanding.load(std::memory_order_relaxed) >= (long)maxOutstanding) backoff(n);
+        }
+        ws_task_t *t = new ws_task_t(nextid.fetch_add(1), wtask);
+        outstanding.fetch_add(1);
+        tasks.insert(t->id, t);
+        ff_epoch::guard g;  // the predecessors are not released while they are being linked
+        for(const param_info &p: P) {
+            if (p.dir == VALUE) continue;
+            deps.update(p.tag, [this, &p, t](entry_t *&e, bool) {
+                if (!e) e = new entry_t;
+                if (p.dir == INPUT) {
+                    addSucc(e->writer, t);                    // RAW
+                    size_t k = 0;                             // drops the completed readers
+                    for(size_t i=0;i<e->readers.size();++i)
+                        if (findTask(e->readers[i])) e->readers[k++] = e->readers[i];
+                    e->readers.resize(k);
+                    e->readers.push_back(t->id);
+                } else {
+                    for(unsigned long r: e->readers)
+                        if (r != t->id) addSucc(r, t);        // WAR
+                    if (e->readers.empty()) addSucc(e->writer, t); // WAW
+                    e->readers.clear();
+                    e->writer = t->id;
+                }
+                return true;
+            });
+        }
+        if (t->remaining.fetch_sub(1) == 1) ready(t);
+    }
+
+    /*
+     * Work-stealing loop of the worker wid, it returns when the runtime has
+     * been closed and all tasks have been executed.
+     */
+    void run(const size_t wid) {
+        self_t &me = self();
+        me.rt = this; me.wid = wid;
+        worker_t &w = *W[wid];
+        ws_task_t *t;
+        unsigned n = 0;
+        for(;;) {
+            if (w.q.take(t) || popInjected(t) || steal(wid, t)) {
+                t->wtask->call();
+                complete(t, w);
+                n = 0;
+                continue;
+            }
+            if (closed.load() && outstanding.load() == 0) break;
+            backoff(n);
+        }
+        me.rt = nullptr; me.wid = -1;
+    }
+
+protected:
+    bool                        wsmode;
+    std::atomic<bool>           active, closed;
+    size_t                      nworkers, maxOutstanding;
+    std::atomic<unsigned long>  nextid;
+    alignas(CACHE_LINE_SIZE) std::atomic<long> outstanding;   // tasks submitted and not completed
+    alignas(CACHE_LINE_SIZE) lock_t            injlock;
+    std::atomic<long>           ninjected;
+    std::deque<ws_task_t*>      injected;
+    std::vector<worker_t*>      W;
+    ff_deptable<entry_t*>       deps;    // data -> last writer and readers
+    ff_deptable<ws_task_t*>     tasks;   // id -> task not completed
+};
+
+/* ------------------------------------------------------ */
+
 class TaskFKeyOnce {
 private:
     pthread_key_t key;
@@ -61,10 +61,16 @@ protected:
     
     /* --------------  worker ------------------------------- */
     struct Worker: ff_node_t<task_f_t> {
+        Worker(TaskWSRuntime *const rt):rt(rt) {}
         inline task_f_t *svc(task_f_t *task) {
+            if ((void*)task == TaskWSRuntime::token()) { // work-stealing mode
+                rt->run(get_my_id());
+                return task;
+            }
             task->wtask->call();
             return task;
         }
+        TaskWSRuntime *const rt;
     };
     
     /* --------------  Scheduler ---------------------------- */
@@ -72,14 +78,35 @@ protected:
     protected:
         inline bool fromInput() { return (lb->get_channel_id() == -1);	}
     public:
-        Scheduler(ff_loadbalancer*const lb, const int):
-            eosreceived(false),numtasks(0), lb(lb) {}
+        Scheduler(ff_loadbalancer*const lb, const int, TaskWSRuntime *const rt):
+            eosreceived(false),numtasks(0),wsactive(0), lb(lb), rt(rt) {}
         
         ~Scheduler() { wait(); }
 
-        int svc_init() { numtasks = 0; eosreceived = false;  return 0;}
+        int svc_init() { numtasks = 0; wsactive = 0; eosreceived = false;  return 0;}
+
+        /*
+         * Work-stealing mode: the only task coming from the input starts the
+         * workers, which get the tasks directly from the runtime. The token
+         * comes back from each worker when it leaves the runtime.
+         */
+        inline task_f_t *svc_ws(task_f_t *) {
+            if (fromInput()) {
+                wsactive = lb->getnworkers();
+                rt->start(wsactive);
+                lb->broadcast_task(TaskWSRuntime::token());
+                return GO_ON;
+            }
+            if (--wsactive == 0 && eosreceived) {
+                rt->reset();
+                lb->broadcast_task(GO_OUT);
+                return GO_OUT;
+            }
+            return GO_ON;
+        }
 
         inline task_f_t *svc(task_f_t *task) { 
+            if (rt->enabled()) return svc_ws(task);
             if (fromInput()) { 
                 ++numtasks; 
                 return task;
@@ -98,15 +125,24 @@ protected:
         void eosnotify(ssize_t id) { 
             if (id == -1) {
                 eosreceived=true; 
+                if (rt->enabled()) {
+                    rt->close();
+                    if (wsactive == 0) {
+                        rt->reset();
+                        lb->broadcast_task(EOS);
+                    }
+                    return;
+                }
                 if (numtasks<=0) lb->broadcast_task(EOS);
             }
         }
 
     protected:	
         bool   eosreceived;
-        size_t numtasks;
+        size_t numtasks, wsactive;
         
         ff_loadbalancer *const lb;
+        TaskWSRuntime   *const rt;
     };
 public:
     // NOTE: by default the scheduling is round-robin (pseudo round-robin indeed).
@@ -120,14 +156,16 @@ public:
                   (std::max)(maxTasks, (size_t)(MAX_NUM_THREADS*8)),
                   true, maxnw, true),
         farmworkers(maxnw),ntasks(0),
-        outstandingTasks((std::max)(maxTasks, (size_t)(MAX_NUM_THREADS*8))),taskscounter(0) {
+        outstandingTasks((std::max)(maxTasks, (size_t)(MAX_NUM_THREADS*8))),taskscounter(0),
+        wsstarted(false),wsrt(maxnw) {
         
         TASKS.resize(outstandingTasks); 
+        wsrt.setMaxOutstanding(outstandingTasks);
         std::vector<ff_node *> w;
         // NOTE: Worker objects are going to be destroyed by the farm destructor
-        for(int i=0;i<maxnw;++i) w.push_back(new Worker);
+        for(int i=0;i<maxnw;++i) w.push_back(new Worker(&wsrt));
         ff_farm::add_workers(w);
-        ff_farm::add_emitter(sched = new Scheduler(ff_farm::getlb(), maxnw));
+        ff_farm::add_emitter(sched = new Scheduler(ff_farm::getlb(), maxnw, &wsrt));
         ff_farm::wrap_around();
         ff_farm::set_scheduling_ondemand(ondemand_buffer);
         
@@ -154,22 +192,39 @@ public:
         ff_task_f_t<F_t, Param...> *wtask = new ff_task_f_t<F_t, Param...>(F, args...);
         std::vector<param_info> useless;
         task_f_t *task = alloc_task(useless,wtask);	
-        while(!ff_farm::offload(task, 1)) ff_relax(1);	
+        if (wsrt.enabled()) {
+            if (!wsstarted) { // the first task of the run starts the workers
+                while(!ff_farm::offload(TaskWSRuntime::token(), 1)) ff_relax(1);
+                wsstarted = true;
+            }
+            wsrt.submit(useless, wtask);
+        } else 
+            while(!ff_farm::offload(task, 1)) ff_relax(1);	
         ++taskscounter;
         return task;
     } 
+
+    /**
+     * Work-stealing mode: the tasks are not sent through the scheduler, each
+     * worker has its own deque and the idle workers steal from the others.
+     * It is meant for fine-grained tasks, for which the single scheduler
+     * thread is the bottleneck. It can be changed only when the workers are
+     * not running.
+     */
+    inline void enableWorkStealing(bool onoff=true) { wsrt.enable(onoff); }
     
     virtual inline int run_and_wait_end() {
         while(!ff_farm::offload(EOS, 1)) ff_relax(1);
         sched->thaw(true,farmworkers);
         sched->wait_freezing();
-            return sched->wait();
+        wsstarted = false;
+        return sched->wait();
     }
     virtual int run_then_freeze(ssize_t nw=-1) {
         while(!ff_farm::offload(EOS, 1)) ff_relax(1);
         sched->thaw(true,(nw>0) ? nw:taskscounter);
         int r=sched->wait_freezing();
-        taskscounter=0;
+        taskscounter=0; wsstarted=false;
         return r;
     }
     
@@ -181,7 +236,7 @@ public:
     virtual inline int wait() { 
         while(!ff_farm::offload(EOS, 1)) ff_relax(1);
         int r=sched->wait_freezing();
-        taskscounter=0;
+        taskscounter=0; wsstarted=false;
         return r;
     }
 
@@ -200,7 +255,9 @@ protected:
     int farmworkers;
     Scheduler *sched;
     size_t ntasks, outstandingTasks, taskscounter;
+    bool   wsstarted;               // the workers have been started in work-stealing mode
     std::vector<task_f_t> TASKS;    // FIX: svector should be used here
+    TaskWSRuntime wsrt;
 };
 
 } // namespace
@@ -75,6 +75,7 @@
 #include <ff/dynqueue.hpp>
 #include <ff/buffer.hpp>
 #include <ff/spin-lock.hpp>
+#include <ff/futex.hpp>
 // #if defined(HAVE_ATOMIC_H)
 // #include <asm/atomic.h>
 // #else
@@ -133,6 +134,8 @@ public:
 #endif
             p.buf = (INTERNAL_BUFFER_T*)malloc(sizeof(INTERNAL_BUFFER_T));
             new (p.buf) INTERNAL_BUFFER_T(size);
+            const int node = numa_node.load(std::memory_order_relaxed);
+            if (node>=0) p.buf->numa_bind(node);
 #if defined(uSWSR_MULTIPUSH)        
             if (!p.buf->init(true)) return NULL;
 #else
@@ -177,6 +180,13 @@ public:
     }
 #endif
 
+    /*
+     * The buffers allocated from now on are placed on the NUMA node \p node
+     * (the node of the consumer), see SWSR_Ptr_Buffer::numa_bind.
+     */
+    inline void set_numa_node(int node) { numa_node.store(node, std::memory_order_relaxed); }
+    inline int  get_numa_node() const   { return numa_node.load(std::memory_order_relaxed); }
+
     // just empties the inuse bucket putting data in the cache
     void reset() {
         union { INTERNAL_BUFFER_T * b1; void * b2;} p;
@@ -212,6 +222,7 @@ private:
                                  // SWSR unbounded queue.
                                  // No lock is needed around pop and push methods.
     INTERNAL_BUFFER_T  bufcache; // This is a bounded buffer
+    std::atomic<int>   numa_node{-1}; // set by the consumer, read by the producer
 };
     
 // --------------------------------------------------------------------------------------
@@ -234,13 +245,18 @@ class uSWSR_Ptr_Buffer {
 private:
     enum {CACHE_SIZE=32};
 
-#if defined(uSWSR_MULTIPUSH)
-    enum { MULTIPUSH_BUFFER_SIZE=16};
+public:
+    enum { MULTIPUSH_BUFFER_SIZE=INTERNAL_BUFFER_T::MULTIPUSH_BUFFER_SIZE};
+    enum { MULTIPOP_BUFFER_SIZE=INTERNAL_BUFFER_T::MULTIPOP_BUFFER_SIZE};
+
+private:
 
     // Multipush: push a bach of items.
     inline bool multipush() {
-        if (buf_w->multipush(multipush_buf,MULTIPUSH_BUFFER_SIZE)) {
+        if (buf_w->multipush(multipush_buf,mcnt)) {
+            pushed_add(mcnt);
             mcnt=0; 
+            notify_cons();
             return true;
         }
 
@@ -250,15 +266,35 @@ private:
         assert(t); // if (!t) return false; // EWOULDBLOCK
         buf_w = t;
         in_use_buffers++;
-        buf_w->multipush(multipush_buf,MULTIPUSH_BUFFER_SIZE);
+        buf_w->multipush(multipush_buf,mcnt);
+        pushed_add(mcnt);
         mcnt=0;
 #if defined(UBUFFER_STATS)
-        ++numBuffers
+        ++numBuffers;
         //atomic_long_inc(&numBuffers);
 #endif
+        notify_cons();
         return true;
     }
-#endif
+
+    // the counters are written only by their owner (see occupancy)
+    inline void pushed_add(unsigned long n) {
+        npushed.store(npushed.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+    }
+    inline void popped_add(unsigned long n) {
+        npopped.store(npopped.load(std::memory_order_relaxed)+n, std::memory_order_relaxed);
+    }
+
+    // wakes up the consumer if it is parked on this channel (see futex.hpp)
+    inline void notify_cons() {
+        ff_notifier * const n = cons_ntf.load(std::memory_order_relaxed);
+        if (n) n->notify();
+    }
+    // wakes up the producer if it is parked on this channel 
+    inline void notify_prod() {
+        ff_notifier * const n = prod_ntf.load(std::memory_order_relaxed);
+        if (n) n->notify();
+    }
 
 public:
     /**
@@ -268,7 +304,7 @@ public:
     uSWSR_Ptr_Buffer(unsigned long n,
                      const bool fixedsize=false,
                      const bool fillcache=false):
-        buf_r(0),buf_w(0),in_use_buffers(1),size(n),fixedsize(fixedsize),
+        buf_r(0),prod_ntf(nullptr),buf_w(0),cons_ntf(nullptr),mcnt(0),in_use_buffers(1),size(n),fixedsize(fixedsize),
         pool(CACHE_SIZE,fillcache,size) {
         init_unlocked(P_lock); init_unlocked(C_lock);
         pushPMF=&uSWSR_Ptr_Buffer::push;
@@ -302,6 +338,8 @@ public:
         buf_r = (INTERNAL_BUFFER_T*)::malloc(sizeof(INTERNAL_BUFFER_T));
         assert(buf_r);
         new ((void *)buf_r) INTERNAL_BUFFER_T(size);
+        if (numa_pages) buf_r->set_numa_pages();
+        if (pool.get_numa_node()>=0) buf_r->numa_bind(pool.get_numa_node());
 #if defined(uSWSR_MULTIPUSH)        
         if (!buf_r->init(true)) return false;
 #else
@@ -363,6 +401,8 @@ public:
         }
         //DBG(assert(buf_w->push(data)); return true;);
         buf_w->push(data);
+        pushed_add(1);
+        notify_cons();
         return true;
     }
 
@@ -373,7 +413,6 @@ public:
         return r;
     }
 
-#if defined(uSWSR_MULTIPUSH)
     /**
      *
      * massimot: experimental code
@@ -381,26 +420,26 @@ public:
      * This method provides the same interface of the push one but uses the
      * multipush method to provide a batch of items to the consumer thus
      * ensuring better cache locality and lowering the cache trashing.
+     * The semantics is the same of SWSR_Ptr_Buffer::mpush.
      *
-     * \return TODO
+     * \return \p false if the batch is full and cannot be published
+     * (only if \p fixedsize is \p true), the call should be retried.
      */
     inline bool mpush(void * const data) {
         assert(data != NULL);
+        if (size < 2*MULTIPUSH_BUFFER_SIZE) return push(data);
         
-        if (mcnt==MULTIPUSH_BUFFER_SIZE) 
-            return multipush();        
-
+        if (mcnt==MULTIPUSH_BUFFER_SIZE && !multipush()) return false;
         multipush_buf[mcnt++]=data;
-
-        if (mcnt==MULTIPUSH_BUFFER_SIZE) return multipush();
-
+        if (mcnt==MULTIPUSH_BUFFER_SIZE) multipush(); // if it fails, it is retried later
         return true;
     }
 
     inline bool flush() {
         return (mcnt ? multipush() : true);
     }
-#endif /* uSWSR_MULTIPUSH */
+
+    inline int mpending() const { return mcnt; }
     
     /**
      *  \brief Pop
@@ -429,9 +468,65 @@ public:
             }
         }
         //DBG(assert(buf_r->pop(data)); return true;);
-        return buf_r->pop(data);
+        if (!buf_r->pop(data)) return false;
+        popped_add(1);
+        notify_prod();
+        return true;
     }    
 
+    /**
+     *  \brief Multipop
+     *
+     *  It pops at most \p len elements updating the read pointer of the
+     *  current internal buffer only once.
+     *
+     *  \return the number of elements popped (0 if the buffer is empty)
+     */
+    inline unsigned long multipop(void * data[], unsigned long len) {
+        assert(len>0);
+        unsigned long n = buf_r->multipop(data, len);
+        if (n) { popped_add(n); notify_prod(); return n; }
+        if (!pop(data)) return 0;  // pop moves to the next internal buffer
+        n = buf_r->multipop(data+1, len-1);
+        popped_add(n);
+        return 1 + n;
+    }
+
+    /**
+     * \brief Places the queue on the NUMA memory node \p node
+     *
+     * The storage of the buffer currently read is migrated to the node and
+     * the buffers allocated later by the producer are allocated on the same
+     * node. If it is called before \p init, the first buffer is allocated
+     * on the node too. It must be called by the consumer (or before the
+     * queue is used).
+     *
+     * \return 0 if successful, -1 otherwise
+     */
+    int numa_bind(int node) {
+        if (node<0) return -1;
+        pool.set_numa_node(node);
+        if (!buf_r) return 0;  // init not called yet
+        return buf_r->numa_bind(node);
+    }
+    inline int get_numa_node() const { return pool.get_numa_node(); }
+    /**
+     * \brief The storage of the first buffer is allocated on whole pages, so
+     * that it can be migrated by numa_bind after \p init (the buffers
+     * allocated after numa_bind are always allocated on the node).
+     * It must be called before \p init.
+     */
+    inline void set_numa_pages() { numa_pages = true; }
+
+    /**
+     *  \brief Sets the notifier of the thread that parks when the queue is
+     *  empty (consumer) or full (producer). Use nullptr to remove it.
+     */
+    inline void set_cons_notifier(ff_notifier * n) { cons_ntf.store(n); }
+    inline void set_prod_notifier(ff_notifier * n) { prod_ntf.store(n); }
+    inline ff_notifier * get_cons_notifier() const { return cons_ntf.load(std::memory_order_relaxed); }
+    inline ff_notifier * get_prod_notifier() const { return prod_ntf.load(std::memory_order_relaxed); }
+
 
 #if defined(UBUFFER_STATS)
     inline unsigned long queue_status() {
@@ -504,9 +599,27 @@ public:
         return len+(in_use>0?in_use:0)*size+buf_w->length();
     }
 
+    /**
+     * \brief number of elements in the queue, it can be called by any thread
+     *
+     * It is computed from two counters, each one written only by its owner
+     * (the producer counts the elements pushed, the consumer the elements
+     * popped) in its own cache line, so the caller neither touches the
+     * internal buffers (the consumer may release them) nor their indexes.
+     * The elements of a pending multi-push are not counted.
+     */
+    inline unsigned long occupancy() const {
+        const unsigned long po = npopped.load(std::memory_order_relaxed);
+        const unsigned long pu = npushed.load(std::memory_order_relaxed);
+        return (pu > po) ? pu - po : 0;
+    }
+
     inline bool isFixedSize() const { return fixedsize; }
 
     inline void reset() {
+        npushed.store(0, std::memory_order_relaxed);
+        npopped.store(0, std::memory_order_relaxed);
+        mcnt = 0;
         if (buf_r) buf_r->reset();
         if (buf_w) buf_w->reset();
         buf_w = buf_r;
@@ -524,12 +637,18 @@ private:
     // core's private cache
     ALIGN_TO_PRE(CACHE_LINE_SIZE) 
     INTERNAL_BUFFER_T * buf_r;
+    std::atomic<ff_notifier*> prod_ntf;   // read by the consumer
     ALIGN_TO_POST(CACHE_LINE_SIZE)
 
     ALIGN_TO_PRE(CACHE_LINE_SIZE)
     INTERNAL_BUFFER_T * buf_w;
+    std::atomic<ff_notifier*> cons_ntf;   // read by the producer
     ALIGN_TO_POST(CACHE_LINE_SIZE)
 
+    // see occupancy
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned long> npushed{0};   // written by the producer
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned long> npopped{0};   // written by the consumer
+
     /* ----- two-lock used only in the mp_push and mc_pop methods ------- */
 	ALIGN_TO_PRE(CACHE_LINE_SIZE) 
     lock_t P_lock;
@@ -544,18 +663,17 @@ private:
     //atomic_long_t numBuffers;
 #endif
 
-#if defined(uSWSR_MULTIPUSH)
     /* massimot: experimental code (see multipush)
      *
      */
     // local multipush buffer used by the mpush method
     void  * multipush_buf[MULTIPUSH_BUFFER_SIZE];
     int     mcnt;
-#endif
 
     unsigned long       in_use_buffers; // used to estimate queue length
     unsigned long	    size;
     bool			    fixedsize;
+    bool                numa_pages = false; // see set_numa_pages
     BufferPool			pool;
 };
 
@@ -0,0 +1,183 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+
+/*!
+ * \file wsdeque.hpp
+ * \ingroup building_blocks
+ *
+ * \brief Chase-Lev work-stealing deque
+ *
+ * @detail The owner thread pushes and takes elements at the bottom of the
+ * deque (LIFO), any other thread can steal elements from the top (FIFO).
+ * The owner operations do not use atomic read-modify-write instructions
+ * unless the deque has only one element left. The circular array grows
+ * when it is full, the old arrays are kept until the deque is destroyed
+ * because a thief might still be reading them.
+ *
+ * The implementation follows the C11 version of the algorithm described in:
+ * N.M. Le, A. Pop, A. Cohen, F. Zappa Nardelli, "Correct and Efficient
+ * Work-Stealing for Weak Memory Models", PPoPP 2013.
+ *
+ * The elements are stored into atomic slots, so they must be trivially
+ * copyable and not larger than 64 bits (e.g. pointers or indexes).
+ */
+
+/* ***************************************************************************
+ *
+ *  FastFlow is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *  Starting from version 3.0.1 FastFlow is dual licensed under the GNU LGPLv3
+ *  or MIT License (https://github.com/ParaGroup/WindFlow/blob/vers3.x/LICENSE.MIT)
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+
+#ifndef FF_WSDEQUE_HPP
+#define FF_WSDEQUE_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <type_traits>
+#include <ff/sysdep.h>
+#include <ff/config.hpp>
+
+namespace ff {
+
+/*!
+ * \class ff_wsdeque
+ * \ingroup building_blocks
+ *
+ * \brief Single-owner multi-thief work-stealing deque.
+ *
+ * \p push and \p take can be called only by the owner thread, \p steal by
+ * any thread.
+ */
+template<typename T>
+class ff_wsdeque {
+    static_assert(std::is_trivially_copyable<T>::value && sizeof(T) <= sizeof(uint64_t),
+                  "ff_wsdeque: the elements must be trivially copyable and at most 64 bits");
+
+    struct array_t {
+        array_t(size_t logsize):
+            logsize(logsize), mask((1L<<logsize)-1), slots(new std::atomic<T>[1L<<logsize]) {}
+        ~array_t() { delete [] slots; }
+
+        inline long capacity() const   { return mask+1; }
+        inline T    get(long i) const  { return slots[i & mask].load(std::memory_order_relaxed); }
+        inline void put(long i, T x)   { slots[i & mask].store(x, std::memory_order_relaxed); }
+
+        // it returns a new array twice as big containing the elements [t, b(
+        array_t * grow(long b, long t) const {
+            array_t *a = new array_t(logsize+1);
+            for(long i=t;i<b;++i) a->put(i, get(i));
+            return a;
+        }
+
+        const size_t     logsize;
+        const long       mask;
+        std::atomic<T> * slots;
+    };
+
+public:
+    /*
+     * \param logsize the initial capacity is 2^logsize elements
+     */
+    explicit ff_wsdeque(size_t logsize=8):top(0),bottom(0),array(new array_t(logsize)) {}
+
+    ~ff_wsdeque() {
+        delete array.load(std::memory_order_relaxed);
+        for(size_t i=0;i<retired.size();++i) delete retired[i];
+    }
+
+    ff_wsdeque(const ff_wsdeque&) = delete;
+    ff_wsdeque& operator=(const ff_wsdeque&) = delete;
+
+    /*
+     * It empties the deque. It is not thread-safe, it can be called only
+     * when no other thread is using the deque.
+     */
+    inline void reset() {
+        top.store(0, std::memory_order_relaxed);
+        bottom.store(0, std::memory_order_relaxed);
+    }
+
+    // owner only
+    inline void push(T x) {
+        const long b = bottom.load(std::memory_order_relaxed);
+        const long t = top.load(std::memory_order_acquire);
+        array_t *a   = array.load(std::memory_order_relaxed);
+        if ((b-t) > (a->capacity()-1)) { // full
+            retired.push_back(a);
+            a = a->grow(b, t);
+            array.store(a, std::memory_order_release);
+        }
+        a->put(b, x);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b+1, std::memory_order_relaxed);
+    }
+
+    // owner only, it returns false if the deque is empty
+    inline bool take(T &x) {
+        const long b = bottom.load(std::memory_order_relaxed) - 1;
+        array_t *a   = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top.load(std::memory_order_relaxed);
+        if (t > b) { // empty
+            bottom.store(b+1, std::memory_order_relaxed);
+            return false;
+        }
+        x = a->get(b);
+        if (t == b) { // last element, competing with the thieves
+            const bool r = top.compare_exchange_strong(t, t+1,
+                                                       std::memory_order_seq_cst,
+                                                       std::memory_order_relaxed);
+            bottom.store(b+1, std::memory_order_relaxed);
+            return r;
+        }
+        return true;
+    }
+
+    /*
+     * Any thread. It returns false if the deque is empty or if the element
+     * has been taken by another thread in the meantime.
+     */
+    inline bool steal(T &x) {
+        long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const long b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return false;
+        array_t *a = array.load(std::memory_order_acquire);
+        x = a->get(t);
+        return top.compare_exchange_strong(t, t+1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    }
+
+    // approximated number of elements
+    inline long size() const {
+        const long s = bottom.load(std::memory_order_relaxed) - top.load(std::memory_order_relaxed);
+        return (s>0) ? s : 0;
+    }
+    inline bool empty() const { return size() == 0; }
+
+protected:
+    alignas(CACHE_LINE_SIZE) std::atomic<long>  top;
+    alignas(CACHE_LINE_SIZE) std::atomic<long>  bottom;
+    std::atomic<array_t*>  array;
+    std::vector<array_t*>  retired;    // used only by the owner
+};
+
+} // namespace ff
+
+#endif /* FF_WSDEQUE_HPP */
@@ -0,0 +1,149 @@
+/*
+ * FastFlow concurrent network:
+ *
+ *                  |--> Fast
+ *      Source -->  |
+ *                  |--> Slow
+ *
+ *  distributed version:
+ *
+ *      --------          --------
+ *     |        |        |  Fast  |
+ *     | Source | -----> |        |
+ *     |        |        |  Slow  |
+ *      --------          --------
+ *         G1                G2
+ *
+ * Credit-based flow control with a skewed destination ("channelCredits"
+ * in the configuration file). The Source sends the tasks alternately to
+ * Fast and Slow. Slow stops at its first task until Fast does not receive
+ * anything for a while: the tasks of Slow pile up in G2 (the queues of
+ * the receiver are unbounded), so G2 has to withhold the credits of Slow
+ * and G1 stops sending. It is checked that, while Slow was stopped, Fast
+ * has received at least the tasks of a credit window (the other channel
+ * keeps flowing) but not all of them (the Source has been throttled).
+ * Finally all the tasks must be received once and in order.
+ */
+
+#include <ff/dff.hpp>
+#include <atomic>
+#include <mutex>
+#include <iostream>
+
+using namespace ff;
+std::mutex mtx;
+
+const long NTASKS  = 5000;  // for each destination
+const long WINDOW  = 8;     // channelCredits in test_group27.json
+
+// trivially copyable, it is sent without serialisation
+struct Task {
+    long seq;
+    long dest;
+};
+
+std::atomic<long> fastReceived{0};
+bool failed = false;
+
+struct Source : ff_monode_t<Task>{
+    Task* svc(Task*){
+        for(long i = 0; i < NTASKS; i++)
+            for(long d = 0; d < 2; d++)
+                ff_send_out_to(new Task{i, d}, d);
+        return EOS;
+    }
+};
+
+struct Fast : ff_minode_t<Task>{
+    Task* svc(Task* in){
+        if (in->dest != 0 || in->seq != expected) {
+            const std::lock_guard<std::mutex> lock(mtx);
+            std::cerr << "Fast: task " << in->seq << " (" << in->dest << ") instead of " << expected << "\n";
+            failed = true;
+        }
+        ++expected;
+        fastReceived.fetch_add(1);
+        delete in;
+        return this->GO_ON;
+    }
+    void svc_end(){
+        if (expected != NTASKS) {
+            const std::lock_guard<std::mutex> lock(mtx);
+            std::cerr << "Fast: received " << expected << " tasks\n";
+            failed = true;
+        }
+    }
+    long expected = 0;
+};
+
+struct Slow : ff_minode_t<Task>{
+    Task* svc(Task* in){
+        if (expected == 0) {
+            // it waits until Fast does not make progress for 500ms
+            long last = -1, now;
+            while((now = fastReceived.load()) != last && now < NTASKS) {
+                last = now;
+                usleep(500000);
+            }
+            const std::lock_guard<std::mutex> lock(mtx);
+            std::cout << "Fast has received " << now << " tasks while Slow was stopped\n";
+            if (now < WINDOW) {
+                std::cerr << "Fast has been blocked by Slow\n";
+                failed = true;
+            }
+            if (now >= NTASKS) {
+                std::cerr << "the Source has not been throttled\n";
+                failed = true;
+            }
+        }
+        if (in->dest != 1 || in->seq != expected) {
+            const std::lock_guard<std::mutex> lock(mtx);
+            std::cerr << "Slow: task " << in->seq << " (" << in->dest << ") instead of " << expected << "\n";
+            failed = true;
+        }
+        ++expected;
+        delete in;
+        return this->GO_ON;
+    }
+    void svc_end(){
+        if (expected != NTASKS) {
+            const std::lock_guard<std::mutex> lock(mtx);
+            std::cerr << "Slow: received " << expected << " tasks\n";
+            failed = true;
+        }
+    }
+    long expected = 0;
+};
+
+int main(int argc, char*argv[]){
+
+	if (DFF_Init(argc, argv) != 0) {
+		error("DFF_Init\n");
+		return -1;
+	}
+
+    ff_a2a  a2a;
+	Source  source;
+	Fast    fast;
+	Slow    slow;
+    a2a.add_firstset<Source>({&source});
+	a2a.add_secondset<ff_node>({&fast, &slow});
+
+	//----- defining the distributed groups ------
+
+	a2a.createGroup("G1") << &source;
+	a2a.createGroup("G2") << &fast << &slow;
+
+    // -------------------------------------------
+
+	// running the distributed groups
+    if (a2a.run_and_wait_end()<0) {
+		error("running a2a\n");
+		return -1;
+	}
+	if (failed) {
+		error("test failed\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * FastFlow concurrent network:
+ *
+ *   Source --> Middle --> Sink
+ *
+ * distributed version:
+ *
+ *       G1            G2            G3
+ *   --------      --------      --------
+ *  | Source | -> | Middle | -> |  Sink  |
+ *   --------      --------      --------
+ *
+ * It drives the transport between the groups end to end (see
+ * test_group28.json, the groups use the sockets and batches of 32 with the
+ * byte and time bounds):
+ *  - the Source sends Task, which is trivially copyable and goes without
+ *    serialisation, in two bursts separated by a trickle (the batches are
+ *    flushed by size and by time);
+ *  - Middle turns each Task into a Msg with a payload of up to ~71KB,
+ *    serialised with cereal into the pooled buffers of the messages; the
+ *    large payloads exceed the byte bound of the batches and are received
+ *    in several reads by the receiver of G3;
+ *  - the Sink checks the order and the content of all the messages;
+ *  - with --DFF_Profile=<dir> (dff_run -P <dir>) each group checks the
+ *    traffic counted in its profile file.
+ */
+
+#include <ff/dff.hpp>
+#include <cereal/types/vector.hpp>
+#include <fstream>
+#include <iostream>
+
+using namespace ff;
+
+#define ITEMS   20000
+#define TRICKLE 200
+
+static inline long payloadLength(long id) {
+    return (id % 100 == 0) ? 70000 + id % 1000 : id % 2000;
+}
+
+// trivially copyable, it is sent without serialisation
+struct Task {
+    long id;
+    long len;
+};
+
+struct Msg {
+    long id;
+    std::vector<char> payload;
+
+	template<class Archive>
+	void serialize(Archive & archive) {
+		archive(id, payload);
+	}
+};
+
+struct Source: ff_monode_t<Task>{
+    Task* svc(Task*){
+        long i = 0;
+        for(; i < ITEMS/2; i++)                  // burst
+            ff_send_out(new Task{i, payloadLength(i)});
+        for(; i < ITEMS/2 + TRICKLE; i++) {      // trickle
+            ff_send_out(new Task{i, payloadLength(i)});
+            usleep(2000);
+        }
+        for(; i < ITEMS; i++)                    // burst
+            ff_send_out(new Task{i, payloadLength(i)});
+        return EOS;
+    }
+};
+
+struct Middle: ff_node_t<Task, Msg>{
+    Msg* svc(Task* t){
+        Msg* m = new Msg;
+        m->id = t->id;
+        m->payload.resize(t->len);
+        for(long j = 0; j < t->len; j++) m->payload[j] = (char)(t->id + j);
+        delete t;
+        return m;
+    }
+};
+
+struct Sink: ff_minode_t<Msg>{
+    Msg* svc(Msg* m){
+        bool ok = m->id == expected && (long)m->payload.size() == payloadLength(expected);
+        for(size_t j = 0; ok && j < m->payload.size(); j++)
+            ok = m->payload[j] == (char)(m->id + j);
+        if (!ok) {
+            error("Sink: wrong message %ld (expected %ld, %ld bytes)\n", m->id, expected, (long)m->payload.size());
+            abort();
+        }
+        ++expected;
+        delete m;
+        return GO_ON;
+    }
+    void svc_end() {
+        if (expected != ITEMS) {
+            error("Sink: received %ld messages instead of %d\n", expected, ITEMS);
+            abort();
+        }
+        ff::cout << "RESULT OK\n";
+    }
+    long expected = 0;
+};
+
+// the traffic towards the next group counted in the profile of this group
+static int checkProfile(const std::string& dir) {
+    const std::string group = DFF_getMyGroup();
+    std::ifstream is(dir + "/" + group + ".json");
+    if (!is) {
+        error("the profile of group %s has not been written\n", group.c_str());
+        return -1;
+    }
+    ff_dprofile::report_t r;
+    {
+        cereal::JSONInputArchive ar(is);
+        ar(cereal::make_nvp("profile", r));
+    }
+    size_t minBytes = 0;
+    std::string next;
+    if (group == "G1") {
+        next = "G2";
+        minBytes = ITEMS * sizeof(Task);
+    } else if (group == "G2") {
+        next = "G3";
+        for(long i = 0; i < ITEMS; i++) minBytes += payloadLength(i);
+    }
+    if (next.empty()) return r.edges.empty() ? 0 : -1;
+    for(auto& e : r.edges)
+        if (e.to == next && e.messages >= ITEMS && e.bytes >= minBytes) {
+            ff::cout << "profile: " << e.messages << " messages, " << e.bytes << " bytes to " << next << "\n";
+            return 0;
+        }
+    error("wrong traffic towards %s in the profile of group %s\n", next.c_str(), group.c_str());
+    return -1;
+}
+
+int main(int argc, char*argv[]){
+    // DFF_Init consumes the option
+    std::string profileDir;
+    for(int i = 1; i < argc; i++) {
+        const char* p = strstr(argv[i], "--DFF_Profile");
+        if (!p) continue;
+        const char* eq = strchr(p, '=');
+        if (eq) profileDir = eq+1;
+        else if (i+1 < argc) profileDir = argv[i+1];
+    }
+
+    if (DFF_Init(argc, argv)<0 ) {
+		error("DFF_Init\n");
+		return -1;
+	}
+
+    ff_pipeline pipe;
+	Source source;
+	Middle middle;
+	Sink   sink;
+	pipe.add_stage(&source);
+	pipe.add_stage(&middle);
+	pipe.add_stage(&sink);
+
+    //----- defining the distributed groups ------
+
+	pipe.createGroup("G1") << &source;
+	pipe.createGroup("G2") << &middle;
+	pipe.createGroup("G3") << &sink;
+
+    // -------------------------------------------
+
+	if (pipe.run_and_wait_end()<0) {
+		error("running the main pipe\n");
+		return -1;
+	}
+	if (!profileDir.empty() && checkProfile(profileDir) < 0) return -1;
+	return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * FastFlow concurrent network:
+ *
+ *      Source1 --> |
+ *      Source2 --> |
+ *      Source3 --> | --> Sink
+ *      Source4 --> |
+ *
+ *  distributed version:
+ *
+ *      ---------
+ *     | Source1 | --|
+ *      ---------    |
+ *         G1        |
+ *      ---------    |
+ *     | Source2 | --|      ------
+ *      ---------    |     |      |
+ *         G2        |---> | Sink |
+ *      ---------    |     |      |
+ *     | Source3 | --|      ------
+ *      ---------    |        G5
+ *         G3        |
+ *      ---------    |
+ *     | Source4 | --|
+ *      ---------
+ *         G4
+ *
+ * The receiver of G5 reads the connections of the four sources with two
+ * I/O threads ("receiverThreads" in test_group29.json), while the Sources
+ * use the credit-based flow control, so the acknowledgements written by the
+ * I/O threads and the credits written by the receiver share the sockets.
+ * The Sink checks that the tasks of each Source are received once and in
+ * order.
+ */
+
+#include <ff/dff.hpp>
+#include <iostream>
+
+using namespace ff;
+
+const long NSOURCES = 4;
+const long NTASKS   = 20000;  // for each Source
+
+// trivially copyable, it is sent without serialisation
+struct Task {
+    long source;
+    long seq;
+};
+
+struct Source : ff_monode_t<Task>{
+    Source(long id):id(id) {}
+    Task* svc(Task*){
+        for(long i = 0; i < NTASKS; i++)
+            ff_send_out(new Task{id, i});
+        return EOS;
+    }
+    long id;
+};
+
+struct Sink : ff_minode_t<Task>{
+    Task* svc(Task* in){
+        if (in->source < 0 || in->source >= NSOURCES || in->seq != expected[in->source]) {
+            error("Sink: task %ld of Source %ld, unexpected\n", in->seq, in->source);
+            abort();
+        }
+        ++expected[in->source];
+        delete in;
+        return this->GO_ON;
+    }
+    void svc_end(){
+        for(long s = 0; s < NSOURCES; s++)
+            if (expected[s] != NTASKS) {
+                error("Sink: received %ld tasks from Source %ld\n", expected[s], s);
+                abort();
+            }
+        ff::cout << "RESULT OK\n";
+    }
+    long expected[NSOURCES] = {};
+};
+
+int main(int argc, char*argv[]){
+
+	if (DFF_Init(argc, argv) != 0) {
+		error("DFF_Init\n");
+		return -1;
+	}
+
+    ff_a2a  a2a;
+	Source  s1(0), s2(1), s3(2), s4(3);
+	Sink    sink;
+    a2a.add_firstset<Source>({&s1, &s2, &s3, &s4});
+	a2a.add_secondset<Sink>({&sink});
+
+	//----- defining the distributed groups ------
+
+	a2a.createGroup("G1") << &s1;
+	a2a.createGroup("G2") << &s2;
+	a2a.createGroup("G3") << &s3;
+	a2a.createGroup("G4") << &s4;
+	a2a.createGroup("G5") << &sink;
+
+    // -------------------------------------------
+
+	// running the distributed groups
+    if (a2a.run_and_wait_end()<0) {
+		error("running a2a\n");
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Shared-memory transport between groups on the same host (ff_shmchannel.hpp).
+ *
+ * The segment is offered on a socket pair as in the handshake of the groups.
+ * It checks that:
+ *  - the receiver maps the segment offered with the right pid and nonce and
+ *    the data written by the sender is read back (the ring wraps around);
+ *  - the segment is refused if the nonce is not the one of the segment
+ *    (a peer claiming the pid and the descriptor of another process);
+ *  - on AF_UNIX sockets the segment is refused if pid is not the peer's one;
+ *  - the receiver sees that the sender is gone.
+ */
+
+#include <ff/distributed/ff_shmchannel.hpp>
+#include <iostream>
+#include <vector>
+
+using namespace ff;
+
+int main() {
+#if !defined(DFF_SHM)
+    std::cout << "shared-memory transport not available, test skipped\n";
+    return 0;
+#else
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+        perror("socketpair");
+        return -1;
+    }
+
+    ff_shmChannel snd;
+    if (snd.create(4096) < 0) {
+        error("creating the segment\n");
+        return -1;
+    }
+    {
+        ff_shmChannel rcv;
+        if (rcv.open(sv[1], getpid(), snd.getFd(), snd.getNonce() + 1) == 0) {
+            error("a segment with another nonce has been accepted\n");
+            return -1;
+        }
+    }
+    {
+        ff_shmChannel rcv;
+        if (rcv.open(sv[1], getppid(), snd.getFd(), snd.getNonce()) == 0) {
+            error("a segment not offered by the peer has been accepted\n");
+            return -1;
+        }
+    }
+
+    ff_shmChannel rcv;
+    if (rcv.open(sv[1], getpid(), snd.getFd(), snd.getNonce()) < 0) {
+        error("the segment offered by the peer has been refused\n");
+        return -1;
+    }
+    snd.closeFd();
+
+    // more bytes than the capacity of the ring, in messages of different sizes
+    std::vector<char> out(1000), in(1000);
+    for(int i = 0; i < 100; i++) {
+        const size_t len = 1 + (i * 37) % out.size();
+        for(size_t j = 0; j < len; j++) out[j] = (char)(i + j);
+        struct iovec iov[2];
+        size_t sz = len;
+        iov[0].iov_base = &sz;        iov[0].iov_len = sizeof(sz);
+        iov[1].iov_base = out.data(); iov[1].iov_len = len;
+        if (snd.writevn(sv[0], iov, 2) < 0) {
+            error("writing message %d\n", i);
+            return -1;
+        }
+        size_t rsz = 0;
+        if (rcv.readn(sv[1], (char*)&rsz, sizeof(rsz)) != 1 || rsz != len ||
+            rcv.readn(sv[1], in.data(), rsz) != 1 || memcmp(in.data(), out.data(), len) != 0) {
+            error("wrong message %d\n", i);
+            return -1;
+        }
+    }
+
+    close(sv[0]);
+    char c;
+    if (rcv.readable() || rcv.readn(sv[1], &c, 1) != 0) {
+        error("the end of the sender has not been detected\n");
+        return -1;
+    }
+    close(sv[1]);
+    std::cout << "DONE\n";
+    return 0;
+#endif
+}
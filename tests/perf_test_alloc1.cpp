@@ -33,7 +33,8 @@
  *
  * This test gives the possibility to test different memory allocator
  * (libc, TBB, FastFlow, Hoard (compiling with USE_STANDARD and preloading the 
- *  Hoard library) )
+ *  Hoard library) ). Compiling with USE_MAGAZINES, the per-thread magazines
+ *  of the FastFlow's allocator are enabled.
  *
  * @include perf_test_alloc1.cpp
  */
@@ -87,6 +88,12 @@ static tbb::cache_aligned_allocator<char> * tbballocator=0;
 #include <ff/allocator.hpp>
 static ff_allocator * ffalloc = 0;
 
+#if defined(USE_MAGAZINES)
+#define MAGAZINES_INIT(a)  { if ((a)->enableMagazines()<0) abort(); }
+#else
+#define MAGAZINES_INIT(a)
+#endif
+
 /* default init 
 #define ALLOCATOR_INIT(size)  {    \
  ffalloc=new ff_allocator();	   \
@@ -106,6 +113,7 @@ static ff_allocator * ffalloc = 0;
           }                                     \
           if (ffalloc->init(nslabs)<0) abort(); \
         }                                       \
+        MAGAZINES_INIT(ffalloc);                \
      }
 
 #define MALLOC(size)   (ffalloc->malloc(size))
@@ -161,6 +169,11 @@ public:
         return GO_ON; 
     }
 
+#if defined(FF_ALLOCATOR) && defined(USE_MAGAZINES)
+    // gives back the buffers still in the magazines
+    void svc_end() { ffalloc->flushMagazines(); }
+#endif
+
 private:
     int itemsize;
     long long nticks;
@@ -33,7 +33,9 @@
  *
  * This test gives the possibility to test different memory allocator
  * (libc, TBB, FastFlow, Hoard (compiling with USE_STANDARD and preloading the
- *  Hoard library) )
+ *  Hoard library) ). Compiling with USE_MAGAZINES, the per-thread magazines
+ *  of the FastFlow's allocator are enabled (the Collector frees in its
+ *  magazines).
  *
  * @include perf_test_alloc2.cpp
  */
@@ -90,8 +92,10 @@ static tbb::cache_aligned_allocator<char> * tbballocator=0;
 #define ALLOCATOR_INIT() 
 #define MALLOC(size)   (FFAllocator::instance()->malloc(size))
 
-#if defined(DONT_USE_FFA)
+#if defined(DONT_USE_FFA) || defined(USE_MAGAZINES)
 static ff_allocator* MYALLOC[MAX_NUM_THREADS]={0};
+#endif
+#if defined(DONT_USE_FFA)
 #define FREE(ptr,id)  (MYALLOC[id]->free(ptr))
 #else
 #define FREE(ptr,unused) (FFAllocator::instance()->free(ptr))
@@ -164,6 +168,9 @@ public:
             }                
             if (myalloc->init(nslabs)<0) abort(); 
         }                                       
+#if defined(USE_MAGAZINES)
+        if (myalloc->enableMagazines()<0) abort();
+#endif
     }
 
     ~Worker() {
@@ -182,7 +189,7 @@ public:
         // create a per-thread allocator
 #if defined(FF_ALLOCATOR)
         myalloc->registerAllocator();
-#if defined(DONT_USE_FFA)
+#if defined(DONT_USE_FFA) || defined(USE_MAGAZINES)
         MYALLOC[get_my_id()]=myalloc;
 #endif
 #endif
@@ -318,6 +325,12 @@ public:
 #endif
         return GO_ON; 
     }
+#if defined(FF_ALLOCATOR) && defined(USE_MAGAZINES)
+    // gives back the buffers still in the Collector's magazines
+    void svc_end() {
+        for(int i=0;i<MAX_NUM_THREADS && MYALLOC[i];++i) MYALLOC[i]->flushMagazines();
+    }
+#endif
 private:
     int itemsize; // needed for TBB's allocators
 };
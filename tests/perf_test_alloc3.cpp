@@ -33,6 +33,9 @@
  *   perf_test_alloc3 10000000 8 10000 #P
  *     - where #P is the number of threads
  *     - 8 is equivalent to 8*sizeof(long) bytes
+ *
+ * Compile with USE_MAGAZINES to enable the per-thread magazines of the
+ * allocator.
  */
 
 #include <sys/types.h>
@@ -157,10 +160,6 @@ public:
         
 #if defined(FF_ALLOCATOR)
         myalloc=new(malloc(sizeof(ff_allocator))) ff_allocator();		      
-        if (myalloc->registerAllocator()<0) {
-            error("Worker, registerAllocator fails\n");
-            return -1;
-        }
         int slab = myalloc->getslabs(itemsize*sizeof(ff_task_t));
         int nslabs[N_SLABBUFFER];               
         if (slab<0) {                           
@@ -172,6 +171,14 @@ public:
             }                
             if (myalloc->init(nslabs)<0) abort(); 
         }
+#if defined(USE_MAGAZINES)
+        if (myalloc->enableMagazines()<0) abort();
+#endif
+        // the allocator must be initialised before registering
+        if (myalloc->registerAllocator()<0) {
+            error("Worker, registerAllocator fails\n");
+            return -1;
+        }
 #endif
         return 0;
     }
@@ -205,11 +212,11 @@ public:
 
     void svc_end() {
         //if (myalloc) FFA->deleteAllocator(myalloc);
-        if (myalloc) delete myalloc;
 #if defined(FF_ALLOCATOR) && defined(ALLOCATOR_STATS)
         myalloc->deregisterAllocator();
         myalloc->printstats(std::cout);
 #endif
+        if (myalloc) delete myalloc;
     }
 
 private:
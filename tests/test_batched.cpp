@@ -0,0 +1,157 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the batched channel mode (mpush/flush/multipop).
+ *
+ * First the buffers are tested directly (bounded and unbounded, with
+ * wrap-around), then the following skeleton is executed in batched mode:
+ *
+ *                               |--> Worker --|
+ *  Source ---> Filter ---> Emitter --> Worker --> Collector ---> Sink
+ *                               |--> Worker --|
+ *
+ * Filter drops odd tasks returning GO_ON (that flushes the output batch),
+ * the Sink checks that all even tasks have been received.
+ * Finally the farm is executed with workers that are compositions of two
+ * nodes (ff_comb), whose output channel is the one of the second node.
+ */
+
+#include <iostream>
+#include <string>
+#include <ff/ff.hpp>
+using namespace ff;
+
+template<typename BUFFER>
+static bool check_buffer(BUFFER& b, const long ntasks) {
+    void *V[BUFFER::MULTIPOP_BUFFER_SIZE];
+    long expected = 1, next = 1;
+    while(expected <= ntasks) {
+        // pushes a random-sized burst then pops everything
+        const long burst = 1 + (next % 37);
+        for(long i=0; i<burst && next<=ntasks; ++i, ++next)
+            while(!b.mpush((void*)next)) {
+                // the queue is full, we have to consume something
+                unsigned long n = b.multipop(V, BUFFER::MULTIPOP_BUFFER_SIZE);
+                for(unsigned long j=0;j<n;++j)
+                    if ((long)V[j] != expected++) return false;
+            }
+        while(!b.flush()) {
+            unsigned long n = b.multipop(V, BUFFER::MULTIPOP_BUFFER_SIZE);
+            for(unsigned long j=0;j<n;++j)
+                if ((long)V[j] != expected++) return false;
+        }
+        unsigned long n;
+        while((n = b.multipop(V, BUFFER::MULTIPOP_BUFFER_SIZE))) 
+            for(unsigned long j=0;j<n;++j)
+                if ((long)V[j] != expected++) return false;
+    }
+    return b.empty();
+}
+
+struct Source: ff_node_t<long> {
+    Source(const long ntasks): ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i = 1; i <= ntasks; ++i)
+            ff_send_out((long*)i);
+        return EOS;
+    }
+    const long ntasks;
+};
+struct Filter: ff_node_t<long> {
+    long* svc(long* in) {
+        if ((long)in & 0x1) return GO_ON;
+        return in;
+    }
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* in) { return in; }
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long* in) {
+        sum += (long)in;
+        ++counter;
+        return GO_ON;
+    }
+    long sum = 0, counter = 0;
+};
+
+int main(int argc, char* argv[]) {
+    long ntasks = 1000000;
+    size_t nworkers = 3;
+    if (argc > 1) {
+        if (argc < 3) {
+            error("use: %s ntasks nworkers\n", argv[0]);
+            return -1;
+        }
+        ntasks   = std::stol(argv[1]);
+        nworkers = std::stol(argv[2]);
+    }
+
+    SWSR_Ptr_Buffer  b1(100);
+    uSWSR_Ptr_Buffer b2(64, false);
+    uSWSR_Ptr_Buffer b3(8, true);  // too small for a batch, mpush is a push
+    if (!b1.init() || !b2.init() || !b3.init()) {
+        error("initializing buffers\n");
+        return -1;
+    }
+    if (!check_buffer(b1, 10000) || !check_buffer(b2, 10000) || !check_buffer(b3, 10000)) {
+        error("wrong order in batched buffers\n");
+        return -1;
+    }
+
+    Source source(ntasks);
+    Filter filter;
+    Sink   sink;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(size_t i=0;i<nworkers;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<long> farm(std::move(W));
+    ff_Pipe<long> pipe(source, filter, farm, sink);
+    pipe.batched_mode();
+
+    if (pipe.run_and_wait_end() < 0) {
+        error("running pipeline\n");
+        return -1;
+    }
+    const long n = ntasks/2;
+    if (sink.counter != n || sink.sum != n*(n+1)) {
+        error("wrong result, received %ld tasks\n", sink.counter);
+        return -1;
+    }
+    std::cout << "time= " << pipe.ffTime() << " (ms)\n";
+
+    {
+        Source source2(ntasks);
+        Sink   sink2;
+        std::vector<std::unique_ptr<ff_node> > W2;
+        for(size_t i=0;i<nworkers;++i)
+            W2.push_back(make_unique<ff_comb>(new Worker, new Worker, true, true));
+        ff_Farm<long> farm2(std::move(W2));
+        farm2.batched_mode();
+        ff_Pipe<long> pipe2(source2, farm2, sink2);
+        if (pipe2.run_and_wait_end() < 0) {
+            error("running pipeline with combined workers\n");
+            return -1;
+        }
+        if (sink2.counter != ntasks || sink2.sum != ntasks*(ntasks+1)/2) {
+            error("wrong result with combined workers, received %ld tasks\n", sink2.counter);
+            return -1;
+        }
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
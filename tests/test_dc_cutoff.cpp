@@ -0,0 +1,105 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the adaptive cutoff of ff_DC with a mergesort whose base case is
+ * a tiny array: without the cutoff every split is a task, with the cutoff
+ * the bottom levels are executed inline by the workers. The result must be
+ * the same.
+ */
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <ff/dc.hpp>
+
+using namespace ff;
+
+struct Problem {
+    long *a;
+    long  start, end;
+};
+struct Result {
+    long *a;
+    long  start, end;
+};
+
+static int sort(long *a, long n, long base, int nw, double ratio) {
+    std::vector<long> R(a, a+n);
+    std::sort(R.begin(), R.end());
+
+    Problem op{a, 0, n};
+    Result  res;
+    // NOTE: ff_DC keeps references to the functions
+    std::function<void(const Problem&, std::vector<Problem>&)> divide =
+        [](const Problem &op, std::vector<Problem> &subops) {
+            const long mid = (op.start + op.end)/2;
+            subops.push_back({op.a, op.start, mid});
+            subops.push_back({op.a, mid, op.end});
+        };
+    std::function<void(std::vector<Result>&, Result&)> combine =
+        [](std::vector<Result> &ress, Result &ret) {
+            long *a = ress[0].a;
+            std::inplace_merge(a + ress[0].start, a + ress[1].start, a + ress[1].end);
+            ret = {a, ress[0].start, ress[1].end};
+        };
+    std::function<void(const Problem&, Result&)> seq =
+        [](const Problem &op, Result &ret) {
+            std::sort(op.a + op.start, op.a + op.end);
+            ret = {op.a, op.start, op.end};
+        };
+    std::function<bool(const Problem&)> cond =
+        [base](const Problem &op) { return (op.end - op.start) <= base; };
+
+    ff_DC<Problem, Result> dac(divide, combine, seq, cond, op, res, nw);
+    dac.setCutoffRatio(ratio);
+    ffTime(START_TIME);
+    if (dac.run_and_wait_end()<0) {
+        error("running dac\n");
+        return -1;
+    }
+    ffTime(STOP_TIME);
+    if (res.start != 0 || res.end != n || !std::equal(R.begin(), R.end(), a)) {
+        std::cerr << "wrong result (ratio " << ratio << ")\n";
+        return -1;
+    }
+    std::cout << "ratio " << ratio << ": time " << ffTime(GET_TIME) << " (ms)\n";
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long n = 1 << 12, base = 16;
+    int  nw = ff_numCores();
+    if (argc>1) {
+        if (argc!=4) {
+            std::cerr << "use: " << argv[0] << " [nworkers size base]\n";
+            return -1;
+        }
+        nw   = atoi(argv[1]);
+        n    = atol(argv[2]);
+        base = atol(argv[3]);
+    }
+    std::vector<long> a(n);
+    for(double ratio: {0.0, 4.0}) {
+        srandom(1);
+        for(auto &x: a) x = random() % (4*n);
+        if (sort(a.data(), n, base, nw, ratio)<0) return -1;
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,138 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the dependency table (ff_deptable) and the epoch-based reclamation.
+ *
+ * Each writer thread owns a disjoint set of keys (consecutive addresses,
+ * so that they share the shards with the other threads' keys) and it
+ * inserts, updates and erases them while the reader threads look them up
+ * inside an epoch critical section. The values are pointers to records
+ * that the writers retire when they replace them: a reader must never see
+ * a released record. At the end the content of the table is checked.
+ */
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <ff/utils.hpp>
+#include <ff/deptable.hpp>
+
+using namespace ff;
+
+struct record_t {
+    record_t(uintptr_t key, long v):key(key),v(v),alive(1) {}
+    uintptr_t        key;
+    long             v;
+    std::atomic<int> alive;
+};
+static std::atomic<long> released(0);
+static void destroy(void *p) {
+    record_t *r = (record_t*)p;
+    r->alive.store(0);
+    ++released;
+    delete r;
+}
+
+int main(int argc, char *argv[]) {
+    long nwriters = 3, nreaders = 2, nkeys = 20000, rounds = 20;
+    if (argc>1) {
+        if (argc!=5) {
+            std::cerr << "use: " << argv[0] << " [nwriters nreaders nkeys rounds]\n";
+            return -1;
+        }
+        nwriters = atol(argv[1]);
+        nreaders = atol(argv[2]);
+        nkeys    = atol(argv[3]);
+        rounds   = atol(argv[4]);
+    }
+    const uintptr_t base = 0x100000;
+    auto key = [&](long w, long i) { return base + (uintptr_t)(i*nwriters + w)*sizeof(long); };
+
+    ff_deptable<record_t*> T(1024);   // small, it must grow
+    std::atomic<long> allocated(0), errors(0);
+    std::atomic<bool> stop(false);
+
+    std::vector<std::thread> R;
+    for(long r=0;r<nreaders;++r)
+        R.push_back(std::thread([&]() {
+            unsigned long seed = 0x9E3779B97F4A7C15UL + (unsigned long)&seed;
+            while(!stop.load()) {
+                seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+                const uintptr_t k = key(seed % nwriters, (seed >> 8) % nkeys);
+                ff_epoch::guard g;
+                record_t *rec;
+                if (T.find(k, rec) && (rec->alive.load() != 1 || rec->key != k)) ++errors;
+            }
+        }));
+
+    std::vector<std::thread> W;
+    for(long w=0;w<nwriters;++w)
+        W.push_back(std::thread([&, w]() {
+            for(long round=0; round<rounds; ++round) {
+                for(long i=0;i<nkeys;++i) {
+                    record_t *n = new record_t(key(w,i), round);
+                    ++allocated;
+                    T.update(key(w,i), [&](record_t *&v, bool found) {
+                        if (found != (v != nullptr)) ++errors;
+                        if (v) ff_epoch::instance()->retire(v, destroy);
+                        v = n;
+                        return true;
+                    });
+                }
+                // odd keys are erased and inserted again at the next round
+                for(long i=1;i<nkeys;i+=2) {
+                    record_t *v = nullptr;
+                    if (!T.find(key(w,i), v) || v->v != round) ++errors;
+                    T.update(key(w,i), [](record_t *&v, bool) {
+                        ff_epoch::instance()->retire(v, destroy);
+                        return false;
+                    });
+                    if (T.find(key(w,i), v)) ++errors;
+                }
+            }
+        }));
+    for(auto &t: W) t.join();
+    stop.store(true);
+    for(auto &t: R) t.join();
+
+    if (T.size() != (size_t)(nwriters*((nkeys+1)/2))) {
+        std::cerr << "wrong size " << T.size() << "\n";
+        return -1;
+    }
+    long n = 0;
+    T.for_each([&](uintptr_t k, record_t *v) {
+        if (v->key != k || v->v != rounds-1 || ((k-base)/sizeof(long)/nwriters) % 2) ++errors;
+        ++n;
+    });
+    if (errors.load() || n != (long)T.size()) {
+        std::cerr << "errors " << errors.load() << "\n";
+        return -1;
+    }
+    std::cout << "allocated " << allocated.load() << " records, released " << released.load()
+              << " during the run, " << n << " in the table\n";
+    // the records retired in the last epochs may be still waiting to be released
+    if (released.load() == 0 || released.load() > allocated.load() - n) {
+        std::cerr << "wrong number of released records\n";
+        return -1;
+    }
+    T.for_each([](uintptr_t, record_t *v) { delete v; });
+    T.clear();
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,156 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the elastic farm (elastic.hpp).
+ *
+ *   Source -> Farm(Worker x nw, elastic) -> Sink
+ *
+ * The Source produces a slow stream (the farm must shrink), then a burst
+ * (the farm must grow), then it stops sending tasks for a while (the idle
+ * farm must shrink to min_workers) and then it produces a slow stream
+ * again. The Sink checks that all the tasks have been computed once. The
+ * farm is executed twice with run_then_freeze. Finally it checks that the
+ * key-partitioned scheduling is rejected.
+ */
+
+#include <iostream>
+#include <vector>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(long n):n(n) {}
+    long* svc(long*) {
+        long i=0;
+        for(;i<n;++i) {                   // slow
+            ff_send_out(new long(i));
+            usleep(200);
+        }
+        for(;i<6*n;++i) {                 // burst
+            ff_send_out(new long(i));
+            if (i%100 == 0) usleep(1000); // the load-balancer sees it
+        }
+        idleactive = (size_t)-1;          // idle
+        for(int k=0;k<300 && idleactive!=1;++k) {
+            usleep(10000);
+            idleactive = farm->get_elastic_stats()->nactive.load();
+        }
+        for(;i<7*n;++i) {                 // slow
+            ff_send_out(new long(i));
+            usleep(200);
+        }
+        return EOS;
+    }
+    long n;
+    ff_farm *farm = nullptr;
+    size_t   idleactive = 0;   // active workers at the end of the idle period
+};
+
+struct Worker: ff_node_t<long> {
+    Worker(long n):n(n) {}
+    long* svc(long *in) {
+        // the tasks of the burst are heavier, so that they are queued
+        ticks_wait((*in >= n && *in < 6*n) ? 200000 : 20000);
+        *in = 2 * *in;
+        return in;
+    }
+    long n;
+};
+
+struct Sink: ff_minode_t<long> {
+    int svc_init() { sum = 0; cnt = 0; return 0; }
+    long* svc(long *in) {
+        sum += *in; ++cnt;
+        delete in;
+        return GO_ON;
+    }
+    long sum, cnt;
+};
+
+int main(int argc, char *argv[]) {
+    int  nw = 4;
+    long n  = 1000;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " [nworkers n]\n";
+            return -1;
+        }
+        nw = atoi(argv[1]);
+        n  = atol(argv[2]);
+    }
+    Source source(n);
+    Sink   sink;
+    std::vector<std::unique_ptr<ff_node>> W;
+    for(int i=0;i<nw;++i) W.push_back(make_unique<Worker>(n));
+    ff_Farm<long> farm(std::move(W));
+    farm.remove_collector();
+    ff_elastic_params P;
+    P.min_workers = 1;
+    P.sampling_us = 500;
+    P.high        = 8.0;
+    P.low         = 2.0;
+    P.hysteresis  = 2;
+    farm.set_elastic(P);
+    source.farm = &farm;
+    ff_Pipe<> pipe(source, farm, sink);
+
+    const long N = 7*n;
+    for(int r=0;r<2;++r) {
+        if (pipe.run_then_freeze()<0) {
+            error("running pipe\n");
+            return -1;
+        }
+        if (pipe.wait_freezing()<0) {
+            error("waiting pipe\n");
+            return -1;
+        }
+        const ff_elastic_stats *S = farm.get_elastic_stats();
+        std::cout << "run " << r << ": grow " << S->ngrow.load() << ", shrink " << S->nshrink.load()
+                  << ", min active " << S->minactive.load() << ", active when idle "
+                  << source.idleactive << "\n";
+        if (sink.cnt != N || sink.sum != N*(N-1)) {
+            std::cerr << "wrong result: " << sink.cnt << " tasks, sum " << sink.sum << "\n";
+            return -1;
+        }
+        if (S->nshrink.load() == 0 || S->ngrow.load() == 0 || S->minactive.load() >= (size_t)nw) {
+            std::cerr << "the farm has not been resized\n";
+            return -1;
+        }
+        if (source.idleactive != P.min_workers) {
+            std::cerr << "the idle farm has not been shrunk\n";
+            return -1;
+        }
+    }
+    pipe.wait();
+
+    // the keys would move at each resize
+    {
+        std::vector<std::unique_ptr<ff_node>> W2;
+        for(int i=0;i<nw;++i) W2.push_back(make_unique<Worker>(n));
+        ff_Farm<long> kfarm(std::move(W2));
+        kfarm.set_scheduling_keyed(ff_keyed_policy([](void *t) { return (uint64_t)*(long*)t; }));
+        kfarm.set_elastic(P);
+        if (kfarm.run_and_wait_end() == 0) {
+            std::cerr << "the key-partitioned scheduling has been accepted in an elastic farm\n";
+            return -1;
+        }
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,113 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the power-of-two-choices scheduling (twochoices_lb in lb.hpp).
+ *
+ *   Source -> Farm(Worker x nw) -> Sink
+ *
+ * The worker 0 is much slower than the others and its input queue grows
+ * while the others' are drained as the tasks arrive: with the two-choices
+ * scheduling it has to receive less tasks than with the round-robin one.
+ * The Sink checks that all the tasks have been computed once.
+ */
+
+#include <iostream>
+#include <vector>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(long n):n(n) {}
+    long* svc(long*) {
+        for(long i=0;i<n;++i) {
+            ff_send_out(new long(i));
+            usleep(50);   // the queues of the fast workers are drained
+        }
+        return EOS;
+    }
+    long n;
+};
+
+struct Worker: ff_node_t<long> {
+    int svc_init() { cnt = 0; return 0; }
+    long* svc(long *in) {
+        if (get_my_id() == 0) usleep(500);
+        ++cnt;
+        return in;
+    }
+    long cnt;
+};
+
+struct Sink: ff_node_t<long> {
+    int svc_init() { sum = 0; cnt = 0; return 0; }
+    long* svc(long *in) {
+        sum += *in; ++cnt;
+        delete in;
+        return GO_ON;
+    }
+    long sum, cnt;
+};
+
+static long run(int nw, long n, bool twochoices) {
+    Source source(n);
+    Sink   sink;
+    std::vector<Worker*> W;
+    std::vector<std::unique_ptr<ff_node>> V;
+    for(int i=0;i<nw;++i) {
+        W.push_back(new Worker);
+        V.push_back(std::unique_ptr<ff_node>(W.back()));
+    }
+    ff_Farm<long> farm(std::move(V));
+    if (twochoices) farm.set_scheduling_twochoices(4);
+    ff_Pipe<> pipe(source, farm, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (sink.cnt != n || sink.sum != n*(n-1)/2) {
+        std::cerr << "wrong result: " << sink.cnt << " tasks, sum " << sink.sum << "\n";
+        return -1;
+    }
+    std::cout << (twochoices ? "two-choices:" : "round-robin:");
+    for(auto w: W) std::cout << " " << w->cnt;
+    std::cout << " (" << pipe.ffTime() << " ms)\n";
+    return W[0]->cnt;
+}
+
+int main(int argc, char *argv[]) {
+    int  nw = 4;
+    long n  = 2000;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " [nworkers ntasks]\n";
+            return -1;
+        }
+        nw = atoi(argv[1]);
+        n  = atol(argv[2]);
+    }
+    const long rr = run(nw, n, false);
+    const long tc = run(nw, n, true);
+    if (rr<0 || tc<0) return -1;
+    if (nw > 1 && tc >= rr) {
+        std::cerr << "the slow worker has not been avoided\n";
+        return -1;
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,144 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the blocking run-time mode, where the threads park on the futex
+ * notifiers attached to the channels.
+ *
+ * 1. pipeline:
+ *                       |--> Worker --|
+ *  Source ---> Stage ---|--> Worker --|---> Collector ---> Sink
+ *                       |--> Worker --|
+ *
+ * 2. farm accelerator (offload/load_result from the main thread).
+ *
+ * The Source produces bursts of tasks separated by pauses so that the
+ * other stages park in between, the channels are bounded and the Sink is
+ * slower than the Workers so that also the producers park on full channels.
+ */
+
+#include <iostream>
+#include <string>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(long nbursts, long burst):nbursts(nbursts),burst(burst) {}
+    long* svc(long*) {
+        long k=1;
+        for(long i=0; i<nbursts; ++i) {
+            for(long j=0; j<burst; ++j)
+                ff_send_out((long*)k++);
+            usleep(2000);
+        }
+        return EOS;
+    }
+    const long nbursts, burst;
+};
+struct Stage: ff_node_t<long> {
+    long* svc(long* in) { return in; }
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long* in) {
+        ticks_wait(2000);
+        sum += (long)in;
+        ++counter;
+        return GO_ON;
+    }
+    long sum = 0, counter = 0;
+};
+
+int main(int argc, char* argv[]) {
+    long nbursts = 50;
+    long burst   = 1000;
+    size_t nworkers = 3;
+    if (argc > 1) {
+        if (argc < 4) {
+            error("use: %s nbursts burst nworkers\n", argv[0]);
+            return -1;
+        }
+        nbursts  = std::stol(argv[1]);
+        burst    = std::stol(argv[2]);
+        nworkers = std::stol(argv[3]);
+    }
+    const long n = nbursts*burst;
+
+    {
+        Source source(nbursts, burst);
+        Stage  stage;
+        Sink   sink;
+        std::vector<std::unique_ptr<ff_node> > W;
+        for(size_t i=0;i<nworkers;++i) W.push_back(make_unique<Stage>());
+        ff_Farm<long> farm(std::move(W));
+        ff_Pipe<long> pipe(source, stage, farm, sink);
+        pipe.setFixedSize(true);
+        pipe.setXNodeInputQueueLength(64, false);
+        pipe.setXNodeOutputQueueLength(64, false);
+        pipe.blocking_mode(true);
+
+        if (pipe.run_and_wait_end() < 0) {
+            error("running pipeline\n");
+            return -1;
+        }
+        if (sink.counter != n || sink.sum != n*(n+1)/2) {
+            error("pipeline: wrong result, received %ld tasks\n", sink.counter);
+            return -1;
+        }
+        const ff_notifier *p = stage.get_notifier_in();
+        if (!p || p->get_nwaits() == 0) {
+            error("the Stage has never been parked\n");
+            return -1;
+        }
+        std::cout << "Stage: parked " << p->get_nwaits() << " times, woken up "
+                  << p->get_nwakes() << " times\n";
+        std::cout << "pipeline DONE, time= " << pipe.ffTime() << " (ms)\n";
+    }
+    {
+        ff_farm farm(true /* accelerator set */);
+        std::vector<ff_node*> W;
+        for(size_t i=0;i<nworkers;++i) W.push_back(new Stage);
+        farm.add_workers(W);
+        farm.add_collector(NULL);
+        farm.cleanup_workers();
+        farm.blocking_mode(true);
+        if (farm.run_then_freeze() < 0) {
+            error("running farm accelerator\n");
+            return -1;
+        }
+        long sum = 0, counter = 0;
+        void *r = nullptr;
+        for(long i=1; i<=n; ++i) {
+            farm.offload((void*)i);
+            // results are collected only every few tasks, so the workers
+            // park on the full output channels from time to time
+            if ((i % 128) == 0)
+                while(farm.load_result_nb(&r)) { sum += (long)r; ++counter; }
+        }
+        farm.offload((void*)FF_EOS);
+        while(farm.load_result(&r)) { sum += (long)r; ++counter; }
+        if (farm.wait_freezing() < 0) {
+            error("waiting farm accelerator\n");
+            return -1;
+        }
+        if (counter != n || sum != n*(n+1)/2) {
+            error("accelerator: wrong result, received %ld tasks\n", counter);
+            return -1;
+        }
+        std::cout << "accelerator DONE, time= " << farm.ffTime() << " (ms)\n";
+    }
+    return 0;
+}
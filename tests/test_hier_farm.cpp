@@ -0,0 +1,176 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the hierarchical farm (ff_farm::set_hierarchical).
+ *
+ *   Source -> Farm(Emitter, Worker x nw, Collector) -> Sink
+ *
+ * The workers are split in groups of 'fanout' workers, each group has its
+ * own emitter and collector. It is checked that:
+ *  - all the tasks are computed once, the EOS reaches the Collector and
+ *    the Sink (with and without the collector, run twice with
+ *    run_then_freeze, on-demand scheduling);
+ *  - the ids of the workers are not changed by the grouping;
+ *  - with the key-partitioned scheduling each key is seen by one worker
+ *    and the keys are spread over all the workers (the hashing of the two
+ *    levels is not correlated).
+ */
+
+#include <iostream>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+static std::mutex mtx;
+static std::vector<std::set<long>> keys;   // worker id -> keys seen
+static const long NKEYS = 997;
+
+struct Source: ff_node_t<long> {
+    Source(long n):n(n) {}
+    long* svc(long*) {
+        for(long i=0;i<n;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long n;
+};
+
+struct Emitter: ff_node_t<long> {
+    long* svc(long *in) { return in; }
+    void eosnotify(ssize_t) { ++neos; }
+    long neos = 0;
+};
+
+struct Worker: ff_node_t<long> {
+    int svc_init() { cnt = 0; return 0; }
+    long* svc(long *in) {
+        ++cnt;
+        std::lock_guard<std::mutex> lck(mtx);
+        keys[get_my_id()].insert(*in % NKEYS);
+        return in;
+    }
+    long cnt;
+};
+
+struct Collector: ff_minode_t<long> {
+    int svc_init() { cnt = 0; return 0; }
+    long* svc(long *in) { ++cnt; return in; }
+    long cnt;
+};
+
+struct Sink: ff_minode_t<long> {
+    int svc_init() { sum = 0; cnt = 0; return 0; }
+    long* svc(long *in) {
+        sum += *in; ++cnt;
+        delete in;
+        return GO_ON;
+    }
+    long sum, cnt;
+};
+
+static uint64_t taskkey(void *t) { return (uint64_t)(*(long*)t % NKEYS); }
+
+static int run(int nw, size_t fanout, long n, bool collector, bool ondemand, bool keyed) {
+    keys.assign(nw, std::set<long>());
+    Source    source(n);
+    Emitter   emitter;
+    Collector coll;
+    Sink      sink;
+    std::vector<Worker*> W;
+    std::vector<std::unique_ptr<ff_node>> V;
+    for(int i=0;i<nw;++i) {
+        W.push_back(new Worker);
+        V.push_back(std::unique_ptr<ff_node>(W.back()));
+    }
+    ff_Farm<long> farm(std::move(V));
+    farm.add_emitter(emitter);
+    if (collector) farm.add_collector(coll);
+    else farm.remove_collector();
+    if (ondemand) farm.set_scheduling_ondemand();
+    if (keyed)    farm.set_scheduling_keyed(ff_keyed_policy(taskkey));
+    farm.set_hierarchical(fanout);
+    ff_Pipe<> pipe(source, farm, sink);
+
+    for(int r=0;r<2;++r) {
+        if (pipe.run_then_freeze()<0 || pipe.wait_freezing()<0) {
+            error("running pipe\n");
+            return -1;
+        }
+        long tot = 0;
+        for(auto w: W) tot += w->cnt;
+        if (sink.cnt != n || sink.sum != n*(n-1)/2 || tot != n || (collector && coll.cnt != n)) {
+            std::cerr << "wrong result: " << sink.cnt << " tasks, sum " << sink.sum << "\n";
+            return -1;
+        }
+        if (emitter.neos != r+1) {
+            std::cerr << "wrong number of EOS at the emitter\n";
+            return -1;
+        }
+    }
+    pipe.wait();
+
+    // ids of the workers and keys
+    for(int i=0;i<nw;++i)
+        if (W[i]->get_my_id() != i) {
+            std::cerr << "wrong worker id " << W[i]->get_my_id() << " (" << i << ")\n";
+            return -1;
+        }
+    if (keyed) {
+        std::set<long> seen;
+        for(auto &s: keys)
+            for(auto k: s)
+                if (!seen.insert(k).second) {
+                    std::cerr << "key " << k << " on more workers\n";
+                    return -1;
+                }
+        // each worker should have ~NKEYS/nw keys
+        for(int i=0;i<nw;++i)
+            if (keys[i].size() < (size_t)(std::min(n, NKEYS)/(2*nw))) {
+                std::cerr << "worker " << i << " has " << keys[i].size() << " keys\n";
+                return -1;
+            }
+    }
+    std::cout << nw << " workers, fanout " << fanout << (collector?", collector":"")
+              << (ondemand?", ondemand":"") << (keyed?", keyed":"") << ":";
+    for(auto w: W) std::cout << " " << w->cnt;
+    std::cout << "\n";
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int    nw     = 10;
+    size_t fanout = 4;
+    long   n      = 500;
+    if (argc>1) {
+        if (argc!=4) {
+            std::cerr << "use: " << argv[0] << " [nworkers fanout ntasks]\n";
+            return -1;
+        }
+        nw     = atoi(argv[1]);
+        fanout = atol(argv[2]);
+        n      = atol(argv[3]);
+    }
+    if (run(nw, fanout, n, true,  false, false)<0) return -1;
+    if (run(nw, fanout, n, false, false, false)<0) return -1;
+    if (run(nw, fanout, n, true,  true,  false)<0) return -1;
+    if (run(nw, fanout, n, true,  false, true)<0)  return -1;
+    std::cout << "DONE\n";
+    return 0;
+}
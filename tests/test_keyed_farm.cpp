@@ -0,0 +1,207 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the key-partitioned scheduling (keyed_policies.hpp).
+ *
+ *   farm:  Source -> Farm(Worker, ff_key_combiner) -> Sink
+ *   a2a:   Source -> A2A(Source x 2, Worker x nw) -> ff_key_combiner -> Sink
+ *
+ * The Workers count the elements of each key and send out the partial
+ * counts at the end of the stream. In the farm, the key 0 receives 30% of
+ * the elements: first it is checked that each key is seen by only one
+ * worker, then the hot-key mode is enabled and the key 0 must be spread
+ * over more workers. The combiner merges the partial counts, the Sink
+ * checks the totals.
+ */
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <mutex>
+#include <ff/ff.hpp>
+
+using namespace ff;
+
+const long NKEYS = 100;
+
+struct item_t {
+    item_t(long key, long count=1):key(key),count(count) {}
+    long key;
+    long count;
+};
+
+static uint64_t itemkey(void *t) { return (uint64_t)((item_t*)t)->key; }
+
+// key -> workers that have seen it
+static std::mutex mtx;
+static std::map<long, std::set<ssize_t>> owners;
+
+static long nextkey(unsigned long &seed) {
+    seed = seed * 6364136223846793005UL + 1442695040888963407UL;
+    const long r = (long)((seed >> 33) % 100);
+    return (r < 30) ? 0 : 1 + (long)((seed >> 17) % (NKEYS-1));
+}
+
+struct Source: ff_node_t<item_t> {
+    Source(long n, unsigned long seed):n(n),seed(seed) {}
+    item_t* svc(item_t*) {
+        for(long i=0;i<n;++i) ff_send_out(new item_t(nextkey(seed)));
+        return EOS;
+    }
+    long n;
+    unsigned long seed;
+};
+
+struct Worker: ff_node_t<item_t> {
+    item_t* svc(item_t *in) {
+        C[in->key] += in->count;
+        delete in;
+        return GO_ON;
+    }
+    void eosnotify(ssize_t) {
+        std::lock_guard<std::mutex> lck(mtx);
+        for(auto &c: C) {
+            owners[c.first].insert(get_my_id());
+            ff_send_out(new item_t(c.first, c.second));
+        }
+        C.clear();
+    }
+    std::map<long, long> C;
+};
+
+struct Sink: ff_node_t<item_t> {
+    item_t* svc(item_t *in) {
+        R[in->key] += in->count;
+        delete in;
+        return GO_ON;
+    }
+    std::map<long, long> R;
+};
+
+static std::vector<long> expected(long n, unsigned long seed) {
+    std::vector<long> E(NKEYS, 0);
+    for(long i=0;i<n;++i) ++E[nextkey(seed)];
+    return E;
+}
+
+static bool check(const char *name, const std::map<long,long> &R, const std::vector<long> &E) {
+    for(long k=0;k<NKEYS;++k) {
+        auto it = R.find(k);
+        if ((it == R.end() ? 0 : it->second) != E[k]) {
+            std::cerr << name << ": wrong count for key " << k << "\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint64_t combinerkey(const item_t &t) { return (uint64_t)t.key; }
+static void combinermerge(item_t &acc, const item_t &t) { acc.count += t.count; }
+
+static int runfarm(int nw, long n, bool hot) {
+    owners.clear();
+    Source source(n, 17);
+    Sink   sink;
+    std::vector<std::unique_ptr<ff_node>> W;
+    for(int i=0;i<nw;++i) W.push_back(make_unique<Worker>());
+    ff_Farm<item_t> farm(std::move(W));
+    ff_keyed_policy P(itemkey);
+    if (hot) P.set_hotkeys(0.2, nw, 1024);
+    farm.set_scheduling_keyed(P);
+    ff_key_combiner<item_t> comb(combinerkey, combinermerge);
+    farm.add_collector(comb);
+    ff_Pipe<> pipe(source, farm, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    if (!check("farm", sink.R, expected(n, 17))) return -1;
+    for(auto &o: owners) {
+        if (o.first != 0 && o.second.size() != 1) {
+            std::cerr << "farm: key " << o.first << " on " << o.second.size() << " workers\n";
+            return -1;
+        }
+    }
+    const size_t nowners0 = owners[0].size();
+    std::cout << "farm: hot-keys " << (hot?"on":"off") << ", key 0 on " << nowners0 << " workers\n";
+    if ((hot && nowners0 < 2) || (!hot && nowners0 != 1)) {
+        std::cerr << "farm: wrong placement of the hot key\n";
+        return -1;
+    }
+    return 0;
+}
+
+static int runa2a(int nw, long n) {
+    owners.clear();
+    Sink sink;
+    std::vector<ff_node*> G, W;
+    G.push_back(new Source(n, 17));
+    G.push_back(new Source(n, 29));
+    for(int i=0;i<nw;++i) W.push_back(new Worker);
+    ff_a2a a2a;
+    a2a.add_firstset(G, 0, true);
+    a2a.add_secondset(W, true);
+    a2a.set_scheduling_keyed(ff_keyed_policy(itemkey));
+    ff_key_combiner<item_t> comb(combinerkey, combinermerge);
+    ff_Pipe<> pipe(a2a, comb, sink);
+    if (pipe.run_and_wait_end()<0) {
+        error("running pipe\n");
+        return -1;
+    }
+    std::vector<long> E = expected(n, 17), E2 = expected(n, 29);
+    for(long k=0;k<NKEYS;++k) E[k] += E2[k];
+    if (!check("a2a", sink.R, E)) return -1;
+    // both the nodes of the first set send a key to the same worker
+    for(auto &o: owners) {
+        if (o.second.size() != 1) {
+            std::cerr << "a2a: key " << o.first << " on " << o.second.size() << " workers\n";
+            return -1;
+        }
+    }
+    std::cout << "a2a: " << owners.size() << " keys, one worker each\n";
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int  nw = 4;
+    long n  = 20000;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " [nworkers nelements]\n";
+            return -1;
+        }
+        nw = atoi(argv[1]);
+        n  = atol(argv[2]);
+    }
+    if (runfarm(nw, n, false)<0) return -1;
+    if (runfarm(nw, n, true)<0)  return -1;
+    if (runa2a(nw, n)<0)         return -1;
+
+    // consistency: with one more destination only few keys move
+    long moved = 0;
+    for(uint64_t k=0;k<10000;++k)
+        if (ff_jump_hash(ff_mix64(k), 8) != ff_jump_hash(ff_mix64(k), 9)) ++moved;
+    std::cout << "keys moved from 8 to 9 workers: " << moved << "/10000\n";
+    if (moved > 10000/9 + 300) {
+        std::cerr << "too many keys moved\n";
+        return -1;
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
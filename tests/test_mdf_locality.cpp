@@ -0,0 +1,122 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the locality-aware dispatch of ff_mdf.
+ *
+ * K independent chains of tasks, each one updates its own block:
+ *
+ *    B[k] = f(B[k])     L times for each k     (RAW and WAW on B[k])
+ *
+ * The result is checked against the sequential one, with and without the
+ * locality-aware dispatch. With the locality-aware dispatch most of the
+ * tasks of a chain should run on the worker that executed the previous one.
+ */
+
+#include <iostream>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/mdf.hpp>
+
+using namespace ff;
+
+static thread_local long myid = -1;
+static std::atomic<long> nextid(0);
+
+struct block_t {
+    std::vector<long> v;
+    long              last;   // thread that executed the last task
+    long              moved;  // n. of tasks executed by a different thread
+};
+
+static void f(block_t *B) {
+    if (myid < 0) myid = nextid++;
+    for(auto &x: B->v) x = (3*x + 1) % 1000003;
+    if (B->last >= 0 && B->last != myid) ++B->moved;
+    B->last = myid;
+}
+
+struct Parameters {
+    long K, L;
+    std::vector<block_t> *B;
+    ff_mdf *mdf;
+};
+
+static void taskGen(Parameters *const P) {
+    std::vector<param_info> Param;
+    for(long i=0;i<P->L;++i)
+        for(long k=0;k<P->K;++k) {
+            block_t *b = &(*P->B)[k];
+            Param.clear();
+            Param.push_back({(uintptr_t)b, INPUT});
+            Param.push_back({(uintptr_t)b, OUTPUT});
+            P->mdf->AddTask(Param, f, b);
+        }
+}
+
+int main(int argc, char *argv[]) {
+    int  nw = 3;
+    long K = 6, L = 20, size = 4096;
+    if (argc>1) {
+        if (argc!=5) {
+            std::cerr << "use: " << argv[0] << " [nworkers K L size]\n";
+            return -1;
+        }
+        nw   = atoi(argv[1]);
+        K    = atol(argv[2]);
+        L    = atol(argv[3]);
+        size = atol(argv[4]);
+    }
+
+    std::vector<long> R(size);
+    for(long j=0;j<size;++j) R[j] = j;
+    for(long i=0;i<L;++i)
+        for(auto &x: R) x = (3*x + 1) % 1000003;
+
+    std::vector<block_t> B;
+    Parameters P;
+    P.K = K; P.L = L; P.B = &B;
+    ff_mdf dag(taskGen, &P, 1024, nw);
+    P.mdf = &dag;
+    for(size_t th: {0, 2}) {
+        dag.setLocality(th);
+        B.assign(K, block_t());
+        for(auto &b: B) {
+            b.v.resize(size);
+            for(long j=0;j<size;++j) b.v[j] = j;
+            b.last = -1; b.moved = 0;
+        }
+        ffTime(START_TIME);
+        if (dag.run_then_freeze()<0) {
+            error("running mdf\n");
+            return -1;
+        }
+        ffTime(STOP_TIME);
+        long moved = 0;
+        for(auto &b: B) {
+            if (b.v != R) {
+                std::cerr << "wrong result\n";
+                return -1;
+            }
+            moved += b.moved;
+        }
+        std::cout << "locality " << th << ": " << K*L << " tasks, " << moved
+                  << " moved to another worker, time " << ffTime(GET_TIME) << " (ms)\n";
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,152 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the work-stealing mode of ff_mdf and ff_taskf.
+ *
+ * The MDF graph is a fine-grained wavefront on a NxN matrix:
+ *
+ *    M[i][j] = M[i-1][j] + M[i][j-1] + 1     (RAW)
+ *    S      += M[i][j]                       (RAW and WAW on S)
+ *    M[i][j] = 2*M[i][j]                     (WAR with the sum, WAW)
+ *
+ * executed several times in work-stealing mode, the result is checked
+ * against the sequential one. Then ff_taskf executes batches of
+ * independent tasks in work-stealing mode.
+ */
+
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <ff/ff.hpp>
+#include <ff/mdf.hpp>
+#include <ff/taskf.hpp>
+
+using namespace ff;
+
+const long MOD = 1000003;
+
+static void wave(long *X, const long *up, const long *left) { *X = (*up + *left + 1) % MOD; }
+static void accum(long *S, const long *X) { *S = (*S + *X) % MOD; }
+static void twice(long *X) { *X = (2 * *X) % MOD; }
+
+struct Parameters {
+    long     N;
+    long    *M;   // (N+1)x(N+1), row 0 and column 0 are the borders
+    long     S;
+    ff_mdf  *mdf;
+};
+
+static void taskGen(Parameters *const P) {
+    const long N = P->N;
+    long *M = P->M;
+    std::vector<param_info> Param;
+    for(long i=1;i<=N;++i)
+        for(long j=1;j<=N;++j) {
+            long *X = &M[i*(N+1)+j], *up = &M[(i-1)*(N+1)+j], *left = &M[i*(N+1)+j-1];
+            Param.clear();
+            Param.push_back({(uintptr_t)up,   INPUT});
+            Param.push_back({(uintptr_t)left, INPUT});
+            Param.push_back({(uintptr_t)X,    OUTPUT});
+            P->mdf->AddTask(Param, wave, X, (const long*)up, (const long*)left);
+        }
+    for(long i=1;i<=N;++i)
+        for(long j=1;j<=N;++j) {
+            long *X = &M[i*(N+1)+j];
+            Param.clear();
+            Param.push_back({(uintptr_t)X,     INPUT});
+            Param.push_back({(uintptr_t)&P->S, INPUT});
+            Param.push_back({(uintptr_t)&P->S, OUTPUT});
+            P->mdf->AddTask(Param, accum, &P->S, (const long*)X);
+        }
+    for(long i=N;i>=1;--i)
+        for(long j=N;j>=1;--j) {
+            long *X = &M[i*(N+1)+j];
+            Param.clear();
+            Param.push_back({(uintptr_t)X, INPUT});
+            Param.push_back({(uintptr_t)X, OUTPUT});
+            P->mdf->AddTask(Param, twice, X);
+        }
+}
+
+static void sequential(long N, std::vector<long> &M, long &S) {
+    for(long i=1;i<=N;++i)
+        for(long j=1;j<=N;++j) wave(&M[i*(N+1)+j], &M[(i-1)*(N+1)+j], &M[i*(N+1)+j-1]);
+    for(long i=1;i<=N;++i)
+        for(long j=1;j<=N;++j) accum(&S, &M[i*(N+1)+j]);
+    for(long i=1;i<=N;++i)
+        for(long j=1;j<=N;++j) twice(&M[i*(N+1)+j]);
+}
+
+int main(int argc, char *argv[]) {
+    int  nw = 3;
+    long N  = 64;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " [nworkers N]\n";
+            return -1;
+        }
+        nw = atoi(argv[1]);
+        N  = atol(argv[2]);
+    }
+
+    std::vector<long> R((N+1)*(N+1), 1), M;
+    long RS = 0;
+    sequential(N, R, RS);
+
+    Parameters P;
+    P.N = N;
+    ff_mdf dag(taskGen, &P, 1024, nw);
+    P.mdf = &dag;
+    dag.enableWorkStealing();
+    for(int k=0;k<4;++k) {
+        M.assign((N+1)*(N+1), 1);
+        P.M = M.data(); P.S = 0;
+        ffTime(START_TIME);
+        if (dag.run_then_freeze()<0) {
+            error("running mdf\n");
+            return -1;
+        }
+        ffTime(STOP_TIME);
+        if (M != R || P.S != RS) {
+            std::cerr << "mdf: wrong result\n";
+            return -1;
+        }
+        std::cout << "mdf: " << 3*N*N << " tasks, time " << ffTime(GET_TIME) << " (ms)\n";
+    }
+
+    ff_taskf taskf(nw);
+    taskf.enableWorkStealing();
+    std::atomic<long> K(0);
+    auto F = [&K](const long i) { K += i; };
+    for(int k=0;k<5;++k) {
+        for(long i=1;i<=10000;++i) taskf.AddTask(F, i);
+        if (taskf.run_then_freeze()<0) {
+            error("running taskf\n");
+            return -1;
+        }
+    }
+    taskf.run();
+    for(long i=1;i<=10000;++i) taskf.AddTask(F, i);
+    taskf.wait();
+    if (K != 6*50005000L) {
+        std::cerr << "taskf: wrong result " << K << "\n";
+        return -1;
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
@@ -0,0 +1,139 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the NUMA mode of the farm:
+ *
+ *           |--> Worker --|
+ *  Emitter -|--> Worker --|--> Collector
+ *           |--> Worker --|
+ *
+ * The farm is executed with the LOCAL, COMPACT and SCATTER policies using
+ * small unbounded channels so that the producers allocate new buffers
+ * while the stream flows. It checks the result, that the workers have been
+ * placed according to the policy and that each channel has been bound to
+ * the memory node of its consumer, and that the storage of a channel not
+ * allocated on whole pages is not moved.
+ * On a machine with a single memory node the placement is trivial but the
+ * code paths are the same.
+ */
+
+#include <iostream>
+#include <vector>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct Emitter: ff_node_t<long> {
+    Emitter(long ntasks):ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i=1;i<=ntasks;++i) ff_send_out((long*)i);
+        return EOS;
+    }
+    const long ntasks;
+};
+struct Worker: ff_node_t<long> {
+    long* svc(long* in) { return in; }
+};
+struct Collector: ff_node_t<long> {
+    long* svc(long* in) { sum += (long)in; return GO_ON; }
+    long sum=0;
+};
+
+static int run(ff_numa_policy policy, const char *name, size_t nw, long ntasks) {
+    Emitter   E(ntasks);
+    Collector C;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(size_t i=0;i<nw;++i) W.push_back(make_unique<Worker>());
+
+    ff_Farm<long> farm(std::move(W), E, C);
+    farm.setInputQueueLength(8, false);
+    farm.setOutputQueueLength(8, false);
+    farm.numa_mode(policy);
+    if (farm.run_and_wait_end()<0) {
+        error("running farm\n");
+        return -1;
+    }
+    if (C.sum != ntasks*(ntasks+1)/2) {
+        std::cerr << name << ": wrong result " << C.sum << "\n";
+        return -1;
+    }
+
+    // the nodes on which the threads may be placed
+    std::vector<int> nodes, cpus;
+    for(int n=0;n<(int)(8*sizeof(unsigned long));++n)
+        if (ff_numaNodeCpus(n, cpus)>0) nodes.push_back(n);
+
+    const svector<ff_node*> &w = farm.getWorkers();
+    for(size_t i=0;i<w.size();++i) {
+        const int cpu  = w[i]->getCPUId();
+        const int node = ff_numaNodeOfCpu(cpu);
+        if (policy == FF_NUMA_SCATTER && nodes.size() && node != nodes[i % nodes.size()]) {
+            std::cerr << name << ": worker " << i << " on node " << node << "\n";
+            return -1;
+        }
+        // the binding is skipped if the kernel does not export the topology
+        if (node>=0 && w[i]->get_in_buffer()->get_numa_node() != node) {
+            std::cerr << name << ": input channel of worker " << i << " not on node " << node << "\n";
+            return -1;
+        }
+    }
+    std::cout << name << ": " << nodes.size() << " node(s), workers on CPUs";
+    for(size_t i=0;i<w.size();++i) std::cout << " " << w[i]->getCPUId();
+    std::cout << "\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    size_t nw     = 3;
+    long   ntasks = 100000;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " [nworkers ntasks]\n";
+            return -1;
+        }
+        nw     = std::stol(argv[1]);
+        ntasks = std::stol(argv[2]);
+    }
+
+    // a stand-alone channel placed on the node of the calling thread
+    {
+        uSWSR_Ptr_Buffer b(4, false);
+        const int node = ff_numaNodeOfCpu((int)ff_getMyCore());
+        if (b.numa_bind((node<0) ? 0 : node)<0 || !b.init()) {
+            error("binding the channel\n");
+            return -1;
+        }
+        long sum=0; void *p;
+        for(long i=1;i<=100;++i) b.push((void*)i);   // new buffers from the pool
+        while(b.pop(&p)) sum += (long)p;
+        if (sum != 5050) { error("wrong channel sum %ld\n", sum); return -1; }
+    }
+    // the storage shares its pages with other data, it must not be moved
+    {
+        SWSR_Ptr_Buffer b(16);
+        if (!b.init() || b.numa_bind(0) != -1) {
+            error("a channel not allocated on whole pages has been moved\n");
+            return -1;
+        }
+    }
+
+    if (run(FF_NUMA_LOCAL,   "LOCAL",   nw, ntasks)<0) return -1;
+    if (run(FF_NUMA_COMPACT, "COMPACT", nw, ntasks)<0) return -1;
+    if (run(FF_NUMA_SCATTER, "SCATTER", nw, ntasks)<0) return -1;
+    std::cout << "DONE\n";
+    return 0;
+}
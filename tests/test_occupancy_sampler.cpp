@@ -0,0 +1,159 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Occupancy sampler on a pipeline containing a farm:
+ *
+ *                       |--> Worker --|
+ *  Source --> Stage --> |--> Worker --| --> Sink
+ *                       |--> Worker --|
+ *
+ * The samples are pulled while the pipeline is running and, at the end,
+ * they are read again from the file through the ff_occupancy_reader.
+ * Before, the occupancy counters of a single channel are checked.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <ff/ff.hpp>
+#include <ff/occupancy_sampler.hpp>
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(const long ntasks): ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i = 1; i <= ntasks; ++i) ff_send_out((long*)i);
+        return EOS;
+    }
+    const long ntasks;
+};
+struct Stage: ff_node_t<long> {
+    Stage(long workload): workload(workload) {}
+    long* svc(long*in) {
+        ticks_wait(workload);
+        return in;
+    }
+    long workload;
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long*) {
+        ++counter;
+        return GO_ON;
+    }
+    size_t counter = 0;
+};
+
+int main(int argc, char* argv[]) {
+    long ntasks = 100000;
+    size_t nworkers = 3;
+    std::string file = "/tmp/test_occupancy_sampler.occ";
+    if (argc > 1) {
+        if (argc < 3) {
+            error("use: %s ntasks nworkers [file]\n", argv[0]);
+            return -1;
+        }
+        ntasks   = std::stol(argv[1]);
+        nworkers = std::stol(argv[2]);
+        if (argc > 3) file = argv[3];
+    }
+
+    // the occupancy of an unbounded channel is computed from the counters
+    // of the producer and of the consumer, also when the internal buffers
+    // are switched and released (the channel grows and shrinks)
+    {
+        uSWSR_Ptr_Buffer b(64);
+        b.init();
+        void *p;
+        for(long r = 0; r < 3; ++r) {
+            for(long i = 1; i <= 1000; ++i) b.push((void*)i);
+            for(long i = 1; i <= 700; ++i) b.pop(&p);
+            if (b.occupancy() != (unsigned long)(300*(r+1))) {
+                error("wrong occupancy %lu\n", b.occupancy());
+                return -1;
+            }
+        }
+        while(b.pop(&p)) ;
+        if (b.occupancy() != 0) {
+            error("wrong occupancy %lu of an empty channel\n", b.occupancy());
+            return -1;
+        }
+    }
+
+    Source first(ntasks);
+    Stage  second(1000);
+    Sink   last;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(size_t i = 0; i < nworkers; ++i)
+        W.push_back(make_unique<Stage>(5000));
+    ff_Farm<long> farm(std::move(W));
+    ff_Pipe<> pipe(first, second, farm, last);
+
+    ff_occupancy_sampler sampler(pipe, 1024, 100000, file);
+    if (pipe.run() < 0) {
+        error("running pipeline\n");
+        return -1;
+    }
+    if (sampler.run() < 0) {
+        error("running sampler\n");
+        return -1;
+    }
+    const size_t nc = sampler.get_num_channels();
+    std::vector<uint64_t> ts(64);
+    std::vector<uint32_t> lengths(64*nc);
+    uint64_t cursor = 0;
+    size_t pulled = 0, maxlen = 0;
+    while(!pipe.done()) {
+        size_t n = sampler.pull(cursor, ts.data(), lengths.data(), ts.size());
+        for(size_t i = 0; i < n*nc; ++i) maxlen = std::max(maxlen, (size_t)lengths[i]);
+        pulled += n;
+        ff_relax(1000);
+    }
+    if (pipe.wait() < 0) {
+        error("waiting pipeline\n");
+        return -1;
+    }
+    sampler.stop();
+    sampler.wait();
+    if (last.counter != (size_t)ntasks) {
+        error("wrong number of tasks received %ld\n", last.counter);
+        return -1;
+    }
+
+    ff_occupancy_reader reader;
+    if (!reader.open(file)) {
+        error("cannot open %s\n", file.c_str());
+        return -1;
+    }
+    if (reader.get_num_channels() != nc || reader.get_head() != sampler.get_head()) {
+        error("wrong file content\n");
+        return -1;
+    }
+    uint64_t rcursor = 0;
+    size_t n = reader.pull(rcursor, ts.data(), lengths.data(), ts.size());
+    for(size_t i = 1; i < n; ++i)
+        if (ts[i] < ts[i-1]) {
+            error("timestamps not monotonic\n");
+            return -1;
+        }
+    std::cout << nc << " channels:";
+    for(size_t i = 0; i < nc; ++i) std::cout << " " << reader.get_channel_name(i);
+    std::cout << "\nsamples " << reader.get_head() << ", pulled while running " << pulled
+              << ", max length " << maxlen << "\n";
+    unlink(file.c_str());
+    return 0;
+}
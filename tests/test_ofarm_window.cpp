@@ -0,0 +1,101 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ *
+ *           |--> Worker --|
+ *  Start -->|--> Worker --|--> Stop
+ *           |--> Worker --|
+ *
+ * Ordered farm with on-demand scheduling and a small reorder window
+ * (set_ordered(MemoryElements)). Some elements take much longer than the
+ * others, so the elements that follow them fill the window: the emitter
+ * has to wait instead of overwriting the elements not yet delivered.
+ * The farm is executed twice, the output must be in order both times.
+ */
+
+#include <iostream>
+#include <vector>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct Start: ff_node_t<long> {
+    Start(long streamlen):streamlen(streamlen) {}
+    long* svc(long*) {
+        for(long i=1;i<=streamlen;++i) ff_send_out(new long(i));
+        return EOS;
+    }
+    long streamlen;
+};
+
+struct Worker: ff_node_t<long> {
+    long* svc(long* task) {
+        if (*task % 97 == 0) usleep(2000);   // long tail
+        *task = -*task;
+        return task;
+    }
+};
+
+struct Stop: ff_minode_t<long> {
+    int svc_init() { expected = 1; return 0; }
+    long* svc(long* task) {
+        if (*task != -expected) {
+            std::cerr << "ERROR: received " << -*task << " expected " << expected << "\n";
+            ++errors;
+        }
+        ++expected;
+        delete task;
+        return GO_ON;
+    }
+    long expected = 1, errors = 0;
+};
+
+int main(int argc, char * argv[]) {
+    int  nworkers  = 3;
+    long streamlen = 1000, memsize = 8;
+    if (argc>1) {
+        if (argc!=4) {
+            std::cerr << "use: " << argv[0] << " nworkers streamlen memsize\n";
+            return -1;
+        }
+        nworkers  = atoi(argv[1]);
+        streamlen = atol(argv[2]);
+        memsize   = atol(argv[3]);
+    }
+
+    std::vector<ff_node *> w;
+    for(int i=0;i<nworkers;++i) w.push_back(new Worker);
+    Stop stop;
+    ff_farm ofarm(w, new Start(streamlen), &stop);
+    ofarm.set_ordered(memsize);
+    ofarm.set_scheduling_ondemand();
+    ofarm.cleanup_emitter();
+    ofarm.cleanup_workers();
+
+    for(int k=0;k<2;++k) {
+        if (ofarm.run_then_freeze()<0 || ofarm.wait_freezing()<0) {
+            error("running ofarm\n");
+            return -1;
+        }
+        if (stop.errors || stop.expected != streamlen+1) {
+            std::cerr << "wrong output, " << stop.expected-1 << " elements\n";
+            return -1;
+        }
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
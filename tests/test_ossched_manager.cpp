@@ -0,0 +1,128 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Same pipeline used in test_ossched_pipe.cpp, but the runtime reallocation
+ * is done by the ff_deadline_manager. The policy is selected by the third
+ * argument (0: master, 1: pool (V2), 2: circular (V3)).
+ *
+ *  Source ---> Stage#1 ---> ... ---> Stage#<nnodes> ---> Sink
+ *    ^            ^                      ^                ^
+ *    |            |                      |                |
+ *    +------------+------ manager -------+----------------+
+ *
+ * Setting SCHED_DEADLINE requires root privileges (or CAP_SYS_NICE),
+ * without them the manager only monitors the channels.
+ */
+
+#include <iostream>
+#include <string>
+#include <ff/ff.hpp>
+#include <ff/deadline_manager.hpp>
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(const long ntasks): ntasks(ntasks) {}
+    long* svc(long*) {
+        for(long i = 1; i <= ntasks; ++i) {
+            ticks_wait(1000);
+            ff_send_out((long*)i);
+        }
+        return EOS;
+    }
+    const long ntasks;
+};
+struct Stage: ff_node_t<long> {
+    Stage(long workload): workload(workload) {}
+    long* svc(long*in) {
+        ticks_wait(workload);
+        return in;
+    }
+    long workload;
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long*) {
+        ticks_wait(1000);
+        ++counter;
+        return GO_ON;
+    }
+    size_t counter = 0;
+};
+
+int main(int argc, char* argv[]) {
+    long ntasks = 100000;
+    size_t nnodes = 3;
+    int policy = 0;
+    if (argc > 1) {
+        if (argc < 3) {
+            error("use: %s ntasks nnodes [policy]\n", argv[0]);
+            return -1;
+        }
+        ntasks = std::stol(argv[1]);
+        nnodes = std::stol(argv[2]);
+        if (argc > 3) policy = std::stol(argv[3]);
+    }
+
+    Source first(ntasks);
+    Sink   last;
+    ff_pipeline pipe;
+    pipe.add_stage(&first);
+    for(size_t i = 1; i <= nnodes; ++i)
+        pipe.add_stage(new Stage(2000 * i), true);
+    pipe.add_stage(&last);
+
+    ff_dl_policy* P = nullptr;
+    switch(policy) {
+    case 1:  P = new ff_dl_policy_pool;     break;
+    case 2:  P = new ff_dl_policy_circular; break;
+    default: P = new ff_dl_policy_master;
+    }
+    ff_dl_params params;
+    params.sampling_ns  = 1000000;
+    params.initial_util = 0.5;
+    ff_deadline_manager manager(pipe, params, P);
+
+    if (pipe.run() < 0) {
+        error("running pipeline\n");
+        return -1;
+    }
+    if (manager.run() < 0) {
+        error("running manager\n");
+        return -1;
+    }
+    if (pipe.wait() < 0) {
+        error("waiting pipeline\n");
+        return -1;
+    }
+    manager.stop();
+    manager.wait();
+
+    if (last.counter != (size_t)ntasks) {
+        error("wrong number of tasks received %ld\n", last.counter);
+        return -1;
+    }
+    std::cout << "policy " << manager.get_policy_name()
+              << (manager.is_enabled() ? "" : " (monitoring only)")
+              << ", nodes " << manager.get_num_nodes()
+              << ", samples " << manager.get_num_samples()
+              << ", adjustments " << manager.get_num_adjustments()
+              << ", rejected " << manager.get_num_rejected() << "\n";
+    for(size_t i = 0; i < manager.get_num_nodes(); ++i)
+        std::cout << "  node " << i << " runtime " << manager.get_runtime(i) << "\n";
+    std::cout << "DONE, time= " << pipe.ffTime() << " (ms)\n";
+    return 0;
+}
@@ -0,0 +1,108 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the bulk reductions of ParallelForReduce (parallel_reduce_range
+ * and parallel_dot) against the sequential loops, for several types,
+ * sizes and (unaligned) starting addresses. Then it compares the time of
+ * the sum of a large array with the one of parallel_reduce.
+ */
+
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+
+using namespace ff;
+
+static long errors = 0;
+
+template<typename T>
+static bool same(const T a, const T b) {
+    if (a == b) return true;
+    if (std::is_floating_point<T>::value)
+        return std::fabs((double)a - (double)b) <= 1e-9 * (1.0 + std::fabs((double)b));
+    return a == b;
+}
+
+template<typename T>
+static void check(const char *name, long nw) {
+    ParallelForReduce<T> pfr(nw);
+    std::vector<T> A(5003), B(5003);
+    for(size_t i=0;i<A.size();++i) {
+        A[i] = (T)((i*7919) % 201) - (T)100;
+        B[i] = (T)((i*104729) % 13);
+    }
+    A[4321] = (T)111; A[17] = (T)-111;
+    for(long off: {0, 1, 3}) {
+        for(long n: {0L, 1L, 7L, 64L, 100L, 1000L, 5000L}) {
+            const T *a = A.data()+off, *b = B.data()+off;
+            T sum = 0, dot = 0, mn = reduce_min::identity<T>(), mx = reduce_max::identity<T>();
+            for(long i=0;i<n;++i) {
+                sum += a[i]; dot += a[i]*b[i];
+                mn = std::min(mn, a[i]); mx = std::max(mx, a[i]);
+            }
+            if (!same(pfr.parallel_reduce_range(a, n, reduce_sum(), nw), sum) ||
+                !same(pfr.parallel_reduce_range(a, n, reduce_min(), nw), mn)  ||
+                !same(pfr.parallel_reduce_range(a, n, reduce_max(), nw), mx)  ||
+                !same(pfr.parallel_dot(a, b, n, nw), dot)) {
+                std::cerr << name << ": wrong result, n=" << n << " offset=" << off << "\n";
+                ++errors;
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    long nw = 3, N = 10000000;
+    if (argc>1) {
+        if (argc!=3) {
+            std::cerr << "use: " << argv[0] << " [nworkers N]\n";
+            return -1;
+        }
+        nw = atol(argv[1]);
+        N  = atol(argv[2]);
+    }
+    check<int>("int", nw);
+    check<long>("long", nw);
+    check<short>("short", nw);
+    check<float>("float", nw);
+    check<double>("double", nw);
+    if (errors) return -1;
+
+    std::vector<double> V(N);
+    for(long i=0;i<N;++i) V[i] = (double)(i % 1000);
+    ParallelForReduce<double> pfr(nw);
+    double s1 = 0;
+    ffTime(START_TIME);
+    pfr.parallel_reduce(s1, 0.0, 0, N, [&](const long i, double &s) { s += V[i]; },
+                        [](double &v, const double e) { v += e; }, nw);
+    ffTime(STOP_TIME);
+    const double t1 = ffTime(GET_TIME);
+    ffTime(START_TIME);
+    const double s2 = pfr.parallel_reduce_range(V.data(), N, reduce_sum(), nw);
+    ffTime(STOP_TIME);
+    if (!same(s1, s2)) {
+        std::cerr << "wrong sum " << s2 << " instead of " << s1 << "\n";
+        return -1;
+    }
+    std::cout << "sum of " << N << " doubles: parallel_reduce " << t1
+              << " (ms), parallel_reduce_range " << ffTime(GET_TIME) << " (ms)\n";
+    std::cout << "DONE\n";
+    return 0;
+}
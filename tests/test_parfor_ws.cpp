@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the work-stealing scheduling of ParallelFor and ParallelForReduce
+ * (enableWorkStealing) on a loop whose iterations have a skewed cost: the
+ * first iterations are much more expensive than the last ones, like the
+ * high-degree vertices of a power-law graph.
+ * Every iteration must be executed exactly once.
+ */
+
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include <ff/ff.hpp>
+#include <ff/parallel_for.hpp>
+using namespace ff;
+
+static inline long cost(long i, long N) {
+    return (long)std::ceil(20000.0 * std::pow(double(i+1), -1.1) * (N/1000.0));
+}
+
+int main(int argc, char *argv[]) {
+    long N = 100000;
+    int  nw = 4;
+    int  niter = 5;
+    if (argc>1) {
+        if (argc<4) {
+            error("use: %s N nworkers niter\n", argv[0]);
+            return -1;
+        }
+        N     = std::stol(argv[1]);
+        nw    = std::stoi(argv[2]);
+        niter = std::stoi(argv[3]);
+    }
+    std::vector<long> V(N, 0);
+
+    for(int spin=0; spin<2; ++spin) {
+        ParallelForReduce<long> pfr(nw, spin==1);
+        pfr.enableWorkStealing();
+        for(int k=0;k<niter;++k) {
+            const long grain = 1+k*7;
+            // parallel_for with step 1 and 3
+            pfr.parallel_for(0, N, 1, grain, [&](const long i) {
+                    ticks_wait(cost(i,N));
+                    V[i] += 1;
+                }, nw);
+            pfr.parallel_for(0, N, 3, grain, [&](const long i) {
+                    V[i] += 1;
+                }, nw);
+            // parallel_reduce
+            long sum = 0;
+            pfr.parallel_reduce(sum, 0, 0, N, 1, grain, [&](const long i, long &s) {
+                    ticks_wait(cost(i,N));
+                    s += i;
+                }, [](long &s, const long e) { s += e; }, nw);
+            if (sum != N*(N-1)/2) {
+                error("wrong reduce result %ld (iteration %d)\n", sum, k);
+                return -1;
+            }
+            for(long i=0;i<N;++i) {
+                const long expected = (k+1)*((i%3)==0 ? 2 : 1);
+                if (V[i] != expected) {
+                    error("iteration %ld executed %ld times instead of %ld\n", i, V[i], expected);
+                    return -1;
+                }
+            }
+        }
+        if (spin) pfr.threadPause();
+        std::fill(V.begin(), V.end(), 0);
+    }
+
+    // ParallelFor with a few iterations (less chunks than workers)
+    ParallelFor pf(nw);
+    pf.enableWorkStealing();
+    long small[3] = {0,0,0};
+    pf.parallel_for(0, 3, 1, 1, [&](const long i) { small[i] += 1; }, nw);
+    if (small[0]!=1 || small[1]!=1 || small[2]!=1) {
+        error("wrong result with less iterations than workers\n");
+        return -1;
+    }
+    std::cout << "DONE\n";
+    return 0;
+}
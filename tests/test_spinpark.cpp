@@ -0,0 +1,114 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *  This program is free software; you can redistribute it and/or modify it
+ *  under the terms of the GNU Lesser General Public License version 3 as
+ *  published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ *  License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with this program; if not, write to the Free Software Foundation,
+ *  Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ ****************************************************************************
+ */
+/*
+ * Tests the adaptive spin-then-park waiting policy (spinpark_mode).
+ *
+ *                       |--> Worker --|
+ *  Source ---> Stage ---|--> Worker --|---> Collector ---> Sink
+ *                       |--> Worker --|
+ *
+ * The Source produces bursts of tasks separated by long pauses, so that
+ * the other stages spin during the bursts and park in between. The channels
+ * are bounded and the Sink is slower than the Workers, so also the producers
+ * park on full channels.
+ */
+
+#include <iostream>
+#include <string>
+#include <ff/ff.hpp>
+using namespace ff;
+
+struct Source: ff_node_t<long> {
+    Source(long nbursts, long burst):nbursts(nbursts),burst(burst) {}
+    long* svc(long*) {
+        long k=1;
+        for(long i=0; i<nbursts; ++i) {
+            for(long j=0; j<burst; ++j)
+                ff_send_out((long*)k++);
+            usleep(5000);
+        }
+        return EOS;
+    }
+    const long nbursts, burst;
+};
+struct Stage: ff_node_t<long> {
+    long* svc(long* in) { return in; }
+};
+struct Sink: ff_node_t<long> {
+    long* svc(long* in) {
+        ticks_wait(2000);
+        sum += (long)in;
+        ++counter;
+        return GO_ON;
+    }
+    long sum = 0, counter = 0;
+};
+
+int main(int argc, char* argv[]) {
+    long nbursts = 50;
+    long burst   = 1000;
+    size_t nworkers = 3;
+    if (argc > 1) {
+        if (argc < 4) {
+            error("use: %s nbursts burst nworkers\n", argv[0]);
+            return -1;
+        }
+        nbursts  = std::stol(argv[1]);
+        burst    = std::stol(argv[2]);
+        nworkers = std::stol(argv[3]);
+    }
+
+    Source source(nbursts, burst);
+    Stage  stage;
+    Sink   sink;
+    std::vector<std::unique_ptr<ff_node> > W;
+    for(size_t i=0;i<nworkers;++i) W.push_back(make_unique<Stage>());
+    ff_Farm<long> farm(std::move(W));
+    ff_Pipe<long> pipe(source, stage, farm, sink);
+    pipe.setFixedSize(true);
+    pipe.setXNodeInputQueueLength(64, false);
+    pipe.setXNodeOutputQueueLength(64, false);
+    pipe.spinpark_mode();
+
+    if (pipe.run_and_wait_end() < 0) {
+        error("running pipeline\n");
+        return -1;
+    }
+    const long n = nbursts*burst;
+    if (sink.counter != n || sink.sum != n*(n+1)/2) {
+        error("wrong result, received %ld tasks\n", sink.counter);
+        return -1;
+    }
+    const ff_spinpark *p = stage.get_spinpark_in();
+    if (!p) {
+        error("the Stage has no spin-then-park state\n");
+        return -1;
+    }
+#if !defined(BLOCKING_MODE)
+    // in blocking mode the threads wait on the channels before parking
+    if (p->get_nparks() == 0) {
+        error("the Stage has never been parked\n");
+        return -1;
+    }
+#endif
+    std::cout << "Stage: parked " << p->get_nparks() << " times, spin window " 
+              << p->get_window() << " ticks\n";
+    std::cout << "Sink : parked " << sink.get_spinpark_in()->get_nparks() << " times\n";
+    std::cout << "DONE, time= " << pipe.ffTime() << " (ms)\n";
+    return 0;
+}